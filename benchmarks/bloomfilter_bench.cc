@@ -0,0 +1,101 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmarks for the bloom filter implementations - BloomFilter versus the
+ * cache-line-blocked BlockedBloomFilter - sized for and filled with range(0)
+ * keys, with the default bfilter_fp_prob.
+ */
+
+#include "bloomfilter.h"
+#include "storeddockey.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+static std::vector<StoredDocKey> makeKeys(size_t first, size_t count) {
+    std::vector<StoredDocKey> keys;
+    keys.reserve(count);
+    for (size_t i = first; i < first + count; ++i) {
+        keys.emplace_back("key_" + std::to_string(i),
+                          DocNamespace::DefaultCollection);
+    }
+    return keys;
+}
+
+/**
+ * Look up keys in a full filter: range(1) == 1 looks up keys which were
+ * added (every probe is a hit), 0 keys which were not (mostly misses, as
+ * for a GET of a non-existent key under full eviction).
+ *
+ * Reports the filter's memory per key and, for misses, its false positive
+ * rate.
+ */
+template <typename Filter>
+static void Probe(benchmark::State& state) {
+    const size_t numKeys = state.range(0);
+    const bool hits = state.range(1) == 1;
+    Filter filter(numKeys, 0.01, BFILTER_ENABLED);
+    for (const auto& key : makeKeys(0, numKeys)) {
+        filter.addKey(key);
+    }
+    const auto keys = makeKeys(hits ? 0 : numKeys, numKeys);
+
+    size_t next = 0;
+    size_t positives = 0;
+    while (state.KeepRunning()) {
+        positives += filter.maybeKeyExists(keys[next]);
+        next = (next + 1) % keys.size();
+    }
+    state.SetLabel(hits ? "hit" : "miss");
+    state.SetItemsProcessed(state.iterations());
+    state.counters["BytesPerKey"] =
+            double(filter.getFilterSize()) / 8 / numKeys;
+    if (!hits) {
+        state.counters["FalsePositiveRate"] =
+                double(positives) / state.iterations();
+    }
+}
+
+/**
+ * Add range(0) keys to an empty filter (as compaction and warmup do).
+ */
+template <typename Filter>
+static void Add(benchmark::State& state) {
+    const auto keys = makeKeys(0, state.range(0));
+    while (state.KeepRunning()) {
+        Filter filter(keys.size(), 0.01, BFILTER_ENABLED);
+        for (const auto& key : keys) {
+            filter.addKey(key);
+        }
+        benchmark::DoNotOptimize(filter.getNumOfKeysInFilter());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+static void ProbeArguments(benchmark::internal::Benchmark* b) {
+    for (int keys : {10000, 1000000}) {
+        b->ArgPair(keys, 0);
+        b->ArgPair(keys, 1);
+    }
+}
+
+BENCHMARK_TEMPLATE(Probe, BloomFilter)->Apply(ProbeArguments);
+BENCHMARK_TEMPLATE(Probe, BlockedBloomFilter)->Apply(ProbeArguments);
+BENCHMARK_TEMPLATE(Add, BloomFilter)->Arg(10000)->Arg(1000000);
+BENCHMARK_TEMPLATE(Add, BlockedBloomFilter)->Arg(10000)->Arg(1000000);
@@ -0,0 +1,148 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmarks for queueing items into a checkpoint: the chunked
+ * CheckpointQueue + open-addressed CheckpointIndex, compared with the
+ * std::list + std::unordered_map layout they replaced.
+ */
+
+#include "checkpoint_queue.h"
+#include "item.h"
+#include "tests/module_tests/test_helpers.h"
+
+#include <benchmark/benchmark.h>
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The previous checkpoint layout - one list node per queued item and one
+ * map node (with a copy of the key) per unique key.
+ */
+struct ListCheckpoint {
+    struct Entry {
+        std::list<queued_item>::iterator position;
+        int64_t mutation_id;
+    };
+
+    void queue(const queued_item& qi) {
+        auto it = index.find(qi->getKey());
+        items.push_back(qi);
+        if (it != index.end()) {
+            items.erase(it->second.position);
+            it->second = {std::prev(items.end()), qi->getBySeqno()};
+        } else {
+            index[qi->getKey()] = {std::prev(items.end()), qi->getBySeqno()};
+        }
+    }
+
+    std::list<queued_item> items;
+    std::unordered_map<StoredDocKey, Entry> index;
+};
+
+struct ChunkedCheckpoint {
+    void queue(const queued_item& qi) {
+        index_entry* existing = index.find(qi->getKey());
+        if (existing) {
+            auto oldPos = existing->position;
+            existing->position = items.push_back(qi);
+            existing->mutation_id = qi->getBySeqno();
+            items.erase(oldPos);
+        } else {
+            index.insert({items.push_back(qi), qi->getBySeqno()});
+        }
+    }
+
+    CheckpointQueue items;
+    CheckpointIndex index;
+};
+
+/**
+ * Queue a checkpoint's worth of items (range(0)) into a new checkpoint,
+ * drawn from range(1) distinct keys - i.e. range(1) < range(0) exercises
+ * de-duplication. The items are created up front so only queueing is
+ * measured. Run with multiple threads to show allocator contention.
+ */
+template <typename Layout>
+static void QueueItems(benchmark::State& state) {
+    const size_t numItems = state.range(0);
+    const size_t numKeys = state.range(1);
+    std::vector<queued_item> items;
+    items.reserve(numItems);
+    for (size_t i = 0; i < numItems; ++i) {
+        items.emplace_back(new Item(
+                makeStoredDocKey("thread" + std::to_string(state.thread_index) +
+                                 "_key_" + std::to_string(i % numKeys)),
+                0,
+                queue_op::set,
+                0,
+                i));
+    }
+
+    while (state.KeepRunning()) {
+        Layout checkpoint;
+        for (const auto& qi : items) {
+            checkpoint.queue(qi);
+        }
+        benchmark::DoNotOptimize(checkpoint);
+        // Include destroying the checkpoint - it is part of the cost of
+        // the layout.
+    }
+    state.SetItemsProcessed(state.iterations() * numItems);
+}
+
+static void QueueArguments(benchmark::internal::Benchmark* b) {
+    // Unique keys, 10% unique and 1% unique.
+    b->ArgPair(10000, 10000);
+    b->ArgPair(10000, 1000);
+    b->ArgPair(10000, 100);
+    b->ThreadRange(1, 8);
+}
+
+BENCHMARK_TEMPLATE(QueueItems, ListCheckpoint)->Apply(QueueArguments);
+BENCHMARK_TEMPLATE(QueueItems, ChunkedCheckpoint)->Apply(QueueArguments);
+
+/**
+ * Iterate over a queued checkpoint, as getAllItemsForCursor does.
+ */
+template <typename Layout>
+static void IterateItems(benchmark::State& state) {
+    const size_t numItems = state.range(0);
+    Layout checkpoint;
+    for (size_t i = 0; i < numItems; ++i) {
+        checkpoint.queue(queued_item(new Item(
+                makeStoredDocKey("key_" + std::to_string(i)),
+                0,
+                queue_op::set,
+                0,
+                i)));
+    }
+
+    while (state.KeepRunning()) {
+        int64_t sum = 0;
+        for (const auto& qi : checkpoint.items) {
+            sum += qi->getBySeqno();
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * numItems);
+}
+
+BENCHMARK_TEMPLATE(IterateItems, ListCheckpoint)->Arg(10000);
+BENCHMARK_TEMPLATE(IterateItems, ChunkedCheckpoint)->Arg(10000);
@@ -0,0 +1,91 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmarks for handing the mutations a DcpProducer streams to memcached:
+ * a reference to the shared queued_item, compared with the per-message Item
+ * copy it replaced. Each item is sent to a number of connections (range(1)),
+ * as a mutation is to each replica, index and XDCR consumer.
+ */
+
+#include "benchmark_memory_tracker.h"
+#include "dcp/response.h"
+#include "tests/module_tests/test_helpers.h"
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+enum class SendMode { Copy, Reference };
+
+/// What memcached does with the item of a DCP mutation: read its info to
+/// build the message, then release it (as EventuallyPersistentEngine's
+/// itemRelease does).
+static void sendAndRelease(Item* itm) {
+    auto info = itm->toItemInfo(0);
+    benchmark::DoNotOptimize(info);
+    if (queued_item::isReferenceCounted(itm)) {
+        queued_item::dropReference(itm);
+    } else {
+        delete itm;
+    }
+}
+
+template <SendMode mode>
+static void SendMutations(benchmark::State& state) {
+    const size_t numItems = state.range(0);
+    const size_t numConnections = state.range(1);
+    const std::string value(200, 'x');
+    std::vector<queued_item> items;
+    items.reserve(numItems);
+    for (size_t i = 0; i < numItems; ++i) {
+        items.emplace_back(new Item(
+                make_item(0, makeStoredDocKey("key_" + std::to_string(i)),
+                          value)));
+    }
+
+    auto* memoryTracker = BenchmarkMemoryTracker::getInstance(
+            *get_mock_server_api()->alloc_hooks);
+    memoryTracker->reset();
+    while (state.KeepRunning()) {
+        for (const auto& qi : items) {
+            for (size_t conn = 0; conn < numConnections; ++conn) {
+                MutationProducerResponse response(
+                        qi, /*opaque*/ 0, /*isKeyOnly*/ false,
+                        /*collectionLen*/ 0);
+                sendAndRelease(mode == SendMode::Copy
+                                       ? response.getItemCopy()
+                                       : response.getItemReference());
+            }
+        }
+    }
+    const size_t sent = state.iterations() * numItems * numConnections;
+    state.SetItemsProcessed(sent);
+    // Includes the allocation of each MutationProducerResponse, which both
+    // modes make.
+    state.counters["AllocationsPerItem"] =
+            double(memoryTracker->getAllocCount()) / sent;
+    BenchmarkMemoryTracker::destroyInstance();
+}
+
+static void SendArguments(benchmark::internal::Benchmark* b) {
+    b->ArgPair(10000, 1);
+    b->ArgPair(10000, 7);
+}
+
+BENCHMARK_TEMPLATE(SendMutations, SendMode::Copy)->Apply(SendArguments);
+BENCHMARK_TEMPLATE(SendMutations, SendMode::Reference)->Apply(SendArguments);
@@ -0,0 +1,249 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmarks for the ExecutorPool schedulers - shared TaskQueues versus
+ * per-thread local queues with work stealing. range(0) selects the scheduler
+ * (0 = shared, 1 = work_stealing).
+ */
+
+#include <executorpool.h>
+#include <executorthread.h>
+#include <taskable.h>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <functional>
+#include <memory>
+#include <thread>
+
+class BenchTaskable : public Taskable {
+public:
+    BenchTaskable() : name("bench"), policy(HIGH_BUCKET_PRIORITY, 1) {
+    }
+
+    const std::string& getName() const override {
+        return name;
+    }
+
+    task_gid_t getGID() const override {
+        return 0;
+    }
+
+    bucket_priority_t getWorkloadPriority() const override {
+        return HIGH_BUCKET_PRIORITY;
+    }
+
+    void setWorkloadPriority(bucket_priority_t prio) override {
+    }
+
+    WorkLoadPolicy& getWorkLoadPolicy() override {
+        return policy;
+    }
+
+    void logQTime(TaskId id, const ProcessClock::duration enqTime) override {
+    }
+
+    void logRunTime(TaskId id, const ProcessClock::duration runTime) override {
+    }
+
+private:
+    std::string name;
+    WorkLoadPolicy policy;
+};
+
+class BenchExecutorPool : public ExecutorPool {
+public:
+    BenchExecutorPool(bool workStealing)
+        : ExecutorPool(/*maxThreads*/ 16,
+                       NUM_TASK_GROUPS,
+                       /*maxReaders*/ 4,
+                       /*maxWriters*/ 8,
+                       /*maxAuxIO*/ 2,
+                       /*maxNonIO*/ 2,
+                       workStealing) {
+    }
+};
+
+class FunctionTask : public GlobalTask {
+public:
+    FunctionTask(Taskable& t, std::function<bool(GlobalTask&)> f)
+        : GlobalTask(t, TaskId::StatSnap, 0, false), func(f) {
+    }
+
+    bool run() override {
+        return func(*this);
+    }
+
+    cb::const_char_buffer getDescription() override {
+        return "Benchmark task";
+    }
+
+private:
+    std::function<bool(GlobalTask&)> func;
+};
+
+class ExecutorPoolBench : public benchmark::Fixture {
+protected:
+    void SetUp(const benchmark::State& state) override {
+        pool.reset(new BenchExecutorPool(state.range(0) == 1));
+        pool->registerTaskable(taskable);
+    }
+
+    void TearDown(const benchmark::State& state) override {
+        pool->unregisterTaskable(taskable, false);
+        pool.reset();
+    }
+
+    static void waitFor(const std::atomic<size_t>& counter, size_t value) {
+        while (counter.load() < value) {
+            std::this_thread::yield();
+        }
+    }
+
+    static const char* label(const benchmark::State& state) {
+        return state.range(0) == 1 ? "work_stealing" : "shared";
+    }
+
+    BenchTaskable taskable;
+    std::unique_ptr<BenchExecutorPool> pool;
+};
+
+/*
+ * Schedule/wake throughput: schedule range(1) one-shot tasks, and wait for
+ * them all to run.
+ */
+BENCHMARK_DEFINE_F(ExecutorPoolBench, ScheduleOneShot)(benchmark::State& state) {
+    state.SetLabel(label(state));
+    const size_t numTasks = state.range(1);
+    std::atomic<size_t> ran{0};
+    size_t expected = 0;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < numTasks; ++i) {
+            pool->schedule(new FunctionTask(taskable, [&ran](GlobalTask&) {
+                ++ran;
+                return false;
+            }));
+        }
+        expected += numTasks;
+        waitFor(ran, expected);
+    }
+    state.SetItemsProcessed(state.iterations() * numTasks);
+}
+
+/*
+ * Reschedule throughput: range(1) tasks which each run 100 times back to
+ * back (returning true without snoozing), as a busy flusher or backfill
+ * does.
+ */
+BENCHMARK_DEFINE_F(ExecutorPoolBench, RescheduleReady)(benchmark::State& state) {
+    state.SetLabel(label(state));
+    const size_t numTasks = state.range(1);
+    static const size_t runsPerTask = 100;
+    std::atomic<size_t> ran{0};
+    size_t expected = 0;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < numTasks; ++i) {
+            auto runs = std::make_shared<size_t>(0);
+            pool->schedule(new FunctionTask(
+                    taskable, [&ran, runs](GlobalTask&) {
+                        ++ran;
+                        return ++(*runs) < runsPerTask;
+                    }));
+        }
+        expected += numTasks * runsPerTask;
+        waitFor(ran, expected);
+    }
+    state.SetItemsProcessed(state.iterations() * numTasks * runsPerTask);
+}
+
+/*
+ * Wake-to-run latency: wake a snoozed task and measure the time until it
+ * starts running, while range(1) other tasks keep the threads busy.
+ */
+BENCHMARK_DEFINE_F(ExecutorPoolBench, WakeToRun)(benchmark::State& state) {
+    state.SetLabel(label(state));
+
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> busyRunning{0};
+    const size_t numBusy = state.range(1);
+    for (size_t i = 0; i < numBusy; ++i) {
+        pool->schedule(
+                new FunctionTask(taskable, [&stop, &busyRunning](GlobalTask&) {
+                    ++busyRunning;
+                    // A short burst of work.
+                    const auto end =
+                            ProcessClock::now() + std::chrono::microseconds(20);
+                    while (ProcessClock::now() < end) {
+                    }
+                    return !stop.load();
+                }));
+    }
+
+    std::atomic<size_t> woken{0};
+    std::atomic<int64_t> ranAt{0};
+    const size_t taskId = pool->schedule(
+            new FunctionTask(taskable, [&woken, &ranAt](GlobalTask& task) {
+                ranAt = ProcessClock::now().time_since_epoch().count();
+                task.snooze(INT_MAX);
+                ++woken;
+                return true;
+            }));
+    // Wait for the initial run, and for the busy tasks to get going.
+    waitFor(woken, 1);
+    waitFor(busyRunning, numBusy);
+
+    size_t expected = 1;
+    while (state.KeepRunning()) {
+        const auto start = ProcessClock::now();
+        pool->wake(taskId);
+        waitFor(woken, ++expected);
+        const ProcessClock::time_point end{ProcessClock::duration(ranAt)};
+        state.SetIterationTime(
+                std::chrono::duration<double>(end - start).count());
+    }
+
+    stop = true;
+    pool->cancel(taskId);
+}
+
+static void SchedulerArguments(benchmark::internal::Benchmark* b) {
+    for (int mode = 0; mode < 2; ++mode) {
+        b->ArgPair(mode, 100);
+        b->ArgPair(mode, 1000);
+    }
+}
+
+static void WakeArguments(benchmark::internal::Benchmark* b) {
+    for (int mode = 0; mode < 2; ++mode) {
+        b->ArgPair(mode, 0);
+        b->ArgPair(mode, 32);
+    }
+}
+
+BENCHMARK_REGISTER_F(ExecutorPoolBench, ScheduleOneShot)
+        ->Apply(SchedulerArguments)
+        ->UseRealTime();
+BENCHMARK_REGISTER_F(ExecutorPoolBench, RescheduleReady)
+        ->Apply(SchedulerArguments)
+        ->UseRealTime();
+BENCHMARK_REGISTER_F(ExecutorPoolBench, WakeToRun)
+        ->Apply(WakeArguments)
+        ->UseManualTime();
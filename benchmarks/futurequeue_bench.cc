@@ -0,0 +1,114 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmarks for the FutureQueue implementations - the binary heap versus
+ * the timer wheel - with range(0) tasks queued.
+ */
+
+#include "futurequeue.h"
+#include "tests/module_tests/test_task.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+/**
+ * Create numTasks tasks with wake times spread over the next minute.
+ */
+static std::vector<ExTask> makeTasks(size_t numTasks) {
+    std::mt19937 gen(numTasks);
+    std::uniform_int_distribution<int> ms(0, 60000);
+    const auto now = ProcessClock::now();
+    std::vector<ExTask> tasks;
+    tasks.reserve(numTasks);
+    for (size_t i = 0; i < numTasks; ++i) {
+        ExTask task = new TestTask(nullptr, TaskId::PendingOpsNotification);
+        task->updateWaketime(now + std::chrono::milliseconds(ms(gen)));
+        tasks.push_back(task);
+    }
+    return tasks;
+}
+
+/**
+ * Schedule all tasks, then run them all in waketime order (top + pop).
+ */
+template <typename Queue>
+static void PushPop(benchmark::State& state) {
+    const auto tasks = makeTasks(state.range(0));
+    while (state.KeepRunning()) {
+        Queue queue;
+        for (const auto& task : tasks) {
+            queue.push(task);
+        }
+        while (!queue.empty()) {
+            benchmark::DoNotOptimize(queue.top());
+            queue.pop();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * tasks.size());
+}
+
+/**
+ * With all tasks queued, snooze one task at a time (as
+ * ExecutorPool::snooze does).
+ */
+template <typename Queue>
+static void Snooze(benchmark::State& state) {
+    const auto tasks = makeTasks(state.range(0));
+    Queue queue;
+    for (const auto& task : tasks) {
+        queue.push(task);
+    }
+    size_t next = 0;
+    while (state.KeepRunning()) {
+        queue.snooze(tasks[next], 30);
+        next = (next + 1) % tasks.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * With all tasks queued, wake one task and snooze it again (as
+ * ExecutorPool::wake and the task's next run do).
+ */
+template <typename Queue>
+static void WakeSnooze(benchmark::State& state) {
+    const auto tasks = makeTasks(state.range(0));
+    Queue queue;
+    for (const auto& task : tasks) {
+        queue.push(task);
+    }
+    size_t next = 0;
+    while (state.KeepRunning()) {
+        queue.updateWaketime(tasks[next], ProcessClock::now());
+        benchmark::DoNotOptimize(queue.top());
+        queue.snooze(tasks[next], 30);
+        next = (next + 1) % tasks.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(PushPop, FutureQueue<>)->Arg(10000)->Arg(100000);
+BENCHMARK_TEMPLATE(PushPop, TimerWheelFutureQueue)->Arg(10000)->Arg(100000);
+BENCHMARK_TEMPLATE(Snooze, FutureQueue<>)->Arg(10000)->Arg(100000);
+BENCHMARK_TEMPLATE(Snooze, TimerWheelFutureQueue)->Arg(10000)->Arg(100000);
+BENCHMARK_TEMPLATE(WakeSnooze, FutureQueue<>)->Arg(10000)->Arg(100000);
+BENCHMARK_TEMPLATE(WakeSnooze, TimerWheelFutureQueue)
+        ->Arg(10000)
+        ->Arg(100000);
@@ -0,0 +1,164 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmarks comparing the HashTable lookup index layouts ('chained' vs
+ * 'tagged' - see HashTagIndex) for get / set / delete at large key counts.
+ */
+
+#include "hash_table.h"
+#include "item.h"
+#include "stats.h"
+#include "stored_value_factories.h"
+#include "tests/module_tests/test_helpers.h"
+
+#include <benchmark/benchmark.h>
+#include <platform/make_unique.h>
+
+#include <algorithm>
+#include <random>
+
+/**
+ * Populated HashTable shared between benchmark runs - populating 10M+ keys
+ * is expensive, and google benchmark calls the fixture SetUp once per run.
+ * Only the most recently requested configuration is kept.
+ */
+class HashTableBenchFixture : public benchmark::Fixture {
+protected:
+    void SetUp(const benchmark::State& state) override {
+        const bool tagged = state.range(0) == 1;
+        const size_t numKeys = state.range(1);
+        if (ht && tagged == cachedTagged && numKeys == cachedNumKeys) {
+            return;
+        }
+
+        ht.reset();
+        keys.clear();
+        missingKeys.clear();
+
+        ht = std::make_unique<HashTable>(
+                stats,
+                std::make_unique<StoredValueFactory>(stats),
+                numKeys,
+                /*locks*/ 47);
+        if (tagged) {
+            ht->enableTagIndex();
+        }
+
+        keys.reserve(numKeys);
+        missingKeys.reserve(numKeys);
+        const std::string value(16, 'x');
+        for (size_t i = 0; i < numKeys; ++i) {
+            keys.push_back(makeStoredDocKey("key_" + std::to_string(i)));
+            missingKeys.push_back(
+                    makeStoredDocKey("missing_" + std::to_string(i)));
+            Item item(keys.back(), 0, 0, value.data(), value.size());
+            ht->set(item);
+        }
+
+        // Access keys in a random order, so we measure the table's cache
+        // behaviour rather than the insertion order.
+        std::mt19937 gen(numKeys);
+        std::shuffle(keys.begin(), keys.end(), gen);
+        std::shuffle(missingKeys.begin(), missingKeys.end(), gen);
+
+        cachedTagged = tagged;
+        cachedNumKeys = numKeys;
+    }
+
+    void setLabel(benchmark::State& state) {
+        state.SetLabel(state.range(0) == 1 ? "tagged" : "chained");
+    }
+
+    static EPStats stats;
+    static std::unique_ptr<HashTable> ht;
+    static std::vector<StoredDocKey> keys;
+    static std::vector<StoredDocKey> missingKeys;
+    static bool cachedTagged;
+    static size_t cachedNumKeys;
+};
+
+EPStats HashTableBenchFixture::stats;
+std::unique_ptr<HashTable> HashTableBenchFixture::ht;
+std::vector<StoredDocKey> HashTableBenchFixture::keys;
+std::vector<StoredDocKey> HashTableBenchFixture::missingKeys;
+bool HashTableBenchFixture::cachedTagged = false;
+size_t HashTableBenchFixture::cachedNumKeys = 0;
+
+BENCHMARK_DEFINE_F(HashTableBenchFixture, GetHit)(benchmark::State& state) {
+    setLabel(state);
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(ht->find(
+                keys[i++ % keys.size()], TrackReference::No, WantsDeleted::No));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_DEFINE_F(HashTableBenchFixture, GetMiss)(benchmark::State& state) {
+    setLabel(state);
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(ht->find(missingKeys[i++ % missingKeys.size()],
+                                          TrackReference::No,
+                                          WantsDeleted::No));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_DEFINE_F(HashTableBenchFixture, Set)(benchmark::State& state) {
+    setLabel(state);
+    const std::string value(16, 'y');
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        Item item(keys[i++ % keys.size()], 0, 0, value.data(), value.size());
+        ht->set(item);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Delete an existing key and re-add it, keeping the table at a steady size.
+BENCHMARK_DEFINE_F(HashTableBenchFixture, DeleteAndAdd)
+(benchmark::State& state) {
+    setLabel(state);
+    const std::string value(16, 'x');
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const auto& key = keys[i++ % keys.size()];
+        {
+            auto hbl = ht->getLockedBucket(key);
+            ht->unlocked_del(hbl, key);
+        }
+        Item item(key, 0, 0, value.data(), value.size());
+        ht->set(item);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void HashTableArguments(benchmark::internal::Benchmark* b) {
+    for (int tagged : {0, 1}) {
+        for (int numKeys : {1000000, 10000000}) {
+            b->ArgPair(tagged, numKeys);
+        }
+    }
+}
+
+BENCHMARK_REGISTER_F(HashTableBenchFixture, GetHit)->Apply(HashTableArguments);
+BENCHMARK_REGISTER_F(HashTableBenchFixture, GetMiss)->Apply(HashTableArguments);
+BENCHMARK_REGISTER_F(HashTableBenchFixture, Set)->Apply(HashTableArguments);
+BENCHMARK_REGISTER_F(HashTableBenchFixture, DeleteAndAdd)
+        ->Apply(HashTableArguments);
@@ -0,0 +1,112 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ * Benchmarks for the EPStats per-object memory counters under churn: every
+ * thread repeatedly "allocates" and "frees" an object, updating the same
+ * counters ObjectRegistry updates for a StoredValue (count, size, overhead
+ * and memOverhead), as the front-end and background threads do when
+ * creating and destroying StoredValues / Items / Blobs concurrently.
+ *
+ * Compares one (cache line padded) RelaxedAtomic per counter, as EPStats
+ * used before, with a ShardedCounter per counter.
+ */
+
+#include "sharded_counter.h"
+
+#include <benchmark/benchmark.h>
+#include <platform/cacheline_padded.h>
+#include <relaxed_atomic.h>
+
+struct AtomicCounters {
+    using Counter = cb::CachelinePadded<Couchbase::RelaxedAtomic<size_t>>;
+
+    void onCreate(size_t size) {
+        (*numStoredVal)++;
+        totalStoredValSize->fetch_add(size);
+        storedValOverhead->fetch_add(size / 4);
+        memOverhead->fetch_add(size / 4);
+    }
+
+    void onDelete(size_t size) {
+        (*numStoredVal)--;
+        totalStoredValSize->fetch_sub(size);
+        storedValOverhead->fetch_sub(size / 4);
+        memOverhead->fetch_sub(size / 4);
+    }
+
+    Counter numStoredVal;
+    Counter totalStoredValSize;
+    Counter storedValOverhead;
+    Counter memOverhead;
+};
+
+struct ShardedCounters {
+    using Counter = ShardedCounter<size_t>;
+
+    void onCreate(size_t size) {
+        const auto shard = Counter::thisThreadShard();
+        numStoredVal.fetch_add(1, shard);
+        totalStoredValSize.fetch_add(size, shard);
+        storedValOverhead.fetch_add(size / 4, shard);
+        memOverhead.fetch_add(size / 4, shard);
+    }
+
+    void onDelete(size_t size) {
+        const auto shard = Counter::thisThreadShard();
+        numStoredVal.fetch_sub(1, shard);
+        totalStoredValSize.fetch_sub(size, shard);
+        storedValOverhead.fetch_sub(size / 4, shard);
+        memOverhead.fetch_sub(size / 4, shard);
+    }
+
+    Counter numStoredVal;
+    Counter totalStoredValSize;
+    Counter storedValOverhead;
+    Counter memOverhead;
+};
+
+/**
+ * Each thread creates and deletes objects; every range(0)th iteration
+ * thread 0 also reads memOverhead, as the memory checks on the front-end
+ * path do (0 means never read).
+ */
+template <typename Counters>
+static void Churn(benchmark::State& state) {
+    static Counters counters;
+    const size_t readEvery = state.range(0);
+    size_t ii = 0;
+    while (state.KeepRunning()) {
+        counters.onCreate(64);
+        counters.onDelete(64);
+        if (readEvery && state.thread_index == 0 && ++ii % readEvery == 0) {
+            benchmark::DoNotOptimize(size_t(counters.memOverhead));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+
+BENCHMARK_TEMPLATE(Churn, AtomicCounters)
+        ->Arg(0)
+        ->Arg(100)
+        ->ThreadRange(1, 16)
+        ->UseRealTime();
+BENCHMARK_TEMPLATE(Churn, ShardedCounters)
+        ->Arg(0)
+        ->Arg(100)
+        ->ThreadRange(1, 16)
+        ->UseRealTime();
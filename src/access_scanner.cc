@@ -23,6 +23,7 @@
 #include <platform/make_unique.h>
 
 #include "access_scanner.h"
+#include "compact_access_log.h"
 #include "ep_engine.h"
 #include "mutation_log.h"
 #include "vb_count_visitor.h"
@@ -56,20 +57,30 @@ public:
         prev = name + ".old";
         next = name + ".next";
 
-        log = std::make_unique<MutationLog>(next, conf.getAlogBlockSize());
-        log->open();
-        if (!log->isOpen()) {
-            LOG(EXTENSION_LOG_WARNING, "Failed to open access log: '%s'",
-                next.c_str());
-            log.reset();
+        if (conf.isAlogCompact()) {
+            try {
+                compactLog = std::make_unique<CompactAccessLog::Writer>(next);
+            } catch (MutationLog::WriteException& e) {
+                LOG(EXTENSION_LOG_WARNING, "Failed to open access log: %s",
+                    e.what());
+            }
         } else {
+            log = std::make_unique<MutationLog>(next, conf.getAlogBlockSize());
+            log->open();
+            if (!log->isOpen()) {
+                LOG(EXTENSION_LOG_WARNING, "Failed to open access log: '%s'",
+                    next.c_str());
+                log.reset();
+            }
+        }
+        if (isLogging()) {
             LOG(EXTENSION_LOG_NOTICE, "Attempting to generate new access file "
                 "'%s'", next.c_str());
         }
     }
 
     bool visit(StoredValue& v) override {
-        if (log && v.isResident()) {
+        if (isLogging() && v.isResident()) {
             if (v.isExpired(startTime) || v.isDeleted()) {
                 LOG(EXTENSION_LOG_INFO,
                     "INFO: Skipping expired/deleted item: %" PRIu64,
@@ -83,7 +94,19 @@ public:
     }
 
     void update() {
-        if (log != nullptr) {
+        if (compactLog != nullptr && !accessed.empty()) {
+            // Each chunk of a vBucket's keys becomes a section of its own,
+            // so no more than alog_max_stored_items are held at once.
+            try {
+                compactLog->addSection(currentBucket->getId(), accessed);
+            } catch (MutationLog::WriteException& e) {
+                LOG(EXTENSION_LOG_WARNING,
+                    "Failed to write access log: %s",
+                    e.what());
+                compactLog.reset();
+                remove(next.c_str());
+            }
+        } else if (log != nullptr) {
             for (auto it = accessed.begin(); it != accessed.end(); ++it) {
                 log->newItem(currentBucket->getId(), *it);
             }
@@ -95,16 +118,18 @@ public:
         currentBucket = vb;
         update();
 
-        if (log == nullptr) {
+        if (!isLogging()) {
             return;
         }
         HashTable::Position ht_start;
         if (vBucketFilter(vb->getId())) {
-            while (ht_start != vb->ht.endPosition()) {
+            while (isLogging() && ht_start != vb->ht.endPosition()) {
                 ht_start = vb->ht.pauseResumeVisit(*this, ht_start);
                 update();
-                log->commit1();
-                log->commit2();
+                if (log != nullptr) {
+                    log->commit1();
+                    log->commit2();
+                }
                 items_scanned = 0;
             }
         }
@@ -112,13 +137,30 @@ public:
 
     void complete() override {
 
-        if (log == nullptr) {
+        if (!isLogging()) {
             updateStateFinalizer(false);
         } else {
-            size_t num_items = log->itemsLogged[int(MutationLogType::New)];
-            log->commit1();
-            log->commit2();
-            log.reset();
+            size_t num_items;
+            if (compactLog != nullptr) {
+                num_items = compactLog->getKeyCount();
+                try {
+                    compactLog->close();
+                } catch (MutationLog::WriteException& e) {
+                    LOG(EXTENSION_LOG_WARNING,
+                        "Failed to write access log: %s",
+                        e.what());
+                    compactLog.reset();
+                    remove(next.c_str());
+                    updateStateFinalizer(false);
+                    return;
+                }
+                compactLog.reset();
+            } else {
+                num_items = log->itemsLogged[int(MutationLogType::New)];
+                log->commit1();
+                log->commit2();
+                log.reset();
+            }
             stats.alogRuntime.store(ep_real_time() - startTime);
             stats.alogNumItems.store(num_items);
             stats.accessScannerHisto.add((gethrtime() - taskStart) / 1000);
@@ -167,6 +209,11 @@ public:
     }
 
 private:
+    /// Is a new access log (of either format) being written?
+    bool isLogging() const {
+        return log != nullptr || compactLog != nullptr;
+    }
+
     /**
      * Finalizer method called at the end of completing a visit.
      * @param created_log: Did we successfully create a MutationLog object on
@@ -200,6 +247,7 @@ private:
     std::vector<StoredDocKey> accessed;
 
     std::unique_ptr<MutationLog> log;
+    std::unique_ptr<CompactAccessLog::Writer> compactLog;
     std::atomic<bool> &stateFinalizer;
     AccessScanner &as;
 
@@ -116,6 +116,7 @@ private:
 
 template <class T> class RCPtr;
 template <class S> class SingleThreadedRCPtr;
+class StoredValue;
 
 /**
  * A reference counted value (used by RCPtr and SingleThreadedRCPtr).
@@ -128,6 +129,8 @@ public:
 private:
     template <class MyTT> friend class RCPtr;
     template <class MySS> friend class SingleThreadedRCPtr;
+    // StoredValue holds an extra reference on the Blobs it allocates inline.
+    friend class StoredValue;
     int _rc_incref() const {
         return ++_rc_refcount;
     }
@@ -230,6 +233,17 @@ RCPtr<T> dynamic_pointer_cast(const RCPtr<U>& r) {
     return p ? RCPtr<T>(p) : RCPtr<T>();
 }
 
+/**
+ * How SingleThreadedRCPtr frees a value once its last reference is
+ * dropped. Specialised for values which can't simply be deleted.
+ */
+template <class T>
+struct RCValueReleaser {
+    static void release(T* value) {
+        delete value;
+    }
+};
+
 /**
  * Single-threaded reference counted pointer.
  * "Single-threaded" means that the reference counted pointer should be accessed
@@ -258,7 +272,7 @@ public:
 
     ~SingleThreadedRCPtr() {
         if (value && static_cast<RCValue *>(value)->_rc_decref() == 0) {
-            delete value;
+            RCValueReleaser<T>::release(value);
         }
     }
 
@@ -282,6 +296,34 @@ public:
         return value;
     }
 
+    /**
+     * Give up this pointer's reference to its value without dropping it, to
+     * hand the value to code which only takes a raw pointer. The reference
+     * must later be dropped by dropReference().
+     */
+    T* release() {
+        T* released = value;
+        value = NULL;
+        return released;
+    }
+
+    /**
+     * @return true if the given value is reference counted (referred to by
+     *         SingleThreadedRCPtrs, or references given up by release()),
+     *         false if it is owned outright by whoever holds it
+     */
+    static bool isReferenceCounted(const T* v) {
+        return static_cast<const RCValue*>(v)->_rc_refcount.load() > 0;
+    }
+
+    /// Drop a reference given up by release(), deleting the value if it was
+    /// the last one.
+    static void dropReference(T* released) {
+        if (static_cast<RCValue*>(released)->_rc_decref() == 0) {
+            RCValueReleaser<T>::release(released);
+        }
+    }
+
     SingleThreadedRCPtr<T> & operator =(const SingleThreadedRCPtr<T> &other) {
         reset(other);
         return *this;
@@ -318,7 +360,7 @@ private:
         T *old = value;
         value = newValue;
         if (old != NULL && static_cast<RCValue *>(old)->_rc_decref() == 0) {
-            delete old;
+            RCValueReleaser<T>::release(old);
         }
     }
 
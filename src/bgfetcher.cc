@@ -20,6 +20,8 @@
 #include <algorithm>
 #include <vector>
 
+#include <phosphor/phosphor.h>
+
 #include "bgfetcher.h"
 #include "ep_engine.h"
 #include "executorthread.h"
@@ -46,6 +48,15 @@ void BgFetcher::stop() {
     bool inverse = true;
     pendingFetch.compare_exchange_strong(inverse, false);
     ExecutorPool::get()->cancel(taskId);
+
+    std::set<size_t> tasks;
+    {
+        LockHolder lh(queueMutex);
+        tasks.swap(batchTasks);
+    }
+    for (const auto id : tasks) {
+        ExecutorPool::get()->cancel(id);
+    }
 }
 
 void BgFetcher::notifyBGEvent(void) {
@@ -56,22 +67,64 @@ void BgFetcher::notifyBGEvent(void) {
     }
 }
 
-size_t BgFetcher::doFetch(VBucket::id_type vbId,
-                          vb_bgfetch_queue_t& itemsToFetch) {
-    ProcessClock::time_point startTime(ProcessClock::now());
+/**
+ * Fetches a sub-batch of a vBucket's bg fetches, when BgFetcher::run hands
+ * it off to be read alongside the others (bg_fetch_max_concurrency).
+ */
+class BGFetchBatchTask : public GlobalTask {
+public:
+    BGFetchBatchTask(EventuallyPersistentEngine* e,
+                     BgFetcher* b,
+                     BgFetcher::FetchJob j)
+        : GlobalTask(e, TaskId::BGFetchBatchTask, 0, false),
+          bgfetcher(b),
+          job(std::move(j)),
+          description("Batching background fetch: vb:" +
+                      std::to_string(job.vbId)) {
+    }
+
+    bool run() {
+        TRACE_EVENT0("ep-engine/task", "BGFetchBatchTask");
+        bgfetcher->runBatchTask(job, getId());
+        return false;
+    }
+
+    cb::const_char_buffer getDescription() {
+        return description;
+    }
+
+private:
+    BgFetcher* bgfetcher;
+    BgFetcher::FetchJob job;
+    const std::string description;
+};
+
+size_t BgFetcher::doFetch(FetchJob& job) {
     LOG(EXTENSION_LOG_DEBUG,
         "BgFetcher is fetching data, vb:%" PRIu16 " numDocs:%" PRIu64 " "
         "startTime:%" PRIu64,
-        vbId,
-        uint64_t(itemsToFetch.size()),
+        job.vbId,
+        uint64_t(job.items.size()),
         std::chrono::duration_cast<std::chrono::milliseconds>(
-                startTime.time_since_epoch())
+                job.startTime.time_since_epoch())
                 .count());
 
-    shard->getROUnderlying()->getMulti(vbId, itemsToFetch);
+    stats.bgFetchQueueDepthHisto.add(++readsInProgress);
+    const auto readStart = ProcessClock::now();
+    shard->getROUnderlying()->getMulti(job.vbId, job.items);
+    --readsInProgress;
+    if (!job.items.empty()) {
+        // Recorded per key, so that batches of different sizes compare.
+        const auto elapsed =
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                        ProcessClock::now() - readStart)
+                        .count();
+        stats.bgFetchReadHisto.add(elapsed / job.items.size(),
+                                   job.items.size());
+    }
 
     std::vector<bgfetched_item_t> fetchedItems;
-    for (const auto& fetch : itemsToFetch) {
+    for (const auto& fetch : job.items) {
         auto& key = fetch.first;
         const vb_bgfetch_item_ctx_t& bg_item_ctx = fetch.second;
 
@@ -83,18 +136,63 @@ size_t BgFetcher::doFetch(VBucket::id_type vbId,
     }
 
     if (fetchedItems.size() > 0) {
-        store->completeBGFetchMulti(vbId, fetchedItems, startTime);
+        store->completeBGFetchMulti(job.vbId, fetchedItems, job.startTime);
         stats.getMultiHisto.add(
                 std::chrono::duration_cast<std::chrono::microseconds>(
-                        ProcessClock::now() - startTime)
+                        ProcessClock::now() - job.startTime)
                         .count(),
                 fetchedItems.size());
     }
 
-    clearItems(vbId, itemsToFetch);
+    clearItems(job.vbId, job.items);
     return fetchedItems.size();
 }
 
+bool BgFetcher::reserveBatchTask(size_t maxTasks) {
+    size_t current = readTasks.load();
+    while (current < maxTasks) {
+        if (readTasks.compare_exchange_weak(current, current + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BgFetcher::runBatchTask(FetchJob& job, size_t batchTaskId) {
+    stats.numRemainingBgItems.fetch_sub(doFetch(job));
+
+    {
+        LockHolder lh(queueMutex);
+        batchTasks.erase(batchTaskId);
+    }
+    --readTasks;
+}
+
+void BgFetcher::splitBatch(VBucket::id_type vbId,
+                           vb_bgfetch_queue_t items,
+                           size_t maxParts,
+                           std::vector<FetchJob>& jobs) {
+    const auto startTime = ProcessClock::now();
+    const size_t parts = std::min(maxParts, items.size());
+    if (parts <= 1) {
+        jobs.push_back({vbId, std::move(items), startTime});
+        return;
+    }
+
+    const size_t perPart = (items.size() + parts - 1) / parts;
+    FetchJob job{vbId, {}, startTime};
+    for (auto& fetch : items) {
+        job.items.emplace(fetch.first, std::move(fetch.second));
+        if (job.items.size() == perPart) {
+            jobs.push_back(std::move(job));
+            job = FetchJob{vbId, {}, startTime};
+        }
+    }
+    if (!job.items.empty()) {
+        jobs.push_back(std::move(job));
+    }
+}
+
 void BgFetcher::clearItems(VBucket::id_type vbId,
                            vb_bgfetch_queue_t& itemsToFetch) {
     for (auto& fetch : itemsToFetch) {
@@ -116,6 +214,8 @@ bool BgFetcher::run(GlobalTask *task) {
         pendingVbs.clear();
     }
 
+    const size_t maxConcurrent = store->getBGFetchMaxConcurrency();
+    std::vector<std::pair<uint16_t, vb_bgfetch_queue_t>> batches;
     for (const uint16_t vbId : bg_vbs) {
         VBucketPtr vb = shard->getBucket(vbId);
         if (vb) {
@@ -132,10 +232,43 @@ bool BgFetcher::run(GlobalTask *task) {
 
             auto items = vb->getBGFetchItems();
             if (items.size() > 0) {
-                num_fetched_items += doFetch(vbId, items);
+                batches.emplace_back(vbId, std::move(items));
+            }
+        }
+    }
+
+    // Share the concurrency between the vBuckets; a lone vBucket's batch is
+    // split bg_fetch_max_concurrency ways.
+    const size_t maxParts =
+            std::max(size_t(1), maxConcurrent / std::max(size_t(1),
+                                                         batches.size()));
+    std::vector<FetchJob> jobs;
+    for (auto& batch : batches) {
+        splitBatch(batch.first, std::move(batch.second), maxParts, jobs);
+    }
+
+    // Hand sub-batches to BGFetchBatchTasks while there is spare
+    // concurrency, always fetching the last one here rather than leaving
+    // this task idle. The tasks are all scheduled before this task starts
+    // reading, so their reads overlap with its own.
+    std::vector<size_t> fetchHere;
+    for (size_t ii = 0; ii < jobs.size(); ++ii) {
+        if (ii + 1 < jobs.size() && maxConcurrent > 1 &&
+            reserveBatchTask(maxConcurrent - 1)) {
+            ExTask batchTask = new BGFetchBatchTask(
+                    &store->getEPEngine(), this, std::move(jobs[ii]));
+            {
+                LockHolder lh(queueMutex);
+                batchTasks.insert(batchTask->getId());
             }
+            ExecutorPool::get()->schedule(batchTask);
+        } else {
+            fetchHere.push_back(ii);
         }
     }
+    for (const auto ii : fetchHere) {
+        num_fetched_items += doFetch(jobs[ii]);
+    }
 
     stats.numRemainingBgItems.fetch_sub(num_fetched_items);
 
@@ -23,6 +23,7 @@
 #include <list>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "item.h"
 #include "kvstore.h"
@@ -49,7 +50,8 @@ public:
      * @param st reference to statistics
      */
     BgFetcher(KVBucket* s, KVShard* k, EPStats &st) :
-        store(s), shard(k), taskId(0), stats(st), pendingFetch(false) {}
+        store(s), shard(k), taskId(0), stats(st), pendingFetch(false),
+        readsInProgress(0), readTasks(0) {}
 
     /**
      * Construct a BgFetcher
@@ -72,6 +74,13 @@ public:
         }
     }
 
+    /// One vBucket's batch (or part of a batch) of items to fetch.
+    struct FetchJob {
+        VBucket::id_type vbId;
+        vb_bgfetch_queue_t items;
+        ProcessClock::time_point startTime;
+    };
+
     void start(void);
     void stop(void);
     bool run(GlobalTask *task);
@@ -83,10 +92,34 @@ public:
         pendingVbs.insert(vbId);
     }
 
+    /**
+     * Fetch a sub-batch handed to a BGFetchBatchTask by run()
+     * (bg_fetch_max_concurrency > 1).
+     *
+     * @param job the sub-batch to fetch
+     * @param batchTaskId id of the task fetching it
+     */
+    void runBatchTask(FetchJob& job, size_t batchTaskId);
+
 private:
-    size_t doFetch(VBucket::id_type vbId, vb_bgfetch_queue_t& items);
+    size_t doFetch(FetchJob& job);
     void clearItems(VBucket::id_type vbId, vb_bgfetch_queue_t& items);
 
+    /**
+     * Split a vBucket's batch into up to maxParts sub-batches of similar
+     * size, appending them to jobs.
+     */
+    void splitBatch(VBucket::id_type vbId,
+                    vb_bgfetch_queue_t items,
+                    size_t maxParts,
+                    std::vector<FetchJob>& jobs);
+
+    /**
+     * Try to reserve a BGFetchBatchTask to fetch a batch, if fewer than
+     * maxTasks are already running.
+     */
+    bool reserveBatchTask(size_t maxTasks);
+
     KVBucket* store;
     KVShard* shard;
     size_t taskId;
@@ -95,6 +128,20 @@ private:
 
     std::atomic<bool> pendingFetch;
     std::set<VBucket::id_type> pendingVbs;
+
+    /*
+     * With bg_fetch_max_concurrency > 1, run() splits the pending vBuckets'
+     * batches into sub-batches (sharing bg_fetch_max_concurrency between
+     * the vBuckets), and hands all but the last of them to BGFetchBatchTasks (up to
+     * bg_fetch_max_concurrency - 1 at once), fetching the others itself.
+     * Each getMulti() reads through its own read-only handle, so the
+     * sub-batches of a vBucket are read concurrently, and each is completed
+     * as soon as its read returns.
+     */
+    std::atomic<size_t> readsInProgress;
+    std::atomic<size_t> readTasks;
+    // Ids of the BGFetchBatchTasks not yet finished, cancelled by stop().
+    std::set<size_t> batchTasks; // Guarded by queueMutex
 };
 
 #endif  // SRC_BGFETCHER_H_
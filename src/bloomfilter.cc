@@ -21,6 +21,7 @@
 
 #include "murmurhash3.h"
 
+#include <algorithm>
 #include <cmath>
 
 #if __x86_64__ || __ppc64__
@@ -29,6 +30,51 @@
 #define MURMURHASH_3 MurmurHash3_x86_128
 #endif
 
+/**
+ * @return the status a filter in status 'from' moves to when asked to
+ *         change to 'to'.
+ */
+static bfilter_status_t nextStatus(bfilter_status_t from,
+                                   bfilter_status_t to) {
+    switch (from) {
+        case BFILTER_DISABLED:
+            if (to == BFILTER_ENABLED) {
+                return BFILTER_PENDING;
+            }
+            break;
+        case BFILTER_PENDING:
+            if (to == BFILTER_DISABLED || to == BFILTER_COMPACTING) {
+                return to;
+            }
+            break;
+        case BFILTER_COMPACTING:
+            if (to == BFILTER_DISABLED || to == BFILTER_ENABLED) {
+                return to;
+            }
+            break;
+        case BFILTER_ENABLED:
+            if (to == BFILTER_DISABLED || to == BFILTER_COMPACTING) {
+                return to;
+            }
+            break;
+    }
+    return from;
+}
+
+static std::string statusToString(bfilter_status_t status) {
+    switch (status) {
+        case BFILTER_DISABLED:
+            return "DISABLED";
+        case BFILTER_PENDING:
+            return "PENDING (ENABLED)";
+        case BFILTER_COMPACTING:
+            return "COMPACTING";
+        case BFILTER_ENABLED:
+            return "ENABLED";
+    }
+    return "UNKNOWN";
+}
+
 BloomFilter::BloomFilter(size_t key_count, double false_positive_prob,
                          bfilter_status_t new_status) {
 
@@ -54,7 +100,8 @@ size_t BloomFilter::estimateNoOfHashes(size_t key_count) {
     return round(((double) filterSize / key_count) * (log(2.0)));
 }
 
-uint64_t BloomFilter::hashDocKey(const DocKey& key, uint32_t iteration) {
+uint64_t BloomFilter::hashDocKey(const DocKey& key,
+                                 uint32_t iteration) const {
     uint64_t result = 0;
     uint32_t seed = iteration + (uint32_t(key.getDocNamespace()) * noOfHashes);
     MURMURHASH_3(key.data(), key.size(), seed, &result);
@@ -62,55 +109,19 @@ uint64_t BloomFilter::hashDocKey(const DocKey& key, uint32_t iteration) {
 }
 
 void BloomFilter::setStatus(bfilter_status_t to) {
-    switch (status) {
-        case BFILTER_DISABLED:
-            if (to == BFILTER_ENABLED) {
-                status = BFILTER_PENDING;
-            }
-            break;
-        case BFILTER_PENDING:
-            if (to == BFILTER_DISABLED) {
-                status = to;
-                bitArray.clear();
-            } else if (to == BFILTER_COMPACTING) {
-                status = to;
-            }
-            break;
-        case BFILTER_COMPACTING:
-            if (to == BFILTER_DISABLED) {
-                status = to;
-                bitArray.clear();
-            } else if (to == BFILTER_ENABLED) {
-                status = to;
-            }
-            break;
-        case BFILTER_ENABLED:
-            if (to == BFILTER_DISABLED) {
-                status = to;
-                bitArray.clear();
-            } else if (to == BFILTER_COMPACTING) {
-                status = to;
-            }
-            break;
+    const auto from = status;
+    status = nextStatus(from, to);
+    if (status == BFILTER_DISABLED && from != BFILTER_DISABLED) {
+        bitArray.clear();
     }
 }
 
-bfilter_status_t BloomFilter::getStatus() {
+bfilter_status_t BloomFilter::getStatus() const {
     return status;
 }
 
-std::string BloomFilter::getStatusString() {
-    switch (status) {
-        case BFILTER_DISABLED:
-            return "DISABLED";
-        case BFILTER_PENDING:
-            return "PENDING (ENABLED)";
-        case BFILTER_COMPACTING:
-            return "COMPACTING";
-        case BFILTER_ENABLED:
-            return "ENABLED";
-    }
-    return "UNKNOWN";
+std::string BloomFilter::getStatusString() const {
+    return statusToString(status);
 }
 
 void BloomFilter::addKey(const DocKey& key) {
@@ -129,7 +140,7 @@ void BloomFilter::addKey(const DocKey& key) {
     }
 }
 
-bool BloomFilter::maybeKeyExists(const DocKey& key) {
+bool BloomFilter::maybeKeyExists(const DocKey& key) const {
     if (status == BFILTER_COMPACTING || status == BFILTER_ENABLED) {
         for (uint32_t i = 0; i < noOfHashes; i++) {
             uint64_t result = hashDocKey(key, i);
@@ -143,7 +154,7 @@ bool BloomFilter::maybeKeyExists(const DocKey& key) {
     return true;
 }
 
-size_t BloomFilter::getNumOfKeysInFilter() {
+size_t BloomFilter::getNumOfKeysInFilter() const {
     if (status == BFILTER_COMPACTING || status == BFILTER_ENABLED) {
         return keyCounter;
     } else {
@@ -151,10 +162,199 @@ size_t BloomFilter::getNumOfKeysInFilter() {
     }
 }
 
-size_t BloomFilter::getFilterSize() {
+size_t BloomFilter::getFilterSize() const {
     if (status == BFILTER_COMPACTING || status == BFILTER_ENABLED) {
         return filterSize;
     } else {
         return 0;
     }
 }
+
+const size_t BlockedBloomFilter::BitsPerBlock;
+const size_t BlockedBloomFilter::WordsPerBlock;
+
+BlockedBloomFilter::BlockedBloomFilter(size_t key_count,
+                                       double false_positive_prob,
+                                       bfilter_status_t new_status)
+    : keyCounter(0), status(new_status) {
+    key_count = std::max(key_count, size_t(1));
+    // Start from the number of bits BloomFilter would use, rounded up to
+    // whole blocks. As the keys are not spread evenly over the blocks that
+    // gives a higher false positive rate, so add blocks (and pick the best
+    // number of hashes for each size) until the estimated rate is within
+    // false_positive_prob.
+    const double bits = round(-(((double)(key_count) *
+                                 log(false_positive_prob)) /
+                                (pow(log(2.0), 2))));
+    noOfBlocks = std::max(size_t(std::ceil(bits / BitsPerBlock)), size_t(1));
+    for (;;) {
+        const double keysPerBlock = double(key_count) / noOfBlocks;
+        const double optimal = (BitsPerBlock / keysPerBlock) * log(2.0);
+        const size_t first = size_t(std::max(1.0, round(optimal) - 2));
+        const size_t last = std::min(
+                BitsPerBlock, size_t(std::max(1.0, round(optimal) + 2)));
+        double rate = 1;
+        noOfHashes = first;
+        for (size_t hashes = first; hashes <= last; hashes++) {
+            const double estimate =
+                    estimateFalsePositiveRate(keysPerBlock, hashes);
+            if (estimate < rate) {
+                rate = estimate;
+                noOfHashes = hashes;
+            }
+        }
+        if (rate <= false_positive_prob) {
+            break;
+        }
+        noOfBlocks += std::max(noOfBlocks / 64, size_t(1));
+    }
+    allocate();
+}
+
+double BlockedBloomFilter::estimateFalsePositiveRate(double keysPerBlock,
+                                                     size_t hashes) {
+    // The number of keys in the block a missing key probes is Poisson
+    // distributed. Each key sets 'hashes' distinct bits of its block, so a
+    // block holding i keys has a given bit clear with probability
+    // (1 - hashes / BitsPerBlock)^i, and all the missing key's bits set
+    // with probability (1 - that)^hashes. Only the terms within ten
+    // standard deviations of the mean count.
+    const double spread = 10 * std::sqrt(keysPerBlock) + 10;
+    const size_t first = size_t(std::max(0.0, keysPerBlock - spread));
+    const size_t last = size_t(keysPerBlock + spread);
+    const double bitClear = 1.0 - double(hashes) / BitsPerBlock;
+    double rate = 0;
+    for (size_t i = first; i <= last; i++) {
+        const double logProb = -keysPerBlock + i * std::log(keysPerBlock) -
+                               std::lgamma(double(i) + 1);
+        const double allSet =
+                std::pow(1.0 - std::pow(bitClear, double(i)), double(hashes));
+        rate += std::exp(logProb) * allSet;
+    }
+    return rate;
+}
+
+BlockedBloomFilter::BlockedBloomFilter(size_t blockCount,
+                                       size_t hashCount,
+                                       size_t keyCount,
+                                       const uint64_t* data,
+                                       bfilter_status_t new_status)
+    : noOfBlocks(blockCount),
+      noOfHashes(hashCount),
+      keyCounter(keyCount),
+      status(new_status) {
+    allocate();
+    std::copy(data, data + noOfBlocks * WordsPerBlock, blocks);
+}
+
+void BlockedBloomFilter::allocate() {
+    storage.assign(noOfBlocks * WordsPerBlock + WordsPerBlock - 1, 0);
+    const auto addr = reinterpret_cast<uintptr_t>(storage.data());
+    const uintptr_t align = WordsPerBlock * sizeof(uint64_t);
+    blocks = reinterpret_cast<uint64_t*>((addr + align - 1) & ~(align - 1));
+}
+
+BlockedBloomFilter::Probe BlockedBloomFilter::probeFor(
+        const DocKey& key) const {
+    // MURMURHASH_3 only produces 64 bits of output here; the top half
+    // picks the block and the bottom half the bits within it.
+    uint64_t hash = 0;
+    MURMURHASH_3(key.data(), key.size(), uint32_t(key.getDocNamespace()),
+                 &hash);
+
+    Probe probe;
+    probe.block = size_t(((hash >> 32) * noOfBlocks) >> 32);
+    std::fill(std::begin(probe.mask), std::end(probe.mask), 0);
+    // The bits within the block are drawn 9 at a time from a splitmix64
+    // sequence seeded by the bottom half, redrawing any already set, so the
+    // noOfHashes bits are distinct and independent. (Double hashing within a
+    // 512-bit block gives keys whose bits overlap all but one of another
+    // key's, which puts a floor of ~0.1% under the false positive rate.)
+    uint64_t state = uint32_t(hash);
+    uint64_t draws = 0;
+    size_t available = 0;
+    for (size_t set = 0; set < noOfHashes;) {
+        if (available == 0) {
+            state += 0x9e3779b97f4a7c15ULL;
+            draws = state;
+            draws = (draws ^ (draws >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            draws = (draws ^ (draws >> 27)) * 0x94d049bb133111ebULL;
+            draws ^= draws >> 31;
+            available = 64 / 9;
+        }
+        const uint32_t bit = uint32_t(draws % BitsPerBlock);
+        draws /= BitsPerBlock;
+        available--;
+        uint64_t& word = probe.mask[bit / 64];
+        const uint64_t mask = uint64_t(1) << (bit % 64);
+        if ((word & mask) == 0) {
+            word |= mask;
+            set++;
+        }
+    }
+    return probe;
+}
+
+void BlockedBloomFilter::setStatus(bfilter_status_t to) {
+    const auto from = status;
+    status = nextStatus(from, to);
+    if (status == BFILTER_DISABLED && from != BFILTER_DISABLED) {
+        storage.clear();
+        storage.shrink_to_fit();
+        blocks = nullptr;
+    }
+}
+
+bfilter_status_t BlockedBloomFilter::getStatus() const {
+    return status;
+}
+
+std::string BlockedBloomFilter::getStatusString() const {
+    return statusToString(status);
+}
+
+void BlockedBloomFilter::addKey(const DocKey& key) {
+    if (isActive()) {
+        const auto probe = probeFor(key);
+        uint64_t* words = block(probe.block);
+        uint64_t missing = 0;
+        for (size_t w = 0; w < WordsPerBlock; w++) {
+            missing |= probe.mask[w] & ~words[w];
+            words[w] |= probe.mask[w];
+        }
+        if (missing != 0) {
+            keyCounter++;
+        }
+    }
+}
+
+bool BlockedBloomFilter::maybeKeyExists(const DocKey& key) const {
+    if (isActive()) {
+        const auto probe = probeFor(key);
+        const uint64_t* words = block(probe.block);
+        uint64_t missing = 0;
+        for (size_t w = 0; w < WordsPerBlock; w++) {
+            missing |= probe.mask[w] & ~words[w];
+        }
+        // If any of the key's bits is not set the key does NOT exist.
+        return missing == 0;
+    }
+    // The key may exist.
+    return true;
+}
+
+size_t BlockedBloomFilter::getNumOfKeysInFilter() const {
+    if (isActive()) {
+        return keyCounter;
+    } else {
+        return 0;
+    }
+}
+
+size_t BlockedBloomFilter::getFilterSize() const {
+    if (isActive()) {
+        return noOfBlocks * BitsPerBlock;
+    } else {
+        return 0;
+    }
+}
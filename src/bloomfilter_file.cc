@@ -0,0 +1,187 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "bloomfilter_file.h"
+
+#include "utility.h"
+
+extern "C" {
+#include "crc32.h"
+}
+
+#include <platform/dirutils.h>
+#include <platform/make_unique.h>
+#include <platform/memorymap.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+
+static_assert(sizeof(BloomFilterFile::Header) == 64,
+              "BloomFilterFile::Header should have no padding");
+
+const uint32_t BloomFilterFile::Magic;
+const uint32_t BloomFilterFile::Version;
+
+static const size_t BytesPerBlock =
+        BlockedBloomFilter::WordsPerBlock * sizeof(uint64_t);
+
+static uint32_t headerCrc(const BloomFilterFile::Header& header) {
+    return crc32buf(reinterpret_cast<uint8_t*>(
+                            const_cast<BloomFilterFile::Header*>(&header)),
+                    offsetof(BloomFilterFile::Header, headerCrc));
+}
+
+std::string BloomFilterFile::getFileName(const std::string& dbname,
+                                         uint16_t vbid) {
+    return dbname + "/" + std::to_string(vbid) + ".bloomfilter";
+}
+
+void BloomFilterFile::save(const std::string& fname,
+                           uint16_t vbid,
+                           uint64_t vbUuid,
+                           int64_t highSeqno,
+                           const BlockedBloomFilter& filter) {
+    const uint64_t* blocks = filter.getBlocks();
+    if (blocks == nullptr) {
+        throw std::logic_error("BloomFilterFile::save: filter for vb " +
+                               std::to_string(vbid) + " is disabled");
+    }
+    const size_t blocksSize = filter.getNoOfBlocks() * BytesPerBlock;
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = Magic;
+    header.version = Version;
+    header.vbUuid = vbUuid;
+    header.highSeqno = highSeqno;
+    header.noOfBlocks = filter.getNoOfBlocks();
+    header.noOfHashes = filter.getNoOfHashes();
+    header.keyCount = filter.getNumOfKeysInFilter();
+    header.vbid = vbid;
+    header.blocksCrc = crc32buf(
+            reinterpret_cast<uint8_t*>(const_cast<uint64_t*>(blocks)),
+            blocksSize);
+    header.headerCrc = headerCrc(header);
+
+    const std::string tmpName = fname + ".tmp";
+    FILE* fp = fopen(tmpName.c_str(), "wb");
+    if (fp == nullptr) {
+        throw std::system_error(errno, std::system_category(),
+                                "BloomFilterFile::save: failed to open " +
+                                        tmpName);
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(blocks, blocksSize, 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) {
+        const int error = errno;
+        remove(tmpName.c_str());
+        throw std::system_error(error, std::system_category(),
+                                "BloomFilterFile::save: failed to write " +
+                                        tmpName);
+    }
+
+    // rename() won't replace an existing file on Windows.
+    remove(fname.c_str());
+    if (rename(tmpName.c_str(), fname.c_str()) != 0) {
+        const int error = errno;
+        remove(tmpName.c_str());
+        throw std::system_error(error, std::system_category(),
+                                "BloomFilterFile::save: failed to rename " +
+                                        tmpName);
+    }
+}
+
+std::unique_ptr<BlockedBloomFilter> BloomFilterFile::load(
+        const std::string& fname,
+        uint16_t vbid,
+        uint64_t vbUuid,
+        int64_t highSeqno) {
+    if (!cb::io::isFile(fname)) {
+        return nullptr;
+    }
+
+    const char* reason = nullptr;
+    try {
+        cb::MemoryMappedFile map(fname.c_str(),
+                                 cb::MemoryMappedFile::Mode::RDONLY);
+        map.open();
+        const auto* root = static_cast<const uint8_t*>(map.getRoot());
+
+        Header header;
+        if (map.getSize() < sizeof(header)) {
+            reason = "file is truncated";
+        } else {
+            memcpy(&header, root, sizeof(header));
+            if (header.magic != Magic) {
+                reason = "bad magic";
+            } else if (header.version != Version) {
+                reason = "unsupported version";
+            } else if (header.headerCrc != headerCrc(header)) {
+                reason = "header checksum mismatch";
+            } else if (header.vbid != vbid) {
+                reason = "vbucket id mismatch";
+            } else if (header.vbUuid != vbUuid) {
+                reason = "vbucket uuid mismatch";
+            } else if (header.highSeqno != highSeqno) {
+                reason = "high seqno mismatch";
+            } else if (header.noOfBlocks == 0 ||
+                       map.getSize() !=
+                               sizeof(header) +
+                                       header.noOfBlocks * BytesPerBlock) {
+                reason = "bad size";
+            } else if (header.noOfHashes == 0 ||
+                       header.noOfHashes > BlockedBloomFilter::BitsPerBlock) {
+                reason = "bad number of hashes";
+            } else if (header.blocksCrc !=
+                       crc32buf(const_cast<uint8_t*>(root + sizeof(header)),
+                                header.noOfBlocks * BytesPerBlock)) {
+                reason = "checksum mismatch";
+            } else {
+                // The mapping is read-only and the filter is updated as
+                // keys are added, so the blocks are copied into the
+                // filter's own (cache line aligned) storage. They start 64
+                // bytes into the page aligned mapping.
+                return std::make_unique<BlockedBloomFilter>(
+                        header.noOfBlocks,
+                        header.noOfHashes,
+                        header.keyCount,
+                        reinterpret_cast<const uint64_t*>(root +
+                                                          sizeof(header)),
+                        BFILTER_ENABLED);
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG(EXTENSION_LOG_WARNING,
+            "BloomFilterFile::load: (vb %" PRIu16 ") failed to read %s: %s",
+            vbid,
+            fname.c_str(),
+            e.what());
+        return nullptr;
+    }
+
+    LOG(EXTENSION_LOG_NOTICE,
+        "BloomFilterFile::load: (vb %" PRIu16 ") ignoring %s: %s",
+        vbid,
+        fname.c_str(),
+        reason);
+    return nullptr;
+}
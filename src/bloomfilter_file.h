@@ -0,0 +1,89 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "bloomfilter.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * A vBucket's bloom filter saved to disk, alongside the vBucket's couchstore
+ * file, so that it can be loaded at warmup instead of being rebuilt by the
+ * next compaction.
+ *
+ * A filter is only valid for the vBucket contents it was saved with, so the
+ * file records the vBucket's failover UUID and persisted high seqno; load()
+ * rejects the file if either differs from the vBucket being warmed up (for
+ * example after an unclean shutdown, a rollback or the vBucket having been
+ * recreated).
+ *
+ * The file is a checksummed Header followed by the filter's blocks, in
+ * native byte order.
+ */
+class BloomFilterFile {
+public:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t vbUuid;
+        int64_t highSeqno;
+        uint64_t noOfBlocks;
+        uint64_t noOfHashes;
+        uint64_t keyCount;
+        uint16_t vbid;
+        uint16_t reserved;
+        uint32_t blocksCrc;
+        // CRC of all the fields above.
+        uint32_t headerCrc;
+        uint32_t reserved2;
+    };
+
+    static const uint32_t Magic = 0x45504246; // "EPBF"
+    static const uint32_t Version = 1;
+
+    /// @return the name of the given vBucket's filter file.
+    static std::string getFileName(const std::string& dbname, uint16_t vbid);
+
+    /**
+     * Write the filter to the given file (via a temporary file, which is
+     * renamed over it).
+     *
+     * @throws std::system_error if the file cannot be written
+     */
+    static void save(const std::string& fname,
+                     uint16_t vbid,
+                     uint64_t vbUuid,
+                     int64_t highSeqno,
+                     const BlockedBloomFilter& filter);
+
+    /**
+     * Memory-map the given file and create an enabled filter from it, if it
+     * is intact and was saved for the given vBucket, UUID and high seqno.
+     *
+     * @return the filter, or null if there is no file or it is not valid
+     *         (the reason is logged)
+     */
+    static std::unique_ptr<BlockedBloomFilter> load(const std::string& fname,
+                                                    uint16_t vbid,
+                                                    uint64_t vbUuid,
+                                                    int64_t highSeqno);
+};
@@ -112,11 +112,11 @@ Checkpoint::~Checkpoint() {
     LOG(EXTENSION_LOG_INFO,
         "Checkpoint %" PRIu64 " for vbucket %d is purged from memory",
         checkpointId, vbucketId);
-    stats.memOverhead->fetch_sub(memorySize());
-    if (stats.memOverhead->load() >= GIGANTOR) {
+    stats.memOverhead.fetch_sub(memorySize());
+    if (stats.memOverhead.load() >= GIGANTOR) {
         LOG(EXTENSION_LOG_WARNING,
             "Checkpoint::~Checkpoint: stats.memOverhead (which is %" PRId64
-            ") is greater than %" PRId64, uint64_t(stats.memOverhead->load()),
+            ") is greater than %" PRId64, uint64_t(stats.memOverhead.load()),
             uint64_t(GIGANTOR));
     }
 }
@@ -134,11 +134,32 @@ void Checkpoint::popBackCheckpointEndItem() {
         toWrite.back()->getOperation() == queue_op::checkpoint_end) {
         metaKeyIndex.erase(toWrite.back()->getKey());
         toWrite.pop_back();
+        updateMemOverhead();
+    }
+}
+
+void Checkpoint::updateMemOverhead() {
+    // Keys aren't copied into the index, and the queue's storage is only
+    // allocated a Chunk at a time, so charge what the structures actually
+    // hold rather than a per-item estimate.
+    const size_t newOverhead = getStructureMemorySize();
+    if (newOverhead >= memOverhead) {
+        stats.memOverhead.fetch_add(newOverhead - memOverhead);
+        if (stats.memOverhead.load() >= GIGANTOR) {
+            LOG(EXTENSION_LOG_WARNING,
+                "Checkpoint::updateMemOverhead: stats.memOverhead (which is "
+                "%" PRId64 ") is greater than %" PRId64,
+                uint64_t(stats.memOverhead.load()),
+                uint64_t(GIGANTOR));
+        }
+    } else {
+        stats.memOverhead.fetch_sub(memOverhead - newOverhead);
     }
+    memOverhead = newOverhead;
 }
 
 bool Checkpoint::keyExists(const DocKey& key) {
-    return keyIndex.find(key) != keyIndex.end();
+    return keyIndex.find(key) != nullptr;
 }
 
 queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
@@ -149,7 +170,7 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
                         ") is not OPEN");
     }
     queue_dirty_t rv;
-    checkpoint_index::iterator it = keyIndex.find(qi->getKey());
+    index_entry* existing = keyIndex.find(qi->getKey());
     // Check if the item is a meta item
     if (qi->isCheckPointMetaItem()) {
         // empty items act only as a dummy element for the start of the
@@ -159,13 +180,17 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
             ++numMetaItems;
         }
         rv = NEW_ITEM;
-        toWrite.push_back(qi);
+        auto pos = toWrite.push_back(qi);
+        if (qi->getKey().size() > 0) {
+            // We add a meta item only once to a checkpoint
+            metaKeyIndex.insert({pos, qi->getBySeqno()});
+        }
     } else {
         // Check if this checkpoint already had an item for the same key
-        if (it != keyIndex.end()) {
+        if (existing) {
             rv = EXISTING_ITEM;
-            CheckpointQueue::iterator currPos = it->second.position;
-            const int64_t currMutationId{it->second.mutation_id};
+            CheckpointQueue::iterator currPos = existing->position;
+            const int64_t currMutationId{existing->mutation_id};
 
             // Given the key already exists, need to check all cursors in this
             // Checkpoint and see if the existing item for this key is to
@@ -184,7 +209,7 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
                                                                 : keyIndex;
 
                     auto cursor_item_idx = index.find(cursor_item->getKey());
-                    if (cursor_item_idx == keyIndex.end()) {
+                    if (!cursor_item_idx) {
                         throw std::logic_error("Checkpoint::queueDirty: Unable "
                                 "to find key with"
                                 " op:" + to_string(cursor_item->getOperation()) +
@@ -199,7 +224,7 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
                     // decrement if the the existing item is strictly less than
                     // the cursor, as meta-items can share a seqno with
                     // a non-meta item but are logically before them.
-                    int64_t cursor_mutation_id{cursor_item_idx->second.mutation_id};
+                    int64_t cursor_mutation_id{cursor_item_idx->mutation_id};
                     if (cursor_item->isCheckPointMetaItem()) {
                         --cursor_mutation_id;
                     }
@@ -221,43 +246,24 @@ queue_dirty_t Checkpoint::queueDirty(const queued_item &qi,
                 }
             }
 
-            toWrite.push_back(qi);
-            // Remove the existing item for the same key from the list.
+            // Point the index at the new item before removing the existing
+            // item for the same key (the index reads keys from the queue).
+            existing->position = toWrite.push_back(qi);
+            existing->mutation_id = qi->getBySeqno();
             toWrite.erase(currPos);
         } else {
             ++numItems;
             rv = NEW_ITEM;
-            // Push the new item into the list
-            toWrite.push_back(qi);
-        }
-    }
-
-    if (qi->getKey().size() > 0) {
-        CheckpointQueue::iterator last = toWrite.end();
-        // --last is okay as the list is not empty now.
-        index_entry entry = {--last, qi->getBySeqno()};
-        // Set the index of the key to the new item that is pushed back into
-        // the list.
-        if (qi->isCheckPointMetaItem()) {
-            // We add a meta item only once to a checkpoint
-            metaKeyIndex[qi->getKey()] = entry;
-        } else {
-            keyIndex[qi->getKey()] = entry;
-        }
-        if (rv == NEW_ITEM) {
-            size_t newEntrySize = qi->getKey().size() +
-                                  sizeof(index_entry) + sizeof(queued_item);
-            memOverhead += newEntrySize;
-            stats.memOverhead->fetch_add(newEntrySize);
-            if (stats.memOverhead->load() >= GIGANTOR) {
-                LOG(EXTENSION_LOG_WARNING,
-                    "Checkpoint::queueDirty: stats.memOverhead (which is %" PRId64
-                    ") is greater than %" PRId64, uint64_t(stats.memOverhead->load()),
-                    uint64_t(GIGANTOR));
+            // Push the new item into the queue
+            auto pos = toWrite.push_back(qi);
+            if (qi->getKey().size() > 0) {
+                keyIndex.insert({pos, qi->getBySeqno()});
             }
         }
     }
 
+    updateMemOverhead();
+
     // Notify flusher if in case queued item is a checkpoint meta item or
     // vbpersist state.
     if (qi->getOperation() == queue_op::checkpoint_start ||
@@ -276,22 +282,16 @@ const StoredDocKey Checkpoint::SetVBucketStateKey("set_vbucket_state", DocNamesp
 
 size_t Checkpoint::mergePrevCheckpoint(Checkpoint *pPrevCheckpoint) {
     size_t numNewItems = 0;
-    size_t newEntryMemOverhead = 0;
 
     LOG(EXTENSION_LOG_INFO,
         "Collapse the checkpoint %" PRIu64 " into the checkpoint %" PRIu64
         " for vbucket %d",
         pPrevCheckpoint->getId(), checkpointId, vbucketId);
 
-    CheckpointQueue::iterator itr = toWrite.begin();
-    uint64_t seqno = pPrevCheckpoint->getMutationIdForKey(Checkpoint::DummyKey, true);
-    metaKeyIndex[Checkpoint::DummyKey].mutation_id = seqno;
-    (*itr)->setBySeqno(seqno);
-
-    seqno = pPrevCheckpoint->getMutationIdForKey(Checkpoint::CheckpointStartKey, true);
-    metaKeyIndex[Checkpoint::CheckpointStartKey].mutation_id = seqno;
-    ++itr;
-    (*itr)->setBySeqno(seqno);
+    const uint64_t dummySeqno =
+            pPrevCheckpoint->getMutationIdForKey(Checkpoint::DummyKey, true);
+    const uint64_t startSeqno = pPrevCheckpoint->getMutationIdForKey(
+            Checkpoint::CheckpointStartKey, true);
 
     // Iterate in reverse over the previous checkpoints' items, inserting them
     // into the current checkpoint as necessary.
@@ -305,14 +305,13 @@ size_t Checkpoint::mergePrevCheckpoint(Checkpoint *pPrevCheckpoint) {
                 // checkpoint if the key isn't already present (if it is already
                 // present then it must be an older revision and hence we can
                 // safely discard it).
-                if (keyIndex.find(key) == keyIndex.end()) {
-                    // Skip the first two meta items (empty & checkpoint start).
-                    auto pos = std::next(toWrite.begin(), 2);
-                    toWrite.insert(pos, *rit);
-                    index_entry entry = {--pos, static_cast<int64_t>(pPrevCheckpoint->
+                if (!keyIndex.find(key)) {
+                    // Prepend; the first two meta items (empty & checkpoint
+                    // start) are moved back to the front below.
+                    auto pos = toWrite.push_front(*rit);
+                    index_entry entry = {pos, static_cast<int64_t>(pPrevCheckpoint->
                                                     getMutationIdForKey(key, false))};
-                    keyIndex[key] = entry;
-                    newEntryMemOverhead += key.size() + sizeof(index_entry);
+                    keyIndex.insert(entry);
                     ++numItems;
                     ++numNewItems;
 
@@ -343,14 +342,11 @@ size_t Checkpoint::mergePrevCheckpoint(Checkpoint *pPrevCheckpoint) {
             case queue_op::set_vbucket_state:
             case queue_op::system_event:
                 // Need to re-insert these into the correct place in the index.
-                if (metaKeyIndex.find(key) == metaKeyIndex.end()) {
-                    // Skip the first two meta items (empty & checkpoint start).
-                    auto pos = std::next(toWrite.begin(), 2);
-                    toWrite.insert(pos, *rit);
+                if (!metaKeyIndex.find(key)) {
+                    auto pos = toWrite.push_front(*rit);
                     auto mutationId = static_cast<int64_t>(
                             pPrevCheckpoint->getMutationIdForKey(key, true));
-                    metaKeyIndex[key] = {--pos, mutationId};
-                    newEntryMemOverhead += key.size() + sizeof(index_entry);
+                    metaKeyIndex.insert({pos, mutationId});
                     ++numMetaItems;
                     ++numNewItems;
 
@@ -361,6 +357,21 @@ size_t Checkpoint::mergePrevCheckpoint(Checkpoint *pPrevCheckpoint) {
         }
     }
 
+    // Move the empty & checkpoint start items back to the front of the
+    // queue, taking the seqnos of the previous checkpoint's ones. No cursor
+    // can be positioned on them (see collapseClosedCheckpoints).
+    for (const auto& meta : {std::make_pair(&Checkpoint::CheckpointStartKey,
+                                            startSeqno),
+                             std::make_pair(&Checkpoint::DummyKey,
+                                            dummySeqno)}) {
+        index_entry* entry = metaKeyIndex.find(*meta.first);
+        const auto oldPos = entry->position;
+        (*oldPos)->setBySeqno(meta.second);
+        entry->position = toWrite.push_front(*oldPos);
+        entry->mutation_id = meta.second;
+        toWrite.erase(oldPos);
+    }
+
     /**
      * Update snapshot start of current checkpoint to the first
      * item's sequence number, after merge completed, as items
@@ -369,22 +380,17 @@ size_t Checkpoint::mergePrevCheckpoint(Checkpoint *pPrevCheckpoint) {
      */
     setSnapshotStartSeqno(getLowSeqno());
 
-    memOverhead += newEntryMemOverhead;
-    stats.memOverhead->fetch_add(newEntryMemOverhead);
-    LOG(EXTENSION_LOG_WARNING,
-        "Checkpoint::mergePrevCheckpoint: stats.memOverhead (which is %" PRId64
-        ") is greater than %" PRId64, uint64_t(stats.memOverhead->load()),
-        uint64_t(GIGANTOR));
+    updateMemOverhead();
     return numNewItems;
 }
 
 uint64_t Checkpoint::getMutationIdForKey(const DocKey& key, bool isMeta) {
     uint64_t mid = 0;
-    checkpoint_index& chkIdx = isMeta ? metaKeyIndex : keyIndex;
+    const CheckpointIndex& chkIdx = isMeta ? metaKeyIndex : keyIndex;
 
-    checkpoint_index::iterator it = chkIdx.find(key);
-    if (it != chkIdx.end()) {
-        mid = it->second.mutation_id;
+    const index_entry* entry = chkIdx.find(key);
+    if (entry) {
+        mid = entry->mutation_id;
     } else {
         throw std::invalid_argument("key{" +
                                     std::string(reinterpret_cast<const char*>(key.data())) +
@@ -436,7 +442,9 @@ CheckpointManager::CheckpointManager(EPStats& st,
       lastClosedChkBySeqno(lastSeqno),
       isCollapsedCheckpoint(false),
       pCursorPreCheckpointId(0),
-      flusherCB(cb) {
+      flusherCB(cb),
+      unlockedReaders(0),
+      cursorGeneration(0) {
     LockHolder lh(queueLock);
     addNewCheckpoint_UNLOCKED(1, lastSnapStart, lastSnapEnd);
     if (checkpointConfig.isPersistenceEnabled()) {
@@ -453,6 +461,22 @@ CheckpointManager::~CheckpointManager() {
     }
 }
 
+std::unique_lock<std::mutex> CheckpointManager::lockQueue(
+        Histogram<hrtime_t>& waitHisto) {
+    std::unique_lock<std::mutex> lh(queueLock, std::try_to_lock);
+    if (!lh.owns_lock()) {
+        const hrtime_t start = gethrtime();
+        lh.lock();
+        waitHisto.add((gethrtime() - start) / 1000);
+    }
+    return lh;
+}
+
+void CheckpointManager::waitForUnlockedReaders(
+        std::unique_lock<std::mutex>& lh) {
+    unlockedReadersDone.wait(lh, [this] { return unlockedReaders == 0; });
+}
+
 uint64_t CheckpointManager::getOpenCheckpointId_UNLOCKED() {
     if (checkpointList.empty()) {
         return 0;
@@ -732,6 +756,7 @@ bool CheckpointManager::registerCursor_UNLOCKED(
     if (name.compare(pCursorName) == 0) {
         resetOnCollapse = false;
     }
+    ++cursorGeneration;
 
     bool found = false;
     std::list<Checkpoint*>::iterator it = checkpointList.begin();
@@ -840,6 +865,7 @@ bool CheckpointManager::removeCursor_UNLOCKED(const std::string &name) {
     LOG(EXTENSION_LOG_INFO,
         "Remove the checkpoint cursor with the name \"%s\" from vbucket %d",
         name.c_str(), vbucketId);
+    ++cursorGeneration;
 
     // We can simply remove the cursor's name from the checkpoint to which it
     // currently belongs,
@@ -909,7 +935,7 @@ bool CheckpointManager::isCheckpointCreationForHighMemUsage(
 size_t CheckpointManager::removeClosedUnrefCheckpoints(
         VBucket& vbucket, bool& newOpenCheckpointCreated) {
     // This function is executed periodically by the non-IO dispatcher.
-    std::unique_lock<std::mutex> lh(queueLock);
+    auto lh = lockQueue(removerLockWaitHisto);
     uint64_t oldCheckpointId = 0;
     bool canCreateNewCheckpoint = false;
     if (checkpointList.size() < checkpointConfig.getMaxCheckpoints() ||
@@ -948,9 +974,10 @@ size_t CheckpointManager::removeClosedUnrefCheckpoints(
 
         removeInvalidCursorsOnCheckpoint(*it);
 
-        // When we encounter the first checkpoint which has cursor(s) in it,
-        // or if the persistence cursor is still operating, stop.
-        if ((*it)->getNumberOfCursors() > 0 ||
+        // When we encounter the first checkpoint which has cursor(s) in it
+        // (or is being read by one), or if the persistence cursor is still
+        // operating, stop.
+        if ((*it)->getNumberOfCursors() > 0 || (*it)->isPinned() ||
                 (checkpointConfig.isPersistenceEnabled() &&
                  (*it)->getId() > pCursorPreCheckpointId)) {
             break;
@@ -984,9 +1011,12 @@ size_t CheckpointManager::removeClosedUnrefCheckpoints(
     // the upstream master is very slow and causes more closed checkpoints in
     // memory, collapse those closed checkpoints into a single one to reduce
     // the memory overhead.
+    // (Skipped while cursors are reading closed checkpoints without the
+    // lock; it will be retried on the next run.)
     if (checkpointConfig.isCheckpointMergeSupported() &&
         !checkpointConfig.canKeepClosedCheckpoints() &&
-        vbucket.getState() == vbucket_state_replica) {
+        vbucket.getState() == vbucket_state_replica &&
+        unlockedReaders == 0) {
         size_t curr_remains = getNumItemsForCursor_UNLOCKED(pCursorName);
         collapseClosedCheckpoints(unrefCheckpointList);
         size_t new_remains = getNumItemsForCursor_UNLOCKED(pCursorName);
@@ -1128,9 +1158,10 @@ std::vector<std::string> CheckpointManager::getListOfCursorsToDrop() {
     return cursorsToDrop;
 }
 
-void CheckpointManager::updateStatsForNewQueuedItem_UNLOCKED(const LockHolder&,
-                                                             VBucket& vb,
-                                                             const queued_item& qi) {
+void CheckpointManager::updateStatsForNewQueuedItem_UNLOCKED(
+        const std::unique_lock<std::mutex>&,
+        VBucket& vb,
+        const queued_item& qi) {
     ++stats.totalEnqueued;
     if (checkpointConfig.isPersistenceEnabled()) {
         ++stats.diskQueueSize;
@@ -1146,7 +1177,7 @@ bool CheckpointManager::queueDirty(
         const GenerateBySeqno generateBySeqno,
         const GenerateCas generateCas,
         PreLinkDocumentContext* preLinkDocumentContext) {
-    LockHolder lh(queueLock);
+    auto lh = lockQueue(appendLockWaitHisto);
 
     bool canCreateNewCheckpoint = false;
     if (checkpointList.size() < checkpointConfig.getMaxCheckpoints() ||
@@ -1226,7 +1257,7 @@ bool CheckpointManager::queueDirty(
 
 void CheckpointManager::queueSetVBState(VBucket& vb) {
     // Take lock to serialize use of {lastBySeqno} and to queue op.
-    LockHolder lh(queueLock);
+    auto lh = lockQueue(appendLockWaitHisto);
 
     // Create the setVBState operation, and enqueue it.
     queued_item item = createCheckpointItem(/*id*/0, vbucketId,
@@ -1247,7 +1278,7 @@ void CheckpointManager::queueSetVBState(VBucket& vb) {
 snapshot_range_t CheckpointManager::getAllItemsForCursor(
                                              const std::string& name,
                                              std::vector<queued_item> &items) {
-    LockHolder lh(queueLock);
+    auto lh = lockQueue(cursorLockWaitHisto);
     snapshot_range_t range;
     cursor_index::iterator it = connCursors.find(name);
     if (it == connCursors.end()) {
@@ -1256,9 +1287,34 @@ snapshot_range_t CheckpointManager::getAllItemsForCursor(
         return range;
     }
 
-    bool moreItems;
     range.start = (*it->second.currentCheckpoint)->getSnapshotStartSeqno();
     range.end = (*it->second.currentCheckpoint)->getSnapshotEndSeqno();
+
+    // Read any closed checkpoints without the lock, so we don't block
+    // front-end threads queueing items (or other cursors) while copying them.
+    if ((*it->second.currentCheckpoint)->getState() == CHECKPOINT_CLOSED) {
+        if (getItemsFromClosedCheckpoints(lh, name, items, range)) {
+            it = connCursors.find(name);
+            if ((*(it->second.currentPos))->getOperation() ==
+                queue_op::checkpoint_end) {
+                moveCursorToNextCheckpoint(it->second);
+            }
+        } else {
+            it = connCursors.find(name);
+            if (it == connCursors.end()) {
+                range.start = 0;
+                range.end = 0;
+                return range;
+            }
+            range.start =
+                    (*it->second.currentCheckpoint)->getSnapshotStartSeqno();
+            range.end = (*it->second.currentCheckpoint)->getSnapshotEndSeqno();
+        }
+    }
+
+    // Then read the remainder (the open checkpoint, and any checkpoints
+    // closed while the lock was released) with the lock held.
+    bool moreItems;
     while ((moreItems = incrCursor(it->second))) {
         queued_item& qi = *(it->second.currentPos);
         items.push_back(qi);
@@ -1282,9 +1338,100 @@ snapshot_range_t CheckpointManager::getAllItemsForCursor(
     return range;
 }
 
+bool CheckpointManager::getItemsFromClosedCheckpoints(
+        std::unique_lock<std::mutex>& lh,
+        const std::string& name,
+        std::vector<queued_item>& items,
+        snapshot_range_t& range) {
+    auto it = connCursors.find(name);
+    const CheckpointCursor& cursor = it->second;
+
+    // Pin the closed checkpoints from the cursor's onwards.
+    std::vector<std::list<Checkpoint*>::iterator> closed;
+    for (auto chk = cursor.currentCheckpoint;
+         chk != checkpointList.end() &&
+         (*chk)->getState() == CHECKPOINT_CLOSED;
+         ++chk) {
+        (*chk)->pin();
+        closed.push_back(chk);
+    }
+    const auto startPos = cursor.currentPos;
+    const size_t startOffset = cursor.offset;
+    const uint64_t startGeneration = cursorGeneration;
+    size_t metaItemsRead = cursor.ckptMetaItemsRead;
+    ++unlockedReaders;
+    lh.unlock();
+
+    // Walk the cursor (as incrCursor would) until we reach the end of the
+    // pinned checkpoints.
+    const size_t origSize = items.size();
+    size_t idx = 0;
+    auto pos = startPos;
+    size_t offset = startOffset;
+    snapshot_range_t newRange = range;
+    while (true) {
+        Checkpoint* chk = *closed[idx];
+        if (++pos == chk->end()) {
+            --pos;
+            if (idx + 1 == closed.size()) {
+                break;
+            }
+            pos = (*closed[++idx])->begin();
+            metaItemsRead = 0;
+            continue;
+        }
+        ++offset;
+        if ((*pos)->isNonEmptyCheckpointMetaItem()) {
+            ++metaItemsRead;
+        }
+        items.push_back(*pos);
+
+        if ((*pos)->getOperation() == queue_op::checkpoint_end) {
+            newRange.end = chk->getSnapshotEndSeqno();
+            if (idx + 1 == closed.size()) {
+                // Moving to the next checkpoint is done by the caller,
+                // under the lock.
+                break;
+            }
+            pos = (*closed[++idx])->begin();
+            metaItemsRead = 0;
+        }
+    }
+
+    lh = lockQueue(cursorLockWaitHisto);
+    for (auto& chk : closed) {
+        (*chk)->unpin();
+    }
+    if (--unlockedReaders == 0) {
+        unlockedReadersDone.notify_all();
+    }
+
+    it = connCursors.find(name);
+    if (it == connCursors.end() || cursorGeneration != startGeneration ||
+        it->second.currentCheckpoint != closed.front() ||
+        it->second.currentPos != startPos ||
+        it->second.offset != startOffset) {
+        // The cursor was moved while we weren't holding the lock.
+        items.erase(items.begin() + origSize, items.end());
+        return false;
+    }
+
+    CheckpointCursor& c = it->second;
+    if (idx > 0) {
+        (*c.currentCheckpoint)->removeCursorName(name);
+        c.currentCheckpoint = closed[idx];
+        (*c.currentCheckpoint)->registerCursorName(name);
+    }
+    c.currentPos = pos;
+    c.offset = offset;
+    c.setMetaItemOffset(metaItemsRead);
+    range = newRange;
+    return true;
+}
+
 queued_item CheckpointManager::nextItem(const std::string &name,
                                         bool &isLastMutationItem) {
-    LockHolder lh(queueLock);
+    auto lh = lockQueue(cursorLockWaitHisto);
     cursor_index::iterator it = connCursors.find(name);
     if (it == connCursors.end()) {
         LOG(EXTENSION_LOG_WARNING,
@@ -1335,7 +1482,8 @@ void CheckpointManager::dump() const {
 }
 
 void CheckpointManager::clear(VBucket& vb, uint64_t seqno) {
-    LockHolder lh(queueLock);
+    std::unique_lock<std::mutex> lh(queueLock);
+    waitForUnlockedReaders(lh);
     clear_UNLOCKED(vb.getState(), seqno);
 
     // Reset the disk write queue size stat for the vbucket
@@ -1365,6 +1513,7 @@ void CheckpointManager::clear_UNLOCKED(vbucket_state_t vbState, uint64_t seqno)
 }
 
 void CheckpointManager::resetCursors(bool resetPersistenceCursor) {
+    ++cursorGeneration;
     for (auto& cit : connCursors) {
         if (cit.second.name.compare(pCursorName) == 0) {
             if (!resetPersistenceCursor) {
@@ -1614,7 +1763,9 @@ void CheckpointManager::updateDiskQueueStats(VBucket& vbucket,
 
 void CheckpointManager::checkAndAddNewCheckpoint(uint64_t id,
                                                  VBucket& vbucket) {
-    LockHolder lh(queueLock);
+    std::unique_lock<std::mutex> lh(queueLock);
+    // May collapse (modify) the closed checkpoints.
+    waitForUnlockedReaders(lh);
 
     // Ignore CHECKPOINT_START message with ID 0 as 0 is reserved for
     // representing backfill.
@@ -2036,6 +2187,15 @@ void CheckpointManager::addStats(ADD_STAT add_stat, const void *cookie) {
                         add_stat, cookie);
         checked_snprintf(buf, sizeof(buf), "vb_%d:mem_usage", vbucketId);
         add_casted_stat(buf, getMemoryUsage_UNLOCKED(), add_stat, cookie);
+        checked_snprintf(buf, sizeof(buf), "vb_%d:queue_lock_wait_append",
+                         vbucketId);
+        add_casted_stat(buf, appendLockWaitHisto, add_stat, cookie);
+        checked_snprintf(buf, sizeof(buf), "vb_%d:queue_lock_wait_cursor",
+                         vbucketId);
+        add_casted_stat(buf, cursorLockWaitHisto, add_stat, cookie);
+        checked_snprintf(buf, sizeof(buf), "vb_%d:queue_lock_wait_remover",
+                         vbucketId);
+        add_casted_stat(buf, removerLockWaitHisto, add_stat, cookie);
 
         cursor_index::iterator cur_it = connCursors.begin();
         for (; cur_it != connCursors.end(); ++cur_it) {
@@ -21,12 +21,14 @@
 #include "config.h"
 
 #include "callbacks.h"
+#include "checkpoint_queue.h"
 #include "ep_types.h"
 #include "item.h"
 #include "locks.h"
 #include "stats.h"
 
 #include <atomic>
+#include <condition_variable>
 #include <list>
 #include <map>
 #include <memory>
@@ -58,18 +60,6 @@ enum checkpoint_state {
 
 const char* to_string(enum checkpoint_state);
 
-// List is used for queueing mutations as vector incurs shift operations for
-// deduplication.
-typedef std::list<queued_item> CheckpointQueue;
-
-/**
- * A checkpoint index entry.
- */
-struct index_entry {
-    CheckpointQueue::iterator position;
-    int64_t mutation_id;
-};
-
 typedef struct {
     uint64_t start;
     uint64_t end;
@@ -88,11 +78,6 @@ enum class MustSendCheckpointEnd {
     YES
 };
 
-/**
- * The checkpoint index maps a key to a checkpoint index_entry.
- */
-typedef std::unordered_map<StoredDocKey, index_entry> checkpoint_index;
-
 /**
  * List of pairs containing checkpoint cursor name and corresponding flag
  * indicating whether we must send checkpoint end meta item for the cursor
@@ -353,12 +338,14 @@ public:
         numItems(0),
         numMetaItems(0),
         memOverhead(0),
-        effectiveMemUsage(0) {
-        stats.memOverhead->fetch_add(memorySize());
-        if (stats.memOverhead->load() >= GIGANTOR) {
+        effectiveMemUsage(0),
+        numUnlockedReaders(0) {
+        memOverhead = getStructureMemorySize();
+        stats.memOverhead.fetch_add(memorySize());
+        if (stats.memOverhead.load() >= GIGANTOR) {
             LOG(EXTENSION_LOG_WARNING,
                 "Checkpoint::Checkpoint: stats.memOverhead (which is %" PRId64
-                ") is greater than %" PRId64, uint64_t(stats.memOverhead->load()),
+                ") is greater than %" PRId64, uint64_t(stats.memOverhead.load()),
                 uint64_t(GIGANTOR));
         }
     }
@@ -443,6 +430,23 @@ public:
         return cursors.find(name) != cursors.end();
     }
 
+    /**
+     * Record that a cursor is reading this (closed) checkpoint without
+     * holding the CheckpointManager's queueLock. While pinned the checkpoint
+     * must not be removed or modified. Requires queueLock.
+     */
+    void pin() {
+        ++numUnlockedReaders;
+    }
+
+    void unpin() {
+        --numUnlockedReaders;
+    }
+
+    bool isPinned() const {
+        return numUnlockedReaders > 0;
+    }
+
     /**
      * Return the list of all cursor names in this checkpoint
      */
@@ -569,6 +573,18 @@ public:
     static const StoredDocKey SetVBucketStateKey;
 
 private:
+    /// @return the memory used by the queue and index structures.
+    size_t getStructureMemorySize() const {
+        return toWrite.memorySize() + keyIndex.memorySize() +
+               metaKeyIndex.memorySize();
+    }
+
+    /**
+     * Update memOverhead (and stats.memOverhead) after items have been
+     * added to or removed from the queue and index.
+     */
+    void updateMemOverhead();
+
     EPStats                       &stats;
     uint64_t                       checkpointId;
     uint64_t                       snapStartSeqno;
@@ -582,15 +598,19 @@ private:
     size_t numMetaItems;
     std::set<std::string>          cursors; // List of cursors with their unique names.
     CheckpointQueue                toWrite;
-    checkpoint_index               keyIndex;
+    CheckpointIndex                keyIndex;
     /* Index for meta keys like "dummy_key" */
-    checkpoint_index               metaKeyIndex;
+    CheckpointIndex                metaKeyIndex;
     size_t                         memOverhead;
 
     // The following stat is to contain the memory consumption of all
     // the queued items in the given checkpoint.
     size_t                         effectiveMemUsage;
 
+    // Number of cursors currently reading this checkpoint without holding
+    // the queueLock (see pin()).
+    size_t                         numUnlockedReaders;
+
     friend std::ostream& operator <<(std::ostream& os, const Checkpoint& m);
 };
 
@@ -756,7 +776,8 @@ public:
     size_t getNumItemsForCursor(const std::string &name) const;
 
     void clear(vbucket_state_t vbState) {
-        LockHolder lh(queueLock);
+        std::unique_lock<std::mutex> lh(queueLock);
+        waitForUnlockedReaders(lh);
         clear_UNLOCKED(vbState, lastBySeqno);
     }
 
@@ -881,10 +902,12 @@ protected:
 
     // Helper method for queueing methods - update the global and per-VBucket
     // stats after queueing a new item to a checkpoint.
-    // Must be called with queueLock held (LockHolder passed in as argument to
+    // Must be called with queueLock held (lock passed in as argument to
     // 'prove' this).
-    void updateStatsForNewQueuedItem_UNLOCKED(const LockHolder&,
-                                     VBucket& vb, const queued_item& qi);
+    void updateStatsForNewQueuedItem_UNLOCKED(
+            const std::unique_lock<std::mutex>&,
+            VBucket& vb,
+            const queued_item& qi);
 
     /**
      * Helper method to update disk queue stats after (maybe) changing the
@@ -914,6 +937,38 @@ private:
 
     bool removeCursor_UNLOCKED(const std::string &name);
 
+    /**
+     * Acquire the queueLock. If it is contended, record how long the wait
+     * took in the given histogram; the uncontended path is just a try_lock.
+     */
+    std::unique_lock<std::mutex> lockQueue(Histogram<hrtime_t>& waitHisto);
+
+    /**
+     * Wait (temporarily releasing the queueLock) until no cursor is reading
+     * closed checkpoints without the lock. Must be called before removing
+     * or modifying closed checkpoints which may be pinned.
+     */
+    void waitForUnlockedReaders(std::unique_lock<std::mutex>& lh);
+
+    /**
+     * Advance the named cursor through the closed checkpoints ahead of it,
+     * appending their items to `items`, without holding the queueLock
+     * while reading the items. Closed checkpoints are immutable; they are
+     * pinned for the duration of the read so they cannot be removed or
+     * collapsed underneath us.
+     *
+     * The cursor is only updated if no one else moved it (or reset the
+     * cursors) while the lock was released; otherwise any items read are
+     * discarded and false is returned so the caller can read them with
+     * the lock held.
+     *
+     * @param lh Lock holder for queueLock; locked on entry and on return.
+     */
+    bool getItemsFromClosedCheckpoints(std::unique_lock<std::mutex>& lh,
+                                       const std::string& name,
+                                       std::vector<queued_item>& items,
+                                       snapshot_range_t& range);
+
     bool registerCursor_UNLOCKED(
                             const std::string &name,
                             uint64_t checkpointId,
@@ -996,6 +1051,21 @@ private:
 
     FlusherCallback          flusherCB;
 
+    // Number of cursors reading closed checkpoints without the queueLock,
+    // and condition variable notified when it drops to zero.
+    size_t                   unlockedReaders;
+    std::condition_variable  unlockedReadersDone;
+
+    // Incremented whenever cursors are registered, removed or reset; used to
+    // detect if a cursor was repositioned during an unlocked read.
+    uint64_t                 cursorGeneration;
+
+    // Time spent waiting for a contended queueLock (in us) for queueing
+    // items, reading items for cursors and removing checkpoints.
+    Histogram<hrtime_t>      appendLockWaitHisto;
+    Histogram<hrtime_t>      cursorLockWaitHisto;
+    Histogram<hrtime_t>      removerLockWaitHisto;
+
     friend std::ostream& operator<<(std::ostream& os, const CheckpointManager& m);
 };
 
@@ -0,0 +1,244 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "checkpoint_queue.h"
+
+#include <platform/make_unique.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// Positions start in the middle of the range so the queue can grow in
+// either direction without adjusting existing positions.
+static const uint64_t initialChunk = uint64_t(1) << 40;
+
+CheckpointQueue::CheckpointQueue()
+    : headPos(initialChunk * ChunkSize),
+      tailPos(initialChunk * ChunkSize),
+      numItems(0) {
+}
+
+CheckpointQueue::iterator CheckpointQueue::push_back(const queued_item& qi) {
+    store(tailPos, qi);
+    return iterator(this, tailPos++);
+}
+
+CheckpointQueue::iterator CheckpointQueue::push_front(const queued_item& qi) {
+    store(--headPos, qi);
+    return iterator(this, headPos);
+}
+
+void CheckpointQueue::pop_back() {
+    if (empty()) {
+        throw std::logic_error("CheckpointQueue::pop_back: queue is empty");
+    }
+    tailPos = prevLive(tailPos - 1);
+    clearSlot(tailPos);
+}
+
+void CheckpointQueue::erase(iterator pos) {
+    if (pos.queue != this || pos.pos < headPos || pos.pos >= tailPos ||
+        !chunkFor(pos.pos) || !*slotFor(pos.pos)) {
+        throw std::invalid_argument(
+                "CheckpointQueue::erase: position does not refer to an item");
+    }
+    clearSlot(pos.pos);
+    if (pos.pos == headPos) {
+        headPos = nextLive(headPos);
+    }
+}
+
+template <typename Iterator>
+static Iterator chunkLowerBound(Iterator begin, Iterator end, uint64_t chunkNo) {
+    return std::lower_bound(
+            begin, end, chunkNo, [](const decltype(*begin)& chunk, uint64_t n) {
+                return chunk->number < n;
+            });
+}
+
+CheckpointQueue::ChunkList::iterator CheckpointQueue::lowerBound(
+        uint64_t chunkNo) {
+    return chunkLowerBound(chunks.begin(), chunks.end(), chunkNo);
+}
+
+CheckpointQueue::ChunkList::const_iterator CheckpointQueue::lowerBound(
+        uint64_t chunkNo) const {
+    return chunkLowerBound(chunks.begin(), chunks.end(), chunkNo);
+}
+
+uint64_t CheckpointQueue::nextLive(uint64_t pos) const {
+    while (pos < tailPos) {
+        const Chunk* chunk = chunkFor(pos);
+        if (!chunk) {
+            // Released chunk(s) - skip to the next chunk holding items.
+            const auto next = lowerBound(pos / ChunkSize);
+            if (next == chunks.end()) {
+                break;
+            }
+            pos = (*next)->number * ChunkSize;
+            continue;
+        }
+        if (chunk->slots[pos % ChunkSize]) {
+            return pos;
+        }
+        ++pos;
+    }
+    return tailPos;
+}
+
+uint64_t CheckpointQueue::prevLive(uint64_t pos) const {
+    while (pos >= headPos && pos < tailPos) {
+        const Chunk* chunk = chunkFor(pos);
+        if (!chunk) {
+            const auto next = lowerBound(pos / ChunkSize);
+            if (next == chunks.begin()) {
+                break;
+            }
+            pos = (*std::prev(next))->number * ChunkSize + ChunkSize - 1;
+            continue;
+        }
+        if (chunk->slots[pos % ChunkSize]) {
+            return pos;
+        }
+        --pos;
+    }
+    return headPos;
+}
+
+void CheckpointQueue::store(uint64_t pos, const queued_item& qi) {
+    if (!qi) {
+        throw std::invalid_argument("CheckpointQueue::store: null item");
+    }
+    Chunk* chunk = chunkFor(pos);
+    if (!chunk) {
+        auto newChunk = spareChunk ? std::move(spareChunk)
+                                   : std::make_unique<Chunk>();
+        newChunk->number = pos / ChunkSize;
+        chunk = newChunk.get();
+        if (chunks.empty() || chunk->number > chunks.back()->number) {
+            chunks.push_back(std::move(newChunk));
+        } else if (chunk->number < chunks.front()->number) {
+            chunks.push_front(std::move(newChunk));
+        } else {
+            chunks.insert(lowerBound(chunk->number), std::move(newChunk));
+        }
+    }
+    chunk->slots[pos % ChunkSize] = qi;
+    ++chunk->live;
+    ++numItems;
+}
+
+void CheckpointQueue::clearSlot(uint64_t pos) {
+    const auto it = lowerBound(pos / ChunkSize);
+    auto& chunk = *it;
+    chunk->slots[pos % ChunkSize].reset();
+    --numItems;
+    if (--chunk->live == 0) {
+        // All slots are holes (no iterator can refer to them); drop the
+        // chunk from the queue, keeping it for re-use.
+        spareChunk = std::move(chunk);
+        chunks.erase(it);
+    }
+}
+
+CheckpointIndex::CheckpointIndex() : table(16), count(0) {
+}
+
+index_entry* CheckpointIndex::find(const DocKey& key) {
+    auto& slot = table[probe(key, key.hash())];
+    return slot.used ? &slot.entry : nullptr;
+}
+
+void CheckpointIndex::insert(const index_entry& entry) {
+    const auto& key = (*entry.position)->getKey();
+    const uint32_t hash = key.hash();
+    auto* slot = &table[probe(key, hash)];
+    if (!slot->used) {
+        // Keep the load factor at or below 1/2 so probe sequences are short.
+        if ((count + 1) * 2 > table.size()) {
+            grow();
+            slot = &table[probe(key, hash)];
+        }
+        slot->hash = hash;
+        slot->used = true;
+        ++count;
+    }
+    slot->entry = entry;
+}
+
+void CheckpointIndex::erase(const DocKey& key) {
+    const size_t mask = table.size() - 1;
+    size_t hole = probe(key, key.hash());
+    if (!table[hole].used) {
+        return;
+    }
+    table[hole].used = false;
+    --count;
+
+    // Backward-shift deletion: move later entries of the probe sequence
+    // into the hole, so lookups never need tombstones.
+    for (size_t next = (hole + 1) & mask; table[next].used;
+         next = (next + 1) & mask) {
+        const size_t home = table[next].hash & mask;
+        // Can the entry at next be moved to hole? Only if its home slot
+        // isn't cyclically within (hole, next].
+        const bool homeInRange = (hole <= next)
+                                         ? (hole < home && home <= next)
+                                         : (hole < home || home <= next);
+        if (!homeInRange) {
+            table[hole] = table[next];
+            table[next].used = false;
+            hole = next;
+        }
+    }
+}
+
+size_t CheckpointIndex::probe(const DocKey& key, uint32_t hash) const {
+    const size_t mask = table.size() - 1;
+    size_t idx = hash & mask;
+    while (table[idx].used) {
+        if (table[idx].hash == hash &&
+            keyEquals((*table[idx].entry.position)->getKey(), key)) {
+            break;
+        }
+        idx = (idx + 1) & mask;
+    }
+    return idx;
+}
+
+bool CheckpointIndex::keyEquals(const StoredDocKey& stored,
+                                const DocKey& key) {
+    return stored.size() == key.size() &&
+           stored.getDocNamespace() == key.getDocNamespace() &&
+           std::memcmp(stored.data(), key.data(), key.size()) == 0;
+}
+
+void CheckpointIndex::grow() {
+    std::vector<Slot> old(table.size() * 2);
+    old.swap(table);
+    const size_t mask = table.size() - 1;
+    for (const auto& slot : old) {
+        if (slot.used) {
+            size_t idx = slot.hash & mask;
+            while (table[idx].used) {
+                idx = (idx + 1) & mask;
+            }
+            table[idx] = slot;
+        }
+    }
+}
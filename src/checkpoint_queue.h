@@ -0,0 +1,325 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "item.h"
+
+#include <array>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+/**
+ * The queue of items held by a Checkpoint.
+ *
+ * Items are stored in fixed-size Chunks, so queueing an item normally
+ * doesn't allocate (one allocation per ChunkSize items, instead of one list
+ * node per item). Every slot has a position which never changes while the
+ * item is queued, so iterators (cursor positions and CheckpointIndex
+ * entries) remain valid as other items are added or removed:
+ *
+ * - Items can be appended (push_back) or prepended (push_front, used when
+ *   merging checkpoints).
+ * - Removing an item (erase, used by de-duplication) leaves a hole in its
+ *   slot; iteration skips over holes. Once every slot of a Chunk is a hole
+ *   the Chunk is released (and kept for re-use by the next push), and no
+ *   longer takes any space in the queue, so repeatedly de-duplicating the
+ *   same keys doesn't grow the queue. At most one Chunk per item (plus the
+ *   spare) is ever held.
+ *
+ * Iterators are bidirectional; incrementing past the last item gives end().
+ * Note that unlike std::list, an iterator equal to end() refers to the
+ * next item pushed - callers should not hold on to end() across push_back.
+ */
+class CheckpointQueue {
+public:
+    /// Number of item slots in each Chunk.
+    static const size_t ChunkSize = 64;
+
+    template <typename Queue, typename Value>
+    class Iterator : public std::iterator<std::bidirectional_iterator_tag,
+                                          Value> {
+    public:
+        Iterator() : queue(nullptr), pos(0) {
+        }
+
+        Iterator(Queue* q, uint64_t p) : queue(q), pos(p) {
+        }
+
+        /// Allow conversion from a non-const iterator to a const one.
+        template <typename OtherQueue, typename OtherValue>
+        Iterator(const Iterator<OtherQueue, OtherValue>& other)
+            : queue(other.queue), pos(other.pos) {
+        }
+
+        Value& operator*() const {
+            return *queue->slotFor(pos);
+        }
+
+        Value* operator->() const {
+            return queue->slotFor(pos);
+        }
+
+        Iterator& operator++() {
+            pos = queue->nextLive(pos + 1);
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator tmp(*this);
+            ++*this;
+            return tmp;
+        }
+
+        Iterator& operator--() {
+            pos = queue->prevLive(pos - 1);
+            return *this;
+        }
+
+        Iterator operator--(int) {
+            Iterator tmp(*this);
+            --*this;
+            return tmp;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return pos == other.pos && queue == other.queue;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        Queue* queue;
+        uint64_t pos;
+
+        template <typename, typename>
+        friend class Iterator;
+        friend class CheckpointQueue;
+    };
+
+    using iterator = Iterator<CheckpointQueue, queued_item>;
+    using const_iterator = Iterator<const CheckpointQueue, const queued_item>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    CheckpointQueue();
+
+    CheckpointQueue(const CheckpointQueue&) = delete;
+    CheckpointQueue& operator=(const CheckpointQueue&) = delete;
+
+    iterator begin() {
+        return iterator(this, nextLive(headPos));
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, nextLive(headPos));
+    }
+
+    iterator end() {
+        return iterator(this, tailPos);
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, tailPos);
+    }
+
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    /// @return the number of items in the queue (excluding holes).
+    size_t size() const {
+        return numItems;
+    }
+
+    bool empty() const {
+        return numItems == 0;
+    }
+
+    queued_item& back() {
+        return *slotFor(prevLive(tailPos - 1));
+    }
+
+    /// Append an item, returning its position.
+    iterator push_back(const queued_item& qi);
+
+    /// Prepend an item, returning its position.
+    iterator push_front(const queued_item& qi);
+
+    /// Remove the last item.
+    void pop_back();
+
+    /**
+     * Remove the item at the given position, leaving a hole. Iterators to
+     * other items remain valid.
+     */
+    void erase(iterator pos);
+
+    /// @return the memory used by the queue's Chunks.
+    size_t memorySize() const {
+        return chunks.size() * (sizeof(Chunk) + sizeof(chunks[0])) +
+               (spareChunk ? sizeof(Chunk) : 0);
+    }
+
+private:
+    struct Chunk {
+        std::array<queued_item, ChunkSize> slots;
+        /// Positions [number * ChunkSize, (number + 1) * ChunkSize).
+        uint64_t number = 0;
+        /// Number of (non-hole) items in slots.
+        size_t live = 0;
+    };
+
+    using ChunkList = std::deque<std::unique_ptr<Chunk>>;
+
+    /// @return the first Chunk numbered chunkNo or above.
+    ChunkList::iterator lowerBound(uint64_t chunkNo);
+    ChunkList::const_iterator lowerBound(uint64_t chunkNo) const;
+
+    /// @return the Chunk holding the given position, or null if released.
+    Chunk* chunkFor(uint64_t pos) const {
+        const uint64_t chunkNo = pos / ChunkSize;
+        // Most accesses are to the last Chunk (push_back, cursors reading
+        // the newest items) or the first.
+        if (chunks.empty() || chunkNo < chunks.front()->number ||
+            chunkNo > chunks.back()->number) {
+            return nullptr;
+        }
+        if (chunkNo == chunks.back()->number) {
+            return chunks.back().get();
+        }
+        const auto it = lowerBound(chunkNo);
+        return (*it)->number == chunkNo ? it->get() : nullptr;
+    }
+
+    queued_item* slotFor(uint64_t pos) {
+        return &chunkFor(pos)->slots[pos % ChunkSize];
+    }
+
+    const queued_item* slotFor(uint64_t pos) const {
+        return &chunkFor(pos)->slots[pos % ChunkSize];
+    }
+
+    /// @return the first position >= pos holding an item, or tailPos.
+    uint64_t nextLive(uint64_t pos) const;
+
+    /// @return the last position <= pos holding an item, or headPos.
+    uint64_t prevLive(uint64_t pos) const;
+
+    /// Store qi at pos (allocating its Chunk if necessary).
+    void store(uint64_t pos, const queued_item& qi);
+
+    /// Remove the item at pos, releasing its Chunk if it becomes empty.
+    void clearSlot(uint64_t pos);
+
+    /// The Chunks holding at least one item, in position order.
+    ChunkList chunks;
+
+    /// Position of the first item (or hole) in the queue.
+    uint64_t headPos;
+    /// Position one past the last item in the queue.
+    uint64_t tailPos;
+
+    size_t numItems;
+
+    /// Most recently released Chunk, re-used by the next allocation.
+    std::unique_ptr<Chunk> spareChunk;
+};
+
+/**
+ * A checkpoint index entry.
+ */
+struct index_entry {
+    CheckpointQueue::iterator position;
+    int64_t mutation_id;
+};
+
+/**
+ * The checkpoint index maps a key to the position of the item for that key
+ * in the CheckpointQueue (and its mutation id).
+ *
+ * An open-addressed hash table (linear probing) of index_entry. Keys are not
+ * copied into the index - an entry's key is the key of the item at its
+ * position - so adding a key doesn't allocate unless the table grows.
+ * Consequently every entry must refer to an item which is still queued;
+ * an entry must be updated or erased before its item is removed from the
+ * queue.
+ */
+class CheckpointIndex {
+public:
+    CheckpointIndex();
+
+    /// @return the entry for the given key, or null if not present.
+    index_entry* find(const DocKey& key);
+
+    const index_entry* find(const DocKey& key) const {
+        return const_cast<CheckpointIndex*>(this)->find(key);
+    }
+
+    /**
+     * Add an entry for the key of the item at entry.position, replacing
+     * any existing entry for that key.
+     */
+    void insert(const index_entry& entry);
+
+    /// Remove the entry for the given key (if present).
+    void erase(const DocKey& key);
+
+    size_t size() const {
+        return count;
+    }
+
+    /// @return the memory used by the index's table.
+    size_t memorySize() const {
+        return table.capacity() * sizeof(Slot);
+    }
+
+private:
+    struct Slot {
+        index_entry entry;
+        uint32_t hash;
+        bool used;
+    };
+
+    /// @return the slot holding key, or the empty slot where it belongs.
+    size_t probe(const DocKey& key, uint32_t hash) const;
+
+    static bool keyEquals(const StoredDocKey& stored, const DocKey& key);
+
+    void grow();
+
+    std::vector<Slot> table;
+    size_t count;
+};
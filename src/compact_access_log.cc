@@ -0,0 +1,360 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "compact_access_log.h"
+
+#include "mutation_log.h"
+
+extern "C" {
+#include "crc32.h"
+}
+
+#include <platform/compress.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace CompactAccessLog {
+
+static_assert(sizeof(IndexEntry) == 24,
+              "CompactAccessLog::IndexEntry should have no padding");
+static_assert(sizeof(Footer) == 16,
+              "CompactAccessLog::Footer should have no padding");
+
+static uint32_t crc(const void* buf, size_t len) {
+    return crc32buf(static_cast<uint8_t*>(const_cast<void*>(buf)), len);
+}
+
+static void appendVarint(std::string& out, size_t value) {
+    while (value >= 0x80) {
+        out.push_back(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+/// Decode a varint from [pos, end), advancing pos past it.
+static size_t readVarint(const char*& pos, const char* end) {
+    size_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos == end) {
+            throw MutationLog::ReadException(
+                    "CompactAccessLog: truncated section");
+        }
+        const uint8_t byte = *pos++;
+        value |= size_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw MutationLog::ReadException("CompactAccessLog: invalid varint");
+}
+
+bool isCompact(const std::string& path) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr) {
+        return false;
+    }
+    uint32_t version = 0;
+    const bool ok = fread(&version, sizeof(version), 1, fp) == 1;
+    fclose(fp);
+    return ok && ntohl(version) == Version;
+}
+
+Writer::Writer(const std::string& path)
+    : path(path), fp(fopen(path.c_str(), "wb")), offset(0), keyCount(0) {
+    if (fp == nullptr) {
+        throw MutationLog::WriteException("Unable to open log file " + path +
+                                          ": " + strerror(errno));
+    }
+
+    std::array<uint8_t, MIN_LOG_HEADER_SIZE> buf;
+    buf.fill(0);
+    LogHeaderBlock header(static_cast<MutationLogVersion>(Version));
+    header.set(MIN_LOG_HEADER_SIZE);
+    std::memcpy(buf.data(), &header, sizeof(header));
+    try {
+        write(buf.data(), buf.size());
+    } catch (...) {
+        fclose(fp);
+        throw;
+    }
+}
+
+Writer::~Writer() {
+    if (fp != nullptr) {
+        fclose(fp);
+    }
+}
+
+void Writer::addSection(uint16_t vbid, std::vector<StoredDocKey>& keys) {
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    if (keys.empty()) {
+        return;
+    }
+
+    // Each key (including its namespace byte) as the length of the prefix
+    // it shares with the previous one, the length of the rest, and the rest.
+    encoded.clear();
+    const uint8_t* prev = nullptr;
+    size_t prevLen = 0;
+    for (const auto& key : keys) {
+        const uint8_t* data = key.getDocNameSpacedData();
+        const size_t len = key.getDocNameSpacedSize();
+        size_t shared = 0;
+        const size_t max = std::min(len, prevLen);
+        while (shared < max && data[shared] == prev[shared]) {
+            ++shared;
+        }
+        appendVarint(encoded, shared);
+        appendVarint(encoded, len - shared);
+        encoded.append(reinterpret_cast<const char*>(data) + shared,
+                       len - shared);
+        prev = data;
+        prevLen = len;
+    }
+
+    cb::compression::Buffer deflated;
+    if (!cb::compression::deflate(cb::compression::Algorithm::Snappy,
+                                  encoded.data(),
+                                  encoded.size(),
+                                  deflated)) {
+        throw MutationLog::WriteException(
+                "CompactAccessLog: failed to compress section of vb " +
+                std::to_string(vbid));
+    }
+
+    IndexEntry entry;
+    entry.offset = offset;
+    entry.length = uint32_t(deflated.len);
+    entry.keyCount = uint32_t(keys.size());
+    entry.crc = crc(deflated.data.get(), deflated.len);
+    entry.vbid = vbid;
+    entry.reserved = 0;
+    write(deflated.data.get(), deflated.len);
+    index.push_back(entry);
+    keyCount += keys.size();
+}
+
+void Writer::close() {
+    if (fp == nullptr) {
+        throw std::logic_error("CompactAccessLog::Writer::close: " + path +
+                               " is already closed");
+    }
+
+    std::vector<IndexEntry> encodedIndex;
+    encodedIndex.reserve(index.size());
+    for (const auto& entry : index) {
+        IndexEntry e;
+        e.offset = htonll(entry.offset);
+        e.length = htonl(entry.length);
+        e.keyCount = htonl(entry.keyCount);
+        e.crc = htonl(entry.crc);
+        e.vbid = htons(entry.vbid);
+        e.reserved = 0;
+        encodedIndex.push_back(e);
+    }
+    const size_t indexSize = encodedIndex.size() * sizeof(IndexEntry);
+
+    Footer footer;
+    footer.indexOffset = htonll(offset);
+    footer.indexEntries = htonl(uint32_t(encodedIndex.size()));
+    footer.indexCrc = htonl(crc(encodedIndex.data(), indexSize));
+
+    write(encodedIndex.data(), indexSize);
+    write(&footer, sizeof(footer));
+
+    bool ok = fflush(fp) == 0;
+#ifdef WIN32
+    ok = ok && _commit(_fileno(fp)) == 0;
+#else
+    ok = ok && fsync(fileno(fp)) == 0;
+#endif
+    const int error = errno;
+    ok = (fclose(fp) == 0) && ok;
+    fp = nullptr;
+    if (!ok) {
+        throw MutationLog::WriteException("Unable to sync log file " + path +
+                                          ": " + strerror(error));
+    }
+}
+
+void Writer::write(const void* buf, size_t len) {
+    if (len > 0 && fwrite(buf, len, 1, fp) != 1) {
+        throw MutationLog::WriteException("Unable to write log file " + path +
+                                          ": " + strerror(errno));
+    }
+    offset += len;
+}
+
+Reader::Reader(const std::string& path)
+    : file(path.c_str(), cb::MemoryMappedFile::Mode::RDONLY) {
+    try {
+        file.open();
+    } catch (const std::exception& e) {
+        throw MutationLog::ReadException("Unable to map log file " + path +
+                                         ": " + e.what());
+    }
+
+    const size_t size = file.getSize();
+    if (size < MIN_LOG_HEADER_SIZE + sizeof(Footer)) {
+        throw MutationLog::ShortReadException();
+    }
+    const auto* root = static_cast<const uint8_t*>(file.getRoot());
+
+    uint32_t version;
+    std::memcpy(&version, root, sizeof(version));
+    if (ntohl(version) != Version) {
+        throw MutationLog::ReadException(
+                "CompactAccessLog: version is unknown " +
+                std::to_string(ntohl(version)));
+    }
+
+    Footer footer;
+    std::memcpy(&footer, root + size - sizeof(footer), sizeof(footer));
+    const uint64_t indexOffset = ntohll(footer.indexOffset);
+    const size_t indexEntries = ntohl(footer.indexEntries);
+    const size_t indexSize = indexEntries * sizeof(IndexEntry);
+    if (indexOffset < MIN_LOG_HEADER_SIZE ||
+        indexOffset + indexSize + sizeof(footer) != size) {
+        // Most likely the file was not completely written.
+        throw MutationLog::ShortReadException();
+    }
+    if (crc(root + indexOffset, indexSize) != ntohl(footer.indexCrc)) {
+        throw MutationLog::CRCReadException();
+    }
+
+    for (size_t ii = 0; ii < indexEntries; ++ii) {
+        IndexEntry entry;
+        std::memcpy(&entry,
+                    root + indexOffset + ii * sizeof(IndexEntry),
+                    sizeof(entry));
+        entry.offset = ntohll(entry.offset);
+        entry.length = ntohl(entry.length);
+        entry.keyCount = ntohl(entry.keyCount);
+        entry.crc = ntohl(entry.crc);
+        entry.vbid = ntohs(entry.vbid);
+        if (entry.offset < MIN_LOG_HEADER_SIZE ||
+            entry.offset + entry.length > indexOffset) {
+            throw MutationLog::ReadException(
+                    "CompactAccessLog: section of vb " +
+                    std::to_string(entry.vbid) + " is out of bounds");
+        }
+        sections[entry.vbid].push_back(entry);
+    }
+}
+
+std::vector<uint16_t> Reader::getVBuckets() const {
+    std::vector<uint16_t> vbids;
+    for (const auto& vb : sections) {
+        vbids.push_back(vb.first);
+    }
+    std::sort(vbids.begin(), vbids.end());
+    return vbids;
+}
+
+size_t Reader::getKeyCount(uint16_t vbid) const {
+    size_t count = 0;
+    const auto it = sections.find(vbid);
+    if (it != sections.end()) {
+        for (const auto& entry : it->second) {
+            count += entry.keyCount;
+        }
+    }
+    return count;
+}
+
+size_t Reader::getSize(uint16_t vbid) const {
+    size_t size = 0;
+    const auto it = sections.find(vbid);
+    if (it != sections.end()) {
+        for (const auto& entry : it->second) {
+            size += entry.length;
+        }
+    }
+    return size;
+}
+
+std::vector<StoredDocKey> Reader::loadKeys(uint16_t vbid) const {
+    std::vector<StoredDocKey> keys;
+    const auto it = sections.find(vbid);
+    if (it == sections.end()) {
+        return keys;
+    }
+    keys.reserve(getKeyCount(vbid));
+    for (const auto& entry : it->second) {
+        const auto middle = keys.size();
+        loadSection(entry, keys);
+        // Each section is sorted; merge it with those before it.
+        std::inplace_merge(keys.begin(), keys.begin() + middle, keys.end());
+    }
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+void Reader::loadSection(const IndexEntry& entry,
+                         std::vector<StoredDocKey>& keys) const {
+    const char* section =
+            static_cast<const char*>(file.getRoot()) + entry.offset;
+    if (crc(section, entry.length) != entry.crc) {
+        throw MutationLog::CRCReadException();
+    }
+
+    cb::compression::Buffer inflated;
+    if (!cb::compression::inflate(cb::compression::Algorithm::Snappy,
+                                  section,
+                                  entry.length,
+                                  inflated)) {
+        throw MutationLog::ReadException(
+                "CompactAccessLog: failed to decompress section of vb " +
+                std::to_string(entry.vbid));
+    }
+
+    const char* pos = inflated.data.get();
+    const char* const end = pos + inflated.len;
+    std::string key;
+    for (size_t ii = 0; ii < entry.keyCount; ++ii) {
+        const size_t shared = readVarint(pos, end);
+        const size_t rest = readVarint(pos, end);
+        if (shared > key.size() || rest > size_t(end - pos) ||
+            shared + rest == 0) {
+            throw MutationLog::ReadException(
+                    "CompactAccessLog: corrupt section of vb " +
+                    std::to_string(entry.vbid));
+        }
+        key.resize(shared);
+        key.append(pos, rest);
+        pos += rest;
+        keys.emplace_back(reinterpret_cast<const uint8_t*>(key.data()),
+                          key.size());
+    }
+    if (pos != end) {
+        throw MutationLog::ReadException(
+                "CompactAccessLog: corrupt section of vb " +
+                std::to_string(entry.vbid));
+    }
+}
+
+} // namespace CompactAccessLog
@@ -0,0 +1,185 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "storeddockey.h"
+
+#include <platform/memorymap.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The compact access log format (version 3 of the access log, following on
+ * from the MutationLogVersion block formats).
+ *
+ * Rather than a stream of one entry per key, each file holds a number of
+ * sections, each of which lists keys of a single vBucket: the keys sorted
+ * by-id and prefix encoded (each key stored as the length of the prefix it
+ * shares with the previous key and the rest of its bytes), and the whole
+ * section Snappy compressed. An index at the end of the file says where
+ * each vBucket's sections are, so a reader can load just the vBuckets it
+ * wants, in whichever order it wants.
+ *
+ * Layout (integers in network byte order):
+ *
+ *     LogHeaderBlock (version 3), padded to MIN_LOG_HEADER_SIZE
+ *     section...
+ *     IndexEntry...
+ *     Footer
+ *
+ * The header keeps the layout of the MutationLog header so that readers of
+ * older versions reject the file as being of an unknown version, rather
+ * than misreading it.
+ */
+namespace CompactAccessLog {
+
+const uint32_t Version = 3;
+
+struct IndexEntry {
+    uint64_t offset;
+    uint32_t length;
+    uint32_t keyCount;
+    // CRC of the (compressed) section.
+    uint32_t crc;
+    uint16_t vbid;
+    uint16_t reserved;
+};
+
+struct Footer {
+    uint64_t indexOffset;
+    uint32_t indexEntries;
+    // CRC of the index.
+    uint32_t indexCrc;
+};
+
+/**
+ * @return true if the file at the given path is a compact access log (false
+ *         if not, or it can't be read)
+ */
+bool isCompact(const std::string& path);
+
+/**
+ * Writes a compact access log, one section at a time; so at most one
+ * section's worth of keys needs to be held in memory.
+ */
+class Writer {
+public:
+    /**
+     * Create (or truncate) the given file and write the header.
+     *
+     * @throws MutationLog::WriteException if the file can't be written
+     */
+    explicit Writer(const std::string& path);
+
+    /// Closes (without syncing) the file if close() wasn't called.
+    ~Writer();
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    /**
+     * Write the given keys of the given vBucket as a section. The keys are
+     * sorted in place; duplicates are dropped.
+     *
+     * @throws MutationLog::WriteException if the section can't be written
+     */
+    void addSection(uint16_t vbid, std::vector<StoredDocKey>& keys);
+
+    /**
+     * Write the index and footer, sync the file and close it.
+     *
+     * @throws MutationLog::WriteException if the file can't be written
+     */
+    void close();
+
+    /// @return the number of keys written so far
+    size_t getKeyCount() const {
+        return keyCount;
+    }
+
+    /// @return the number of bytes written so far
+    uint64_t getSize() const {
+        return offset;
+    }
+
+private:
+    void write(const void* buf, size_t len);
+
+    const std::string path;
+    FILE* fp;
+    uint64_t offset;
+    size_t keyCount;
+    std::vector<IndexEntry> index;
+    // Reused between sections.
+    std::string encoded;
+};
+
+/**
+ * Reads a compact access log through a memory mapping. The header, index
+ * and footer are checked when the file is opened; each section is checked
+ * as it is loaded.
+ */
+class Reader {
+public:
+    /**
+     * @throws MutationLog::ReadException if the file can't be mapped or is
+     *         not a compact access log, MutationLog::ShortReadException if
+     *         it is truncated, or MutationLog::CRCReadException if the index
+     *         is corrupt
+     */
+    explicit Reader(const std::string& path);
+
+    /// @return the vBuckets which have keys in the log
+    std::vector<uint16_t> getVBuckets() const;
+
+    /// @return the number of keys listed for the given vBucket
+    size_t getKeyCount(uint16_t vbid) const;
+
+    /// @return the size of the given vBucket's (compressed) sections
+    size_t getSize(uint16_t vbid) const;
+
+    /// @return the size of the file
+    size_t getSize() const {
+        return file.getSize();
+    }
+
+    /**
+     * Load the keys of the given vBucket, in by-id order with duplicates
+     * removed.
+     *
+     * @throws MutationLog::CRCReadException or MutationLog::ReadException if
+     *         a section of the vBucket is corrupt
+     */
+    std::vector<StoredDocKey> loadKeys(uint16_t vbid) const;
+
+private:
+    void loadSection(const IndexEntry& entry,
+                     std::vector<StoredDocKey>& keys) const;
+
+    cb::MemoryMappedFile file;
+    // Each vBucket's sections, in file order (with host byte order fields).
+    std::unordered_map<uint16_t, std::vector<IndexEntry>> sections;
+};
+
+} // namespace CompactAccessLog
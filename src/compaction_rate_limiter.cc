@@ -0,0 +1,98 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "compaction_rate_limiter.h"
+
+#include <algorithm>
+#include <thread>
+
+const size_t CompactionRateLimiter::IncreaseSteps;
+const size_t CompactionRateLimiter::MinRateDivisor;
+
+CompactionRateLimiter::CompactionRateLimiter()
+    : maxRate(0),
+      currentRate(0),
+      latencyTarget(0),
+      tokens(0),
+      lastRefill(ProcessClock::now()) {
+}
+
+void CompactionRateLimiter::configure(
+        size_t maxBytesPerSec, std::chrono::microseconds commitLatencyTarget) {
+    std::lock_guard<std::mutex> lh(mutex);
+    maxRate = maxBytesPerSec;
+    currentRate = maxBytesPerSec;
+    latencyTarget = commitLatencyTarget;
+    // Start with a full bucket (one second's worth).
+    tokens = double(currentRate);
+    lastRefill = ProcessClock::now();
+}
+
+std::chrono::microseconds CompactionRateLimiter::acquire(size_t bytes) {
+    std::chrono::microseconds wait(0);
+    {
+        std::lock_guard<std::mutex> lh(mutex);
+        if (currentRate == 0) {
+            return wait;
+        }
+        refill_UNLOCKED(ProcessClock::now());
+        tokens -= double(bytes);
+        if (tokens < 0) {
+            // Wait until the refill covers everything taken so far,
+            // including by earlier acquirers which are still waiting.
+            wait = std::chrono::microseconds(
+                    int64_t(-tokens * 1000000.0 / double(currentRate)));
+        }
+    }
+    if (wait.count() > 0) {
+        std::this_thread::sleep_for(wait);
+    }
+    return wait;
+}
+
+void CompactionRateLimiter::recordCommitLatency(
+        std::chrono::microseconds latency) {
+    std::lock_guard<std::mutex> lh(mutex);
+    if (maxRate == 0) {
+        return;
+    }
+    refill_UNLOCKED(ProcessClock::now());
+    const size_t minRate = std::max(maxRate / MinRateDivisor, size_t(1));
+    if (latency > latencyTarget) {
+        // Back off quickly...
+        currentRate = std::max(currentRate - currentRate / 4, minRate);
+    } else {
+        // ... and recover gradually.
+        currentRate = std::min(
+                currentRate + std::max(maxRate / IncreaseSteps, size_t(1)),
+                maxRate);
+    }
+    tokens = std::min(tokens, double(currentRate));
+}
+
+size_t CompactionRateLimiter::getRate() const {
+    std::lock_guard<std::mutex> lh(mutex);
+    return currentRate;
+}
+
+void CompactionRateLimiter::refill_UNLOCKED(ProcessClock::time_point now) {
+    const std::chrono::duration<double> elapsed = now - lastRefill;
+    lastRefill = now;
+    // Allow at most one second's worth of burst.
+    tokens = std::min(tokens + elapsed.count() * double(currentRate),
+                      double(currentRate));
+}
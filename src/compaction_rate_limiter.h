@@ -0,0 +1,82 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <platform/processclock.h>
+
+#include <chrono>
+#include <mutex>
+
+/**
+ * Token bucket limiting the disk bandwidth (bytes read plus bytes written)
+ * of all of a bucket's compactions, which share one limiter however many
+ * are running at once.
+ *
+ * The allowed rate adapts to how the flushers are faring: each flusher
+ * commit reports its latency, and while commits take longer than the
+ * target the rate is cut (down to 1/16th of the maximum); once they are
+ * back under the target it is raised again step by step to the maximum.
+ *
+ * A maximum rate of zero means unlimited: acquire() never waits.
+ */
+class CompactionRateLimiter {
+public:
+    CompactionRateLimiter();
+
+    /**
+     * Set the maximum rate and the flusher commit latency to aim for. The
+     * current rate is reset to the maximum.
+     *
+     * @param maxBytesPerSec maximum bytes per second; 0 for unlimited
+     */
+    void configure(size_t maxBytesPerSec,
+                   std::chrono::microseconds commitLatencyTarget);
+
+    /**
+     * Take tokens for the given number of bytes of I/O, waiting until they
+     * are available.
+     *
+     * @return how long the caller was made to wait
+     */
+    std::chrono::microseconds acquire(size_t bytes);
+
+    /// Adapt the rate to the latency of a flusher commit.
+    void recordCommitLatency(std::chrono::microseconds latency);
+
+    /// @return the current rate in bytes per second (0 if unlimited)
+    size_t getRate() const;
+
+    /// Each on-target commit raises the rate by the maximum divided by this.
+    static const size_t IncreaseSteps = 32;
+
+    /// The minimum rate is the maximum divided by this.
+    static const size_t MinRateDivisor = 16;
+
+private:
+    void refill_UNLOCKED(ProcessClock::time_point now);
+
+    mutable std::mutex mutex;
+    size_t maxRate;
+    size_t currentRate;
+    std::chrono::microseconds latencyTarget;
+    // Available bytes; negative when acquirers are waiting for their share.
+    double tokens;
+    ProcessClock::time_point lastRefill;
+};
@@ -0,0 +1,92 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef SRC_COUCH_KVSTORE_COUCH_FS_THROTTLE_H_
+#define SRC_COUCH_KVSTORE_COUCH_FS_THROTTLE_H_ 1
+
+#include "config.h"
+
+#include <chrono>
+
+#include <libcouchstore/couch_db.h>
+
+class CompactionRateLimiter;
+
+/**
+ * FileOpsInterface implementation which takes tokens from a
+ * CompactionRateLimiter for every read and write before passing it on to
+ * the wrapped FileOps, and counts the bytes read / written and the time
+ * spent waiting for tokens. Used for one compaction at a time.
+ */
+class ThrottledOps : public FileOpsInterface {
+public:
+    /**
+     * @param ops the FileOps to wrap
+     * @param limiter the limiter to take tokens from; null to only count
+     */
+    ThrottledOps(FileOpsInterface& ops, CompactionRateLimiter* limiter)
+        : wrapped_ops(ops),
+          limiter(limiter),
+          bytesRead(0),
+          bytesWritten(0),
+          throttleTime(0) {}
+
+    couch_file_handle constructor(couchstore_error_info_t* errinfo) override;
+    couchstore_error_t open(couchstore_error_info_t* errinfo,
+                            couch_file_handle* handle, const char* path,
+                            int oflag) override;
+    couchstore_error_t close(couchstore_error_info_t* errinfo,
+                             couch_file_handle handle) override;
+    ssize_t pread(couchstore_error_info_t* errinfo,
+                  couch_file_handle handle, void* buf, size_t nbytes,
+                  cs_off_t offset) override;
+    ssize_t pwrite(couchstore_error_info_t* errinfo,
+                   couch_file_handle handle, const void* buf,
+                   size_t nbytes, cs_off_t offset) override;
+    cs_off_t goto_eof(couchstore_error_info_t* errinfo,
+                      couch_file_handle handle) override;
+    couchstore_error_t sync(couchstore_error_info_t* errinfo,
+                            couch_file_handle handle) override;
+    couchstore_error_t advise(couchstore_error_info_t* errinfo,
+                              couch_file_handle handle, cs_off_t offset,
+                              cs_off_t len,
+                              couchstore_file_advice_t advice) override;
+    void destructor(couch_file_handle handle) override;
+
+    size_t getBytesRead() const {
+        return bytesRead;
+    }
+
+    size_t getBytesWritten() const {
+        return bytesWritten;
+    }
+
+    std::chrono::microseconds getThrottleTime() const {
+        return throttleTime;
+    }
+
+private:
+    void throttle(size_t nbytes);
+
+    FileOpsInterface& wrapped_ops;
+    CompactionRateLimiter* limiter;
+    size_t bytesRead;
+    size_t bytesWritten;
+    std::chrono::microseconds throttleTime;
+};
+
+#endif  // SRC_COUCH_KVSTORE_COUCH_FS_THROTTLE_H_
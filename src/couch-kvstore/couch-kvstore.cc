@@ -42,9 +42,12 @@
 #include <vector>
 #include <cJSON.h>
 #include <platform/dirutils.h>
+#include <platform/make_unique.h>
 
 #include "common.h"
+#include "couch-kvstore/couch-fs-throttle.h"
 #include "couch-kvstore/couch-kvstore.h"
+#include "disk_document.h"
 #include "ep_types.h"
 #define STATWRITER_NAMESPACE couchstore_engine
 #include "statwriter.h"
@@ -197,21 +200,13 @@ couchstore_content_meta_flags CouchRequest::getContentMeta(const Item& it) {
         rval = COUCH_DOC_NON_JSON_MODE;
     }
 
-    if (mcbp::datatype::is_snappy(it.getDataType())) {
-        // We are currently using couchstore in a mode where it will try to
-        // compress documents iff COUCH_DOC_IS_COMPRESSED is specified.
-        // This would cause a conflict if we tried to store a document which
-        // is already compressed.
-        //
-        // Luckily for us we don't support keeping objects compressed in
-        // memory yet, so this won't happen. Let's throw an exception
-        // to make sure that we fix this when we're going to support
-        // compressed objects.
-        throw std::logic_error(
-            "CouchRequest::getContentMeta: can't store compressed items");
-    }
-
-    if (it.getNBytes() > 0) {
+    // We are using couchstore in a mode where it will compress documents
+    // iff COUCH_DOC_IS_COMPRESSED is specified. Values held compressed in
+    // memory (see compression_mode) are written as-is instead; the SNAPPY
+    // bit of the datatype persisted in the metadata records that the body
+    // is compressed, so they come back from disk compressed (with the same
+    // datatype) and are never inflated and deflated again on the way out.
+    if (it.getNBytes() > 0 && !mcbp::datatype::is_snappy(it.getDataType())) {
         // Don't try to compress empty bodies ;-)
         rval |= COUCH_DOC_IS_COMPRESSED;
     }
@@ -279,11 +274,13 @@ CouchKVStore::CouchKVStore(KVStoreConfig& config,
                            FileOpsInterface& ops,
                            bool readOnly,
                            std::vector<std::atomic<uint64_t>>& dbFileRevMap,
-                           size_t fileRevMapSize)
+                           size_t fileRevMapSize,
+                           ReadHandleCache* readHandleCache)
     : KVStore(config, readOnly),
       dbname(config.getDBName()),
       dbFileRevMap(dbFileRevMap),
       fileRevMap(fileRevMapSize),
+      readHandles(readHandleCache),
       intransaction(false),
       scanCounter(0),
       logger(config.getLogger()),
@@ -305,6 +302,11 @@ CouchKVStore::CouchKVStore(KVStoreConfig& config,
     cachedSpaceUsed.assign(numDbFiles, Couchbase::RelaxedAtomic<uint64_t>(0));
     cachedVBStates.assign(numDbFiles, nullptr);
 
+    if (!readHandles) {
+        ownedReadHandles = std::make_unique<ReadHandleCache>(numDbFiles);
+        readHandles = ownedReadHandles.get();
+    }
+
     initialize();
 }
 
@@ -313,7 +315,8 @@ CouchKVStore::CouchKVStore(KVStoreConfig& config, FileOpsInterface& ops)
                    ops,
                    false /*readonly*/,
                    fileRevMap,
-                   config.getMaxVBuckets()) {
+                   config.getMaxVBuckets(),
+                   nullptr) {
 }
 
 CouchKVStore::CouchKVStore(const CouchKVStore& copyFrom)
@@ -321,6 +324,7 @@ CouchKVStore::CouchKVStore(const CouchKVStore& copyFrom)
       dbname(copyFrom.dbname),
       dbFileRevMap(copyFrom.dbFileRevMap),
       fileRevMap(copyFrom.fileRevMap.size()),
+      readHandles(copyFrom.readHandles),
       numDbFiles(copyFrom.numDbFiles),
       intransaction(false),
       logger(copyFrom.logger),
@@ -341,16 +345,18 @@ CouchKVStore::CouchKVStore(const CouchKVStore& copyFrom)
 std::unique_ptr<CouchKVStore> CouchKVStore::makeReadOnlyStore() {
     // Not using make_unique due to the private constructor we're calling
     return std::unique_ptr<CouchKVStore>(
-            new CouchKVStore(configuration, fileRevMap));
+            new CouchKVStore(configuration, fileRevMap, *readHandles));
 }
 
 CouchKVStore::CouchKVStore(KVStoreConfig& config,
-                           std::vector<std::atomic<uint64_t>>& dbFileRevMap)
+                           std::vector<std::atomic<uint64_t>>& dbFileRevMap,
+                           ReadHandleCache& readHandleCache)
     : CouchKVStore(config,
                    *couchstore_get_default_file_ops(),
                    true /*readonly*/,
                    dbFileRevMap,
-                   0) {
+                   0,
+                   &readHandleCache) {
 }
 
 void CouchKVStore::initialize() {
@@ -418,7 +424,9 @@ void CouchKVStore::reset(uint16_t vbucketId) {
         // Unlink the current revision and then increment it to ensure any
         // pending delete doesn't delete us. Note that the expectation is that
         // some higher level per VB lock is required to prevent data-races here.
-        // KVBucket::vb_mutexes is used in this case.
+        // KVBucket::vb_mutexes is used in this case. A cached read handle
+        // would keep the unlinked file open, so close it first.
+        invalidateReadHandle(vbucketId, true);
         unlinkCouchFile(vbucketId, dbFileRevMap[vbucketId]);
         incrementRevision(vbucketId);
 
@@ -457,12 +465,10 @@ void CouchKVStore::set(const Item &itm, Callback<mutation_result> &cb) {
 
 void CouchKVStore::get(const DocKey& key, uint16_t vb,
                        Callback<GetValue> &cb, bool fetchDelete) {
-    Db *db = NULL;
+    ReadHandle handle;
     GetValue rv;
-    uint64_t fileRev = dbFileRevMap[vb];
 
-    couchstore_error_t errCode = openDB(vb, fileRev, &db,
-                                        COUCHSTORE_OPEN_FLAG_RDONLY);
+    couchstore_error_t errCode = acquireReadHandle(vb, handle);
     if (errCode != COUCHSTORE_SUCCESS) {
         ++st.numGetFailure;
         logger.log(EXTENSION_LOG_WARNING,
@@ -473,8 +479,8 @@ void CouchKVStore::get(const DocKey& key, uint16_t vb,
         return;
     }
 
-    getWithHeader(db, key, vb, cb, fetchDelete);
-    closeDatabaseHandle(db);
+    getWithHeader(handle.db, key, vb, cb, fetchDelete);
+    releaseReadHandle(vb, handle);
 }
 
 void CouchKVStore::getWithHeader(void *dbHandle, const DocKey& key,
@@ -537,11 +543,10 @@ void CouchKVStore::getWithHeader(void *dbHandle, const DocKey& key,
 
 void CouchKVStore::getMulti(uint16_t vb, vb_bgfetch_queue_t &itms) {
     int numItems = itms.size();
-    uint64_t fileRev = dbFileRevMap[vb];
 
-    Db *db = NULL;
-    couchstore_error_t errCode = openDB(vb, fileRev, &db,
-                                        COUCHSTORE_OPEN_FLAG_RDONLY);
+    ReadHandle handle;
+    couchstore_error_t errCode = acquireReadHandle(vb, handle);
+    Db* db = handle.db;
     if (errCode != COUCHSTORE_SUCCESS) {
         logger.log(EXTENSION_LOG_WARNING,
                    "CouchKVStore::getMulti: openDB error:%s, "
@@ -587,8 +592,11 @@ void CouchKVStore::getMulti(uint16_t vb, vb_bgfetch_queue_t &itms) {
                 fetch->value.setStatus(couchErr2EngineErr(errCode));
             }
         }
+        // Don't keep a handle which hit an error.
+        closeDatabaseHandle(db);
+    } else {
+        releaseReadHandle(vb, handle);
     }
-    closeDatabaseHandle(db);
     delete []ids;
 }
 
@@ -780,7 +788,9 @@ static int notify_expired_item(DocInfo& info,
                                sized_buf item,
                                compaction_ctx& ctx,
                                time_t currtime) {
-    std::array<uint8_t, 1> ext_meta = {{metadata.getDataType()}};
+    // Any body passed to the callback has been inflated below.
+    std::array<uint8_t, 1> ext_meta = {{uint8_t(
+            metadata.getDataType() & ~PROTOCOL_BINARY_DATATYPE_SNAPPY)}};
     cb::char_buffer data;
     cb::compression::Buffer inflated;
 
@@ -911,7 +921,9 @@ bool CouchKVStore::compactDB(compaction_ctx *hook_ctx) {
 
     couchstore_compact_hook       hook = time_purge_hook;
     couchstore_docinfo_hook      dhook = edit_docinfo_hook;
-    FileOpsInterface         *def_iops = statCollectingFileOpsCompaction.get();
+    ThrottledOps         throttledOps(*statCollectingFileOpsCompaction,
+                                      hook_ctx->rateLimiter);
+    FileOpsInterface         *def_iops = &throttledOps;
     Db                      *compactdb = NULL;
     Db                       *targetDb = NULL;
     couchstore_error_t         errCode = COUCHSTORE_SUCCESS;
@@ -1026,7 +1038,15 @@ bool CouchKVStore::compactDB(compaction_ctx *hook_ctx) {
     // Removing the stale couch file
     unlinkCouchFile(vbid, fileRev);
 
-    st.compactHisto.add((gethrtime() - start) / 1000);
+    const hrtime_t duration = (gethrtime() - start) / 1000;
+    st.compactHisto.add(duration);
+    if (duration > 0) {
+        st.compactReadRateHisto.add(throttledOps.getBytesRead() * 1000000 /
+                                    duration);
+        st.compactWriteRateHisto.add(throttledOps.getBytesWritten() * 1000000 /
+                                     duration);
+    }
+    st.compactThrottleHisto.add(throttledOps.getThrottleTime().count());
 
     return true;
 }
@@ -1087,6 +1107,7 @@ bool CouchKVStore::setVBucketState(uint16_t vbucketId,
                 closeDatabaseHandle(db);
                 return false;
             }
+            invalidateReadHandle(vbucketId);
         }
 
         DbInfo info;
@@ -1401,6 +1422,9 @@ DbInfo CouchKVStore::getDbInfo(uint16_t vbid) {
 
 void CouchKVStore::close() {
     intransaction = false;
+    if (isReadOnly()) {
+        closeReadHandles();
+    }
 }
 
 uint64_t CouchKVStore::checkNewRevNum(std::string &dbFileName, bool newFile) {
@@ -1446,6 +1470,96 @@ void CouchKVStore::updateDbFileMap(uint16_t vbucketId, uint64_t newFileRev) {
     }
 
     dbFileRevMap[vbucketId] = newFileRev;
+    // The old file is unlinked next; don't hold it open.
+    invalidateReadHandle(vbucketId, true);
+}
+
+couchstore_error_t CouchKVStore::acquireReadHandle(uint16_t vbid,
+                                                   ReadHandle& handle) {
+    if (!isReadOnly()) {
+        handle.fileRev = dbFileRevMap[vbid];
+        return openDB(vbid, handle.fileRev, &handle.db,
+                      COUCHSTORE_OPEN_FLAG_RDONLY);
+    }
+
+    Db* stale = nullptr;
+    {
+        std::lock_guard<std::mutex> lh(readHandles->mutex);
+        // Note the revision and generation before opening, so a handle
+        // opened concurrently with a commit is never cached.
+        handle.fileRev = dbFileRevMap[vbid];
+        handle.generation = readHandles->generations[vbid];
+        auto& cached = readHandles->handles[vbid];
+        if (cached.db) {
+            if (cached.fileRev == handle.fileRev &&
+                cached.generation == handle.generation) {
+                handle.db = cached.db;
+                cached.db = nullptr;
+                ++st.numReadHandleHits;
+                return COUCHSTORE_SUCCESS;
+            }
+            stale = cached.db;
+            cached.db = nullptr;
+            ++st.numReadHandleReopens;
+        }
+    }
+
+    if (stale) {
+        closeDatabaseHandle(stale);
+    }
+    ++st.numReadHandleMisses;
+    return openDB(vbid, handle.fileRev, &handle.db,
+                  COUCHSTORE_OPEN_FLAG_RDONLY);
+}
+
+void CouchKVStore::releaseReadHandle(uint16_t vbid, ReadHandle& handle) {
+    Db* db = handle.db;
+    handle.db = nullptr;
+    if (isReadOnly()) {
+        std::lock_guard<std::mutex> lh(readHandles->mutex);
+        auto& cached = readHandles->handles[vbid];
+        if (!cached.db && handle.fileRev == dbFileRevMap[vbid] &&
+            handle.generation == readHandles->generations[vbid]) {
+            cached = handle;
+            cached.db = db;
+            return;
+        }
+    }
+    closeDatabaseHandle(db);
+}
+
+void CouchKVStore::invalidateReadHandle(uint16_t vbid, bool closeNow) {
+    if (vbid >= readHandles->handles.size()) {
+        return;
+    }
+    Db* db = nullptr;
+    {
+        std::lock_guard<std::mutex> lh(readHandles->mutex);
+        ++readHandles->generations[vbid];
+        if (closeNow) {
+            db = readHandles->handles[vbid].db;
+            readHandles->handles[vbid].db = nullptr;
+        }
+    }
+    if (db) {
+        closeDatabaseHandle(db);
+    }
+}
+
+void CouchKVStore::closeReadHandles() {
+    std::vector<Db*> dbs;
+    {
+        std::lock_guard<std::mutex> lh(readHandles->mutex);
+        for (auto& cached : readHandles->handles) {
+            if (cached.db) {
+                dbs.push_back(cached.db);
+                cached.db = nullptr;
+            }
+        }
+    }
+    for (auto* db : dbs) {
+        closeDatabaseHandle(db);
+    }
 }
 
 couchstore_error_t CouchKVStore::openDB(uint16_t vbucketId,
@@ -1713,8 +1827,9 @@ int CouchKVStore::recordDbDump(Db *db, DocInfo *docinfo, void *ctx) {
                     // We always store the document bodies compressed on disk,
                     // but now the client _wanted_ to fetch the document
                     // in a compressed mode.
-                    // We've never stored the "compressed" flag on disk
-                    // (as we don't keep items compressed in memory).
+                    // Documents compressed by couchstore don't have the
+                    // "compressed" flag in their stored datatype (documents
+                    // which were already compressed in memory do).
                     // Update the datatype flag for this item to
                     // reflect that it is compressed so that the
                     // receiver of the object may notice (Note:
@@ -1744,6 +1859,35 @@ int CouchKVStore::recordDbDump(Db *db, DocInfo *docinfo, void *ctx) {
 
     uint8_t extMeta = metadata->getDataType();
     uint8_t extMetaLen = metadata->getFlexCode() == FLEX_META_CODE ? EXT_META_LEN : 0;
+
+    if (sctx->documentCallback && sctx->valFilter != ValueFilter::KEYS_ONLY) {
+        // Pass the document on without an Item; the value's Blob is the only
+        // copy made of it.
+        value_t blob(value.buf
+                             ? Blob::New(value.buf, value.size, &extMeta,
+                                         extMetaLen)
+                             : Blob::New(value.size, &extMeta, extMetaLen));
+        DiskDocument document(docKey,
+                              blob,
+                              ItemMetaData(metadata->getCas(),
+                                           docinfo->rev_seq,
+                                           metadata->getFlags(),
+                                           metadata->getExptime()),
+                              docinfo->db_seq,
+                              vbucketId,
+                              docinfo->deleted);
+        sctx->documentCallback->callback(document);
+
+        couchstore_free_document(doc);
+
+        if (sctx->documentCallback->getStatus() == ENGINE_ENOMEM) {
+            return COUCHSTORE_ERROR_CANCEL;
+        }
+
+        sctx->lastReadSeqno = byseqno;
+        return COUCHSTORE_SUCCESS;
+    }
+
     // Collections: TODO: Permanently restore to stored namespace
     Item* it = new Item(
             DocKey(makeDocKey(
@@ -1965,6 +2109,7 @@ couchstore_error_t CouchKVStore::saveDocs(uint16_t vbid,
                     couchkvstore_strerrno(db.getDb(), errCode).c_str());
             return errCode;
         }
+        invalidateReadHandle(vbid);
 
         st.batchSize.add(docs.size());
 
@@ -2580,6 +2725,7 @@ RollbackResult CouchKVStore::rollback(uint16_t vbid, uint64_t rollbackSeqno,
     if (errCode != COUCHSTORE_SUCCESS) {
         return RollbackResult(false, 0, 0, 0);
     }
+    invalidateReadHandle(vbid);
 
     vbucket_state *vb_state = cachedVBStates[vbid];
     return RollbackResult(true, vb_state->highSeqno,
@@ -2731,6 +2877,7 @@ bool CouchKVStore::persistCollectionsManifestItem(uint16_t vbid,
     if (errCode != COUCHSTORE_SUCCESS) {
         return false;
     }
+    invalidateReadHandle(vbid);
 
     return true;
 }
@@ -2752,6 +2899,7 @@ std::string CouchKVStore::getCollectionsManifest(uint16_t vbid) {
 
 void CouchKVStore::incrementRevision(uint16_t vbid) {
     dbFileRevMap[vbid]++;
+    invalidateReadHandle(vbid, true);
 }
 
 uint64_t CouchKVStore::prepareToDelete(uint16_t vbid) {
@@ -2761,6 +2909,8 @@ uint64_t CouchKVStore::prepareToDelete(uint16_t vbid) {
     cachedDeleteCount[vbid] = 0;
     cachedFileSize[vbid] = 0;
     cachedSpaceUsed[vbid] = 0;
+    // Don't hold the file open once it is deleted.
+    invalidateReadHandle(vbid, true);
     return dbFileRevMap[vbid];
 }
 
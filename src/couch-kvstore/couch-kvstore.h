@@ -24,6 +24,7 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -540,6 +541,68 @@ protected:
     void setDocsCommitted(uint16_t docs);
     void closeDatabaseHandle(Db *db);
 
+    /**
+     * A read-only handle on a vbucket's file, and the file revision and
+     * commit generation it was opened at.
+     */
+    struct ReadHandle {
+        Db* db = nullptr;
+        uint64_t fileRev = 0;
+        uint64_t generation = 0;
+    };
+
+    /**
+     * Per-vbucket cache of read-only handles, so the RO store's get() and
+     * getMulti() don't open the file (and read its header) for every BG
+     * fetch. Owned by the RW store and shared with its RO sibling, like
+     * fileRevMap. The RW store bumps a vbucket's generation whenever it
+     * commits to or replaces the vbucket's file, so a cached handle is only
+     * re-used while it sees every commit.
+     *
+     * A couchstore handle reads the file header once, when opened, so it
+     * can't be kept across a commit. Handles are therefore only re-used
+     * between the flusher's commits to a vbucket: the cache saves most
+     * opens for vbuckets BG fetched from more often than they are written
+     * to, and little for ones written to continuously (read_handle_reopens
+     * then tracks read_handle_misses). When the file is replaced (compaction,
+     * reset, deletion) the cached handle is closed straight away, so the
+     * old file can be unlinked.
+     */
+    struct ReadHandleCache {
+        explicit ReadHandleCache(size_t numVbs)
+            : handles(numVbs), generations(numVbs, 0) {
+        }
+
+        std::mutex mutex;
+        std::vector<ReadHandle> handles;
+        std::vector<uint64_t> generations;
+    };
+
+    /**
+     * Open a read-only handle on the vbucket's current file. A RO store
+     * re-uses the cached handle if it is still current. The handle must be
+     * given back with releaseReadHandle.
+     */
+    couchstore_error_t acquireReadHandle(uint16_t vbid, ReadHandle& handle);
+
+    /**
+     * Give back a handle from acquireReadHandle; a RO store caches it for
+     * the next read if it is still current, else it is closed.
+     */
+    void releaseReadHandle(uint16_t vbid, ReadHandle& handle);
+
+    /**
+     * Mark any cached read handle for the vbucket as stale (so the next read
+     * re-opens the file), and stop handles opened before now being cached.
+     * Called after the vbucket's file is changed.
+     *
+     * @param closeNow close the stale handle now rather than on the next read
+     */
+    void invalidateReadHandle(uint16_t vbid, bool closeNow = false);
+
+    /// Close all cached read handles (RO store only).
+    void closeReadHandles();
+
     /**
      * Unlink selected couch file, which will be removed by the OS,
      * once all its references close.
@@ -573,6 +636,13 @@ protected:
      */
     std::vector<std::atomic<uint64_t>> fileRevMap;
 
+    /**
+     * The cache of read-only handles; owned by the RW store
+     * (ownedReadHandles) and shared with its RO sibling.
+     */
+    ReadHandleCache* readHandles;
+    std::unique_ptr<ReadHandleCache> ownedReadHandles;
+
     uint16_t numDbFiles;
     std::vector<CouchRequest *> pendingReqsQ;
     bool intransaction;
@@ -627,12 +697,15 @@ private:
      *        read-only constructor is called, it doesn't need to resize the map
      *        as it will use a reference to the RW store's map, so 0 would be
      *        passed.
+     * @param readHandleCache the RW store's read handle cache, or null to
+     *        create one (for a RW store).
      */
     CouchKVStore(KVStoreConfig& config,
                  FileOpsInterface& ops,
                  bool readOnly,
                  std::vector<std::atomic<uint64_t>>& dbFileRevMap,
-                 size_t fileRevMapSize);
+                 size_t fileRevMapSize,
+                 ReadHandleCache* readHandleCache);
 
     /**
      * Construct a read-only store - private as should be called via
@@ -641,9 +714,11 @@ private:
      * @param config configuration data for the store
      * @param dbFileRevMap a reference to the map (which should be data owned by
      *        the RW store).
+     * @param readHandleCache the RW store's read handle cache.
      */
     CouchKVStore(KVStoreConfig& config,
-                 std::vector<std::atomic<uint64_t>>& dbFileRevMap);
+                 std::vector<std::atomic<uint64_t>>& dbFileRevMap,
+                 ReadHandleCache& readHandleCache);
 
     class DbHolder {
     public:
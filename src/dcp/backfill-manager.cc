@@ -210,6 +210,19 @@ void BackfillManager::bytesForceRead(size_t bytes) {
     }
 }
 
+bool BackfillManager::bytesCheckAndReadShared(size_t bytes) {
+    LockHolder lh(lock);
+    if (buffer.bytesRead == 0 || buffer.bytesRead + bytes <= buffer.maxBytes) {
+        buffer.bytesRead += bytes;
+        return true;
+    }
+
+    /* Resumed by bytesSent() once the connection has drained enough */
+    buffer.full = true;
+    buffer.nextReadSize = bytes;
+    return false;
+}
+
 void BackfillManager::bytesSent(size_t bytes) {
     LockHolder lh(lock);
     if (bytes > buffer.bytesRead) {
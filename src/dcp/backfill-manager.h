@@ -84,6 +84,19 @@ public:
      */
     void bytesForceRead(size_t bytes);
 
+    /**
+     * Checks if the read size can fit into the backfill buffer and reads
+     * only if it can. Used for the items a disk scan run by another
+     * stream's backfill reads for this connection's streams; the scan
+     * buffer only limits the backfill this manager is running.
+     *
+     * @param bytes read size
+     *
+     * @return true upon read success
+     *         false if the backfill buffer is full
+     */
+    bool bytesCheckAndReadShared(size_t bytes);
+
     void bytesSent(size_t bytes);
 
     // Called by the managerTask to acutally perform backfilling & manage
@@ -101,6 +114,14 @@ protected:
         bool full;
     } buffer;
 
+    //! The scan buffer is for the current stream being backfilled
+    struct {
+        size_t bytesRead;
+        size_t itemsRead;
+        size_t maxBytes;
+        size_t maxItems;
+    } scanBuffer;
+
 private:
 
     void moveToActiveQueue();
@@ -113,14 +134,6 @@ private:
     std::list<UniqueDCPBackfillPtr> pendingBackfills;
     EventuallyPersistentEngine& engine;
     ExTask managerTask;
-
-    //! The scan buffer is for the current stream being backfilled
-    struct {
-        size_t bytesRead;
-        size_t itemsRead;
-        size_t maxBytes;
-        size_t maxItems;
-    } scanBuffer;
 };
 
 #endif  // SRC_DCP_BACKFILL_MANAGER_H_
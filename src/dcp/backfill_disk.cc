@@ -18,9 +18,13 @@
 #include "config.h"
 
 #include "dcp/backfill_disk.h"
+#include "dcp/dcpconnmap.h"
+#include "dcp/disk_scan_registry.h"
 #include "dcp/stream.h"
 #include "ep_engine.h"
 
+#include <algorithm>
+
 static std::string backfillStateToString(backfill_state_t state) {
     switch (state) {
     case backfill_state_init:
@@ -35,20 +39,18 @@ static std::string backfillStateToString(backfill_state_t state) {
     return "<invalid>:" + std::to_string(state);
 }
 
-CacheCallback::CacheCallback(EventuallyPersistentEngine& e, active_stream_t& s)
-    : engine_(e), stream_(s) {
-    if (stream_.get() == nullptr) {
-        throw std::invalid_argument("CacheCallback(): stream is NULL");
-    }
-    if (!stream_.get()->isTypeActive()) {
-        throw std::invalid_argument(
-                "CacheCallback(): stream->getType() "
-                "(which is " +
-                to_string(stream_.get()->getType()) + ") is not Active");
-    }
+CacheCallback::CacheCallback(EventuallyPersistentEngine& e, DCPDiskScan& s)
+    : engine_(e), scan_(s) {
 }
 
 void CacheCallback::callback(CacheLookup& lookup) {
+    if (!scan_.wanted(lookup.getBySeqno())) {
+        // Every stream reading the scan already has the item (or the item
+        // is before their ranges), so don't read it again.
+        setStatus(ENGINE_KEY_EEXISTS);
+        return;
+    }
+
     VBucketPtr vb =
             engine_.getKVBucket()->getVBucket(lookup.getVBucketId());
     if (!vb) {
@@ -62,26 +64,26 @@ void CacheCallback::callback(CacheLookup& lookup) {
                                           WantsDeleted::No,
                                           TrackReference::No);
     if (v && v->isResident() && v->getBySeqno() == lookup.getBySeqno()) {
+        const bool keyOnly =
+                scan_.getValueFilter() == ValueFilter::KEYS_ONLY;
         std::unique_ptr<Item> it;
         try {
-            it = stream_->isKeyOnly() ?
-                    v->toItemWithNoValue(lookup.getVBucketId()) :
-                    v->toItem(false, lookup.getVBucketId());
+            it = keyOnly ? v->toItemWithNoValue(lookup.getVBucketId())
+                         : v->toItem(false, lookup.getVBucketId());
         } catch (const std::bad_alloc&) {
             setStatus(ENGINE_ENOMEM);
-            stream_->getLogger().log(
-                    EXTENSION_LOG_WARNING,
-                    "Alloc error when trying to create an "
-                    "item copy from hash table. Item seqno:%" PRIi64
-                    ", vb:%" PRIu16 " isKeyOnly:%s",
-                    v->getBySeqno(),
-                    lookup.getVBucketId(),
-                    stream_->isKeyOnly() ? "True" : "False");
+            LOG(EXTENSION_LOG_WARNING,
+                "Alloc error when trying to create an "
+                "item copy from hash table. Item seqno:%" PRIi64
+                ", vb:%" PRIu16 " isKeyOnly:%s",
+                v->getBySeqno(),
+                lookup.getVBucketId(),
+                keyOnly ? "True" : "False");
             return;
         }
         hbl.getHTLock().unlock();
-        if (!stream_->backfillReceived(
-                    std::move(it), BACKFILL_FROM_MEMORY, /*force*/ false)) {
+        if (!scan_.deliver(queued_item(std::move(it)),
+                           BACKFILL_FROM_MEMORY)) {
             setStatus(ENGINE_ENOMEM); // Pause the backfill
         } else {
             setStatus(ENGINE_KEY_EEXISTS);
@@ -91,16 +93,7 @@ void CacheCallback::callback(CacheLookup& lookup) {
     }
 }
 
-DiskCallback::DiskCallback(active_stream_t& s) : stream_(s) {
-    if (stream_.get() == nullptr) {
-        throw std::invalid_argument("DiskCallback(): stream is NULL");
-    }
-    if (!stream_.get()->isTypeActive()) {
-        throw std::invalid_argument(
-                "DiskCallback(): stream->getType() "
-                "(which is " +
-                to_string(stream_.get()->getType()) + ") is not Active");
-    }
+DiskCallback::DiskCallback(DCPDiskScan& s) : scan_(s) {
 }
 
 void DiskCallback::callback(GetValue& val) {
@@ -108,86 +101,302 @@ void DiskCallback::callback(GetValue& val) {
         throw std::invalid_argument("DiskCallback::callback: val is NULL");
     }
 
-    if (!stream_->backfillReceived(std::unique_ptr<Item>(val.getValue()),
-                                   BACKFILL_FROM_DISK,
-                                   /*force*/ false)) {
+    if (!scan_.deliver(queued_item(val.getValue()), BACKFILL_FROM_DISK)) {
         setStatus(ENGINE_ENOMEM); // Pause the backfill
     } else {
         setStatus(ENGINE_SUCCESS);
     }
 }
 
-DCPBackfillDisk::DCPBackfillDisk(EventuallyPersistentEngine& e,
-                                 const active_stream_t& s,
-                                 uint64_t startSeqno,
-                                 uint64_t endSeqno)
-    : DCPBackfill(s, startSeqno, endSeqno),
-      engine(e),
+DCPDiskScan::DCPDiskScan(EventuallyPersistentEngine& e,
+                         uint16_t vbid,
+                         ValueFilter valFilter)
+    : engine(e),
+      vbid(vbid),
+      valFilter(valFilter),
+      startSeqno(0),
+      endSeqno(0),
       scanCtx(nullptr),
-      state(backfill_state_init) {
+      state(backfill_state_init),
+      runner(nullptr),
+      scanStartSeqno(0),
+      scanMaxSeqno(0),
+      lastReadSeqno(0) {
 }
 
-backfill_status_t DCPBackfillDisk::run() {
-    LockHolder lh(lock);
-    switch (state) {
+DCPDiskScan::~DCPDiskScan() {
+    if (scanCtx) {
+        engine.getKVBucket()->getROUnderlying(vbid)->destroyScanContext(
+                scanCtx);
+    }
+}
+
+bool DCPDiskScan::join(const active_stream_t& stream,
+                       uint64_t startSeqno,
+                       uint64_t endSeqno,
+                       bool attached) {
+    switch (state.load()) {
     case backfill_state_init:
-        return create();
+        break;
     case backfill_state_scanning:
-        return scan();
+        if (startSeqno < scanStartSeqno || startSeqno <= lastReadSeqno ||
+            endSeqno > scanMaxSeqno) {
+            return false;
+        }
+        break;
     case backfill_state_completing:
-        return complete(false);
     case backfill_state_done:
+        return false;
+    }
+
+    LockHolder lh(joinLock);
+    joining.push_back({stream,
+                       startSeqno,
+                       endSeqno,
+                       0,
+                       attached,
+                       Participant::State::Joining});
+    return true;
+}
+
+backfill_status_t DCPDiskScan::run(const active_stream_t& stream,
+                                   bool& refused) {
+    refused = false;
+    std::unique_lock<std::mutex> lh(scanLock, std::try_to_lock);
+    if (!lh.owns_lock()) {
+        // Another stream's backfill is running the scan.
+        return backfill_snooze;
+    }
+
+    admitJoining();
+    removeLeaving();
+
+    auto p = std::find_if(
+            participants.begin(),
+            participants.end(),
+            [&stream](const Participant& p) { return p.stream == stream; });
+    if (p == participants.end()) {
+        return backfill_finished;
+    }
+
+    switch (p->state) {
+    case Participant::State::Joining:
+    case Participant::State::Reading:
+        break;
+    case Participant::State::Refused:
+        participants.erase(p);
+        refused = true;
+        return backfill_success;
+    case Participant::State::Done:
+        participants.erase(p);
+        return backfill_finished;
+    }
+
+    backfill_status_t status = backfill_finished;
+    runner = stream.get();
+    switch (state.load()) {
+    case backfill_state_init:
+        status = create();
+        break;
+    case backfill_state_scanning:
+        status = scan();
+        break;
+    case backfill_state_completing:
+        status = complete(false);
+        break;
+    case backfill_state_done:
+        // No scan context could be created.
+        runner = nullptr;
+        participants.erase(p);
         return backfill_finished;
     }
+    runner = nullptr;
+
+    // Streams cancelled during the run; including any cancelled just as it
+    // finished, whose cancel() found scanLock still held.
+    removeLeaving();
+    lh.unlock();
+    for (;;) {
+        {
+            LockHolder jlh(joinLock);
+            if (leaving.empty()) {
+                break;
+            }
+        }
+        if (!lh.try_lock()) {
+            break;
+        }
+        removeLeaving();
+        lh.unlock();
+    }
+    return status;
+}
 
-    throw std::logic_error("DCPBackfillDisk::run: Invalid backfill state " +
-                           std::to_string(state));
+void DCPDiskScan::cancel(const active_stream_t& stream) {
+    {
+        LockHolder jlh(joinLock);
+        leaving.push_back(stream);
+    }
+    std::unique_lock<std::mutex> lh(scanLock, std::try_to_lock);
+    if (lh.owns_lock()) {
+        admitJoining();
+        removeLeaving();
+    }
 }
 
-void DCPBackfillDisk::cancel() {
-    LockHolder lh(lock);
-    if (state != backfill_state_done) {
-        complete(true);
+void DCPDiskScan::admitJoining() {
+    std::vector<Participant> joined;
+    {
+        LockHolder lh(joinLock);
+        joined.swap(joining);
+    }
+
+    auto& registry = engine.getDcpConnMap().getDiskScanRegistry();
+    for (auto& p : joined) {
+        switch (state.load()) {
+        case backfill_state_init: {
+            // The scan context isn't created yet, so widen the range to
+            // read to include the stream's.
+            const bool first = std::none_of(
+                    participants.begin(),
+                    participants.end(),
+                    [](const Participant& other) {
+                        return other.state == Participant::State::Reading;
+                    });
+            startSeqno = first ? p.startSeqno
+                               : std::min(startSeqno, p.startSeqno);
+            endSeqno = first ? p.endSeqno : std::max(endSeqno, p.endSeqno);
+            p.state = Participant::State::Reading;
+            break;
+        }
+        case backfill_state_scanning:
+            if (p.startSeqno >= scanCtx->startSeqno &&
+                p.startSeqno > scanCtx->lastReadSeqno &&
+                p.endSeqno <= scanCtx->maxSeqno) {
+                p.state = Participant::State::Reading;
+                startReading(p);
+            } else {
+                p.state = Participant::State::Refused;
+            }
+            break;
+        case backfill_state_completing:
+        case backfill_state_done:
+            p.state = Participant::State::Refused;
+            break;
+        }
+
+        if (p.attached && p.state == Participant::State::Reading) {
+            registry.recordAttach();
+        }
+        participants.push_back(std::move(p));
+    }
+}
+
+void DCPDiskScan::removeLeaving() {
+    std::vector<active_stream_t> left;
+    {
+        LockHolder lh(joinLock);
+        left.swap(leaving);
+    }
+
+    for (const auto& stream : left) {
+        auto p = std::find_if(participants.begin(),
+                              participants.end(),
+                              [&stream](const Participant& p) {
+                                  return p.stream == stream;
+                              });
+        if (p == participants.end()) {
+            continue;
+        }
+        if (p->state != Participant::State::Done) {
+            stream->completeBackfill();
+            stream->getLogger().log(EXTENSION_LOG_NOTICE,
+                                    "(vb %d) Backfill task (%" PRIu64
+                                    " to %" PRIu64 ") cancelled",
+                                    vbid,
+                                    p->startSeqno,
+                                    p->endSeqno);
+        }
+        participants.erase(p);
+    }
+
+    if (participants.empty() && state != backfill_state_done) {
+        if (scanCtx) {
+            KVStore* kvstore = engine.getKVBucket()->getROUnderlying(vbid);
+            kvstore->destroyScanContext(scanCtx);
+            scanCtx = nullptr;
+        }
+        transitionState(backfill_state_done);
     }
 }
 
-backfill_status_t DCPBackfillDisk::create() {
-    uint16_t vbid = stream->getVBucket();
+bool DCPDiskScan::wanted(uint64_t bySeqno) const {
+    for (const auto& p : participants) {
+        if (p.state == Participant::State::Reading &&
+            bySeqno >= p.startSeqno && bySeqno > p.lastSeqnoReceived) {
+            return true;
+        }
+    }
+    return false;
+}
 
+bool DCPDiskScan::deliver(const queued_item& item, backfill_source_t source) {
+    const uint64_t bySeqno = item->getBySeqno();
+    auto& registry = engine.getDcpConnMap().getDiskScanRegistry();
+    bool full = false;
+    for (auto& p : participants) {
+        if (p.state != Participant::State::Reading ||
+            bySeqno < p.startSeqno || bySeqno <= p.lastSeqnoReceived) {
+            continue;
+        }
+        if (!p.stream->backfillReceived(item,
+                                        source,
+                                        /*force*/ false,
+                                        /*shared*/ p.stream.get() != runner)) {
+            // Passed to the stream again when the scan resumes; the others
+            // skip it then.
+            full = true;
+            continue;
+        }
+        p.lastSeqnoReceived = bySeqno;
+        if (p.attached) {
+            registry.recordBytesSaved(item->size());
+        }
+    }
+    return !full;
+}
+
+backfill_status_t DCPDiskScan::create() {
     uint64_t lastPersistedSeqno =
             engine.getKVBucket()->getLastPersistedSeqno(vbid);
 
     if (lastPersistedSeqno < endSeqno) {
-        stream->getLogger().log(EXTENSION_LOG_NOTICE,
-                                "(vb %d) Rescheduling backfill"
-                                "because backfill up to seqno %" PRIu64
-                                " is needed but only up to "
-                                "%" PRIu64 " is persisted",
-                                vbid,
-                                endSeqno,
-                                lastPersistedSeqno);
+        LOG(EXTENSION_LOG_NOTICE,
+            "(vb %d) Rescheduling backfill"
+            "because backfill up to seqno %" PRIu64
+            " is needed but only up to "
+            "%" PRIu64 " is persisted",
+            vbid,
+            endSeqno,
+            lastPersistedSeqno);
         return backfill_snooze;
     }
 
     KVStore* kvstore = engine.getKVBucket()->getROUnderlying(vbid);
-    ValueFilter valFilter = ValueFilter::VALUES_DECOMPRESSED;
-    if (stream->isKeyOnly()) {
-        valFilter = ValueFilter::KEYS_ONLY;
-    } else {
-        if (stream->isCompressionEnabled()) {
-            valFilter = ValueFilter::VALUES_COMPRESSED;
-        }
-    }
-
-    std::shared_ptr<Callback<GetValue> > cb(new DiskCallback(stream));
+    std::shared_ptr<Callback<GetValue> > cb(new DiskCallback(*this));
     std::shared_ptr<Callback<CacheLookup> > cl(
-            new CacheCallback(engine, stream));
+            new CacheCallback(engine, *this));
     scanCtx = kvstore->initScanContext(
             cb, cl, vbid, startSeqno, DocumentFilter::ALL_ITEMS, valFilter);
 
     if (scanCtx) {
-        stream->incrBackfillRemaining(scanCtx->documentCount);
-        stream->markDiskSnapshot(startSeqno, scanCtx->maxSeqno);
+        scanStartSeqno = scanCtx->startSeqno;
+        scanMaxSeqno = scanCtx->maxSeqno;
+        for (auto& p : participants) {
+            if (p.state == Participant::State::Reading) {
+                startReading(p);
+            }
+        }
         transitionState(backfill_state_scanning);
     } else {
         transitionState(backfill_state_done);
@@ -196,17 +405,24 @@ backfill_status_t DCPBackfillDisk::create() {
     return backfill_success;
 }
 
-backfill_status_t DCPBackfillDisk::scan() {
-    uint16_t vbid = stream->getVBucket();
-
-    if (!(stream->isActive())) {
+backfill_status_t DCPDiskScan::scan() {
+    if (!hasActiveStream()) {
         return complete(true);
     }
 
     KVStore* kvstore = engine.getKVBucket()->getROUnderlying(vbid);
+    const uint64_t lastReadBefore = scanCtx->lastReadSeqno;
     scan_error_t error = kvstore->scan(scanCtx);
+    lastReadSeqno = scanCtx->lastReadSeqno;
 
     if (error == scan_again) {
+        // If a stream's full backfill buffer paused the scan before it read
+        // anything, let the stream drain rather than have the backfills of
+        // the others run the scan straight into it again.
+        if (scanCtx->lastReadSeqno == lastReadBefore &&
+            participants.size() > 1) {
+            return backfill_snooze;
+        }
         return backfill_success;
     }
 
@@ -215,29 +431,64 @@ backfill_status_t DCPBackfillDisk::scan() {
     return backfill_success;
 }
 
-backfill_status_t DCPBackfillDisk::complete(bool cancelled) {
-    uint16_t vbid = stream->getVBucket();
+backfill_status_t DCPDiskScan::complete(bool cancelled) {
     KVStore* kvstore = engine.getKVBucket()->getROUnderlying(vbid);
     kvstore->destroyScanContext(scanCtx);
-
-    stream->completeBackfill();
+    scanCtx = nullptr;
 
     EXTENSION_LOG_LEVEL severity =
             cancelled ? EXTENSION_LOG_NOTICE : EXTENSION_LOG_INFO;
-    stream->getLogger().log(severity,
-                            "(vb %d) Backfill task (%" PRIu64 " to %" PRIu64
-                            ") %s",
-                            vbid,
-                            startSeqno,
-                            endSeqno,
-                            cancelled ? "cancelled" : "finished");
+    for (auto& p : participants) {
+        if (p.state != Participant::State::Reading) {
+            continue;
+        }
+        p.stream->completeBackfill();
+        p.state = Participant::State::Done;
+        p.stream->getLogger().log(severity,
+                                  "(vb %d) Backfill task (%" PRIu64
+                                  " to %" PRIu64 ") %s",
+                                  vbid,
+                                  p.startSeqno,
+                                  p.endSeqno,
+                                  cancelled ? "cancelled" : "finished");
+    }
 
     transitionState(backfill_state_done);
 
     return backfill_success;
 }
 
-void DCPBackfillDisk::transitionState(backfill_state_t newState) {
+void DCPDiskScan::startReading(Participant& p) {
+    // The scan covers the union of the participants' ranges; count only
+    // the items in this participant's.
+    KVStore* kvstore = engine.getKVBucket()->getROUnderlying(vbid);
+    size_t numItems = scanCtx->documentCount;
+    try {
+        numItems = kvstore->getNumItems(vbid, p.startSeqno, scanCtx->maxSeqno);
+    } catch (std::exception& e) {
+        p.stream->getLogger().log(EXTENSION_LOG_WARNING,
+                                  "(vb %d) DCPDiskScan::startReading: "
+                                  "failed to count the items from %" PRIu64
+                                  " to %" PRIu64 ": %s",
+                                  vbid,
+                                  p.startSeqno,
+                                  scanCtx->maxSeqno,
+                                  e.what());
+    }
+    p.stream->incrBackfillRemaining(numItems);
+    p.stream->markDiskSnapshot(p.startSeqno, scanCtx->maxSeqno);
+}
+
+bool DCPDiskScan::hasActiveStream() const {
+    for (const auto& p : participants) {
+        if (p.state == Participant::State::Reading && p.stream->isActive()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DCPDiskScan::transitionState(backfill_state_t newState) {
     if (state == newState) {
         return;
     }
@@ -267,7 +518,7 @@ void DCPBackfillDisk::transitionState(backfill_state_t newState) {
 
     if (!validTransition) {
         throw std::invalid_argument(
-                "DCPBackfillDisk::transitionState:"
+                "DCPDiskScan::transitionState:"
                 " newState (which is " +
                 backfillStateToString(newState) +
                 ") is not valid for current state (which is " +
@@ -276,3 +527,39 @@ void DCPBackfillDisk::transitionState(backfill_state_t newState) {
 
     state = newState;
 }
+
+DCPBackfillDisk::DCPBackfillDisk(EventuallyPersistentEngine& e,
+                                 const active_stream_t& s,
+                                 uint64_t startSeqno,
+                                 uint64_t endSeqno)
+    : DCPBackfill(s, startSeqno, endSeqno),
+      engine(e),
+      scan(e.getDcpConnMap().getDiskScanRegistry().join(
+              e, s, startSeqno, endSeqno)),
+      cancelled(false) {
+}
+
+backfill_status_t DCPBackfillDisk::run() {
+    LockHolder lh(lock);
+    if (cancelled) {
+        return backfill_finished;
+    }
+
+    bool refused = false;
+    backfill_status_t status = scan->run(stream, refused);
+    if (refused) {
+        // The shared scan had read past the start of the backfill by the
+        // time it looked at the stream; read it with a scan of its own.
+        scan = engine.getDcpConnMap().getDiskScanRegistry().join(
+                engine, stream, startSeqno, endSeqno, /*share*/ false);
+    }
+    return status;
+}
+
+void DCPBackfillDisk::cancel() {
+    LockHolder lh(lock);
+    if (!cancelled) {
+        cancelled = true;
+        scan->cancel(stream);
+    }
+}
@@ -21,11 +21,17 @@
 
 #include "callbacks.h"
 #include "dcp/backfill.h"
+#include "kvstore.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class DCPDiskScan;
 class EventuallyPersistentEngine;
-class ScanContext;
 
-/* The possible states of the DCPBackfillDisk */
+/* The possible states of the DCPDiskScan */
 enum backfill_state_t {
     backfill_state_init,
     backfill_state_scanning,
@@ -36,75 +42,170 @@ enum backfill_state_t {
 /* Callback to get the items that are found to be in the cache */
 class CacheCallback : public Callback<CacheLookup> {
 public:
-    CacheCallback(EventuallyPersistentEngine& e, active_stream_t& s);
+    CacheCallback(EventuallyPersistentEngine& e, DCPDiskScan& s);
 
     void callback(CacheLookup& lookup);
 
 private:
     EventuallyPersistentEngine& engine_;
-    active_stream_t stream_;
+    DCPDiskScan& scan_;
 };
 
 /* Callback to get the items that are found to be in the disk */
 class DiskCallback : public Callback<GetValue> {
 public:
-    DiskCallback(active_stream_t& s);
+    DiskCallback(DCPDiskScan& s);
 
     void callback(GetValue& val);
 
 private:
-    active_stream_t stream_;
+    DCPDiskScan& scan_;
 };
 
 /**
- * Concrete class that does backfill from the disk and informs the DCP stream
- * of the backfill progress.
- * This class calls asynchronous kvstore apis and manages a state machine to
- * read items in the sequential order from the disk and to call the DCP stream
- * for disk snapshot, backfill items and backfill completion.
+ * A scan of a vbucket's disk snapshot for the backfills of one or more
+ * streams (see DCPDiskScanRegistry).
+ *
+ * Manages a state machine to read items in the sequential order from the
+ * disk (by calling asynchronous kvstore apis) and to call each stream for its
+ * disk snapshot, backfill items and backfill completion. Any of the streams'
+ * backfills may run the scan; items are passed to every stream whose range
+ * they are in, and a stream which is passed an item it already has (as the
+ * scan is paused and resumed by another stream's full backfill buffer)
+ * skips it.
+ *
+ * A stream can join the scan until the scan has read past its start seqno;
+ * a stream which can't (or has its join refused once the scan looks at it)
+ * runs a scan of its own.
  */
-class DCPBackfillDisk : public DCPBackfill {
+class DCPDiskScan {
 public:
-    DCPBackfillDisk(EventuallyPersistentEngine& e,
-                    const active_stream_t& s,
-                    uint64_t startSeqno,
-                    uint64_t endSeqno);
+    DCPDiskScan(EventuallyPersistentEngine& e,
+                uint16_t vbid,
+                ValueFilter valFilter);
 
-    backfill_status_t run() override;
+    ~DCPDiskScan();
 
-    bool isStreamDead() override {
-        return !stream->isActive();
+    ValueFilter getValueFilter() const {
+        return valFilter;
     }
 
-    void cancel() override;
+    /**
+     * Ask for the backfill of the given stream to be read by this scan.
+     * Checked again when the scan next runs, which may refuse it (see run()).
+     *
+     * @param attached true if the scan was created for another stream
+     * @return false if the scan can't include the stream
+     */
+    bool join(const active_stream_t& stream,
+              uint64_t startSeqno,
+              uint64_t endSeqno,
+              bool attached);
+
+    /**
+     * Run the scan for a while on behalf of the given stream's backfill.
+     *
+     * @param refused set to true if the stream's join was refused, in which
+     *        case its backfill must be read by another scan
+     * @return status of the stream's backfill
+     */
+    backfill_status_t run(const active_stream_t& stream, bool& refused);
+
+    /**
+     * The given stream's backfill is cancelled; the scan stops if it was
+     * the last stream reading it.
+     *
+     * Doesn't wait for a run of the scan (on behalf of another stream) to
+     * finish, as the BackfillManager cancels backfills holding its lock,
+     * which the run may need to pass an item to a stream; the run removes
+     * the stream before it returns instead.
+     */
+    void cancel(const active_stream_t& stream);
 
 private:
+    friend class CacheCallback;
+    friend class DiskCallback;
+
+    /* One stream's backfill read by the scan */
+    struct Participant {
+        enum class State {
+            // Waiting to be checked by the scan
+            Joining,
+            // Being passed the items in its range
+            Reading,
+            // Must be read by another scan
+            Refused,
+            // Backfill completed
+            Done
+        };
+
+        active_stream_t stream;
+        uint64_t startSeqno;
+        uint64_t endSeqno;
+        // The last seqno passed to (and taken by) the stream
+        uint64_t lastSeqnoReceived;
+        bool attached;
+        State state;
+    };
+
+    /**
+     * Check the streams which joined since the last run, accepting those
+     * the scan can read the whole backfill of. Expects scanLock to be held.
+     */
+    void admitJoining();
+
+    /**
+     * Remove the streams whose backfills were cancelled, completing their
+     * backfills, and stop the scan if none are left. Expects scanLock to be
+     * held.
+     */
+    void removeLeaving();
+
+    /// @return true if a stream reading the scan still needs the item
+    bool wanted(uint64_t bySeqno) const;
+
+    /**
+     * Pass an item to each stream which is reading the scan, wants it and
+     * hasn't had it yet. Only the running stream is limited by its
+     * connection's scan buffer; the others by their backfill buffers.
+     *
+     * @return false if a stream's buffer was full (so the scan must pause,
+     *         and pass the item again when it resumes)
+     */
+    bool deliver(const queued_item& item, backfill_source_t source);
+
     /**
-     * Creates a scan context with the KV Store to read items in the sequential
-     * order from the disk. Backfill snapshot range is decided here.
+     * Creates a scan context with the KV Store to read items in the
+     * sequential order from the disk. Backfill snapshot range is decided
+     * here.
      */
     backfill_status_t create();
 
     /**
      * Scan the disk (by calling KVStore apis) for the items in the backfill
      * snapshot range created in the create scan context. This is an
-     * asynchronous operation, KVStore calls the CacheCallback and DiskCallback
-     * to populate the items read in the snapshot of scan.
+     * asynchronous operation, KVStore calls the CacheCallback and
+     * DiskCallback to populate the items read in the snapshot of scan.
      */
     backfill_status_t scan();
 
     /**
      * Handles the completion of the backfill.
-     * Destroys the scan context, indicates the completion to the stream.
+     * Destroys the scan context, indicates the completion to the streams.
      *
      * @param cancelled indicates the if backfill finished fully or was
      *                  cancelled in between; for debug
      */
     backfill_status_t complete(bool cancelled);
 
+    /// Start reading the given stream's backfill from the scan.
+    void startReading(Participant& p);
+
+    bool hasActiveStream() const;
+
     /**
      * Makes transitions to the state machine to backfill from the disk
-     * asynchronously and to inform the DCP stream of the backfill progress.
+     * asynchronously and to inform the DCP streams of the backfill progress.
      */
     void transitionState(backfill_state_t newState);
 
@@ -115,7 +216,59 @@ private:
      */
     EventuallyPersistentEngine& engine;
 
+    const uint16_t vbid;
+    const ValueFilter valFilter;
+
+    // Range the scan reads; widened for the streams which join before the
+    // scan context is created.
+    uint64_t startSeqno;
+    uint64_t endSeqno;
+
     ScanContext* scanCtx;
-    backfill_state_t state;
+    // Guards the scan, its state and participants.
+    std::mutex scanLock;
+    std::atomic<backfill_state_t> state;
+    std::vector<Participant> participants;
+    // The stream whose backfill is running the scan; the others are passed
+    // items without charging their connections' scan buffers, which are
+    // reset only when their own backfill managers run.
+    const ActiveStream* runner;
+
+    // Streams which joined, or were cancelled while the scan was running,
+    // since the last run; and the range the scan has read so far (so join()
+    // can tell without scanLock whether a stream can still be included).
+    std::mutex joinLock;
+    std::vector<Participant> joining;
+    std::vector<active_stream_t> leaving;
+    std::atomic<uint64_t> scanStartSeqno;
+    std::atomic<uint64_t> scanMaxSeqno;
+    std::atomic<uint64_t> lastReadSeqno;
+};
+
+/**
+ * Concrete class that does backfill from the disk and informs the DCP stream
+ * of the backfill progress; the reading is done by a DCPDiskScan, which may
+ * be shared with the backfills of other streams of the same vbucket.
+ */
+class DCPBackfillDisk : public DCPBackfill {
+public:
+    DCPBackfillDisk(EventuallyPersistentEngine& e,
+                    const active_stream_t& s,
+                    uint64_t startSeqno,
+                    uint64_t endSeqno);
+
+    backfill_status_t run() override;
+
+    bool isStreamDead() override {
+        return !stream->isActive();
+    }
+
+    void cancel() override;
+
+private:
+    EventuallyPersistentEngine& engine;
+
+    std::shared_ptr<DCPDiskScan> scan;
+    bool cancelled;
     std::mutex lock;
 };
@@ -0,0 +1,125 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "dcp/compression_cache.h"
+
+#include "statwriter.h"
+
+DcpCompressionCache::DcpCompressionCache(size_t maxSize, size_t numShards)
+    : shards(numShards), maxSize(maxSize) {
+}
+
+bool DcpCompressionCache::lookup(const value_t& value, value_t& compressed) {
+    Shard& shard = getShard(value.get());
+    std::lock_guard<std::mutex> lh(shard.mutex);
+    const auto it = shard.entries.find(value.get());
+    if (it == shard.entries.end()) {
+        ++shard.misses;
+        return false;
+    }
+    compressed = it->second.compressed;
+    shard.timeSaved += it->second.duration;
+    ++shard.hits;
+    return true;
+}
+
+void DcpCompressionCache::insert(const value_t& value,
+                                 const value_t& compressed,
+                                 hrtime_t duration) {
+    Entry entry{value, compressed, duration};
+    const size_t required = entrySize(entry);
+
+    Shard& shard = getShard(value.get());
+    std::lock_guard<std::mutex> lh(shard.mutex);
+    const size_t shardMaxSize = getShardMaxSize();
+    if (required > shardMaxSize) {
+        return;
+    }
+    // Another producer may have compressed the value at the same time.
+    if (!shard.entries.emplace(value.get(), std::move(entry)).second) {
+        return;
+    }
+    shard.order.push_back(value.get());
+    shard.size += required;
+    evict_UNLOCKED(shard, shardMaxSize);
+}
+
+void DcpCompressionCache::clear() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lh(shard.mutex);
+        evict_UNLOCKED(shard, 0);
+    }
+}
+
+void DcpCompressionCache::setMaxSize(size_t newMaxSize) {
+    maxSize.store(newMaxSize);
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lh(shard.mutex);
+        evict_UNLOCKED(shard, getShardMaxSize());
+    }
+}
+
+size_t DcpCompressionCache::getSize() const {
+    size_t size = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lh(shard.mutex);
+        size += shard.size;
+    }
+    return size;
+}
+
+void DcpCompressionCache::addStats(ADD_STAT add_stat, const void* c) const {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t size = 0;
+    hrtime_t timeSaved = 0;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lh(shard.mutex);
+        hits += shard.hits;
+        misses += shard.misses;
+        size += shard.size;
+        timeSaved += shard.timeSaved;
+    }
+    add_casted_stat("ep_dcp_compression_cache_hits", hits, add_stat, c);
+    add_casted_stat(
+            "ep_dcp_compression_cache_misses", misses, add_stat, c);
+    add_casted_stat("ep_dcp_compression_cache_size", size, add_stat, c);
+    add_casted_stat(
+            "ep_dcp_compression_time_saved", timeSaved / 1000, add_stat, c);
+}
+
+size_t DcpCompressionCache::entrySize(const Entry& entry) {
+    return sizeof(Entry) + entry.value->getSize() +
+           (entry.compressed ? entry.compressed->getSize() : 0);
+}
+
+DcpCompressionCache::Shard& DcpCompressionCache::getShard(const Blob* blob) {
+    // Blobs are heap allocated, so the low bits of their address carry
+    // little information; mix them all in (Fibonacci hashing).
+    const uint64_t hash =
+            uint64_t(reinterpret_cast<uintptr_t>(blob)) * 0x9E3779B97F4A7C15ull;
+    return shards[(hash >> 32) % shards.size()];
+}
+
+void DcpCompressionCache::evict_UNLOCKED(Shard& shard, size_t target) {
+    while (shard.size > target && !shard.order.empty()) {
+        const auto it = shard.entries.find(shard.order.front());
+        shard.size -= entrySize(it->second);
+        shard.entries.erase(it);
+        shard.order.pop_front();
+    }
+}
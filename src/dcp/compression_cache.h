@@ -0,0 +1,131 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "item.h"
+
+#include <memcached/engine_common.h>
+#include <platform/platform.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The values DCP producers have snappy-compressed for the connections which
+ * enabled value compression, shared by all the producers of a bucket; so a
+ * mutation streamed to several such connections is compressed just once.
+ *
+ * Entries are keyed by the (uncompressed) value's Blob, which each entry
+ * keeps a reference to so it can't be freed and its address reused. An
+ * entry may also record that the value isn't worth compressing (it doesn't
+ * achieve dcp_min_compression_ratio), so that later producers send it as
+ * it is without trying again.
+ *
+ * The memory the entries keep (both values) is bounded by the
+ * dcp_compression_cache_size; once full the oldest entries are dropped, as
+ * the producers of a bucket mostly stream the same recent mutations at
+ * about the same time. A size of zero disables the cache.
+ *
+ * So that producers don't all serialise on one lock, the entries are split
+ * across shards by the address of their Blob, each shard with its own lock
+ * and an equal part of the max size (and dropping its own oldest entries).
+ */
+class DcpCompressionCache {
+public:
+    static const size_t DefaultShards = 16;
+
+    explicit DcpCompressionCache(size_t maxSize,
+                                 size_t numShards = DefaultShards);
+
+    DcpCompressionCache(const DcpCompressionCache&) = delete;
+    DcpCompressionCache& operator=(const DcpCompressionCache&) = delete;
+
+    /**
+     * Look up the compressed form of the given value.
+     *
+     * @param value the uncompressed value
+     * @param compressed set to the compressed value if found, or to null if
+     *        the value was found not to be worth compressing
+     * @return true if the value was found
+     */
+    bool lookup(const value_t& value, value_t& compressed);
+
+    /**
+     * Record the compressed form of the given value (or, if compressed is
+     * null, that it isn't worth compressing) for later lookups.
+     *
+     * @param duration the time it took to compress the value, which each
+     *        later lookup of it saves
+     */
+    void insert(const value_t& value,
+                const value_t& compressed,
+                hrtime_t duration);
+
+    /// Drop every entry (say, as the compression ratio changed).
+    void clear();
+
+    void setMaxSize(size_t newMaxSize);
+
+    /// @return the memory kept by the entries
+    size_t getSize() const;
+
+    void addStats(ADD_STAT add_stat, const void* c) const;
+
+private:
+    struct Entry {
+        value_t value;
+        value_t compressed;
+        hrtime_t duration;
+    };
+
+    struct Shard {
+        Shard() : size(0), hits(0), misses(0), timeSaved(0) {
+        }
+
+        mutable std::mutex mutex;
+        std::unordered_map<const Blob*, Entry> entries;
+        // Keys of the entries, oldest first.
+        std::deque<const Blob*> order;
+        size_t size;
+
+        size_t hits;
+        size_t misses;
+        // Sum of the compression time of the values looked up.
+        hrtime_t timeSaved;
+    };
+
+    static size_t entrySize(const Entry& entry);
+
+    Shard& getShard(const Blob* blob);
+
+    /// @return the max size of each shard
+    size_t getShardMaxSize() const {
+        return maxSize.load() / shards.size();
+    }
+
+    /// Drop a shard's oldest entries until it fits the given size.
+    static void evict_UNLOCKED(Shard& shard, size_t target);
+
+    std::vector<Shard> shards;
+    std::atomic<size_t> maxSize;
+};
@@ -33,6 +33,7 @@ public:
     virtual ~DcpConfigChangeListener() {
     }
     virtual void sizeValueChanged(const std::string& key, size_t value);
+    virtual void booleanValueChanged(const std::string& key, bool value);
 
 private:
     DcpConnMap& myConnMap;
@@ -40,6 +41,12 @@ private:
 
 DcpConnMap::DcpConnMap(EventuallyPersistentEngine &e)
     : ConnMap(e),
+      compressionCache(e.getConfiguration().getDcpCompressionCacheSize()),
+      producerStepBatchItems(
+              e.getConfiguration().getDcpProducerStepBatchItems()),
+      producerStepBatchBytes(
+              e.getConfiguration().getDcpProducerStepBatchBytes()),
+      diskScanRegistry(e.getConfiguration().isDcpBackfillShareScans()),
       aggrDcpConsumerBufferSize(0) {
     backfills.numActiveSnoozing = 0;
     updateMaxActiveSnoozingBackfills(engine.getEpStats().getMaxDataSize());
@@ -53,6 +60,18 @@ DcpConnMap::DcpConnMap(EventuallyPersistentEngine &e)
     engine.getConfiguration().
         addValueChangedListener("dcp_consumer_process_buffered_messages_batch_size",
                                 new DcpConfigChangeListener(*this));
+    engine.getConfiguration().
+        addValueChangedListener("dcp_compression_cache_size",
+                                new DcpConfigChangeListener(*this));
+    engine.getConfiguration().
+        addValueChangedListener("dcp_producer_step_batch_items",
+                                new DcpConfigChangeListener(*this));
+    engine.getConfiguration().
+        addValueChangedListener("dcp_producer_step_batch_bytes",
+                                new DcpConfigChangeListener(*this));
+    engine.getConfiguration().
+        addValueChangedListener("dcp_backfill_share_scans",
+                                new DcpConfigChangeListener(*this));
 }
 
 DcpConsumer *DcpConnMap::newConsumer(const void* cookie,
@@ -441,6 +460,8 @@ void DcpConnMap::addStats(ADD_STAT add_stat, const void *c) {
 
 void DcpConnMap::updateMinCompressionRatioForProducers(float value) {
     minCompressionRatioForProducer.store(value);
+    // Whether values were worth compressing depended on the old ratio.
+    compressionCache.clear();
 }
 
 float DcpConnMap::getMinCompressionRatio() {
@@ -456,6 +477,19 @@ void DcpConnMap::DcpConfigChangeListener::sizeValueChanged(const std::string &ke
         myConnMap.consumerYieldConfigChanged(value);
     } else if (key == "dcp_consumer_process_buffered_messages_batch_size") {
         myConnMap.consumerBatchSizeConfigChanged(value);
+    } else if (key == "dcp_compression_cache_size") {
+        myConnMap.compressionCache.setMaxSize(value);
+    } else if (key == "dcp_producer_step_batch_items") {
+        myConnMap.producerStepBatchItems.store(value);
+    } else if (key == "dcp_producer_step_batch_bytes") {
+        myConnMap.producerStepBatchBytes.store(value);
+    }
+}
+
+void DcpConnMap::DcpConfigChangeListener::booleanValueChanged(
+        const std::string& key, bool value) {
+    if (key == "dcp_backfill_share_scans") {
+        myConnMap.diskScanRegistry.setShareScans(value);
     }
 }
 
@@ -20,6 +20,8 @@
 #include "config.h"
 
 #include "connmap.h"
+#include "dcp/compression_cache.h"
+#include "dcp/disk_scan_registry.h"
 
 #include <atomic>
 #include <list>
@@ -122,6 +124,27 @@ public:
 
     float getMinCompressionRatio();
 
+    /// @return the max number of messages a producer sends per step
+    size_t getProducerStepBatchItems() const {
+        return producerStepBatchItems;
+    }
+
+    /// @return the number of bytes after which a producer ends a step's
+    ///         batch of messages (0 for no limit)
+    size_t getProducerStepBatchBytes() const {
+        return producerStepBatchBytes;
+    }
+
+    /// The values compressed by the producers, shared between them.
+    DcpCompressionCache& getCompressionCache() {
+        return compressionCache;
+    }
+
+    /// The disk scans of the backfills, which streams may share.
+    DCPDiskScanRegistry& getDiskScanRegistry() {
+        return diskScanRegistry;
+    }
+
     connection_t findByName(const std::string &name);
 
     bool isConnections() {
@@ -186,6 +209,13 @@ protected:
 
     std::atomic<float> minCompressionRatioForProducer;
 
+    DcpCompressionCache compressionCache;
+
+    std::atomic<size_t> producerStepBatchItems;
+    std::atomic<size_t> producerStepBatchBytes;
+
+    DCPDiskScanRegistry diskScanRegistry;
+
     /* Total memory used by all DCP consumer buffers */
     std::atomic<size_t> aggrDcpConsumerBufferSize;
 
@@ -0,0 +1,79 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "dcp/disk_scan_registry.h"
+
+#include "dcp/backfill_disk.h"
+#include "dcp/stream.h"
+#include "statwriter.h"
+
+#include <algorithm>
+
+static ValueFilter getValueFilter(ActiveStream& stream) {
+    if (stream.isKeyOnly()) {
+        return ValueFilter::KEYS_ONLY;
+    }
+    if (stream.isCompressionEnabled()) {
+        return ValueFilter::VALUES_COMPRESSED;
+    }
+    return ValueFilter::VALUES_DECOMPRESSED;
+}
+
+DCPDiskScanRegistry::DCPDiskScanRegistry(bool shareScans)
+    : shareScans(shareScans), attaches(0), bytesSaved(0) {
+}
+
+std::shared_ptr<DCPDiskScan> DCPDiskScanRegistry::join(
+        EventuallyPersistentEngine& e,
+        const active_stream_t& stream,
+        uint64_t startSeqno,
+        uint64_t endSeqno,
+        bool share) {
+    const uint16_t vbid = stream->getVBucket();
+    const ValueFilter valFilter = getValueFilter(*stream);
+
+    LockHolder lh(lock);
+    auto& vbScans = scans[vbid];
+    vbScans.erase(std::remove_if(vbScans.begin(),
+                                 vbScans.end(),
+                                 [](const std::weak_ptr<DCPDiskScan>& s) {
+                                     return s.expired();
+                                 }),
+                  vbScans.end());
+
+    if (share && shareScans.load()) {
+        for (const auto& weak : vbScans) {
+            auto scan = weak.lock();
+            if (scan && scan->getValueFilter() == valFilter &&
+                scan->join(stream, startSeqno, endSeqno, /*attached*/ true)) {
+                return scan;
+            }
+        }
+    }
+
+    auto scan = std::make_shared<DCPDiskScan>(e, vbid, valFilter);
+    scan->join(stream, startSeqno, endSeqno, /*attached*/ false);
+    vbScans.push_back(scan);
+    return scan;
+}
+
+void DCPDiskScanRegistry::addStats(ADD_STAT add_stat, const void* c) const {
+    add_casted_stat("ep_dcp_backfill_shared_scan_attaches",
+                    attaches.load(), add_stat, c);
+    add_casted_stat("ep_dcp_backfill_shared_scan_bytes_saved",
+                    bytesSaved.load(), add_stat, c);
+}
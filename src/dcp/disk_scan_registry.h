@@ -0,0 +1,98 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "dcp/dcp-types.h"
+
+#include <memcached/engine_common.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class DCPDiskScan;
+class EventuallyPersistentEngine;
+
+/**
+ * The disk scans running for the DCP backfills of a bucket, by vbucket; so
+ * the backfills of streams on the same vbucket with overlapping ranges (such
+ * as an indexer and XDCR both streaming a vbucket from seqno 0) read the
+ * couchstore file once, rather than once each (see DCPDiskScan).
+ *
+ * Only streams which read the same values (whether key only, and whether
+ * compressed) share a scan. Sharing is off unless dcp_backfill_share_scans
+ * is set, as a stream whose backfill buffer is full pauses the scan for
+ * every stream reading it.
+ */
+class DCPDiskScanRegistry {
+public:
+    explicit DCPDiskScanRegistry(bool shareScans);
+
+    DCPDiskScanRegistry(const DCPDiskScanRegistry&) = delete;
+    DCPDiskScanRegistry& operator=(const DCPDiskScanRegistry&) = delete;
+
+    /**
+     * Find a scan to read the backfill of the given stream: a running scan
+     * of the vbucket which the stream can join, else a new one.
+     *
+     * @param share false to always create a new scan (for a stream whose
+     *        join of a shared scan was refused)
+     */
+    std::shared_ptr<DCPDiskScan> join(EventuallyPersistentEngine& e,
+                                      const active_stream_t& stream,
+                                      uint64_t startSeqno,
+                                      uint64_t endSeqno,
+                                      bool share = true);
+
+    void setShareScans(bool enabled) {
+        shareScans.store(enabled);
+    }
+
+    /// A stream started reading a scan created for another stream.
+    void recordAttach() {
+        attaches++;
+    }
+
+    /// A stream which attached to a scan was passed an item of this size.
+    void recordBytesSaved(size_t bytes) {
+        bytesSaved.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    size_t getAttaches() const {
+        return attaches.load();
+    }
+
+    size_t getBytesSaved() const {
+        return bytesSaved.load();
+    }
+
+    void addStats(ADD_STAT add_stat, const void* c) const;
+
+private:
+    std::atomic<bool> shareScans;
+    std::atomic<size_t> attaches;
+    std::atomic<size_t> bytesSaved;
+
+    std::mutex lock;
+    std::unordered_map<uint16_t, std::vector<std::weak_ptr<DCPDiskScan>>>
+            scans;
+};
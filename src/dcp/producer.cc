@@ -419,6 +419,72 @@ ENGINE_ERROR_CODE DcpProducer::getFailoverLog(uint32_t opaque, uint16_t vbucket,
     return vb->failovers->addFailoverLog(getCookie(), callback);
 }
 
+Item* DcpProducer::getItemToSend(MutationResponse& response) {
+    const Item& item = *response.getItem();
+    if (response.isKeyOnly()) {
+        return response.getItemCopy();
+    }
+
+    // Hand memcached a reference to the item rather than a copy when its
+    // value is already in the form this connection wants; it is released
+    // (and the reference dropped) once the message is sent.
+    const bool isCompressed = mcbp::datatype::is_snappy(item.getDataType());
+    if (item.getNBytes() == 0 || isCompressed == enableValueCompression) {
+        return response.getItemReference();
+    }
+
+    if (!enableValueCompression) {
+        /**
+         * The value may be held compressed in memory or on disk (see
+         * compression_mode); a consumer which did not enable value
+         * compression must be sent the inflated document.
+         */
+        std::unique_ptr<Item> copy(response.getItemCopy());
+        if (!copy->decompressValue()) {
+            LOG(EXTENSION_LOG_WARNING,
+                "%s Failed to inflate a compressed value!",
+                logHeader());
+        }
+        return copy.release();
+    }
+
+    /**
+     * Value compression is enabled, so the producer will need to
+     * snappy-compress the document before transmitting - unless another
+     * producer already has (or found it not worth compressing).
+     */
+    auto& cache = engine_.getDcpConnMap().getCompressionCache();
+    value_t compressed;
+    const bool cached = cache.lookup(item.getValue(), compressed);
+    if (cached && !compressed) {
+        return response.getItemReference();
+    }
+
+    std::unique_ptr<Item> copy(response.getItemCopy());
+    if (cached) {
+        copy->setValue(compressed);
+    } else {
+        const hrtime_t start = gethrtime();
+        if (copy->compressValue(
+                    engine_.getDcpConnMap().getMinCompressionRatio())) {
+            const bool worthCompressing =
+                    mcbp::datatype::is_snappy(copy->getDataType());
+            cache.insert(item.getValue(),
+                         worthCompressing ? copy->getValue() : value_t(),
+                         gethrtime() - start);
+        } else {
+            LOG(EXTENSION_LOG_WARNING,
+                "%s Failed to snappy compress an uncompressed value!",
+                logHeader());
+        }
+    }
+
+    if (copy->getNBytes() < item.getNBytes()) {
+        log.acknowledge(item.getNBytes() - copy->getNBytes());
+    }
+    return copy.release();
+}
+
 ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
     setLastWalkTime();
 
@@ -435,22 +501,60 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
         return ret;
     }
 
-    DcpResponse *resp;
-    if (rejectResp) {
-        resp = rejectResp;
-        rejectResp = NULL;
-    } else {
-        resp = getNextItem();
-        if (!resp) {
-            return ENGINE_SUCCESS;
+    // Send up to a batch of messages (see dcp_producer_step_batch_items),
+    // which may be taken from the same stream without going through the
+    // ready queue.
+    auto& connMap = engine_.getDcpConnMap();
+    const size_t batchItems = connMap.getProducerStepBatchItems();
+    const size_t batchBytes = connMap.getProducerStepBatchBytes();
+    StepBatch batch;
+    size_t items = 0;
+    size_t bytes = 0;
+    do {
+        DcpResponse *resp;
+        if (rejectResp) {
+            resp = rejectResp;
+            rejectResp = NULL;
+        } else {
+            resp = getNextItem(&batch);
+            if (!resp) {
+                break;
+            }
+        }
+        bytes += resp->getMessageSize();
+        ret = sendResponse(producers, resp);
+        if (ret == ENGINE_ENOMEM) {
+            return ret;
         }
+        ++items;
+    } while (ret == ENGINE_SUCCESS && items < batchItems &&
+             (batchBytes == 0 || bytes < batchBytes));
+
+    if (items == 0) {
+        return ENGINE_SUCCESS;
     }
 
-    Item* itmCpy = nullptr;
+    lastSendTime = ep_current_time();
+
+    // E2BIG means the connection's write buffer is full; memcached closes
+    // the connection if step() returns it. Once part of the batch has gone
+    // out that buffer will be flushed before we are stepped again, so keep
+    // the rejected message for the next step and ask to be called back.
+    // Only a message rejected on its own is reported as E2BIG.
+    if (ret == ENGINE_E2BIG && items > 1) {
+        return ENGINE_WANT_MORE;
+    }
+    return (ret == ENGINE_SUCCESS) ? ENGINE_WANT_MORE : ret;
+}
+
+ENGINE_ERROR_CODE DcpProducer::sendResponse(
+        struct dcp_message_producers* producers, DcpResponse* resp) {
+    ENGINE_ERROR_CODE ret;
+    Item* itm = nullptr;
     auto* mutationResponse = dynamic_cast<MutationProducerResponse*>(resp);
     if (mutationResponse != nullptr) {
         try {
-            itmCpy = mutationResponse->getItemCopy();
+            itm = getItemToSend(*mutationResponse);
         } catch (const std::bad_alloc&) {
             rejectResp = resp;
             LOG(EXTENSION_LOG_WARNING,
@@ -461,27 +565,6 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
                 *mutationResponse->getBySeqno());
             return ENGINE_ENOMEM;
         }
-
-        if (enableValueCompression) {
-            /**
-             * If value compression is enabled, the producer will need
-             * to snappy-compress the document before transmitting.
-             * Compression will obviously be done only if the datatype
-             * indicates that the value isn't compressed already.
-             */
-            uint32_t sizeBefore = itmCpy->getNBytes();
-            if (!itmCpy->compressValue(
-                            engine_.getDcpConnMap().getMinCompressionRatio())) {
-                LOG(EXTENSION_LOG_WARNING,
-                    "%s Failed to snappy compress an uncompressed value!",
-                    logHeader());
-            }
-            uint32_t sizeAfter = itmCpy->getNBytes();
-
-            if (sizeAfter < sizeBefore) {
-                log.acknowledge(sizeBefore - sizeAfter);
-            }
-        }
     }
 
     EventuallyPersistentEngine *epe = ObjectRegistry::onSwitchThread(NULL,
@@ -496,9 +579,9 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
         }
         case DcpResponse::Event::Mutation:
         {
-            if (itmCpy == nullptr) {
+            if (itm == nullptr) {
                 throw std::logic_error(
-                    "DcpProducer::step(Mutation): itmCpy must be != nullptr");
+                    "DcpProducer::step(Mutation): itm must be != nullptr");
             }
             std::pair<const char*, uint16_t> meta{nullptr, 0};
             if (mutationResponse->getExtMetaData()) {
@@ -507,7 +590,7 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
             ret = producers->mutation(
                     getCookie(),
                     mutationResponse->getOpaque(),
-                    itmCpy,
+                    itm,
                     mutationResponse->getVBucket(),
                     *mutationResponse->getBySeqno(),
                     mutationResponse->getRevSeqno(),
@@ -520,9 +603,9 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
         }
         case DcpResponse::Event::Deletion:
         {
-            if (itmCpy == nullptr) {
+            if (itm == nullptr) {
                 throw std::logic_error(
-                    "DcpProducer::step(Deletion): itmCpy must be != nullptr");
+                    "DcpProducer::step(Deletion): itm must be != nullptr");
             }
             std::pair<const char*, uint16_t> meta{nullptr, 0};
             if (mutationResponse->getExtMetaData()) {
@@ -530,7 +613,7 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
             }
             ret = producers->deletion(getCookie(),
                                       mutationResponse->getOpaque(),
-                                      itmCpy,
+                                      itm,
                                       mutationResponse->getVBucket(),
                                       *mutationResponse->getBySeqno(),
                                       mutationResponse->getRevSeqno(),
@@ -587,9 +670,7 @@ ENGINE_ERROR_CODE DcpProducer::step(struct dcp_message_producers* producers) {
     } else {
         delete resp;
     }
-
-    lastSendTime = ep_current_time();
-    return (ret == ENGINE_SUCCESS) ? ENGINE_WANT_MORE : ret;
+    return ret;
 }
 
 ENGINE_ERROR_CODE DcpProducer::bufferAcknowledgement(uint32_t opaque,
@@ -786,11 +867,16 @@ void DcpProducer::notifyBackfillManager() {
     backfillMgr->wakeUpTask();
 }
 
-bool DcpProducer::recordBackfillManagerBytesRead(size_t bytes, bool force) {
+bool DcpProducer::recordBackfillManagerBytesRead(size_t bytes,
+                                                 bool force,
+                                                 bool shared) {
     if (force) {
         backfillMgr->bytesForceRead(bytes);
         return true;
     }
+    if (shared) {
+        return backfillMgr->bytesCheckAndReadShared(bytes);
+    }
     return backfillMgr->bytesCheckAndRead(bytes);
 }
 
@@ -952,7 +1038,18 @@ const char* DcpProducer::getType() const {
     }
 }
 
-DcpResponse* DcpProducer::getNextItem() {
+DcpResponse* DcpProducer::getNextItem(StepBatch* batch) {
+    if (batch && batch->stream) {
+        // Carry on with the stream the batch's last message came from; its
+        // vbucket is still in the ready queue, so it isn't missed if empty.
+        DcpResponse* op = batch->stream->next();
+        if (op) {
+            countSent(*op);
+            return op;
+        }
+        batch->stream.reset();
+    }
+
     do {
         setPaused(false);
 
@@ -998,15 +1095,10 @@ DcpResponse* DcpProducer::getNextItem() {
 
             ready.pushUnique(vbucket);
 
-            if (op->getEvent() == DcpResponse::Event::Mutation ||
-                op->getEvent() == DcpResponse::Event::Deletion ||
-                op->getEvent() == DcpResponse::Event::Expiration ||
-                op->getEvent() == DcpResponse::Event::SystemEvent) {
-                itemsSent++;
+            if (batch) {
+                batch->stream = stream;
             }
-
-            totalBytesSent.fetch_add(op->getMessageSize());
-
+            countSent(*op);
             return op;
         }
 
@@ -1021,6 +1113,17 @@ DcpResponse* DcpProducer::getNextItem() {
     return NULL;
 }
 
+void DcpProducer::countSent(DcpResponse& op) {
+    if (op.getEvent() == DcpResponse::Event::Mutation ||
+        op.getEvent() == DcpResponse::Event::Deletion ||
+        op.getEvent() == DcpResponse::Event::Expiration ||
+        op.getEvent() == DcpResponse::Event::SystemEvent) {
+        itemsSent++;
+    }
+
+    totalBytesSent.fetch_add(op.getMessageSize());
+}
+
 void DcpProducer::setDisconnect(bool disconnect) {
     ConnHandler::setDisconnect(disconnect);
 
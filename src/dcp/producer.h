@@ -26,6 +26,7 @@
 
 class BackfillManager;
 class DcpResponse;
+class MutationResponse;
 
 class DcpProducer : public Producer {
 public:
@@ -138,7 +139,9 @@ enum class MutationType {
     void notifyStreamReady(uint16_t vbucket);
 
     void notifyBackfillManager();
-    bool recordBackfillManagerBytesRead(size_t bytes, bool force);
+    bool recordBackfillManagerBytesRead(size_t bytes,
+                                        bool force,
+                                        bool shared = false);
     void recordBackfillManagerBytesSent(size_t bytes);
     void scheduleBackfillManager(VBucket& vb,
                                  const active_stream_t& s,
@@ -271,6 +274,16 @@ protected:
      */
     ENGINE_ERROR_CODE maybeSendNoop(struct dcp_message_producers* producers);
 
+    /**
+     * Get the item of the given response to hand to memcached (which
+     * releases it once sent), with its value in the form this connection
+     * sends: the item itself if it already is, otherwise a copy with its
+     * value compressed or inflated as needed.
+     *
+     * @throws std::bad_alloc if a copy could not be allocated
+     */
+    Item* getItemToSend(MutationResponse& response);
+
     /**
      * Create the ActiveStreamCheckpointProcessorTask and assign to
      * checkpointCreatorTask
@@ -293,7 +306,26 @@ protected:
 
     Couchbase::RelaxedAtomic<rel_time_t> lastReceiveTime;
 
-    DcpResponse* getNextItem();
+    /**
+     * State of a step() sending a batch of messages: the stream the last
+     * message came from, which the next may be taken from directly.
+     */
+    struct StepBatch {
+        stream_t stream;
+    };
+
+    /**
+     * Get the next message to send, from the batch's stream if it has one
+     * (and the batch is given), else from the next ready stream.
+     */
+    DcpResponse* getNextItem(StepBatch* batch = nullptr);
+
+    /// Send the given message, taking ownership of it.
+    ENGINE_ERROR_CODE sendResponse(struct dcp_message_producers* producers,
+                                   DcpResponse* resp);
+
+    /// Account for the given message being sent.
+    void countSent(DcpResponse& op);
 
     size_t getItemsRemaining();
     stream_t findStreamByVbid(uint16_t vbid);
@@ -0,0 +1,113 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "spsc_ring_buffer.h"
+
+#include <atomic>
+#include <deque>
+
+class DcpResponse;
+
+/**
+ * The queue of messages a Stream has ready to send.
+ *
+ * Messages go into a SpscRingBuffer; if that is full they go into an
+ * (unbounded) overflow deque until it is drained, so the order of the
+ * messages is kept. Pushes, and pops which may need to refill the ring from
+ * the overflow deque, must be made holding a lock (the Stream's
+ * streamMutex); frontLockFree() and pop() let the one consumer send what is
+ * in the ring without taking that lock, while a producer pushes more.
+ *
+ * The queue doesn't own the messages.
+ */
+class ReadyQueue {
+public:
+    static const size_t DefaultRingCapacity = 256;
+
+    explicit ReadyQueue(size_t ringCapacity = DefaultRingCapacity)
+        : ring(ringCapacity), overflowSize(0) {
+    }
+
+    /// Add a message to the back of the queue (with the lock held).
+    void push(DcpResponse* resp) {
+        if (overflowSize.load(std::memory_order_relaxed) != 0 ||
+            !ring.push(resp)) {
+            overflow.push_back(resp);
+            overflowSize.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /// Consumer: @return true if there are no messages to pop.
+    bool empty() const {
+        return ring.empty() &&
+               overflowSize.load(std::memory_order_relaxed) == 0;
+    }
+
+    /**
+     * Consumer: @return the message at the front; the queue mustn't be
+     * empty. The lock must be held unless frontLockFree() just returned
+     * non-null (so the front message is in the ring).
+     */
+    DcpResponse* front() {
+        if (ring.empty()) {
+            refill();
+        }
+        return ring.front();
+    }
+
+    /**
+     * Consumer, without the lock: @return the message at the front if it is
+     * in the ring, else null (the queue is empty or the rest of it is in the
+     * overflow deque).
+     */
+    DcpResponse* frontLockFree() const {
+        return ring.empty() ? nullptr : ring.front();
+    }
+
+    /// Consumer: remove the message at the front (as returned by front() or
+    /// frontLockFree()).
+    void pop() {
+        ring.pop();
+    }
+
+    /// @return the number of messages in the queue (a snapshot unless the
+    ///         lock is held by the consumer).
+    size_t size() const {
+        return ring.size() + overflowSize.load(std::memory_order_relaxed);
+    }
+
+private:
+    /// Move what fits of the overflow deque into the (empty) ring; with the
+    /// lock held the consumer is the only producer.
+    void refill() {
+        while (!overflow.empty() && ring.push(overflow.front())) {
+            overflow.pop_front();
+            overflowSize.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    SpscRingBuffer<DcpResponse*> ring;
+    // Messages pushed while the ring was full (or the deque non-empty).
+    // Guarded by the lock.
+    std::deque<DcpResponse*> overflow;
+    // Size of the overflow deque, so it can be checked without the lock.
+    std::atomic<size_t> overflowSize;
+};
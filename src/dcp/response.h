@@ -337,6 +337,24 @@ public:
         return new Item(*item_, keyOnly);
     }
 
+    /**
+     * Get the item itself to send, rather than a copy: a reference to the
+     * shared queued_item which the receiver must drop (as the engine's item
+     * release does). Only possible if the whole item is to be sent.
+     */
+    Item* getItemReference() {
+        if (keyOnly) {
+            throw std::logic_error(
+                    "MutationResponse::getItemReference: response is key "
+                    "only");
+        }
+        return queued_item(item_).release();
+    }
+
+    bool isKeyOnly() const {
+        return keyOnly;
+    }
+
     uint16_t getVBucket() {
         return item_->getVBucketId();
     }
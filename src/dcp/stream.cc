@@ -149,20 +149,23 @@ void Stream::pushToReadyQ(DcpResponse* resp)
 {
    /* expect streamMutex.ownsLock() == true */
     if (resp) {
-        readyQ.push(resp);
+        // Account for resp before pushing it, as the consumer may pop it
+        // without streamMutex.
         if (!resp->isMetaEvent()) {
             readyQ_non_meta_items++;
         }
         readyQueueMemory.fetch_add(resp->getMessageSize(),
                                    std::memory_order_relaxed);
+        readyQ.push(resp);
     }
 }
 
 void Stream::popFromReadyQ(void)
 {
-    /* expect streamMutex.ownsLock() == true */
+    /* expect streamMutex.ownsLock() == true, or the front of the readyQ
+       to have been returned by frontLockFree() */
     if (!readyQ.empty()) {
-        const auto& front = readyQ.front();
+        auto* front = readyQ.front();
         if (!front->isMetaEvent()) {
             readyQ_non_meta_items--;
         }
@@ -309,6 +312,12 @@ ActiveStream::~ActiveStream() {
 }
 
 DcpResponse* ActiveStream::next() {
+    DcpResponse* response = nextInMemoryItem();
+    if (response) {
+        itemsReady.store(true);
+        return response;
+    }
+
     std::lock_guard<std::mutex> lh(streamMutex);
     return next(lh);
 }
@@ -418,9 +427,10 @@ void ActiveStream::markDiskSnapshot(uint64_t startSeqno, uint64_t endSeqno) {
     }
 }
 
-bool ActiveStream::backfillReceived(std::unique_ptr<Item> itm,
+bool ActiveStream::backfillReceived(queued_item itm,
                                     backfill_source_t backfill_source,
-                                    bool force) {
+                                    bool force,
+                                    bool shared) {
     if (!itm) {
         return false;
     }
@@ -428,10 +438,9 @@ bool ActiveStream::backfillReceived(std::unique_ptr<Item> itm,
     if (itm->shouldReplicate()) {
         std::unique_lock<std::mutex> lh(streamMutex);
         if (isBackfilling()) {
-            queued_item qi(std::move(itm));
-            std::unique_ptr<DcpResponse> resp(makeResponseFromItem(qi));
+            std::unique_ptr<DcpResponse> resp(makeResponseFromItem(itm));
             if (!producer->recordBackfillManagerBytesRead(
-                        resp->getApproximateSize(), force)) {
+                        resp->getApproximateSize(), force, shared)) {
                 // Deleting resp may also delete itm (which is owned by resp)
                 resp.reset();
                 return false;
@@ -794,6 +803,32 @@ DcpResponse* ActiveStream::nextQueuedItem() {
     return NULL;
 }
 
+DcpResponse* ActiveStream::nextInMemoryItem() {
+    // Only the producer's thread sends, transitions the stream out of
+    // InMemory (other than to Dead, after which any items left are still
+    // sent) and updates lastSentSeqno; so these checks hold until the
+    // message is popped. System events may change the separator, which
+    // is left to the locked path.
+    if (!isInMemory() || lastSentSeqno.load() >= end_seqno_) {
+        return NULL;
+    }
+
+    DcpResponse* response = readyQ.frontLockFree();
+    if (!response ||
+        response->getEvent() == DcpResponse::Event::SystemEvent ||
+        !producer->bufferLogInsert(response->getMessageSize())) {
+        return NULL;
+    }
+
+    auto seqno = response->getBySeqno();
+    if (seqno) {
+        lastSentSeqno.store(*seqno);
+        itemsFromMemoryPhase++;
+    }
+    popFromReadyQ();
+    return response;
+}
+
 bool ActiveStream::nextCheckpointItem() {
     VBucketPtr vbucket = engine->getVBucket(vb_);
     if (vbucket && vbucket->checkpointManager.getNumItemsForCursor(name_) > 0) {
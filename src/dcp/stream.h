@@ -24,6 +24,7 @@
 #include "ext_meta_parser.h"
 #include "dcp/dcp-types.h"
 #include "dcp/producer.h"
+#include "dcp/ready_queue.h"
 #include "response.h"
 #include "vbucket.h"
 
@@ -187,7 +188,9 @@ protected:
 
     std::atomic<bool> itemsReady;
     std::mutex streamMutex;
-    std::queue<DcpResponse*> readyQ;
+    // Pushed to (and popped from, bar ActiveStream::nextInMemoryItem) with
+    // streamMutex held.
+    ReadyQueue readyQ;
 
     // Number of items in the readyQ that are not meta items. Used for
     // calculating getItemsRemaining(). Atomic so it can be safely read by
@@ -242,9 +245,21 @@ public:
 
     void markDiskSnapshot(uint64_t startSeqno, uint64_t endSeqno);
 
-    bool backfillReceived(std::unique_ptr<Item> itm,
+    /**
+     * Queue an item read by the backfill (which may be shared with the
+     * other streams a disk scan is read for).
+     *
+     * @param shared true if the item was read by a disk scan which another
+     *        stream's backfill is running, so only the backfill buffer (not
+     *        the scan buffer) of this stream's connection is charged
+     *
+     * @return false if the backfill buffer is full, so the backfill should
+     *         pause and pass the item again later
+     */
+    bool backfillReceived(queued_item itm,
                           backfill_source_t backfill_source,
-                          bool force);
+                          bool force,
+                          bool shared = false);
 
     void completeBackfill();
 
@@ -349,6 +364,16 @@ private:
 
     DcpResponse* next(std::lock_guard<std::mutex>& lh);
 
+    /**
+     * Send the next message of an in-memory stream without taking
+     * streamMutex, if it is a mutation (or deletion) already in the
+     * readyQ's ring; the steady state of replication, where the
+     * checkpoint processor task pushes snapshots while the producer pops.
+     *
+     * @return the message, or null if it must be left to the locked path
+     */
+    DcpResponse* nextInMemoryItem();
+
     DcpResponse* inMemoryPhase();
 
     DcpResponse* takeoverSendPhase();
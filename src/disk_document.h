@@ -0,0 +1,117 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include "item.h"
+
+#include <memcached/dockey.h>
+
+/**
+ * A document read from disk by a KVStore scan, handed to a
+ * Callback<DiskDocument> for as long as the callback runs.
+ *
+ * Unlike an Item it is not heap allocated and does not own a copy of the
+ * key (which refers into the scan's buffers); the value is a Blob, which a
+ * StoredValue created from the document shares rather than copies. So
+ * loading a document into the HashTable costs just the StoredValue and
+ * Blob allocations.
+ *
+ * Offers the subset of the Item interface which StoredValues (and the
+ * HashTable) are created and updated from.
+ */
+class DiskDocument {
+public:
+    DiskDocument(const DocKey& key,
+                 const value_t& value,
+                 const ItemMetaData& metaData,
+                 int64_t bySeqno,
+                 uint16_t vbid,
+                 bool deleted)
+        : key(key),
+          value(value),
+          metaData(metaData),
+          bySeqno(bySeqno),
+          vbucketId(vbid),
+          deleted(deleted) {
+    }
+
+    DiskDocument(const DiskDocument&) = delete;
+    DiskDocument& operator=(const DiskDocument&) = delete;
+
+    const DocKey& getKey() const {
+        return key;
+    }
+
+    const value_t& getValue() const {
+        return value;
+    }
+
+    uint64_t getCas() const {
+        return metaData.cas;
+    }
+
+    void setCas(uint64_t cas) {
+        metaData.cas = cas;
+    }
+
+    uint64_t getRevSeqno() const {
+        return metaData.revSeqno;
+    }
+
+    uint32_t getFlags() const {
+        return metaData.flags;
+    }
+
+    time_t getExptime() const {
+        return metaData.exptime;
+    }
+
+    int64_t getBySeqno() const {
+        return bySeqno;
+    }
+
+    uint16_t getVBucketId() const {
+        return vbucketId;
+    }
+
+    bool isDeleted() const {
+        return deleted;
+    }
+
+    protocol_binary_datatype_t getDataType() const {
+        return value ? value->getDataType() : PROTOCOL_BINARY_RAW_BYTES;
+    }
+
+    uint32_t getNBytes() const {
+        return value ? static_cast<uint32_t>(value->vlength()) : 0;
+    }
+
+    uint8_t getNRUValue() const {
+        return INITIAL_NRU_VALUE;
+    }
+
+private:
+    const DocKey key;
+    const value_t value;
+    ItemMetaData metaData;
+    const int64_t bySeqno;
+    const uint16_t vbucketId;
+    const bool deleted;
+};
@@ -18,6 +18,7 @@
 #include "ep_bucket.h"
 
 #include "bgfetcher.h"
+#include "bloomfilter_file.h"
 #include "ep_engine.h"
 #include "ep_vb.h"
 #include "failover-table.h"
@@ -53,9 +54,37 @@ void EPBucket::deinitialize() {
     stopFlusher();
     stopBgFetcher();
 
+    if (!stats.forceShutdown && engine.getConfiguration().isBfilterEnabled()) {
+        saveBloomFilters();
+    }
+
     KVBucket::deinitialize();
 }
 
+void EPBucket::saveBloomFilters() {
+    const std::string dbname = engine.getConfiguration().getDbname();
+    size_t saved = 0;
+    for (auto vbid : vbMap.getBuckets()) {
+        VBucketPtr vb = getVBucket(vbid);
+        if (!vb) {
+            continue;
+        }
+        try {
+            if (vb->saveFilter(BloomFilterFile::getFileName(dbname, vbid))) {
+                ++saved;
+            }
+        } catch (const std::exception& e) {
+            LOG(EXTENSION_LOG_WARNING,
+                "EPBucket::saveBloomFilters: (vb %" PRIu16 ") %s",
+                vbid,
+                e.what());
+        }
+    }
+    LOG(EXTENSION_LOG_NOTICE,
+        "EPBucket::saveBloomFilters: saved %" PRIu64 " bloom filters",
+        uint64_t(saved));
+}
+
 void EPBucket::reset() {
     KVBucket::reset();
 
@@ -58,6 +58,12 @@ public:
     /// Stops the background fetcher for each shard.
     void stopBgFetcher();
 
+    /**
+     * Save every vBucket's bloom filter, to be loaded by the next warmup.
+     * Only valid once the flushers have persisted everything.
+     */
+    void saveBloomFilters();
+
     std::pair<uint64_t, bool> getLastPersistedCheckpointId(
             uint16_t vb) override;
 
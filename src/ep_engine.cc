@@ -446,8 +446,12 @@ protocol_binary_response_status EventuallyPersistentEngine::setFlushParam(
     try {
         if (strcmp(keyz, "bg_fetch_delay") == 0) {
             getConfiguration().setBgFetchDelay(std::stoull(valz));
+        } else if (strcmp(keyz, "bg_fetch_max_concurrency") == 0) {
+            getConfiguration().setBgFetchMaxConcurrency(std::stoull(valz));
         } else if (strcmp(keyz, "flushall_enabled") == 0) {
             getConfiguration().setFlushallEnabled(cb_stob(valz));
+        } else if (strcmp(keyz, "flusher_pipeline_enabled") == 0) {
+            getConfiguration().setFlusherPipelineEnabled(cb_stob(valz));
         } else if (strcmp(keyz, "max_size") == 0) {
             size_t vsize = std::stoull(valz);
 
@@ -504,6 +508,8 @@ protocol_binary_response_status EventuallyPersistentEngine::setFlushParam(
             getConfiguration().setAlogTaskTime(std::stoull(valz));
         } else if (strcmp(keyz, "pager_active_vb_pcnt") == 0) {
             getConfiguration().setPagerActiveVbPcnt(std::stoull(valz));
+        } else if (strcmp(keyz, "pager_algorithm") == 0) {
+            getConfiguration().setPagerAlgorithm(valz);
         } else if (strcmp(keyz, "warmup_min_memory_threshold") == 0) {
             getConfiguration().setWarmupMinMemoryThreshold(std::stoull(valz));
         } else if (strcmp(keyz, "warmup_min_items_threshold") == 0) {
@@ -548,8 +554,21 @@ protocol_binary_response_status EventuallyPersistentEngine::setFlushParam(
             runDefragmenterTask();
         } else if (strcmp(keyz, "compaction_write_queue_cap") == 0) {
             getConfiguration().setCompactionWriteQueueCap(std::stoull(valz));
+        } else if (strcmp(keyz, "compaction_max_bandwidth") == 0) {
+            getConfiguration().setCompactionMaxBandwidth(std::stoull(valz));
+        } else if (strcmp(keyz, "compaction_commit_latency_target") == 0) {
+            getConfiguration().setCompactionCommitLatencyTarget(
+                    std::stoull(valz));
         } else if (strcmp(keyz, "dcp_min_compression_ratio") == 0) {
             getConfiguration().setDcpMinCompressionRatio(std::stof(valz));
+        } else if (strcmp(keyz, "dcp_compression_cache_size") == 0) {
+            getConfiguration().setDcpCompressionCacheSize(std::stoull(valz));
+        } else if (strcmp(keyz, "dcp_backfill_share_scans") == 0) {
+            getConfiguration().setDcpBackfillShareScans(cb_stob(valz));
+        } else if (strcmp(keyz, "compression_mode") == 0) {
+            getConfiguration().setCompressionMode(valz);
+        } else if (strcmp(keyz, "compression_min_ratio") == 0) {
+            getConfiguration().setCompressionMinRatio(std::stof(valz));
         } else if (strcmp(keyz, "access_scanner_run") == 0) {
             if (!(runAccessScannerTask())) {
                 rv = PROTOCOL_BINARY_RESPONSE_ETMPFAIL;
@@ -622,6 +641,14 @@ protocol_binary_response_status EventuallyPersistentEngine::setDcpParam(
             validate(v, size_t(1), std::numeric_limits<size_t>::max());
             getConfiguration().setDcpConsumerProcessBufferedMessagesBatchSize(
                     v);
+        } else if (strcmp(keyz, "dcp_producer_step_batch_items") == 0) {
+            size_t v = atoi(valz);
+            checkNumeric(valz);
+            validate(v, size_t(1), size_t(100000));
+            getConfiguration().setDcpProducerStepBatchItems(v);
+        } else if (strcmp(keyz, "dcp_producer_step_batch_bytes") == 0) {
+            checkNumeric(valz);
+            getConfiguration().setDcpProducerStepBatchBytes(std::stoull(valz));
         } else {
             msg = "Unknown config param";
             rv = PROTOCOL_BINARY_RESPONSE_KEY_ENOENT;
@@ -1241,6 +1268,7 @@ static ENGINE_ERROR_CODE processUnknownCommand(
     }
 
     if (itm) {
+        h->decompressValueIfRequired(cookie, *itm);
         uint32_t flags = itm->getFlags();
         rv = sendResponse(response,
                           static_cast<const void*>(itm->getKey().data()),
@@ -2157,6 +2185,7 @@ cb::EngineErrorItemPair EventuallyPersistentEngine::get_and_touch(const void* co
     if (rv == ENGINE_SUCCESS) {
         ++stats.numOpsGet;
         ++stats.numOpsStore;
+        decompressValueIfRequired(cookie, *gv.getValue());
         return std::make_pair(cb::engine_errc::success,
                               cb::unique_item_ptr{gv.getValue(),
                                                   cb::ItemDeleter{handle}});
@@ -2235,6 +2264,7 @@ cb::EngineErrorItemPair EventuallyPersistentEngine::get_if(const void* cookie,
         // Currently
         if (filter(item->toItemInfo(vb_uuid))) {
             if (!gv.isPartial()) {
+                decompressValueIfRequired(cookie, *item);
                 return std::make_pair(cb::engine_errc::success,
                                cb::unique_item_ptr{ret.release(),
                                                    cb::ItemDeleter{handle}});
@@ -2277,12 +2307,28 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::get_locked(const void* cookie,
 
     if (result.getStatus() == ENGINE_SUCCESS) {
         ++stats.numOpsGet;
+        decompressValueIfRequired(cookie, *result.getValue());
         *itm = result.getValue();
     }
 
     return result.getStatus();
 }
 
+void EventuallyPersistentEngine::decompressValueIfRequired(const void* cookie,
+                                                           Item& itm) {
+    if (!mcbp::datatype::is_snappy(itm.getDataType()) ||
+        isSnappySupported(cookie)) {
+        return;
+    }
+
+    if (!itm.decompressValue()) {
+        LOG(EXTENSION_LOG_WARNING,
+            "EventuallyPersistentEngine::decompressValueIfRequired: "
+            "Failed to inflate a compressed value for vb %" PRIu16,
+            itm.getVBucketId());
+    }
+}
+
 ENGINE_ERROR_CODE EventuallyPersistentEngine::unlock(const void* cookie,
                                                      const DocKey& key,
                                                      uint16_t vbucket,
@@ -2452,6 +2498,12 @@ inline uint16_t EventuallyPersistentEngine::doWalkTapQueue(const void *cookie,
     case TAP_DELETION:
         *itm = it;
         if (ret == TAP_MUTATION) {
+            // TAP connections cannot negotiate snappy.
+            if (!it->decompressValue()) {
+                LOG(EXTENSION_LOG_WARNING,
+                    "%s Failed to inflate a compressed value for vb %" PRIu16,
+                    connection->logHeader(), it->getVBucketId());
+            }
             *nes = TapEngineSpecific::packSpecificData(ret, connection,
                                                        it->getRevSeqno(), nru);
             *es = connection->specificData;
@@ -3008,7 +3060,7 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::processTapAck(const void *cookie,
 ENGINE_ERROR_CODE EventuallyPersistentEngine::memoryCondition() {
     // Do we think it's possible we could free something?
     bool haveEvidenceWeCanFreeMemory =
-        (stats.getMaxDataSize() > stats.memOverhead->load());
+        (stats.getMaxDataSize() > stats.memOverhead.load());
     if (haveEvidenceWeCanFreeMemory) {
         // Look for more evidence by seeing if we have resident items.
         VBucketCountVisitor countVisitor(vbucket_state_active);
@@ -3109,6 +3161,8 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
                         flusher->stateName(), add_stat, cookie);
         add_casted_stat("ep_flusher_todo",
                         epstats.flusher_todo, add_stat, cookie);
+        add_casted_stat("ep_flusher_pipeline_depth",
+                        epstats.flusherPipelineDepth, add_stat, cookie);
         add_casted_stat("ep_total_persisted",
                         epstats.totalPersisted, add_stat, cookie);
         add_casted_stat("ep_uncommitted_items",
@@ -3202,6 +3256,8 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
 
     add_casted_stat("ep_pending_compactions", epstats.pendingCompactions,
                     add_stat, cookie);
+    add_casted_stat("ep_compaction_bandwidth_limit",
+                    kvBucket->getCompactionBandwidthLimit(), add_stat, cookie);
     add_casted_stat("ep_rollback_count", epstats.rollbackCount,
                     add_stat, cookie);
 
@@ -3244,6 +3300,8 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doEngineStats(const void *cookie,
                         epstats.bgLoad,
                         add_stat, cookie);
     }
+    add_casted_stat("ep_bg_fetch_queue_depth", epstats.bgFetchQueueDepthHisto,
+                    add_stat, cookie);
 
     add_casted_stat("ep_degraded_mode", isDegradedMode(), add_stat, cookie);
 
@@ -3410,8 +3468,28 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doMemoryStats(const void *cookie,
     add_casted_stat("ep_storedval_overhead", "unknown", add_stat, cookie);
 #endif
     add_casted_stat("ep_storedval_num", stats.numStoredVal, add_stat, cookie);
+    add_casted_stat("ep_storedval_inline_num", stats.numInlineStoredVal,
+                    add_stat, cookie);
+    add_casted_stat("ep_storedval_inline_savings", stats.inlineValueSavings,
+                    add_stat, cookie);
+    add_casted_stat("ep_storedval_inline_pinned", stats.inlineStoragePinned,
+                    add_stat, cookie);
     add_casted_stat("ep_item_num", stats.numItem, add_stat, cookie);
 
+    const size_t cacheHits = stats.cacheHits;
+    const size_t cacheMisses = stats.cacheMisses;
+    add_casted_stat("ep_cache_hits", cacheHits, add_stat, cookie);
+    add_casted_stat("ep_cache_misses", cacheMisses, add_stat, cookie);
+    add_casted_stat("ep_pager_hit_ratio_before",
+                    EPStats::getHitRatio(stats.cacheHitsBeforeEviction,
+                                         stats.cacheMissesBeforeEviction),
+                    add_stat, cookie);
+    add_casted_stat("ep_pager_hit_ratio_after",
+                    EPStats::getHitRatio(
+                            cacheHits - stats.cacheHitsAtEviction,
+                            cacheMisses - stats.cacheMissesAtEviction),
+                    add_stat, cookie);
+
     std::map<std::string, size_t> alloc_stats;
     MemoryTracker::getInstance(*getServerApiFunc()->alloc_hooks)->
         getAllocatorStats(alloc_stats);
@@ -3543,8 +3621,24 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doHashStats(const void *cookie,
                 add_casted_stat(buf, depthVisitor.size, add_stat, cookie);
                 checked_snprintf(buf, sizeof(buf), "vb_%d:resized", vbid);
                 add_casted_stat(buf, vb->ht.getNumResizes(), add_stat, cookie);
+                checked_snprintf(buf, sizeof(buf), "vb_%d:resize_target",
+                                 vbid);
+                add_casted_stat(buf, vb->ht.getResizeTargetSize(), add_stat,
+                                cookie);
                 checked_snprintf(buf, sizeof(buf), "vb_%d:mem_size", vbid);
                 add_casted_stat(buf, vb->ht.memSize, add_stat, cookie);
+                checked_snprintf(buf, sizeof(buf),
+                                 "vb_%d:inline_value_savings", vbid);
+                add_casted_stat(buf, vb->ht.inlineValueSavings, add_stat,
+                                cookie);
+                checked_snprintf(buf, sizeof(buf),
+                                 "vb_%d:compressed_value_size", vbid);
+                add_casted_stat(buf, vb->ht.getCompressedValueSize(),
+                                add_stat, cookie);
+                checked_snprintf(buf, sizeof(buf),
+                                 "vb_%d:uncompressed_value_size", vbid);
+                add_casted_stat(buf, vb->ht.getUncompressedValueSize(),
+                                add_stat, cookie);
                 checked_snprintf(buf, sizeof(buf), "vb_%d:mem_size_counted",
                                  vbid);
                 add_casted_stat(buf, depthVisitor.memUsed, add_stat, cookie);
@@ -3858,6 +3952,10 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doConnAggStats(
         delete it->second;
     }
 
+    if (connType == DCP_CONN) {
+        dcpConnMap_->getCompressionCache().addStats(add_stat, cookie);
+    }
+
     return ENGINE_SUCCESS;
 }
 
@@ -3960,6 +4058,7 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doDcpStats(const void *cookie,
                     dcpConnMap_->getNumActiveSnoozingBackfills(), add_stat, cookie);
     add_casted_stat("ep_dcp_max_running_backfills",
                     dcpConnMap_->getMaxActiveSnoozingBackfills(), add_stat, cookie);
+    dcpConnMap_->getDiskScanRegistry().addStats(add_stat, cookie);
 
     dcpConnMap_->addStats(add_stat, cookie);
     return ENGINE_SUCCESS;
@@ -4097,6 +4196,9 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doTimingStats(const void *cookie,
     // Misc
     add_casted_stat("notify_io", stats.notifyIOHisto, add_stat, cookie);
     add_casted_stat("batch_read", stats.getMultiHisto, add_stat, cookie);
+    add_casted_stat("bg_fetch_read", stats.bgFetchReadHisto, add_stat, cookie);
+    add_casted_stat("ht_resize_lookup", stats.htResizeLookupHisto,
+                    add_stat, cookie);
 
     // Disk stats
     add_casted_stat("disk_insert", stats.diskInsertHisto, add_stat, cookie);
@@ -4104,6 +4206,8 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::doTimingStats(const void *cookie,
     add_casted_stat("disk_del", stats.diskDelHisto, add_stat, cookie);
     add_casted_stat("disk_vb_del", stats.diskVBDelHisto, add_stat, cookie);
     add_casted_stat("disk_commit", stats.diskCommitHisto, add_stat, cookie);
+    add_casted_stat("disk_commit_overlap", stats.flusherCommitOverlapHisto,
+                    add_stat, cookie);
 
     add_casted_stat("item_alloc_sizes", stats.itemAllocSizeHisto,
                     add_stat, cookie);
@@ -6022,6 +6126,7 @@ ENGINE_ERROR_CODE EventuallyPersistentEngine::getRandomKey(const void *cookie,
 
     if (ret == ENGINE_SUCCESS) {
         Item *it = gv.getValue();
+        decompressValueIfRequired(cookie, *it);
         uint32_t flags = it->getFlags();
         ret = sendResponse(response, static_cast<const void *>(it->getKey().data()),
                            it->getKey().size(),
@@ -163,7 +163,14 @@ public:
     void itemRelease(const void* cookie, item *itm)
     {
         (void)cookie;
-        delete (Item*)itm;
+        auto* it = reinterpret_cast<Item*>(itm);
+        // DCP hands memcached references to the queued_items it streams
+        // rather than copies (see DcpProducer::step).
+        if (queued_item::isReferenceCounted(it)) {
+            queued_item::dropReference(it);
+        } else {
+            delete it;
+        }
     }
 
     ENGINE_ERROR_CODE get(const void* cookie,
@@ -176,7 +183,27 @@ public:
         GetValue gv(kvBucket->get(key, vbucket, cookie, options));
         ENGINE_ERROR_CODE ret = gv.getStatus();
 
+        // A get which has to wait for a background fetch is retried once
+        // the fetch completes. Mark the cookie so the retry isn't counted
+        // again: each get is either a cache hit or a cache miss. A failed
+        // fetch isn't retried, so its completion clears the mark (see
+        // KVBucket::notifyBGFetchComplete).
+        const bool retry = getEngineSpecific(cookie) != nullptr;
+        if (ret == ENGINE_EWOULDBLOCK) {
+            if (!retry) {
+                if (options & TRACK_REFERENCE) {
+                    ++stats.cacheMisses;
+                }
+                storeEngineSpecific(cookie, this);
+            }
+        } else if (retry) {
+            storeEngineSpecific(cookie, NULL);
+        } else if (ret == ENGINE_SUCCESS && (options & TRACK_REFERENCE)) {
+            ++stats.cacheHits;
+        }
+
         if (ret == ENGINE_SUCCESS) {
+            decompressValueIfRequired(cookie, *gv.getValue());
             *itm = gv.getValue();
             if (options & TRACK_STATISTICS) {
                 ++stats.numOpsGet;
@@ -373,6 +400,18 @@ public:
         return isDatatypeSupported(cookie, PROTOCOL_BINARY_DATATYPE_XATTR);
     }
 
+    bool isSnappySupported(const void* cookie) {
+        return isDatatypeSupported(cookie, PROTOCOL_BINARY_DATATYPE_SNAPPY);
+    }
+
+    /**
+     * Inflate the value of an item about to be returned to the given
+     * connection, if the value is held snappy-compressed (see
+     * compression_mode) and the connection did not negotiate snappy.
+     * The item must be a private copy - its value is replaced.
+     */
+    void decompressValueIfRequired(const void* cookie, Item& itm);
+
     bool isCollectionsSupported(const void* cookie) {
         EventuallyPersistentEngine* epe =
                 ObjectRegistry::onSwitchThread(NULL, true);
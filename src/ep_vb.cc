@@ -52,7 +52,7 @@ EPVBucket::EPVBucket(id_type i,
               lastSnapEnd,
               std::move(table),
               flusherCb,
-              std::make_unique<StoredValueFactory>(st),
+              makeStoredValueFactory(st, config),
               std::move(newSeqnoCb),
               config,
               evictionPolicy,
@@ -68,6 +68,15 @@ EPVBucket::EPVBucket(id_type i,
       shard(kvshard) {
 }
 
+std::unique_ptr<AbstractStoredValueFactory> EPVBucket::makeStoredValueFactory(
+        EPStats& st, Configuration& config) {
+    const size_t maxInlineSize = config.getHtInlineValueMaxSize();
+    if (maxInlineSize > 0) {
+        return std::make_unique<CompactStoredValueFactory>(st, maxInlineSize);
+    }
+    return std::make_unique<StoredValueFactory>(st);
+}
+
 EPVBucket::~EPVBucket() {
     if (!pendingBGFetches.empty()) {
         LOG(EXTENSION_LOG_WARNING,
@@ -417,7 +426,7 @@ void EPVBucket::queueBackfillItem(queued_item& qi,
     ++stats.vbBackfillQueueSize;
     ++stats.totalEnqueued;
     doStatsForQueueing(*qi, qi->size());
-    stats.memOverhead->fetch_add(sizeof(queued_item));
+    stats.memOverhead.fetch_add(sizeof(queued_item));
 }
 
 size_t EPVBucket::queueBGFetchItem(const DocKey& key,
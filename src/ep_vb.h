@@ -141,6 +141,13 @@ protected:
                             BgFetcher* bgFetcher);
 
 private:
+    /**
+     * Create the StoredValue factory for the HashTable, as selected by
+     * ht_inline_value_max_size.
+     */
+    static std::unique_ptr<AbstractStoredValueFactory> makeStoredValueFactory(
+            EPStats& st, Configuration& config);
+
     std::tuple<StoredValue*, MutationStatus, VBNotifyCtx> updateStoredValue(
             const HashTable::HashBucketLock& hbl,
             StoredValue& v,
@@ -283,7 +283,7 @@ void EphemeralVBucket::queueBackfillItem(
         checkpointManager.setBySeqno(qi->getBySeqno());
     }
     ++stats.totalEnqueued;
-    stats.memOverhead->fetch_add(sizeof(queued_item));
+    stats.memOverhead.fetch_add(sizeof(queued_item));
 }
 
 size_t EphemeralVBucket::purgeTombstones(rel_time_t purgeAge) {
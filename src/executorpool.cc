@@ -132,12 +132,15 @@ ExecutorPool *ExecutorPool::get(void) {
                 ObjectRegistry::getCurrentEngine()->getConfiguration();
             EventuallyPersistentEngine *epe =
                                    ObjectRegistry::onSwitchThread(NULL, true);
-            tmp = new ExecutorPool(config.getMaxThreads(),
-                                   NUM_TASK_GROUPS,
-                                   config.getNumReaderThreads(),
-                                   config.getNumWriterThreads(),
-                                   config.getNumAuxioThreads(),
-                                   config.getNumNonioThreads());
+            tmp = new ExecutorPool(
+                    config.getMaxThreads(),
+                    NUM_TASK_GROUPS,
+                    config.getNumReaderThreads(),
+                    config.getNumWriterThreads(),
+                    config.getNumAuxioThreads(),
+                    config.getNumNonioThreads(),
+                    config.getExecutorPoolScheduler() == "work_stealing",
+                    config.getExecutorPoolFutureQueue() == "timer_wheel");
             ObjectRegistry::onSwitchThread(epe);
             instance.store(tmp);
         }
@@ -156,10 +159,13 @@ void ExecutorPool::shutdown(void) {
 
 ExecutorPool::ExecutorPool(size_t maxThreads, size_t nTaskSets,
                            size_t maxReaders, size_t maxWriters,
-                           size_t maxAuxIO,   size_t maxNonIO) :
+                           size_t maxAuxIO,   size_t maxNonIO,
+                           bool workStealing, bool timerWheel) :
                   numTaskSets(nTaskSets), totReadyTasks(0),
                   isHiPrioQset(false), isLowPrioQset(false), numBuckets(0),
-                  numSleepers(0) {
+                  numSleepers(0), workStealing(workStealing),
+                  timerWheel(timerWheel),
+                  threadsByType(nTaskSets) {
     size_t numCPU = Couchbase::get_available_cpu_count();
     size_t numThreads = (size_t)((numCPU * 3)/4);
     numThreads = (numThreads < EP_MIN_NUM_THREADS) ?
@@ -201,11 +207,22 @@ ExecutorPool::~ExecutorPool(void) {
 // polling frequencies as follows ...
 #define LOW_PRIORITY_FREQ 5 // 1 out of 5 times threads check low priority Q
 
+// Similarly, with work stealing a thread's local queue could be kept busy by
+// tasks which keep rescheduling themselves; threads check the shared queues
+// before their local queue 1 out of SHARED_QUEUE_FREQ times.
+#define SHARED_QUEUE_FREQ 4
+
 TaskQueue *ExecutorPool::_nextTask(ExecutorThread &t, uint8_t tick) {
     if (!tick) {
         return NULL;
     }
 
+    if (workStealing && (tick % SHARED_QUEUE_FREQ)) {
+        if (TaskQueue* q = _nextLocalTask(t)) {
+            return q;
+        }
+    }
+
     task_type_t myq = t.taskType;
     TaskQueue *checkQ; // which TaskQueue set should be polled first
     TaskQueue *checkNextQ; // which set of TaskQueue should be polled next
@@ -225,6 +242,13 @@ TaskQueue *ExecutorPool::_nextTask(ExecutorThread &t, uint8_t tick) {
             return checkQ;
         }
         if (toggle || checkQ == checkNextQ) {
+            if (workStealing) {
+                // Nothing in the shared queues - look for local work (again,
+                // in case it was skipped above) before sleeping.
+                if (TaskQueue* q = _nextLocalTask(t)) {
+                    return q;
+                }
+            }
             TaskQueue *sleepQ = getSleepQ(myq);
             if (sleepQ->fetchNextTask(t, true)) {
                 return sleepQ;
@@ -239,6 +263,56 @@ TaskQueue *ExecutorPool::_nextTask(ExecutorThread &t, uint8_t tick) {
     return NULL;
 }
 
+TaskQueue* ExecutorPool::_nextLocalTask(ExecutorThread& t) {
+    TaskQpair entry;
+    while (t.localQueue.pop(entry) || _stealTask(t, entry)) {
+        ExTask& task = entry.first;
+        TaskQueue* q = entry.second;
+        lessWork(q->getQueueType());
+        if (task->isdead() || task->getWaketime() <= ProcessClock::now()) {
+            t.setCurrentTask(task);
+            return q;
+        }
+        // Snoozed since it was queued - return it to the future queue.
+        q->requeue(task);
+    }
+    return NULL;
+}
+
+bool ExecutorPool::_stealTask(ExecutorThread& t, TaskQpair& entry) {
+    std::lock_guard<cb::ReaderLock> rlh(stealLock.reader());
+    const auto& threads = threadsByType[t.taskType];
+    // Start from a different victim each time, so idle threads don't all
+    // contend on the same queue.
+    const size_t start = t.nextVictim++;
+    for (size_t i = 0; i < threads.size(); ++i) {
+        ExecutorThread* victim = threads[(start + i) % threads.size()];
+        if (victim != &t && victim->localQueue.steal(entry)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ProcessClock::time_point ExecutorPool::reschedule(ExecutorThread& t,
+                                                  ExTask& task,
+                                                  TaskQueue* q) {
+    if (workStealing && task->getWaketime() <= ProcessClock::now()) {
+        t.localQueue.push(task, q);
+        addWork(1, q->getQueueType());
+        return task->getWaketime();
+    }
+    return q->reschedule(task);
+}
+
+void ExecutorPool::drainLocalQueue(ExecutorThread& t) {
+    TaskQpair entry;
+    while (t.localQueue.pop(entry)) {
+        lessWork(entry.second->getQueueType());
+        entry.second->requeue(entry.first);
+    }
+}
+
 TaskQueue *ExecutorPool::nextTask(ExecutorThread &t, uint8_t tick) {
     EventuallyPersistentEngine *epe = ObjectRegistry::onSwitchThread(NULL, true);
     TaskQueue *tq = _nextTask(t, tick);
@@ -486,7 +560,8 @@ void ExecutorPool::_registerTaskable(Taskable& taskable) {
             taskQ->reserve(numTaskSets);
             for (size_t i = 0; i < numTaskSets; ++i) {
                 taskQ->push_back(
-                        new TaskQueue(this, (task_type_t)i, queueName));
+                        new TaskQueue(this, (task_type_t)i, queueName,
+                                      timerWheel));
             }
             *whichQset = true;
         }
@@ -541,6 +616,10 @@ ssize_t ExecutorPool::_adjustWorkers(task_type_t type, size_t desiredNumItems) {
                         this,
                         type,
                         typeName + "_worker_" + std::to_string(tidx)));
+                {
+                    std::lock_guard<cb::WriterLock> wlh(stealLock.writer());
+                    threadsByType[type].push_back(threadQ.back());
+                }
                 threadQ.back()->start();
             }
         } else if (numItems > desiredNumItems) {
@@ -551,6 +630,17 @@ ssize_t ExecutorPool::_adjustWorkers(task_type_t type, size_t desiredNumItems) {
             auto itr = threadQ.rbegin();
             while (itr != threadQ.rend() && toRemove) {
                 if ((*itr)->taskType == type) {
+                    // Stop other threads stealing from it.
+                    {
+                        std::lock_guard<cb::WriterLock> wlh(
+                                stealLock.writer());
+                        auto& threads = threadsByType[type];
+                        threads.erase(std::remove(threads.begin(),
+                                                  threads.end(),
+                                                  *itr),
+                                      threads.end());
+                    }
+
                     // stop but /don't/ join yet
                     (*itr)->stop(false);
 
@@ -702,6 +792,16 @@ void ExecutorPool::_unregisterTaskable(Taskable& taskable, bool force) {
 
         for (size_t tidx = 0; tidx < threadQ.size(); ++tidx) {
             threadQ[tidx]->stop(/*wait for threads */);
+        }
+
+        {
+            std::lock_guard<cb::WriterLock> wlh(stealLock.writer());
+            for (auto& threads : threadsByType) {
+                threads.clear();
+            }
+        }
+
+        for (size_t tidx = 0; tidx < threadQ.size(); ++tidx) {
             delete threadQ[tidx];
         }
 
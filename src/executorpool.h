@@ -62,6 +62,20 @@
  * ExecutorPool::snooze(size_t taskId, double toSleep)
  *   The pool's snooze method will locate the task matching taskId and adjust
  *   its wakeTime to account for the toSleep value.
+ *
+ * === Work-stealing scheduler ===
+ *
+ * With executor_pool_scheduler=work_stealing, each thread also has its own
+ * LocalTaskQueue of ready tasks. A task which is to run again immediately
+ * is kept in the local queue of the thread which ran it, and a thread which
+ * fetches from a shared TaskQueue takes all of the queue's ready tasks in
+ * one go. Threads run tasks from their local queue first, and when idle
+ * steal from the local queues of other threads of the same type, before
+ * falling back to the shared TaskQueues (and sleeping there). This keeps
+ * most scheduling off the shared TaskQueue mutexes. Future (snoozed) tasks,
+ * wake() and snooze() still go through the shared TaskQueues, as do the
+ * high and low priority queue sets; task priority is respected within each
+ * local queue.
  */
 #ifndef SRC_EXECUTORPOOL_H_
 #define SRC_EXECUTORPOOL_H_ 1
@@ -72,8 +86,11 @@
 #include "task_type.h"
 #include "taskable.h"
 
+#include <platform/rwlock.h>
+
 #include <map>
 #include <set>
+#include <vector>
 
 // Forward decl
 class TaskQueue;
@@ -109,6 +126,28 @@ public:
 
     TaskQueue *nextTask(ExecutorThread &t, uint8_t tick);
 
+    /// @return true if using the work-stealing scheduler.
+    bool isWorkStealing() const {
+        return workStealing;
+    }
+
+    /**
+     * Reschedule a task which thread t has just run (and which was fetched
+     * from q). With the work-stealing scheduler, a task which is ready to
+     * run again is kept in t's local queue; otherwise it is returned to q.
+     *
+     * @return the task's new waketime (or q's earliest waketime).
+     */
+    ProcessClock::time_point reschedule(ExecutorThread& t,
+                                        ExTask& task,
+                                        TaskQueue* q);
+
+    /**
+     * Return any tasks left in t's local queue to their TaskQueues; called
+     * by a thread when it stops.
+     */
+    void drainLocalQueue(ExecutorThread& t);
+
     TaskQueue *getSleepQ(unsigned int curTaskType) {
         return isHiPrioQset ? hpTaskQ[curTaskType] : lpTaskQ[curTaskType];
     }
@@ -206,10 +245,13 @@ public:
 protected:
 
     ExecutorPool(size_t t, size_t nTaskSets, size_t r, size_t w, size_t a,
-                 size_t n);
+                 size_t n, bool workStealing = false,
+                 bool timerWheel = false);
     virtual ~ExecutorPool(void);
 
     TaskQueue* _nextTask(ExecutorThread &t, uint8_t tick);
+    TaskQueue* _nextLocalTask(ExecutorThread& t);
+    bool _stealTask(ExecutorThread& t, TaskQpair& entry);
     bool _cancel(size_t taskId, bool eraseTask=false);
     bool _wake(size_t taskId);
     virtual bool _startWorkers(void);
@@ -253,6 +295,19 @@ protected:
     // Set of all known task owners
     std::set<void *> taskOwners;
 
+    // Use per-thread local queues and work stealing (see top of file).
+    const bool workStealing;
+
+    // TaskQueues keep future tasks in a TimerWheelFutureQueue (rather than
+    // a FutureQueue heap).
+    const bool timerWheel;
+
+    // The threads of each task type, which idle threads of that type may
+    // steal tasks from. Readers (thieves) hold stealLock shared; threads
+    // are only added or removed with it held exclusively.
+    cb::RWLock stealLock;
+    std::vector<std::vector<ExecutorThread*>> threadsByType;
+
     // Singleton creation
     static std::mutex initGuard;
     static std::atomic<ExecutorPool*> instance;
@@ -149,8 +149,9 @@ void ExecutorThread::run() {
                 currentTask->updateWaketimeIfLessThan(getCurTime());
 
                 // reschedule this task back into the queue it was fetched from
+                // (or our local queue, if work stealing)
                 const ProcessClock::time_point new_waketime =
-                        q->reschedule(currentTask);
+                        manager->reschedule(*this, currentTask, q);
                 // record min waketime ...
                 if (new_waketime < getWaketime()) {
                     setWaketime(new_waketime);
@@ -174,6 +175,9 @@ void ExecutorThread::run() {
     // Thread is about to terminate - disassociate it from any engine.
     ObjectRegistry::onSwitchThread(nullptr);
 
+    // Hand back any tasks we were holding for other threads to run.
+    manager->drainLocalQueue(*this);
+
     state = EXECUTOR_DEAD;
 }
 
@@ -22,6 +22,7 @@
 #include "objectregistry.h"
 #include "task_type.h"
 #include "tasklogentry.h"
+#include "taskqueue.h"
 
 #include <platform/ring_buffer.h>
 #include <platform/processclock.h>
@@ -93,7 +94,8 @@ public:
           now(ProcessClock::now()),
           waketime(ProcessClock::time_point::max()),
           taskStart(),
-          currentTask(NULL) {
+          currentTask(NULL),
+          nextVictim(0) {
     }
 
     ~ExecutorThread() {
@@ -183,4 +185,9 @@ protected:
     std::mutex logMutex;
     cb::RingBuffer<TaskLogEntry, TASK_LOG_SIZE> tasklog;
     cb::RingBuffer<TaskLogEntry, TASK_LOG_SIZE> slowjobs;
+
+    // Ready tasks owned by this thread (work-stealing scheduler only).
+    LocalTaskQueue localQueue;
+    // Where to start looking for tasks to steal (only used by this thread).
+    size_t nextVictim;
 };
@@ -18,10 +18,15 @@
 #include "flusher.h"
 
 #include "common.h"
+#include "ep_engine.h"
+#include "objectregistry.h"
 #include "tasks.h"
 
+#include <phosphor/phosphor.h>
+#include <platform/make_unique.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <sstream>
 
 
@@ -267,10 +272,29 @@ void Flusher::flushVB(void) {
         LOG(EXTENSION_LOG_INFO,
             "Flusher::flushVB: Trying to flush but no vbuckets exist");
         return;
-    } else if (!hpVbs.empty()) {
+    }
+
+    if (!store->isFlusherPipelineEnabled()) {
+        flushOneVB(false);
+        return;
+    }
+
+    // Pipelined: flush each vBucket currently queued (once), overlapping
+    // the commit of each with draining the next.
+    size_t toFlush = hpVbs.size() + lpVbs.size();
+    while (toFlush-- > 0 && !(hpVbs.empty() && lpVbs.empty())) {
+        flushOneVB(true);
+    }
+    completePipeline();
+}
+
+void Flusher::flushOneVB(bool pipelined) {
+    if (!hpVbs.empty()) {
         uint16_t vbid = hpVbs.front();
         hpVbs.pop();
-        if (store->flushVBucket(vbid) == RETRY_FLUSH_VBUCKET) {
+        const int rv = pipelined ? flushVBucketPipelined(vbid, true)
+                                 : store->flushVBucket(vbid);
+        if (rv == RETRY_FLUSH_VBUCKET) {
             hpVbs.push(vbid);
         }
     } else {
@@ -279,8 +303,154 @@ void Flusher::flushVB(void) {
         }
         uint16_t vbid = lpVbs.front();
         lpVbs.pop();
-        if (store->flushVBucket(vbid) == RETRY_FLUSH_VBUCKET) {
+        const int rv = pipelined ? flushVBucketPipelined(vbid, false)
+                                 : store->flushVBucket(vbid);
+        if (rv == RETRY_FLUSH_VBUCKET) {
             lpVbs.push(vbid);
         }
     }
 }
+
+int Flusher::flushVBucketPipelined(uint16_t vbid, bool highPriority) {
+    if (store->isDeleteAllScheduled() ||
+        (committing && committing->vb->getId() == vbid)) {
+        // The delete-all (or this vBucket's next batch) must wait for the
+        // committing batch.
+        completePipeline();
+    }
+    if (store->isDeleteAllScheduled()) {
+        return store->flushVBucket(vbid);
+    }
+
+    EPStats& stats = store->getEPEngine().getEpStats();
+    auto batch = std::make_unique<KVBucket::FlushBatch>();
+    const hrtime_t drainStart = gethrtime();
+    if (!store->drainFlushBatch(vbid, *batch)) {
+        return RETRY_FLUSH_VBUCKET;
+    }
+    const hrtime_t drainEnd = gethrtime();
+    if (!batch->vb) {
+        return 0;
+    }
+    ++stats.flusherPipelineDepth;
+
+    // The KVStore can't be written to until the previous batch's commit
+    // is done.
+    completePipeline(drainStart, drainEnd);
+
+    if (!store->writeFlushBatch(*batch)) {
+        --stats.flusherPipelineDepth;
+        return RETRY_FLUSH_VBUCKET;
+    }
+    if (!batch->needsCommit) {
+        --stats.flusherPipelineDepth;
+        return store->completeFlushBatch(*batch);
+    }
+
+    const int flushed = batch->itemsFlushed;
+    startCommit(std::move(batch), highPriority);
+    return flushed;
+}
+
+/**
+ * Commits a pipelined flush batch (flusher_pipeline_enabled) while the
+ * flusher drains the next vBucket.
+ */
+class FlushCommitTask : public GlobalTask {
+public:
+    FlushCommitTask(EventuallyPersistentEngine* e,
+                    KVBucket* s,
+                    std::shared_ptr<Flusher::PipelinedCommit> c,
+                    uint16_t vbid)
+        : GlobalTask(e, TaskId::FlushCommitTask, 0, false),
+          store(s),
+          pipelinedCommit(std::move(c)),
+          description("Committing flush batch: vb:" + std::to_string(vbid)) {
+    }
+
+    bool run() {
+        TRACE_EVENT0("ep-engine/task", "FlushCommitTask");
+        pipelinedCommit->commit(*store);
+        return false;
+    }
+
+    cb::const_char_buffer getDescription() {
+        return description;
+    }
+
+private:
+    KVBucket* store;
+    std::shared_ptr<Flusher::PipelinedCommit> pipelinedCommit;
+    const std::string description;
+};
+
+bool Flusher::PipelinedCommit::commit(KVBucket& store) {
+    KVBucket::FlushBatch* toCommit;
+    {
+        std::lock_guard<std::mutex> lh(mutex);
+        toCommit = batch;
+        batch = nullptr;
+    }
+    if (!toCommit) {
+        return false;
+    }
+    store.commitFlushBatch(*toCommit);
+    std::lock_guard<std::mutex> lh(mutex);
+    end = gethrtime();
+    done = true;
+    cond.notify_all();
+    return true;
+}
+
+void Flusher::startCommit(std::unique_ptr<KVBucket::FlushBatch> batch,
+                          bool highPriority) {
+    committing = std::move(batch);
+    committingHighPriority = highPriority;
+    pipelinedCommit = std::make_shared<PipelinedCommit>();
+    pipelinedCommit->batch = committing.get();
+    ExTask task = new FlushCommitTask(&store->getEPEngine(),
+                                      store,
+                                      pipelinedCommit,
+                                      committing->vb->getId());
+    commitTaskId = task->getId();
+    ExecutorPool::get()->schedule(task);
+}
+
+void Flusher::completePipeline(hrtime_t drainStart, hrtime_t drainEnd) {
+    if (!committing) {
+        return;
+    }
+
+    // If no writer thread has started the commit task yet, commit here.
+    const bool committedHere = pipelinedCommit->commit(*store);
+    if (committedHere) {
+        ExecutorPool::get()->cancel(commitTaskId);
+    }
+    hrtime_t end;
+    {
+        std::unique_lock<std::mutex> lh(pipelinedCommit->mutex);
+        pipelinedCommit->cond.wait(lh,
+                                   [this] { return pipelinedCommit->done; });
+        end = pipelinedCommit->end;
+    }
+    pipelinedCommit.reset();
+
+    EPStats& stats = store->getEPEngine().getEpStats();
+    if (drainStart) {
+        // How long the drain of the next batch ran alongside the commit.
+        const hrtime_t overlap = !committedHere && end > drainStart
+                                         ? std::min(end, drainEnd) - drainStart
+                                         : 0;
+        stats.flusherCommitOverlapHisto.add(overlap / 1000);
+    }
+
+    std::unique_ptr<KVBucket::FlushBatch> batch = std::move(committing);
+    const uint16_t vbid = batch->vb->getId();
+    const bool retry =
+            store->completeFlushBatch(*batch) == RETRY_FLUSH_VBUCKET;
+    batch.reset();
+    --stats.flusherPipelineDepth;
+    if (retry) {
+        (committingHighPriority ? hpVbs : lpVbs).push(vbid);
+    }
+}
@@ -20,8 +20,11 @@
 
 #include "config.h"
 
+#include <condition_variable>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <string>
 
@@ -51,7 +54,9 @@ public:
           doHighPriority(false),
           numHighPriority(0),
           pendingMutation(false),
-          shard(k) {
+          shard(k),
+          committingHighPriority(false),
+          commitTaskId(0) {
     }
 
     ~Flusher() {
@@ -84,6 +89,27 @@ public:
     }
     void setTaskId(size_t newId) { taskId = newId; }
 
+    /**
+     * A batch handed to a FlushCommitTask. Shared with the task, which may
+     * still run (finding nothing to do) after the flusher has committed the
+     * batch itself.
+     */
+    struct PipelinedCommit {
+        /**
+         * Commit the batch, unless the flusher or the task already has (or
+         * is doing so).
+         * @return true if this call committed it
+         */
+        bool commit(KVBucket& store);
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        // The batch, until one of the flusher and the task claims it.
+        KVBucket::FlushBatch* batch = nullptr;
+        bool done = false;
+        hrtime_t end = 0;
+    };
+
 private:
     enum class State {
         Initializing,
@@ -97,6 +123,7 @@ private:
     bool transitionState(State to);
     bool validTransition(State to) const;
     void flushVB();
+    void flushOneVB(bool pipelined);
     void completeFlush();
     void initialize();
     void schedule_UNLOCKED();
@@ -126,6 +153,32 @@ private:
 
     KVShard *shard;
 
+    /*
+     * Pipelined flushing (flusher_pipeline_enabled): the KVStore commit of
+     * one vBucket's batch runs as a FlushCommitTask on another writer thread
+     * while this flusher drains and sorts the next vBucket. If no writer
+     * thread has picked the task up by the time the flusher needs the
+     * commit done, the flusher commits the batch itself (so a busy writer
+     * pool only loses the overlap). At most one batch is committing; it is
+     * completed (so persistence notifications stay in flush order) before
+     * the next batch is written to the shard's KVStore. flushVB() empties
+     * the pipeline before returning, so a batch (and the vBucket lock it
+     * holds) never outlives the writer thread running the flusher task.
+     */
+    int flushVBucketPipelined(uint16_t vbid, bool highPriority);
+    void startCommit(std::unique_ptr<KVBucket::FlushBatch> batch,
+                     bool highPriority);
+    /**
+     * Wait for the committing batch (if any) and complete it. If a drain
+     * window is given, records how long it overlapped with the commit.
+     */
+    void completePipeline(hrtime_t drainStart = 0, hrtime_t drainEnd = 0);
+
+    std::unique_ptr<KVBucket::FlushBatch> committing;
+    std::shared_ptr<PipelinedCommit> pipelinedCommit;
+    bool committingHighPriority;
+    size_t commitTaskId;
+
     DISALLOW_COPY_AND_ASSIGN(Flusher);
 };
 
@@ -0,0 +1,350 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "futurequeue.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+/// @return the index of the most significant set bit of a non-zero value.
+static int highestBit(uint64_t value) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+/// @return the index of the least significant set bit of a non-zero value.
+static int lowestBit(uint64_t value) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(value);
+#else
+    int bit = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+void TimerWheelFutureQueue::TaskHeap::insert(GlobalTask* task) {
+    heap.push_back(task);
+    task->timerWheelLinks.heapIndex = heap.size() - 1;
+    siftUp(heap.size() - 1);
+}
+
+void TimerWheelFutureQueue::TaskHeap::erase(GlobalTask* task) {
+    const size_t index = task->timerWheelLinks.heapIndex;
+    GlobalTask* last = heap.back();
+    heap.pop_back();
+    if (last == task) {
+        return;
+    }
+    place(last, index);
+    if (index > 0 && before(last, heap[(index - 1) / 2])) {
+        siftUp(index);
+    } else {
+        siftDown(index);
+    }
+}
+
+void TimerWheelFutureQueue::TaskHeap::siftUp(size_t index) {
+    GlobalTask* task = heap[index];
+    while (index > 0) {
+        const size_t parent = (index - 1) / 2;
+        if (!before(task, heap[parent])) {
+            break;
+        }
+        place(heap[parent], index);
+        index = parent;
+    }
+    place(task, index);
+}
+
+void TimerWheelFutureQueue::TaskHeap::siftDown(size_t index) {
+    GlobalTask* task = heap[index];
+    const size_t n = heap.size();
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && before(heap[child + 1], heap[child])) {
+            ++child;
+        }
+        if (!before(heap[child], task)) {
+            break;
+        }
+        place(heap[child], index);
+        index = child;
+    }
+    place(task, index);
+}
+
+TimerWheelFutureQueue::TimerWheelFutureQueue()
+    : baseTick(0), wheelCount(0), queued(0) {
+    for (auto& level : slots) {
+        level.fill(nullptr);
+    }
+    occupied.fill(0);
+}
+
+TimerWheelFutureQueue::~TimerWheelFutureQueue() {
+    // Drop the references held by the queue.
+    std::vector<GlobalTask*> tasks(due.begin(), due.end());
+    tasks.insert(tasks.end(), overflow.begin(), overflow.end());
+    for (auto& level : slots) {
+        for (GlobalTask* task : level) {
+            for (; task; task = task->timerWheelLinks.next) {
+                tasks.push_back(task);
+            }
+        }
+    }
+    for (GlobalTask* task : tasks) {
+        task->timerWheelLinks.queue = nullptr;
+        task->timerWheelLinks.count = 0;
+        ExTask::dropReference(task);
+    }
+}
+
+void TimerWheelFutureQueue::push(ExTask task) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    Links& links = task->timerWheelLinks;
+    if (links.queue == this) {
+        // Already queued; count it again, at its current wakeTime.
+        ++links.count;
+        ++queued;
+        reposition_UNLOCKED(task);
+        return;
+    }
+    if (links.queue) {
+        throw std::logic_error(
+                "TimerWheelFutureQueue::push: task " +
+                std::to_string(task->getId()) + " is in another queue");
+    }
+    links.queue = this;
+    links.count = 1;
+    links.waketime = task->getWaketime();
+    ++queued;
+    // The queue's reference is dropped when the task is finally popped.
+    insert_UNLOCKED(task.release());
+}
+
+void TimerWheelFutureQueue::pop() {
+    GlobalTask* popped = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        GlobalTask* task = first_UNLOCKED();
+        if (!task) {
+            throw std::logic_error(
+                    "TimerWheelFutureQueue::pop: queue is empty");
+        }
+        --queued;
+        Links& links = task->timerWheelLinks;
+        if (--links.count == 0) {
+            unlink_UNLOCKED(task);
+            links.queue = nullptr;
+            popped = task;
+        }
+    }
+    if (popped) {
+        ExTask::dropReference(popped);
+    }
+}
+
+ExTask TimerWheelFutureQueue::top() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    GlobalTask* task = first_UNLOCKED();
+    if (!task) {
+        throw std::logic_error("TimerWheelFutureQueue::top: queue is empty");
+    }
+    return ExTask(task);
+}
+
+size_t TimerWheelFutureQueue::size() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return queued;
+}
+
+bool TimerWheelFutureQueue::empty() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return queued == 0;
+}
+
+bool TimerWheelFutureQueue::updateWaketime(const ExTask& task,
+                                           ProcessClock::time_point newTime) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    task->updateWaketime(newTime);
+    return reposition_UNLOCKED(task);
+}
+
+bool TimerWheelFutureQueue::snooze(const ExTask& task, const double secs) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    task->snooze(secs);
+    return reposition_UNLOCKED(task);
+}
+
+size_t TimerWheelFutureQueue::getNumDue() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return due.size();
+}
+
+uint64_t TimerWheelFutureQueue::toTick(ProcessClock::time_point tp) {
+    // Map the signed nanosecond count onto an unsigned one (preserving
+    // order), so time_point::min() and max() are valid ticks.
+    const auto ns = uint64_t(to_ns_since_epoch(tp).count());
+    return (ns ^ (uint64_t(1) << 63)) >> TickShift;
+}
+
+void TimerWheelFutureQueue::insert_UNLOCKED(GlobalTask* task) {
+    Links& links = task->timerWheelLinks;
+    links.tick = toTick(links.waketime);
+    if (due.empty() && wheelCount == 0) {
+        // Nothing earlier than the overflow; re-base the wheel on the
+        // current time (or this task, if already due), and bring in any
+        // overflow tasks which now fit. Not on this task regardless, as a
+        // far-future first task (e.g. snoozed forever) would then leave
+        // every sooner task in the due heap until it was woken.
+        baseTick = std::min(toTick(ProcessClock::now()), links.tick);
+        while (!overflow.empty()) {
+            GlobalTask* next = overflow.front();
+            const uint64_t tick = next->timerWheelLinks.tick;
+            if (tick > baseTick &&
+                highestBit(tick ^ baseTick) / SlotBits >= Levels) {
+                break;
+            }
+            overflow.erase(next);
+            file_UNLOCKED(next);
+        }
+    }
+    file_UNLOCKED(task);
+}
+
+void TimerWheelFutureQueue::file_UNLOCKED(GlobalTask* task) {
+    Links& links = task->timerWheelLinks;
+    if (links.tick <= baseTick) {
+        links.location = Links::Location::Due;
+        due.insert(task);
+        return;
+    }
+
+    // The level is given by the most significant digit where the task's
+    // tick differs from the base.
+    const int level = highestBit(links.tick ^ baseTick) / SlotBits;
+    if (level >= Levels) {
+        links.location = Links::Location::Overflow;
+        overflow.insert(task);
+        return;
+    }
+
+    const size_t slot =
+            (links.tick >> (level * SlotBits)) & (SlotsPerLevel - 1);
+    links.location = Links::Location::Wheel;
+    links.level = uint8_t(level);
+    links.slot = uint8_t(slot);
+    links.prev = nullptr;
+    links.next = slots[level][slot];
+    if (links.next) {
+        links.next->timerWheelLinks.prev = task;
+    }
+    slots[level][slot] = task;
+    occupied[level] |= uint64_t(1) << slot;
+    ++wheelCount;
+}
+
+void TimerWheelFutureQueue::unlink_UNLOCKED(GlobalTask* task) {
+    Links& links = task->timerWheelLinks;
+    switch (links.location) {
+    case Links::Location::Due:
+        due.erase(task);
+        return;
+    case Links::Location::Overflow:
+        overflow.erase(task);
+        return;
+    case Links::Location::Wheel:
+        if (links.prev) {
+            links.prev->timerWheelLinks.next = links.next;
+        } else {
+            slots[links.level][links.slot] = links.next;
+            if (!links.next) {
+                occupied[links.level] &= ~(uint64_t(1) << links.slot);
+            }
+        }
+        if (links.next) {
+            links.next->timerWheelLinks.prev = links.prev;
+        }
+        --wheelCount;
+        return;
+    }
+}
+
+GlobalTask* TimerWheelFutureQueue::first_UNLOCKED() {
+    advance_UNLOCKED();
+    if (!due.empty()) {
+        return due.front();
+    }
+    if (!overflow.empty()) {
+        return overflow.front();
+    }
+    return nullptr;
+}
+
+void TimerWheelFutureQueue::advance_UNLOCKED() {
+    while (due.empty() && wheelCount != 0) {
+        // All tasks in lower levels are earlier than those in higher
+        // levels, and within a level later slots are later.
+        int level = 0;
+        while (occupied[level] == 0) {
+            ++level;
+        }
+        const size_t slot = lowestBit(occupied[level]);
+
+        // Move the base to the start of that slot...
+        const int shift = level * SlotBits;
+        const uint64_t digitMask = uint64_t(SlotsPerLevel - 1) << shift;
+        baseTick = (baseTick & ~(digitMask | ((uint64_t(1) << shift) - 1))) |
+                   (uint64_t(slot) << shift);
+
+        // ... and re-file its tasks: each moves to due or a lower level.
+        GlobalTask* task = slots[level][slot];
+        slots[level][slot] = nullptr;
+        occupied[level] &= ~(uint64_t(1) << slot);
+        while (task) {
+            GlobalTask* next = task->timerWheelLinks.next;
+            --wheelCount;
+            file_UNLOCKED(task);
+            task = next;
+        }
+    }
+}
+
+bool TimerWheelFutureQueue::reposition_UNLOCKED(const ExTask& task) {
+    Links& links = task->timerWheelLinks;
+    if (links.queue != this) {
+        return false;
+    }
+    unlink_UNLOCKED(task.get());
+    links.waketime = task->getWaketime();
+    insert_UNLOCKED(task.get());
+    return true;
+}
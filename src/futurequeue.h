@@ -22,43 +22,82 @@
  *
  * FutureQueue provides methods that allow a task's wakeTime to be mutated
  * whilst maintaining the priority ordering.
+ *
+ * Two implementations of AbstractFutureQueue are provided, selected for
+ * TaskQueue by the executor_pool_future_queue setting:
+ * - FutureQueue ("heap"): a binary heap. updateWaketime() and snooze()
+ *   search for the task and re-heapify, which is O(n).
+ * - TimerWheelFutureQueue ("timer_wheel"): a hierarchical timer wheel, with
+ *   O(1) push(), updateWaketime() and snooze().
  */
 
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <mutex>
 #include <platform/processclock.h>
 #include <queue>
+#include <vector>
 
 #include "globaltask.h"
 
+class AbstractFutureQueue {
+public:
+    virtual ~AbstractFutureQueue() {
+    }
+
+    virtual void push(ExTask task) = 0;
+
+    virtual void pop() = 0;
+
+    virtual ExTask top() = 0;
+
+    virtual size_t size() = 0;
+
+    virtual bool empty() = 0;
+
+    /*
+     * Update the wakeTime of task and maintain the queue's ordering.
+     * @returns true if 'task' is in the FutureQueue.
+     */
+    virtual bool updateWaketime(const ExTask& task,
+                                ProcessClock::time_point newTime) = 0;
+
+    /*
+     * snooze the task (by altering its wakeTime) and maintain the queue's
+     * ordering.
+     * @returns true if 'task' is in the FutureQueue.
+     */
+    virtual bool snooze(const ExTask& task, const double secs) = 0;
+};
+
 template <class C = std::deque<ExTask>,
           class Compare = CompareByDueDate>
-class FutureQueue {
+class FutureQueue : public AbstractFutureQueue {
 public:
 
-    void push(ExTask task) {
+    void push(ExTask task) override {
         std::lock_guard<std::mutex> lock(queueMutex);
         queue.push(task);
     }
 
-    void pop() {
+    void pop() override {
         std::lock_guard<std::mutex> lock(queueMutex);
         queue.pop();
     }
 
-    ExTask top() {
+    ExTask top() override {
         std::lock_guard<std::mutex> lock(queueMutex);
         return queue.top();
     }
 
-    size_t size() {
+    size_t size() override {
         std::lock_guard<std::mutex> lock(queueMutex);
         return queue.size();
     }
 
-    bool empty() {
+    bool empty() override {
         std::lock_guard<std::mutex> lock(queueMutex);
         return queue.empty();
     }
@@ -68,7 +107,8 @@ public:
      * maintained.
      * @returns true if 'task' is in the FutureQueue.
      */
-    bool updateWaketime(const ExTask& task, ProcessClock::time_point newTime) {
+    bool updateWaketime(const ExTask& task,
+                        ProcessClock::time_point newTime) override {
         std::lock_guard<std::mutex> lock(queueMutex);
         task->updateWaketime(newTime);
         // After modifiying the task's wakeTime, rebuild the heap
@@ -80,7 +120,7 @@ public:
      * heap property is maintained.
      * @returns true if 'task' is in the FutureQueue.
      */
-    bool snooze(const ExTask& task, const double secs) {
+    bool snooze(const ExTask& task, const double secs) override {
         std::lock_guard<std::mutex> lock(queueMutex);
         task->snooze(secs);
         // After modifiying the task's wakeTime, rebuild the heap
@@ -135,3 +175,139 @@ protected:
     // All access to queue must be done with the queueMutex
     std::mutex queueMutex;
 };
+
+/*
+ * A FutureQueue implemented as a hierarchical timer wheel, so the cost of
+ * scheduling, snoozing and waking a task doesn't grow with the number of
+ * queued tasks.
+ *
+ * Wake times are bucketed into ticks (of ~1ms). The wheel has Levels levels
+ * of SlotsPerLevel slots; level k slots each cover SlotsPerLevel^k ticks,
+ * relative to the wheel's base tick. Each slot is an intrusive list threaded
+ * through the tasks' GlobalTask::TimerWheelLinks, so queueing a task
+ * allocates nothing. Tasks due at or before the base tick are held in a
+ * "due" heap ordered by wakeTime, so top() is exact (not rounded to a tick).
+ * When the due heap is empty, top() advances the base to the next occupied
+ * slot, moving that slot's tasks down the wheel (each task is moved at most
+ * Levels times). Tasks too far in the future for the wheel (e.g. snoozed
+ * forever) are kept in an overflow heap.
+ *
+ * A task can only be in one TimerWheelFutureQueue at a time. Pushing a task
+ * which is already queued counts it again (it is then popped that many
+ * times) at its current wakeTime.
+ */
+class TimerWheelFutureQueue : public AbstractFutureQueue {
+public:
+    TimerWheelFutureQueue();
+
+    ~TimerWheelFutureQueue();
+
+    TimerWheelFutureQueue(const TimerWheelFutureQueue&) = delete;
+    TimerWheelFutureQueue& operator=(const TimerWheelFutureQueue&) = delete;
+
+    void push(ExTask task) override;
+
+    void pop() override;
+
+    ExTask top() override;
+
+    size_t size() override;
+
+    bool empty() override;
+
+    bool updateWaketime(const ExTask& task,
+                        ProcessClock::time_point newTime) override;
+
+    bool snooze(const ExTask& task, const double secs) override;
+
+    /// @return the number of tasks held in the due heap (for testing).
+    size_t getNumDue();
+
+private:
+    static const int TickShift = 20; // 2^20ns ~= 1ms per tick
+    static const int SlotBits = 6;
+    static const size_t SlotsPerLevel = size_t(1) << SlotBits;
+    static const int Levels = 6; // 2^36 ticks ~= 2 years
+
+    typedef GlobalTask::TimerWheelLinks Links;
+
+    /*
+     * A binary min-heap of tasks ordered by their queued wakeTime, which
+     * records each task's index in its links so it can be removed directly.
+     */
+    class TaskHeap {
+    public:
+        bool empty() const {
+            return heap.empty();
+        }
+
+        GlobalTask* front() const {
+            return heap.front();
+        }
+
+        size_t size() const {
+            return heap.size();
+        }
+
+        void insert(GlobalTask* task);
+
+        void erase(GlobalTask* task);
+
+        std::vector<GlobalTask*>::const_iterator begin() const {
+            return heap.begin();
+        }
+
+        std::vector<GlobalTask*>::const_iterator end() const {
+            return heap.end();
+        }
+
+    private:
+        static bool before(const GlobalTask* a, const GlobalTask* b) {
+            return a->timerWheelLinks.waketime < b->timerWheelLinks.waketime;
+        }
+
+        void place(GlobalTask* task, size_t index) {
+            heap[index] = task;
+            task->timerWheelLinks.heapIndex = index;
+        }
+
+        void siftUp(size_t index);
+
+        void siftDown(size_t index);
+
+        std::vector<GlobalTask*> heap;
+    };
+
+    static uint64_t toTick(ProcessClock::time_point tp);
+
+    /// Queue task (at its links' waketime), re-basing the wheel if empty.
+    void insert_UNLOCKED(GlobalTask* task);
+
+    /// Queue task (at its links' waketime) relative to the current base.
+    void file_UNLOCKED(GlobalTask* task);
+
+    void unlink_UNLOCKED(GlobalTask* task);
+
+    /// @return the task with the earliest wakeTime, or null if empty.
+    GlobalTask* first_UNLOCKED();
+
+    /// Move tasks from the wheel to due until due is non-empty.
+    void advance_UNLOCKED();
+
+    /// Move task after its wakeTime changed.
+    bool reposition_UNLOCKED(const ExTask& task);
+
+    uint64_t baseTick;
+    TaskHeap due;
+    std::array<std::array<GlobalTask*, SlotsPerLevel>, Levels> slots;
+    std::array<uint64_t, Levels> occupied; // bitmap of non-empty slots
+    size_t wheelCount;
+    TaskHeap overflow;
+
+    // Number of times tasks are queued (the sum of their links' counts).
+    size_t queued;
+
+    // All access to the above (and the queued tasks' links) must be done
+    // with the queueMutex
+    std::mutex queueMutex;
+};
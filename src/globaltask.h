@@ -57,6 +57,7 @@ friend class CompareByDueDate;
 friend class CompareByPriority;
 friend class ExecutorPool;
 friend class ExecutorThread;
+friend class TimerWheelFutureQueue;
 public:
 
     GlobalTask(Taskable& t,
@@ -233,6 +234,31 @@ protected:
 
 private:
     atomic_time_point waketime; // used for priority_queue
+
+    /*
+     * A TimerWheelFutureQueue's links for this task, so queueing it needs
+     * no allocation. Only accessed with that queue's mutex held.
+     */
+    struct TimerWheelLinks {
+        enum class Location : uint8_t { Due, Wheel, Overflow };
+
+        // The queue the task is in, or null.
+        const void* queue = nullptr;
+        // How many times the task is queued (it may be pushed again before
+        // it is popped).
+        size_t count = 0;
+        // The task's wakeTime when it was queued (or last moved).
+        ProcessClock::time_point waketime;
+        uint64_t tick = 0;
+        Location location = Location::Due;
+        // Position in a wheel slot's list...
+        uint8_t level = 0;
+        uint8_t slot = 0;
+        GlobalTask* prev = nullptr;
+        GlobalTask* next = nullptr;
+        // ... or in the due / overflow heap.
+        size_t heapIndex = 0;
+    } timerWheelLinks;
 };
 
 typedef SingleThreadedRCPtr<GlobalTask> ExTask;
@@ -19,6 +19,8 @@
 
 #include "stored_value_factories.h"
 
+#include <platform/make_unique.h>
+
 #include <cstring>
 
 static const ssize_t prime_size_table[] = {
@@ -37,7 +39,8 @@ std::ostream& operator<<(std::ostream& os, const HashTable::Position& pos) {
 HashTable::HashTable(EPStats& st,
                      std::unique_ptr<AbstractStoredValueFactory> svFactory,
                      size_t initialSize,
-                     size_t locks)
+                     size_t locks,
+                     LockMode lockMode)
     : maxDeletedRevSeqno(0),
       numTotalItems(0),
       numNonResidentItems(0),
@@ -47,9 +50,14 @@ HashTable::HashTable(EPStats& st,
       memSize(0),
       cacheSize(0),
       metaDataMemory(0),
+      inlineValueSavings(0),
       initialSize(initialSize),
       size(initialSize),
       n_locks(locks),
+      resizeTargetSize(0),
+      resizeMigrated(0),
+      resizeStepSize(0),
+      lockMode(lockMode),
       stats(st),
       valFact(std::move(svFactory)),
       visitors(0),
@@ -57,7 +65,10 @@ HashTable::HashTable(EPStats& st,
       numResizes(0),
       numTempItems(0) {
     values.resize(size);
-    mutexes = new std::mutex[n_locks];
+    mutexes = new StripeLock[n_locks];
+    for (size_t i = 0; i < n_locks; ++i) {
+        mutexes[i].setMode(lockMode);
+    }
     activeState = true;
 }
 
@@ -84,7 +95,7 @@ void HashTable::clear(bool deactivate) {
                     "non-active object");
         }
     }
-    MultiLockHolder mlh(mutexes, n_locks);
+    MultiStripeLockHolder mlh(mutexes, n_locks);
     clear_UNLOCKED(deactivate);
 }
 
@@ -92,6 +103,10 @@ void HashTable::clear_UNLOCKED(bool deactivate) {
     if (deactivate) {
         setActiveState(false);
     }
+    // Any in-progress resize is completed first, so there's only one
+    // table to clear.
+    finishResize_UNLOCKED();
+
     size_t clearedMemSize = 0;
     size_t clearedValSize = 0;
     for (int i = 0; i < (int)size; i++) {
@@ -107,13 +122,22 @@ void HashTable::clear_UNLOCKED(bool deactivate) {
 
     stats.currentSize.fetch_sub(clearedMemSize - clearedValSize);
 
-    datatypeCounts.fill(0);
+    if (valuesIndex) {
+        valuesIndex->clear();
+    }
+
+    for (auto& count : datatypeCounts) {
+        count.items.store(0);
+        count.valueSize.store(0);
+        count.uncompressedValueSize.store(0);
+    }
     numTotalItems.store(0);
     numItems.store(0);
     numTempItems.store(0);
     numNonResidentItems.store(0);
     memSize.store(0);
     cacheSize.store(0);
+    inlineValueSavings.store(0);
 }
 
 static size_t distance(size_t a, size_t b) {
@@ -130,7 +154,17 @@ static bool isCurrently(size_t size, ssize_t a, ssize_t b) {
 }
 
 void HashTable::resize() {
-    size_t ni = getNumInMemoryItems();
+    resize(getPreferredSize(getNumInMemoryItems()));
+}
+
+void HashTable::presize(size_t expectedItems) {
+    const size_t newSize = getPreferredSize(expectedItems);
+    if (newSize > size) {
+        resize(newSize, /*allowIncremental*/ false);
+    }
+}
+
+size_t HashTable::getPreferredSize(size_t ni) const {
     int i(0);
     size_t new_size(0);
 
@@ -157,10 +191,14 @@ void HashTable::resize() {
         new_size = nearest(ni, prime_size_table[i-1], prime_size_table[i]);
     }
 
-    resize(new_size);
+    return new_size;
 }
 
 void HashTable::resize(size_t newSize) {
+    resize(newSize, /*allowIncremental*/ true);
+}
+
+void HashTable::resize(size_t newSize, bool allowIncremental) {
     if (!isActive()) {
         throw std::logic_error("HashTable::resize: Cannot call on a "
                 "non-active object");
@@ -177,7 +215,39 @@ void HashTable::resize(size_t newSize) {
         return;
     }
 
-    MultiLockHolder mlh(mutexes, n_locks);
+    // Only one resize at a time; an in-progress incremental resize must
+    // complete (via resizeStep) before another can begin.
+    if (isResizing()) {
+        return;
+    }
+
+    // Incremental resizing numbers the new table's buckets after the
+    // current ones, so the combined count must also fit in an int.
+    const bool incremental =
+            allowIncremental && resizeStepSize.load() != 0 &&
+            (size + newSize) <=
+                    static_cast<size_t>(std::numeric_limits<int>::max());
+    if (incremental) {
+        // Allocate the new table before taking the locks.
+        table_type newValues(newSize);
+
+        MultiStripeLockHolder mlh(mutexes, n_locks);
+        if (visitors.load() > 0 || isResizing()) {
+            return;
+        }
+
+        stats.memOverhead.fetch_sub(memorySize());
+        resizeValues = std::move(newValues);
+        if (valuesIndex) {
+            resizeIndex = std::make_unique<HashTagIndex>(newSize, n_locks);
+        }
+        resizeMigrated.store(0);
+        resizeTargetSize.store(newSize);
+        stats.memOverhead.fetch_add(memorySize());
+        return;
+    }
+
+    MultiStripeLockHolder mlh(mutexes, n_locks);
     if (visitors.load() > 0) {
         // Do not allow a resize while any visitors are actually
         // processing.  The next attempt will have to pick it up.  New
@@ -189,9 +259,14 @@ void HashTable::resize(size_t newSize) {
     // Get a place for the new items.
     table_type newValues(newSize);
 
-    stats.memOverhead->fetch_sub(memorySize());
+    stats.memOverhead.fetch_sub(memorySize());
     ++numResizes;
 
+    std::unique_ptr<HashTagIndex> newIndex;
+    if (valuesIndex) {
+        newIndex = std::make_unique<HashTagIndex>(newSize, n_locks);
+    }
+
     // Set the new size so all the hashy stuff works.
     size_t oldSize = size;
     size.store(newSize);
@@ -205,6 +280,11 @@ void HashTable::resize(size_t newSize) {
 
             // And re-link it into the correct place in newValues.
             int newBucket = getBucketForHash(v->getKey().hash());
+            if (newIndex) {
+                newIndex->insert(newBucket,
+                                 HashTagIndex::tagForHash(v->getKey().hash()),
+                                 v.get());
+            }
             v->setNext(std::move(newValues[newBucket]));
             newValues[newBucket] = std::move(v);
         }
@@ -212,8 +292,141 @@ void HashTable::resize(size_t newSize) {
 
     // Finally assign the new table to values.
     values = std::move(newValues);
+    valuesIndex = std::move(newIndex);
+
+    stats.memOverhead.fetch_add(memorySize());
+}
+
+bool HashTable::resizeStep() {
+    if (!isResizing()) {
+        return false;
+    }
+
+    MultiStripeLockHolder mlh(mutexes, n_locks);
+    if (!isActive() || !isResizing()) {
+        return false;
+    }
+    if (visitors.load() > 0) {
+        // As per resize(), don't move items underneath a visitor. The next
+        // call will pick up where we left off.
+        return false;
+    }
+
+    const size_t oldSize = size;
+    const size_t begin = resizeMigrated;
+    const size_t end = std::min(oldSize, begin + resizeStepSize.load());
+
+    for (size_t i = begin; i < end; i++) {
+        migrateBucket_UNLOCKED(i);
+    }
+    resizeMigrated.store(end);
+
+    if (end == oldSize) {
+        finishResize_UNLOCKED();
+    }
+    return true;
+}
+
+void HashTable::finishResize_UNLOCKED() {
+    if (!isResizing()) {
+        return;
+    }
+
+    const size_t target = resizeTargetSize;
+    for (size_t i = resizeMigrated; i < size; i++) {
+        migrateBucket_UNLOCKED(i);
+    }
+
+    stats.memOverhead.fetch_sub(memorySize());
+    ++numResizes;
+
+    values = std::move(resizeValues);
+    resizeValues = table_type();
+    valuesIndex = std::move(resizeIndex);
+    size.store(target);
+    resizeTargetSize.store(0);
+    resizeMigrated.store(0);
+
+    stats.memOverhead.fetch_add(memorySize());
+}
+
+void HashTable::migrateBucket_UNLOCKED(size_t i) {
+    const size_t target = resizeTargetSize;
+    while (values[i]) {
+        // unlink the front element from the hash chain at values[i].
+        auto v = std::move(values[i]);
+        values[i] = std::move(v->getNext());
+        if (valuesIndex) {
+            valuesIndex->remove(i, v.get(), [this](size_t slot) {
+                return values[slot].get();
+            });
+        }
+
+        // And re-link it into the correct place in resizeValues.
+        int newBucket = bucketInTable(v->getKey().hash(), target);
+        if (resizeIndex) {
+            resizeIndex->insert(newBucket,
+                                HashTagIndex::tagForHash(v->getKey().hash()),
+                                v.get());
+        }
+        v->setNext(std::move(resizeValues[newBucket]));
+        resizeValues[newBucket] = std::move(v);
+    }
+}
+
+void HashTable::enableTagIndex() {
+    MultiStripeLockHolder mlh(mutexes, n_locks);
+    if (valuesIndex) {
+        return;
+    }
+
+    stats.memOverhead.fetch_sub(memorySize());
+    valuesIndex = std::make_unique<HashTagIndex>(size, n_locks);
+    for (size_t i = 0; i < size; i++) {
+        for (StoredValue* v = values[i].get(); v; v = v->getNext().get()) {
+            valuesIndex->insert(
+                    i, HashTagIndex::tagForHash(v->getKey().hash()), v);
+        }
+    }
+    if (isResizing()) {
+        resizeIndex = std::make_unique<HashTagIndex>(resizeTargetSize.load(),
+                                                     n_locks);
+        for (size_t i = 0; i < resizeValues.size(); i++) {
+            for (StoredValue* v = resizeValues[i].get(); v;
+                 v = v->getNext().get()) {
+                resizeIndex->insert(
+                        i, HashTagIndex::tagForHash(v->getKey().hash()), v);
+            }
+        }
+    }
+    stats.memOverhead.fetch_add(memorySize());
+}
+
+void HashTable::indexInsert(size_t bucket_num, StoredValue* v) {
+    if (!valuesIndex) {
+        return;
+    }
+    const uint8_t tag = HashTagIndex::tagForHash(v->getKey().hash());
+    if (bucket_num < size) {
+        valuesIndex->insert(bucket_num, tag, v);
+    } else {
+        resizeIndex->insert(bucket_num - size, tag, v);
+    }
+}
 
-    stats.memOverhead->fetch_add(memorySize());
+void HashTable::indexRemove(size_t bucket_num, const StoredValue* v) {
+    if (!valuesIndex) {
+        return;
+    }
+    if (bucket_num < size) {
+        valuesIndex->remove(bucket_num, v, [this](size_t slot) {
+            return values[slot].get();
+        });
+    } else {
+        resizeIndex->remove(bucket_num - size, v, [this](size_t slot) {
+            return resizeValues[slot].get();
+        });
+    }
 }
 
 StoredValue* HashTable::find(const DocKey& key,
@@ -229,13 +442,14 @@ StoredValue* HashTable::find(const DocKey& key,
 
 std::unique_ptr<Item> HashTable::getRandomKey(long rnd) {
     /* Try to locate a partition */
-    size_t start = rnd % size;
+    const size_t slots = getNumSlots();
+    size_t start = rnd % slots;
     size_t curr = start;
     std::unique_ptr<Item> ret;
 
     do {
         ret = getRandomKeyFromSlot(curr++);
-        if (curr == size) {
+        if (curr >= slots) {
             curr = 0;
         }
     } while (ret == NULL && curr != start);
@@ -261,10 +475,11 @@ MutationStatus HashTable::set(Item& val) {
     }
 }
 
+template <typename Document>
 MutationStatus HashTable::unlocked_updateStoredValue(
-        const std::unique_lock<std::mutex>& htLock,
+        const std::unique_lock<StripeLock>& htLock,
         StoredValue& v,
-        const Item& itm) {
+        const Document& itm) {
     if (!htLock) {
         throw std::invalid_argument(
                 "HashTable::unlocked_updateStoredValue: htLock "
@@ -299,8 +514,8 @@ MutationStatus HashTable::unlocked_updateStoredValue(
     // If the item we are replacing is resident then we need to make sure we
     // appropriately alter the datatype stats.
     if (v.getDatatype() != itm.getDataType()) {
-        --datatypeCounts[v.getDatatype()];
-        ++datatypeCounts[itm.getDataType()];
+        --datatypeCounts[v.getDatatype()].items;
+        ++datatypeCounts[itm.getDataType()].items;
     }
 
     /* setValue() will mark v as undeleted if required */
@@ -309,8 +524,9 @@ MutationStatus HashTable::unlocked_updateStoredValue(
     return status;
 }
 
+template <typename Document>
 StoredValue* HashTable::unlocked_addNewStoredValue(const HashBucketLock& hbl,
-                                                   const Item& itm) {
+                                                   const Document& itm) {
     if (!hbl.getHTLock()) {
         throw std::invalid_argument(
                 "HashTable::unlocked_addNewStoredValue: htLock "
@@ -324,23 +540,27 @@ StoredValue* HashTable::unlocked_addNewStoredValue(const HashBucketLock& hbl,
     }
 
     // Create a new StoredValue and link it into the head of the bucket chain.
-    auto v = (*valFact)(itm, std::move(values[hbl.getBucketNum()]));
+    auto& chain = chainForBucket(hbl.getBucketNum());
+    auto v = (*valFact)(itm, std::move(chain));
     increaseMetaDataSize(stats, v->metaDataSize());
+    inlineValueSavings.fetch_add(v->getInlineValueSavings());
     increaseCacheSize(v->size());
+    increaseDatatypeValueSize(*v);
 
     if (v->isTempItem()) {
         ++numTempItems;
     } else {
         ++numItems;
         ++numTotalItems;
-        ++datatypeCounts[v->getDatatype()];
+        ++datatypeCounts[v->getDatatype()].items;
     }
     if (v->isDeleted()) {
         ++numDeletedItems;
     }
-    values[hbl.getBucketNum()] = std::move(v);
+    chain = std::move(v);
+    indexInsert(hbl.getBucketNum(), chain.get());
 
-    return values[hbl.getBucketNum()].get();
+    return chain.get();
 }
 
 std::pair<StoredValue*, StoredValue::UniquePtr>
@@ -362,20 +582,21 @@ HashTable::unlocked_replaceByCopy(const HashBucketLock& hbl,
     auto releasedSv = unlocked_release(hbl, vToCopy.getKey());
 
     /* Copy the StoredValue and link it into the head of the bucket chain. */
-    auto newSv = valFact->copyStoredValue(
-            vToCopy, std::move(values[hbl.getBucketNum()]));
+    auto& chain = chainForBucket(hbl.getBucketNum());
+    auto newSv = valFact->copyStoredValue(vToCopy, std::move(chain));
     if (newSv->isTempItem()) {
         ++numTempItems;
     } else {
         ++numItems;
         ++numTotalItems;
     }
-    values[hbl.getBucketNum()] = std::move(newSv);
+    chain = std::move(newSv);
+    indexInsert(hbl.getBucketNum(), chain.get());
 
-    return {values[hbl.getBucketNum()].get(), std::move(releasedSv)};
+    return {chain.get(), std::move(releasedSv)};
 }
 
-void HashTable::unlocked_softDelete(const std::unique_lock<std::mutex>& htLock,
+void HashTable::unlocked_softDelete(const std::unique_lock<StripeLock>& htLock,
                                     StoredValue& v,
                                     bool onlyMarkDeleted) {
     const bool alreadyDeleted = v.isDeleted();
@@ -383,7 +604,7 @@ void HashTable::unlocked_softDelete(const std::unique_lock<std::mutex>& htLock,
         decrNumNonResidentItems();
     }
 
-    --datatypeCounts[v.getDatatype()];
+    --datatypeCounts[v.getDatatype()].items;
 
     if (onlyMarkDeleted) {
         v.markDeleted();
@@ -394,9 +615,11 @@ void HashTable::unlocked_softDelete(const std::unique_lock<std::mutex>& htLock,
             ++numTotalItems;
         }
         size_t len = v.valuelen();
+        reduceDatatypeValueSize(v);
         if (v.del()) {
             reduceCacheSize(len);
         }
+        increaseDatatypeValueSize(v);
     }
     if (!alreadyDeleted) {
         ++numDeletedItems;
@@ -407,21 +630,46 @@ StoredValue* HashTable::unlocked_find(const DocKey& key,
                                       int bucket_num,
                                       WantsDeleted wantsDeleted,
                                       TrackReference trackReference) {
-    for (StoredValue* v = values[bucket_num].get(); v; v = v->getNext().get()) {
-        if (v->hasKey(key)) {
-            if (trackReference == TrackReference::Yes && !v->isDeleted()) {
-                v->referenced();
-            }
-            if (wantsDeleted == WantsDeleted::Yes || !v->isDeleted()) {
-                return v;
-            } else {
-                return NULL;
-            }
+    StoredValue* v = findInBucket(key, bucket_num);
+    if (v) {
+        if (trackReference == TrackReference::Yes && !v->isDeleted()) {
+            v->referenced();
+        }
+        if (wantsDeleted == WantsDeleted::Yes || !v->isDeleted()) {
+            return v;
         }
     }
     return NULL;
 }
 
+StoredValue* HashTable::findInBucket(const DocKey& key, int bucket_num) {
+    if (valuesIndex) {
+        const size_t bucket = bucket_num;
+        const auto& line = (bucket < size)
+                                   ? valuesIndex->getLine(bucket)
+                                   : resizeIndex->getLine(bucket - size);
+        if (line.isComplete()) {
+            // Only compare keys of entries whose tag matches.
+            const uint8_t tag = HashTagIndex::tagForHash(key.hash());
+            for (uint8_t i = 0; i < line.count; ++i) {
+                if (line.tags[i] == tag && line.values[i]->hasKey(key)) {
+                    return line.values[i];
+                }
+            }
+            return nullptr;
+        }
+        // Line has overflowed; fall back to walking the chain.
+    }
+
+    for (StoredValue* v = chainForBucket(bucket_num).get(); v;
+         v = v->getNext().get()) {
+        if (v->hasKey(key)) {
+            return v;
+        }
+    }
+    return nullptr;
+}
+
 void HashTable::unlocked_del(const HashBucketLock& hbl, const DocKey& key) {
     unlocked_release(hbl, key).reset();
 }
@@ -442,7 +690,7 @@ StoredValue::UniquePtr HashTable::unlocked_release(
 
     // Remove the first (should only be one) StoredValue with the given key.
     auto released = hashChainRemoveFirst(
-            values[hbl.getBucketNum()],
+            chainForBucket(hbl.getBucketNum()),
             [key](const StoredValue* v) { return v->hasKey(key); });
 
     if (!released) {
@@ -452,16 +700,19 @@ StoredValue::UniquePtr HashTable::unlocked_release(
                 "HashTable::unlocked_del: StoredValue to be deleted "
                 "not found in HashTable; possibly HashTable leak");
     }
+    indexRemove(hbl.getBucketNum(), released.get());
 
     // Update statistics now the item has been removed.
     reduceCacheSize(released->size());
     reduceMetaDataSize(stats, released->metaDataSize());
+    inlineValueSavings.fetch_sub(released->getInlineValueSavings());
+    reduceDatatypeValueSize(*released);
     if (released->isTempItem()) {
         --numTempItems;
     } else {
         decrNumItems();
         decrNumTotalItems();
-        --datatypeCounts[released->getDatatype()];
+        --datatypeCounts[released->getDatatype()].items;
         if (released->isDeleted()) {
             --numDeletedItems;
         }
@@ -477,7 +728,7 @@ void HashTable::visit(HashTableVisitor &visitor) {
     // Acquire one (any) of the mutexes before incrementing {visitors}, this
     // prevents any race between this visitor and the HashTable resizer.
     // See comments in pauseResumeVisit() for further details.
-    std::unique_lock<std::mutex> lh(mutexes[0]);
+    std::unique_lock<StripeLock> lh(mutexes[0]);
     VisitorTracker vt(&visitors);
     lh.unlock();
 
@@ -485,12 +736,12 @@ void HashTable::visit(HashTableVisitor &visitor) {
     size_t visited = 0;
     for (int l = 0; isActive() && !aborted && l < static_cast<int>(n_locks);
          l++) {
-        for (int i = l; i < static_cast<int>(size); i+= n_locks) {
+        for (int i = l; i < static_cast<int>(getNumSlots()); i += n_locks) {
             // (re)acquire mutex on each HashBucket, to minimise any impact
             // on front-end threads.
             HashBucketLock lh(i, mutexes[l]);
 
-            StoredValue* v = values[i].get();
+            StoredValue* v = chainForBucket(i).get();
             if (v) {
                 // TODO: Perf: This check seems costly - do we think it's still
                 // worth keeping?
@@ -522,10 +773,10 @@ void HashTable::visitDepth(HashTableDepthVisitor &visitor) {
     VisitorTracker vt(&visitors);
 
     for (int l = 0; l < static_cast<int>(n_locks); l++) {
-        LockHolder lh(mutexes[l]);
-        for (int i = l; i < static_cast<int>(size); i+= n_locks) {
+        std::lock_guard<StripeLock> lh(mutexes[l]);
+        for (int i = l; i < static_cast<int>(getNumSlots()); i += n_locks) {
             size_t depth = 0;
-            StoredValue* p = values[i].get();
+            StoredValue* p = chainForBucket(i).get();
             if (p) {
                 // TODO: Perf: This check seems costly - do we think it's still
                 // worth keeping?
@@ -571,7 +822,7 @@ HashTable::pauseResumeVisit(PauseResumeHashTableVisitor& visitor,
     // inside the inner for() loop. To prevent this race, we explicitly acquire
     // (any) mutex, increment {visitors} and then release the mutex. This
     //avoids the race as if visitors >0 then Resizer will not attempt to resize.
-    std::unique_lock<std::mutex> lh(mutexes[0]);
+    std::unique_lock<StripeLock> lh(mutexes[0]);
     VisitorTracker vt(&visitors);
     lh.unlock();
 
@@ -585,18 +836,19 @@ HashTable::pauseResumeVisit(PauseResumeHashTableVisitor& visitor,
         // recorded bucket (as long as we haven't resized).
         hash_bucket = lock;
         if (start_pos.lock == lock &&
-            start_pos.ht_size == size &&
-            start_pos.hash_bucket < size) {
+            start_pos.ht_size == getNumSlots() &&
+            start_pos.hash_bucket < getNumSlots()) {
             hash_bucket = start_pos.hash_bucket;
         }
 
         // Iterate across all values in the hash buckets owned by this lock.
         // Note: we don't record how far into the bucket linked-list we
         // pause at; so any restart will begin from the next bucket.
-        for (; !paused && hash_bucket < size; hash_bucket += n_locks) {
-            LockHolder lh(mutexes[lock]);
+        for (; !paused && hash_bucket < getNumSlots();
+             hash_bucket += n_locks) {
+            std::lock_guard<StripeLock> lh(mutexes[lock]);
 
-            StoredValue* v = values[hash_bucket].get();
+            StoredValue* v = chainForBucket(hash_bucket).get();
             while (!paused && v) {
                 StoredValue* tmp = v->getNext().get();
                 paused = !visitor.visit(*v);
@@ -607,21 +859,21 @@ HashTable::pauseResumeVisit(PauseResumeHashTableVisitor& visitor,
         // If the visitor paused us before we visited all hash buckets owned
         // by this lock, we don't want to skip the remaining hash buckets, so
         // stop the outer for loop from advancing to the next lock.
-        if (paused && hash_bucket < size) {
+        if (paused && hash_bucket < getNumSlots()) {
             break;
         }
 
         // Finished all buckets owned by this lock. Set hash_bucket to 'size'
         // to give a consistent marker for "end of lock".
-        hash_bucket = size;
+        hash_bucket = getNumSlots();
     }
 
     // Return the *next* location that should be visited.
-    return HashTable::Position(size, lock, hash_bucket);
+    return HashTable::Position(getNumSlots(), lock, hash_bucket);
 }
 
 HashTable::Position HashTable::endPosition() const  {
-    return HashTable::Position(size, n_locks, size);
+    return HashTable::Position(getNumSlots(), n_locks, getNumSlots());
 }
 
 bool HashTable::unlocked_ejectItem(StoredValue*& vptr,
@@ -633,6 +885,7 @@ bool HashTable::unlocked_ejectItem(StoredValue*& vptr,
     if (policy == VALUE_ONLY) {
         if (vptr->eligibleForEviction(policy)) {
             reduceCacheSize(vptr->valuelen());
+            reduceDatatypeValueSize(*vptr);
             vptr->ejectValue();
             ++stats.numValueEjects;
             ++numNonResidentItems;
@@ -646,12 +899,15 @@ bool HashTable::unlocked_ejectItem(StoredValue*& vptr,
         if (vptr->eligibleForEviction(policy)) {
             reduceMetaDataSize(stats, vptr->metaDataSize());
             reduceCacheSize(vptr->size());
+            inlineValueSavings.fetch_sub(vptr->getInlineValueSavings());
+            reduceDatatypeValueSize(*vptr);
             int bucket_num = getBucketForHash(vptr->getKey().hash());
 
             // Remove the item from the hash table.
             auto removed = hashChainRemoveFirst(
-                    values[bucket_num],
+                    chainForBucket(bucket_num),
                     [vptr](const StoredValue* v) { return v == vptr; });
+            indexRemove(bucket_num, removed.get());
 
             if (removed->isResident()) {
                 ++stats.numValueEjects;
@@ -661,7 +917,7 @@ bool HashTable::unlocked_ejectItem(StoredValue*& vptr,
                                            // fully evicted.
             }
             decrNumItems(); // Decrement because the item is fully evicted.
-            --datatypeCounts[vptr->getDatatype()];
+            --datatypeCounts[vptr->getDatatype()].items;
             ++numEjects;
             updateMaxDeletedRevSeqno(vptr->getRevSeqno());
 
@@ -675,7 +931,12 @@ bool HashTable::unlocked_ejectItem(StoredValue*& vptr,
 
 std::unique_ptr<Item> HashTable::getRandomKeyFromSlot(int slot) {
     auto lh = getLockedBucket(slot);
-    for (StoredValue* v = values[slot].get(); v; v = v->getNext().get()) {
+    // The table may have been resized since the slot was chosen.
+    if (static_cast<size_t>(slot) >= getNumSlots()) {
+        return nullptr;
+    }
+    for (StoredValue* v = chainForBucket(slot).get(); v;
+         v = v->getNext().get()) {
         if (!v->isTempItem() && !v->isDeleted() && v->isResident()) {
             return v->toItem(false, 0);
         }
@@ -685,7 +946,7 @@ std::unique_ptr<Item> HashTable::getRandomKeyFromSlot(int slot) {
 }
 
 bool HashTable::unlocked_restoreValue(
-        const std::unique_lock<std::mutex>& htLock,
+        const std::unique_lock<StripeLock>& htLock,
         const Item& itm,
         StoredValue& v) {
     if (!htLock || !isActive() || v.isResident()) {
@@ -698,7 +959,7 @@ bool HashTable::unlocked_restoreValue(
         /* set it back to false as we created a temp item by setting it to true
            when bg fetch is scheduled (full eviction mode). */
         v.setNewCacheItem(false);
-        ++datatypeCounts[itm.getDataType()];
+        ++datatypeCounts[itm.getDataType()].items;
     } else {
         decrNumNonResidentItems();
     }
@@ -706,10 +967,11 @@ bool HashTable::unlocked_restoreValue(
     v.restoreValue(itm);
 
     increaseCacheSize(v.getValue()->length());
+    increaseDatatypeValueSize(v);
     return true;
 }
 
-void HashTable::unlocked_restoreMeta(const std::unique_lock<std::mutex>& htLock,
+void HashTable::unlocked_restoreMeta(const std::unique_lock<StripeLock>& htLock,
                                      const Item& itm,
                                      StoredValue& v) {
     if (!htLock) {
@@ -729,7 +991,7 @@ void HashTable::unlocked_restoreMeta(const std::unique_lock<std::mutex>& htLock,
         --numTempItems;
         ++numItems;
         ++numNonResidentItems;
-        ++datatypeCounts[v.getDatatype()];
+        ++datatypeCounts[v.getDatatype()].items;
     }
 }
 
@@ -753,10 +1015,51 @@ void HashTable::reduceMetaDataSize(EPStats &st, size_t by) {
     st.currentSize.fetch_sub(by);
 }
 
-void HashTable::setValue(const Item& itm, StoredValue& v) {
+size_t HashTable::getCompressedValueSize() const {
+    size_t total = 0;
+    for (size_t ii = 0; ii < datatypeCounts.size(); ++ii) {
+        if (mcbp::datatype::is_snappy(protocol_binary_datatype_t(ii))) {
+            total += datatypeCounts[ii].valueSize;
+        }
+    }
+    return total;
+}
+
+size_t HashTable::getUncompressedValueSize() const {
+    size_t total = 0;
+    for (size_t ii = 0; ii < datatypeCounts.size(); ++ii) {
+        if (mcbp::datatype::is_snappy(protocol_binary_datatype_t(ii))) {
+            total += datatypeCounts[ii].uncompressedValueSize;
+        }
+    }
+    return total;
+}
+
+void HashTable::increaseDatatypeValueSize(const StoredValue& v) {
+    const auto& value = v.getValue();
+    if (value) {
+        auto& count = datatypeCounts[value->getDataType()];
+        count.valueSize.fetch_add(value->vlength());
+        count.uncompressedValueSize.fetch_add(value->getUncompressedLength());
+    }
+}
+
+void HashTable::reduceDatatypeValueSize(const StoredValue& v) {
+    const auto& value = v.getValue();
+    if (value) {
+        auto& count = datatypeCounts[value->getDataType()];
+        count.valueSize.fetch_sub(value->vlength());
+        count.uncompressedValueSize.fetch_sub(value->getUncompressedLength());
+    }
+}
+
+template <typename Document>
+void HashTable::setValue(const Document& itm, StoredValue& v) {
     reduceCacheSize(v.size());
+    reduceDatatypeValueSize(v);
     v.setValue(itm);
     increaseCacheSize(v.size());
+    increaseDatatypeValueSize(v);
 }
 
 std::ostream& operator<<(std::ostream& os, const HashTable& ht) {
@@ -764,13 +1067,30 @@ std::ostream& operator<<(std::ostream& os, const HashTable& ht) {
        << " numInMemory:" << ht.getNumInMemoryItems()
        << " numDeleted:" << ht.getNumDeletedItems()
        << " values: " << std::endl;
-    for (const auto& chain : ht.values) {
-        if (chain) {
-            for (StoredValue* sv = chain.get(); sv != nullptr;
-                 sv = sv->getNext().get()) {
-                os << "    " << *sv << std::endl;
+    for (const auto* table : {&ht.values, &ht.resizeValues}) {
+        for (const auto& chain : *table) {
+            if (chain) {
+                for (StoredValue* sv = chain.get(); sv != nullptr;
+                     sv = sv->getNext().get()) {
+                    os << "    " << *sv << std::endl;
+                }
             }
         }
     }
     return os;
 }
+
+// Items are stored from Items, and (when warming up) straight from the
+// DiskDocuments read from disk.
+template void HashTable::setValue(const Item&, StoredValue&);
+template void HashTable::setValue(const DiskDocument&, StoredValue&);
+template MutationStatus HashTable::unlocked_updateStoredValue(
+        const std::unique_lock<StripeLock>&, StoredValue&, const Item&);
+template MutationStatus HashTable::unlocked_updateStoredValue(
+        const std::unique_lock<StripeLock>&,
+        StoredValue&,
+        const DiskDocument&);
+template StoredValue* HashTable::unlocked_addNewStoredValue(
+        const HashBucketLock&, const Item&);
+template StoredValue* HashTable::unlocked_addNewStoredValue(
+        const HashBucketLock&, const DiskDocument&);
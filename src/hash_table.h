@@ -18,6 +18,9 @@
 #pragma once
 
 #include "config.h"
+#include "hash_tag_index.h"
+#include "locks.h"
+#include "stats.h"
 #include "storeddockey.h"
 #include "stored-value.h"
 #include <platform/non_negative_counter.h>
@@ -64,6 +67,11 @@ enum class AddStatus : uint16_t {
  * order of the number of CPUs. Essentially ht bucket B is guarded by
  * mutex B mod N.
  *
+ * By default each of the N locks is exclusive. In LockMode::SharedReads the
+ * locks are reader-writer locks - pure lookups (see getReadLockedBucket())
+ * take their stripe in shared mode so they do not serialise against each
+ * other, while every mutation still takes the stripe exclusively.
+ *
  * StoredValue objects can have their value (Blob object) ejected, making the
  * value non-resident. Such StoredValues are still in the HashTable, and their
  * metadata (CAS, revSeqno, bySeqno, etc) is still accessible, but the value
@@ -125,6 +133,75 @@ public:
         friend std::ostream& operator<<(std::ostream& os, const Position& pos);
     };
 
+    /**
+     * How the per-stripe locks guarding the hash buckets behave.
+     */
+    enum class LockMode {
+        /// Each stripe is a plain mutex; all accesses are exclusive.
+        Exclusive,
+        /// Each stripe is a reader-writer lock; read-only lookups via
+        /// getReadLockedBucket() share it, mutations remain exclusive.
+        SharedReads
+    };
+
+    /**
+     * The lock guarding one stripe of hash buckets.
+     *
+     * Meets the Lockable requirements (lock() / unlock() take the stripe
+     * exclusively) so it can be used with std::unique_lock, and additionally
+     * provides lock_shared() / unlock_shared(). In LockMode::Exclusive the
+     * shared operations simply take the mutex exclusively.
+     */
+    class StripeLock {
+    public:
+        StripeLock() : sharedReads(false) {
+        }
+
+        /// Select the lock mode; must be called before the lock is used.
+        void setMode(LockMode mode) {
+            sharedReads = (mode == LockMode::SharedReads);
+        }
+
+        void lock() {
+            if (sharedReads) {
+                rwLock.writer().lock();
+            } else {
+                mutex.lock();
+            }
+        }
+
+        void unlock() {
+            if (sharedReads) {
+                rwLock.writer().unlock();
+            } else {
+                mutex.unlock();
+            }
+        }
+
+        void lock_shared() {
+            if (sharedReads) {
+                rwLock.reader().lock();
+            } else {
+                mutex.lock();
+            }
+        }
+
+        void unlock_shared() {
+            if (sharedReads) {
+                rwLock.reader().unlock();
+            } else {
+                mutex.unlock();
+            }
+        }
+
+    private:
+        bool sharedReads;
+        std::mutex mutex;
+        cb::RWLock rwLock;
+
+        DISALLOW_COPY_AND_ASSIGN(StripeLock);
+    };
+
     /**
      * Represents a locked hash bucket that provides RAII semantics for the lock
      *
@@ -136,7 +213,7 @@ public:
         HashBucketLock()
             : bucketNum(-1) {}
 
-        HashBucketLock(int bucketNum, std::mutex& mutex)
+        HashBucketLock(int bucketNum, StripeLock& mutex)
             : bucketNum(bucketNum), htLock(mutex) {
         }
 
@@ -150,17 +227,65 @@ public:
             return bucketNum;
         }
 
-        const std::unique_lock<std::mutex>& getHTLock() const {
+        const std::unique_lock<StripeLock>& getHTLock() const {
             return htLock;
         }
 
-        std::unique_lock<std::mutex>& getHTLock() {
+        std::unique_lock<StripeLock>& getHTLock() {
             return htLock;
         }
 
     private:
         int bucketNum;
-        std::unique_lock<std::mutex> htLock;
+        std::unique_lock<StripeLock> htLock;
+    };
+
+    /**
+     * A hash bucket locked for reading only; the RAII counterpart of
+     * HashBucketLock returned by getReadLockedBucket().
+     *
+     * Holders may look up StoredValues in the bucket and read them, but must
+     * not modify the bucket or its StoredValues (other than the NRU
+     * reference hint - see getReadLockedBucket()).
+     */
+    class HashBucketReadLock {
+    public:
+        HashBucketReadLock(int bucketNum, StripeLock& mutex)
+            : bucketNum(bucketNum), mutex(&mutex) {
+            mutex.lock_shared();
+        }
+
+        HashBucketReadLock(HashBucketReadLock&& other)
+            : bucketNum(other.bucketNum), mutex(other.mutex) {
+            other.mutex = nullptr;
+        }
+
+        HashBucketReadLock(const HashBucketReadLock& other) = delete;
+
+        ~HashBucketReadLock() {
+            unlock();
+        }
+
+        int getBucketNum() const {
+            return bucketNum;
+        }
+
+        /// Is the lock currently held?
+        bool ownsLock() const {
+            return mutex != nullptr;
+        }
+
+        /// Release the lock early.
+        void unlock() {
+            if (mutex) {
+                mutex->unlock_shared();
+                mutex = nullptr;
+            }
+        }
+
+    private:
+        int bucketNum;
+        StripeLock* mutex;
     };
 
     /**
@@ -170,30 +295,80 @@ public:
      * @param svFactory Factory to use for constructing stored values
      * @param initialSize the number of hash table buckets to initially create.
      * @param locks the number of locks in the hash table
+     * @param lockMode how the hash table locks behave; see LockMode
      */
     HashTable(EPStats& st,
               std::unique_ptr<AbstractStoredValueFactory> svFactory,
               size_t initialSize,
-              size_t locks);
+              size_t locks,
+              LockMode lockMode = LockMode::Exclusive);
 
     ~HashTable();
 
     size_t memorySize() {
         return sizeof(HashTable)
-            + (size * sizeof(StoredValue*))
-            + (n_locks * sizeof(std::mutex));
+            + (getNumSlots() * sizeof(StoredValue*))
+            + (n_locks * sizeof(StripeLock))
+            + (valuesIndex ? valuesIndex->memorySize() : 0)
+            + (resizeIndex ? resizeIndex->memorySize() : 0);
     }
 
     /**
      * Get the number of hash table buckets this hash table has.
+     *
+     * During an incremental resize this is the size of the table being
+     * migrated away from; see getResizeTargetSize().
      */
     size_t getSize(void) { return size; }
 
+    /**
+     * Is an incremental resize currently in progress?
+     */
+    bool isResizing() const {
+        return resizeTargetSize.load() != 0;
+    }
+
+    /**
+     * Get the size the hash table is being incrementally resized to, or
+     * zero if no resize is in progress.
+     */
+    size_t getResizeTargetSize() const {
+        return resizeTargetSize.load();
+    }
+
+    /**
+     * Set the maximum number of hash buckets migrated per incremental
+     * resize step. Zero (the default) disables incremental resizing; the
+     * whole table is then rehashed in one go with all locks held.
+     */
+    void setResizeStepSize(size_t buckets) {
+        resizeStepSize.store(buckets);
+    }
+
+    /**
+     * Enable the cache-line packed tag index (see HashTagIndex) for lookups,
+     * in place of walking the hash chains. Typically called on an empty
+     * HashTable; any existing items are indexed.
+     */
+    void enableTagIndex();
+
+    /**
+     * Is the tag index enabled?
+     */
+    bool isTagIndexEnabled() const {
+        return valuesIndex != nullptr;
+    }
+
     /**
      * Get the number of locks in this hash table.
      */
     size_t getNumLocks(void) { return n_locks; }
 
+    /// How the hash table locks behave.
+    LockMode getLockMode() const {
+        return lockMode;
+    }
+
     /**
      * Get the number of in-memory non-resident and resident items within
      * this hash table.
@@ -250,6 +425,17 @@ public:
      */
     size_t getItemMemory(void) { return memSize; }
 
+    /**
+     * Get the bytes held by resident values with the SNAPPY datatype.
+     */
+    size_t getCompressedValueSize() const;
+
+    /**
+     * Get the bytes the resident values with the SNAPPY datatype would
+     * occupy uncompressed.
+     */
+    size_t getUncompressedValueSize() const;
+
     /**
      * Clear the hash table.
      *
@@ -274,9 +460,35 @@ public:
 
     /**
      * Resize to the specified size.
+     *
+     * If incremental resizing is enabled (see setResizeStepSize()) this only
+     * allocates the new table; the items are then moved across by
+     * subsequent calls to resizeStep().
      */
     void resize(size_t to);
 
+    /**
+     * Grow the table to the size resize() would pick for the given number
+     * of items, ahead of adding them (e.g. when warmup knows how many items
+     * are on disk), so the table isn't repeatedly resized as they are
+     * added. Unlike resize(size_t) the items already in the table (if any)
+     * are moved immediately, never incrementally.
+     */
+    void presize(size_t expectedItems);
+
+    /**
+     * Perform one step of an in-progress incremental resize, moving at most
+     * resizeStepSize hash buckets into the new table. All locks are held for
+     * the duration of the step, but released between steps so front-end
+     * operations can interleave with the migration.
+     *
+     * @return true if any hash buckets were moved (see isResizing() for
+     *         whether the resize is now complete); false if there is no
+     *         resize in progress or the step was skipped because the table
+     *         has visitors.
+     */
+    bool resizeStep();
+
     /**
      * Find the item with the given key.
      *
@@ -310,11 +522,12 @@ public:
     /**
      * Set item into StoredValue
      *
-     * @param itm the Item to store
+     * @param itm the Item (or DiskDocument) to store
      * @param   v the stored value in which itm needs
      *            to be stored
      */
-    void setValue(const Item& itm, StoredValue& v);
+    template <typename Document>
+    void setValue(const Document& itm, StoredValue& v);
 
     /**
      * Updates an existing StoredValue in the HT.
@@ -322,27 +535,29 @@ public:
      *
      * @param htLock Hash table lock that must be held.
      * @param v Reference to the StoredValue to be updated.
-     * @param itm Item to be updated.
+     * @param itm Item (or DiskDocument) to be updated.
      *
      * @return Result indicating the status of the operation
      */
+    template <typename Document>
     MutationStatus unlocked_updateStoredValue(
-            const std::unique_lock<std::mutex>& htLock,
+            const std::unique_lock<StripeLock>& htLock,
             StoredValue& v,
-            const Item& itm);
+            const Document& itm);
 
     /**
      * Adds a new StoredValue in the HT.
      * Assumes that HT bucket lock is grabbed.
      *
      * @param hbl Hash table bucket lock that must be held.
-     * @param itm Item to be added.
+     * @param itm Item (or DiskDocument) to be added.
      *
      * @return Ptr of the StoredValue added. This function always succeeds and
      *         returns non-null ptr
      */
+    template <typename Document>
     StoredValue* unlocked_addNewStoredValue(const HashBucketLock& hbl,
-                                            const Item& itm);
+                                            const Document& itm);
 
     /**
      * Replaces a StoredValue in the HT with its copy, and releases the
@@ -372,7 +587,7 @@ public:
      * @param onlyMarkDeleted indicates if we must reset the StoredValue or
      *                        just mark deleted
      */
-    void unlocked_softDelete(const std::unique_lock<std::mutex>& htLock,
+    void unlocked_softDelete(const std::unique_lock<StripeLock>& htLock,
                              StoredValue& v,
                              bool onlyMarkDeleted);
 
@@ -409,6 +624,9 @@ public:
      * @return HashBucketLock which contains a lock and the hash bucket number
      */
     inline HashBucketLock getLockedBucketForHash(int h) {
+        // Only time lookups which land mid-resize, to keep the common path
+        // free of clock reads.
+        const hrtime_t start = isResizing() ? gethrtime() : 0;
         while (true) {
             if (!isActive()) {
                 throw std::logic_error("HashTable::getLockedBucket: "
@@ -417,6 +635,10 @@ public:
             int bucket = getBucketForHash(h);
             HashBucketLock rv(bucket, mutexes[mutexForBucket(bucket)]);
             if (bucket == getBucketForHash(h)) {
+                if (start != 0) {
+                    stats.htResizeLookupHisto.add(
+                            (gethrtime() - start) / 1000);
+                }
                 return rv;
             }
         }
@@ -437,6 +659,44 @@ public:
         return getLockedBucketForHash(key.hash());
     }
 
+    /**
+     * Get a read-only lock holder for the bucket for the hash of the given
+     * key.
+     *
+     * In LockMode::SharedReads concurrent readers of the same stripe do not
+     * block each other; in LockMode::Exclusive this is equivalent to
+     * getLockedBucket(). The holder may only be used for lookups
+     * (unlocked_find()) and reads of the found StoredValue - anything which
+     * modifies the bucket requires getLockedBucket().
+     *
+     * The one exception is the NRU value and frequency counter updated by
+     * TrackReference::Yes (StoredValue::referenced()), which are updated
+     * atomically so concurrent readers may do so.
+     *
+     * @param key the key
+     * @return HashBucketReadLock which holds a shared lock and the hash
+     *         bucket number
+     */
+    inline HashBucketReadLock getReadLockedBucket(const DocKey& key) {
+        if (!isActive()) {
+            throw std::logic_error("HashTable::getReadLockedBucket: Cannot "
+                    "call on a non-active object");
+        }
+        const int h = key.hash();
+        const hrtime_t start = isResizing() ? gethrtime() : 0;
+        while (true) {
+            int bucket = getBucketForHash(h);
+            HashBucketReadLock rv(bucket, mutexes[mutexForBucket(bucket)]);
+            if (bucket == getBucketForHash(h)) {
+                if (start != 0) {
+                    stats.htResizeLookupHisto.add(
+                            (gethrtime() - start) / 1000);
+                }
+                return rv;
+            }
+        }
+    }
+
     /**
      * Delete a key from the cache without trying to lock the cache first
      * (Please note that you <b>MUST</b> acquire the mutex before calling
@@ -546,7 +806,7 @@ public:
      *
      * @return true if restored; else false
      */
-    bool unlocked_restoreValue(const std::unique_lock<std::mutex>& htLock,
+    bool unlocked_restoreValue(const std::unique_lock<StripeLock>& htLock,
                                const Item& itm,
                                StoredValue& v);
 
@@ -559,7 +819,7 @@ public:
      * @param itm the Item whose metadata is being restored
      * @param v corresponding StoredValue
      */
-    void unlocked_restoreMeta(const std::unique_lock<std::mutex>& htLock,
+    void unlocked_restoreMeta(const std::unique_lock<StripeLock>& htLock,
                               const Item& itm,
                               StoredValue& v);
 
@@ -584,8 +844,17 @@ public:
     std::atomic<size_t>       numTotalItems;
     cb::NonNegativeCounter<size_t> numNonResidentItems;
     cb::NonNegativeCounter<size_t> numDeletedItems;
-    std::array<cb::NonNegativeCounter<size_t>, mcbp::datatype::highest + 1>
-            datatypeCounts;
+    /**
+     * Per datatype: the number of items, and the bytes held by the values
+     * of those which are resident (and the bytes those values would
+     * occupy uncompressed).
+     */
+    struct DatatypeCount {
+        cb::NonNegativeCounter<size_t> items;
+        std::atomic<size_t> valueSize{0};
+        std::atomic<size_t> uncompressedValueSize{0};
+    };
+    std::array<DatatypeCount, mcbp::datatype::highest + 1> datatypeCounts;
     std::atomic<size_t>       numEjects;
     //! Memory consumed by items in this hashtable.
     std::atomic<size_t>       memSize;
@@ -593,6 +862,9 @@ public:
     std::atomic<size_t>       cacheSize;
     //! Meta-data size.
     std::atomic<size_t>       metaDataMemory;
+    //! Estimated memory saved by StoredValues with inline value storage
+    //! (see StoredValue::getInlineValueSavings()).
+    std::atomic<size_t>       inlineValueSavings;
 
 private:
     // The container for actually holding the StoredValues.
@@ -604,13 +876,40 @@ private:
     inline bool isActive() const { return activeState; }
     inline void setActiveState(bool newv) { activeState = newv; }
 
+    /**
+     * The size (from the prime size table, and at least initialSize) to
+     * resize to for the given number of items.
+     */
+    size_t getPreferredSize(size_t numItems) const;
+
+    /**
+     * Resize to the specified size; incrementally only if allowIncremental
+     * and incremental resizing is enabled.
+     */
+    void resize(size_t newSize, bool allowIncremental);
+
     // The initial (and minimum) size of the HashTable.
     const size_t initialSize;
 
     std::atomic<size_t> size;
     size_t               n_locks;
     table_type values;
-    std::mutex               *mutexes;
+    // Destination table of an in-progress incremental resize; empty
+    // otherwise. Its hash buckets are numbered after those of {values}, i.e.
+    // bucket N of resizeValues is bucket number (size + N).
+    table_type resizeValues;
+    // Size of resizeValues; zero if no resize is in progress.
+    std::atomic<size_t> resizeTargetSize;
+    // Number of hash buckets of {values} already moved into resizeValues.
+    std::atomic<size_t> resizeMigrated;
+    // Maximum number of hash buckets to migrate per resizeStep().
+    std::atomic<size_t> resizeStepSize;
+    // Optional lookup indexes over {values} and {resizeValues}; null unless
+    // the tag index is enabled.
+    std::unique_ptr<HashTagIndex> valuesIndex;
+    std::unique_ptr<HashTagIndex> resizeIndex;
+    StripeLock               *mutexes;
+    const LockMode           lockMode;
     EPStats&             stats;
     std::unique_ptr<AbstractStoredValueFactory> valFact;
     std::atomic<size_t>       visitors;
@@ -619,10 +918,66 @@ private:
     std::atomic<size_t>       numTempItems;
     bool                 activeState;
 
+    static int bucketInTable(int h, size_t tableSize) {
+        return abs(h % static_cast<int>(tableSize));
+    }
+
     int getBucketForHash(int h) {
-        return abs(h % static_cast<int>(size));
+        const int bucket = bucketInTable(h, size);
+        const size_t target = resizeTargetSize.load();
+        if (target == 0 || static_cast<size_t>(bucket) >= resizeMigrated) {
+            return bucket;
+        }
+        // This bucket has already been migrated; route to the new table.
+        return static_cast<int>(size) + bucketInTable(h, target);
+    }
+
+    /**
+     * Total number of hash buckets across the current table and (if
+     * resizing) the table being resized to.
+     */
+    size_t getNumSlots() const {
+        return size + resizeTargetSize;
     }
 
+    /**
+     * Get the hash chain for the given bucket number. Caller must hold the
+     * lock for that bucket.
+     */
+    StoredValue::UniquePtr& chainForBucket(size_t bucket_num) {
+        if (bucket_num < size) {
+            return values[bucket_num];
+        }
+        return resizeValues[bucket_num - size];
+    }
+
+    /**
+     * Complete an in-progress incremental resize, migrating every
+     * remaining hash bucket. Caller must hold all locks.
+     */
+    void finishResize_UNLOCKED();
+
+    /**
+     * Move all items in bucket {i} of {values} into {resizeValues}. Caller
+     * must hold all locks.
+     */
+    void migrateBucket_UNLOCKED(size_t i);
+
+    /**
+     * Search the given bucket for the key, via the tag index if enabled.
+     * Caller must hold the lock for the bucket.
+     */
+    StoredValue* findInBucket(const DocKey& key, int bucket_num);
+
+    /**
+     * Update the tag index (if enabled) after the given StoredValue was
+     * linked into / unlinked from the given bucket.
+     */
+    void indexInsert(size_t bucket_num, StoredValue* v);
+    void indexRemove(size_t bucket_num, const StoredValue* v);
+
+    using MultiStripeLockHolder = GenericMultiLockHolder<StripeLock>;
+
     inline size_t mutexForBucket(size_t bucket_num) {
         if (!isActive()) {
             throw std::logic_error("HashTable::mutexForBucket: Cannot call on a "
@@ -686,6 +1041,17 @@ private:
      */
     void increaseMetaDataSize(EPStats& st, size_t by);
 
+    /**
+     * Account for v's value (if resident) in the value sizes of its
+     * datatype.
+     */
+    void increaseDatatypeValueSize(const StoredValue& v);
+
+    /**
+     * Remove v's value (if resident) from the value sizes of its datatype.
+     */
+    void reduceDatatypeValueSize(const StoredValue& v);
+
     /**
      * Reduce the size of the meta data
      */
@@ -0,0 +1,105 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "hash_tag_index.h"
+
+#include "stored-value.h"
+
+#include <cstring>
+#include <limits>
+
+static const size_t cacheLineSize = 64;
+
+static_assert(sizeof(HashTagIndex::Line) == cacheLineSize,
+              "HashTagIndex::Line should occupy exactly one cache line");
+
+HashTagIndex::HashTagIndex(size_t tableSize, size_t numLocks)
+    : tableSize(tableSize),
+      numLocks(numLocks),
+      numLines(0),
+      lines(nullptr) {
+    // Lines are allocated for every (lock, block) pair; the final block may
+    // be partial.
+    const size_t blockSize = numLocks * SlotsPerLine;
+    numLines = ((tableSize + blockSize - 1) / blockSize) * numLocks;
+
+    storage.reset(new uint8_t[(numLines + 1) * sizeof(Line)]);
+    auto addr = reinterpret_cast<uintptr_t>(storage.get());
+    addr = (addr + cacheLineSize - 1) & ~(uintptr_t(cacheLineSize) - 1);
+    lines = reinterpret_cast<Line*>(addr);
+    clear();
+}
+
+void HashTagIndex::insert(size_t bucket, uint8_t tag, StoredValue* sv) {
+    Line& line = lines[lineForBucket(bucket)];
+    if (line.count < Line::Capacity) {
+        line.tags[line.count] = tag;
+        line.values[line.count] = sv;
+    }
+    if (line.count < std::numeric_limits<uint8_t>::max()) {
+        ++line.count;
+    }
+}
+
+void HashTagIndex::remove(size_t bucket,
+                          const StoredValue* sv,
+                          const ChainFn& chainFor) {
+    Line& line = lines[lineForBucket(bucket)];
+    if (line.isComplete()) {
+        for (uint8_t i = 0; i < line.count; ++i) {
+            if (line.values[i] == sv) {
+                // Swap the last entry into the vacated position.
+                --line.count;
+                line.tags[i] = line.tags[line.count];
+                line.values[i] = line.values[line.count];
+                return;
+            }
+        }
+        return;
+    }
+
+    if (line.count == std::numeric_limits<uint8_t>::max()) {
+        // Saturated; we no longer know the exact count.
+        rebuild(bucket, chainFor);
+        return;
+    }
+
+    --line.count;
+    if (line.isComplete()) {
+        // Just dropped back within capacity - repopulate the entries.
+        rebuild(bucket, chainFor);
+    }
+}
+
+void HashTagIndex::clear() {
+    std::memset(lines, 0, numLines * sizeof(Line));
+}
+
+void HashTagIndex::rebuild(size_t bucket, const ChainFn& chainFor) {
+    Line& line = lines[lineForBucket(bucket)];
+    line.count = 0;
+
+    const size_t blockSize = numLocks * SlotsPerLine;
+    const size_t first = (bucket / blockSize) * blockSize + (bucket % numLocks);
+    for (size_t slot = first;
+         slot < tableSize && slot < first + blockSize;
+         slot += numLocks) {
+        for (StoredValue* v = chainFor(slot); v; v = v->getNext().get()) {
+            insert(slot, tagForHash(v->getKey().hash()), v);
+        }
+    }
+}
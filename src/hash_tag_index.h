@@ -0,0 +1,124 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+class StoredValue;
+
+/**
+ * A cache-line packed lookup index over the hash chains of a HashTable.
+ *
+ * The HashTable's hash chains remain the owners of the StoredValues; this
+ * index sits alongside them so that lookups can avoid chasing chain
+ * pointers. Each 64-byte Line holds an 8-bit hash tag and a StoredValue
+ * pointer for up to Line::Capacity entries, covering SlotsPerLine hash
+ * buckets. A lookup compares the tags in the single Line for its bucket and
+ * only dereferences a StoredValue (to compare the key) on a tag match - so
+ * most misses touch one cache line, and most hits one line plus the
+ * matching StoredValue.
+ *
+ * If more than Capacity entries hash to a Line it is marked overflowed and
+ * lookups fall back to walking the hash chain; the Line becomes usable again
+ * once entries are removed.
+ *
+ * The hash buckets sharing a Line are always guarded by the same HashTable
+ * mutex (they are equal modulo the number of locks), so a Line is protected
+ * by the lock of any of its buckets.
+ */
+class HashTagIndex {
+public:
+    struct Line {
+        static const uint8_t Capacity = 7;
+
+        /// Is the Line a complete index of its buckets' entries?
+        bool isComplete() const {
+            return count <= Capacity;
+        }
+
+        uint8_t tags[Capacity];
+        /// Number of entries hashing to this Line (saturating at 255).
+        uint8_t count;
+        StoredValue* values[Capacity];
+    };
+
+    /// Number of hash buckets covered by each Line.
+    static const size_t SlotsPerLine = 4;
+
+    /**
+     * Callback returning the head of the given hash bucket's chain; used
+     * to rebuild a Line from the chains it covers.
+     */
+    using ChainFn = std::function<StoredValue*(size_t)>;
+
+    /**
+     * @param tableSize Number of hash buckets in the table being indexed.
+     * @param numLocks Number of locks in the owning HashTable.
+     */
+    HashTagIndex(size_t tableSize, size_t numLocks);
+
+    /// Compute the hash tag for the given key hash.
+    static uint8_t tagForHash(uint32_t hash) {
+        // Bucket selection uses the low-order bits (modulo the table size),
+        // so take the tag from the high-order byte.
+        return static_cast<uint8_t>(hash >> 24);
+    }
+
+    /// Get the Line covering the given hash bucket.
+    const Line& getLine(size_t bucket) const {
+        return lines[lineForBucket(bucket)];
+    }
+
+    /// Record that sv (with the given tag) was added to the bucket.
+    void insert(size_t bucket, uint8_t tag, StoredValue* sv);
+
+    /**
+     * Record that sv was removed from the bucket. sv must already have been
+     * unlinked from its chain.
+     */
+    void remove(size_t bucket, const StoredValue* sv, const ChainFn& chainFor);
+
+    /// Forget all entries.
+    void clear();
+
+    /// Memory used by the index.
+    size_t memorySize() const {
+        return sizeof(HashTagIndex) + (numLines * sizeof(Line));
+    }
+
+private:
+    size_t lineForBucket(size_t bucket) const {
+        return (bucket / (numLocks * SlotsPerLine)) * numLocks +
+               (bucket % numLocks);
+    }
+
+    /// Re-populate the Line covering the given bucket from its chains.
+    void rebuild(size_t bucket, const ChainFn& chainFor);
+
+    const size_t tableSize;
+    const size_t numLocks;
+    size_t numLines;
+    // Backing storage for lines; over-allocated by one Line so lines can be
+    // aligned to a cache line boundary.
+    std::unique_ptr<uint8_t[]> storage;
+    Line* lines;
+};
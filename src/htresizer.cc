@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include "ep_engine.h"
+#include "executorpool.h"
 #include "htresizer.h"
 #include "kv_bucket_iface.h"
 
@@ -31,11 +32,31 @@
  */
 class ResizingVisitor : public VBucketVisitor {
 public:
-    ResizingVisitor() { }
+    ResizingVisitor(size_t resizerTaskId)
+        : resizerTaskId(resizerTaskId), incomplete(false) {
+    }
 
     void visitBucket(VBucketPtr &vb) override {
         vb->ht.resize();
+        // An incremental resize only allocates the new table here; take the
+        // first step now and leave the rest to the HashtableResizerTask.
+        vb->ht.resizeStep();
+        if (vb->ht.isResizing()) {
+            incomplete = true;
+        }
+    }
+
+    void complete() override {
+        // Wake the resizer task so it carries on with any migrations we
+        // started, rather than waiting for its next regular run.
+        if (incomplete) {
+            ExecutorPool::get()->wake(resizerTaskId);
+        }
     }
+
+private:
+    const size_t resizerTaskId;
+    bool incomplete;
 };
 
 HashtableResizerTask::HashtableResizerTask(KVBucketIface* s, double sleepTime)
@@ -48,7 +69,31 @@ HashtableResizerTask::HashtableResizerTask(KVBucketIface* s, double sleepTime)
 
 bool HashtableResizerTask::run(void) {
     TRACE_EVENT0("ep-engine/task", "HashtableResizerTask");
-    auto pv = std::make_unique<ResizingVisitor>();
+
+    // Move any in-progress incremental resizes on by a single step each.
+    // A step is skipped while the table has visitors; it is then retried
+    // on a later run.
+    bool incomplete = false;
+    bool progressed = false;
+    for (auto vbid : store->getVBuckets().getBuckets()) {
+        VBucketPtr vb = store->getVBucket(vbid);
+        if (vb && vb->ht.isResizing()) {
+            progressed |= vb->ht.resizeStep();
+            incomplete |= vb->ht.isResizing();
+        }
+    }
+    if (incomplete) {
+        // Carry on until every migration is done before looking for new
+        // tables to resize. If we made progress just yield to other tasks;
+        // if every table was blocked by a visitor (which may run for a long
+        // time) wait for the usual interval, rather than spin taking all of
+        // their locks.
+        snooze(progressed ? 0
+                          : engine->getConfiguration().getHtResizeInterval());
+        return true;
+    }
+
+    auto pv = std::make_unique<ResizingVisitor>(getId());
     store->visit(std::move(pv),
                  "Hashtable resizer",
                  TaskId::HashtableResizerVisitorTask);
@@ -21,6 +21,7 @@
 #include "cJSON.h"
 
 #include <platform/compress.h>
+#include <snappy.h>
 
 #include  <iomanip>
 
@@ -117,6 +118,29 @@ std::ostream& operator<<(std::ostream& os, const Blob& b) {
     return os;
 }
 
+void Blob::Release(Blob* blob) {
+    if (blob->isInline()) {
+        blob->~Blob();
+        deleteInline(blob);
+    } else {
+        delete blob;
+    }
+}
+
+size_t Blob::getUncompressedLength() const {
+    size_t len = vlength();
+    if (mcbp::datatype::is_snappy(getDataType())) {
+        // Snappy records the uncompressed length in the preamble, so there
+        // is no need to inflate the value. A body which is not valid snappy
+        // (it came from a client) counts as its own length; the HashTable
+        // calls this while updating its stats, so must not throw.
+        if (!snappy::GetUncompressedLength(getData(), vlength(), &len)) {
+            len = vlength();
+        }
+    }
+    return len;
+}
+
 bool Item::compressValue(float minCompressionRatio) {
     auto datatype = getDataType();
     if (!mcbp::datatype::is_snappy(datatype)) {
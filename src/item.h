@@ -162,6 +162,15 @@ public:
         return t;
     }
 
+    /**
+     * Creates an exact copy of the specified Blob in the given storage,
+     * which must be the inline value storage of a StoredValue (see
+     * CompactStoredValueFactory) and at least other.getSize() bytes.
+     */
+    static Blob* CopyInline(void* storage, const Blob& other) {
+        return new (storage) Blob(other, /*isInline*/ true);
+    }
+
     // Actual accessorish things.
 
     /**
@@ -214,6 +223,13 @@ public:
         return size - extMetaLen - FLEX_DATA_OFFSET;
     }
 
+    /**
+     * Get the length the value part would have once inflated. For values
+     * which are not snappy-compressed (or whose snappy preamble is invalid)
+     * this is just vlength().
+     */
+    size_t getUncompressedLength() const;
+
     /**
      * Get the size of this Blob instance.
      */
@@ -256,10 +272,27 @@ public:
                            vlength());
     }
 
+    /**
+     * Does this Blob live inside the allocation of a StoredValue, rather
+     * than in its own heap allocation?
+     */
+    bool isInline() const {
+        return inlined;
+    }
+
+    /**
+     * Free a Blob once its last reference is dropped (see value_t). An
+     * inline Blob doesn't own its memory: releasing it frees the
+     * StoredValue allocation it lives in.
+     */
+    static void Release(Blob* blob);
+
     // This is necessary for making C++ happy when I'm doing a
     // placement new on fairly "normal" c++ heap allocations, just
     // with variable-sized objects.
-    void operator delete(void* p) { ::operator delete(p); }
+    void operator delete(void* p) {
+        ::operator delete(p);
+    }
 
     ~Blob() {
         ObjectRegistry::onDeleteBlob(this);
@@ -279,6 +312,7 @@ protected:
     explicit Blob(const char *start, const size_t len, uint8_t* ext_meta,
                   uint8_t ext_len) :
         size(static_cast<uint32_t>(len + FLEX_DATA_OFFSET + ext_len)),
+        inlined(false),
         extMetaLen(static_cast<uint8_t>(ext_len)),
         age(0)
     {
@@ -296,6 +330,7 @@ protected:
 
     explicit Blob(const size_t len, uint8_t ext_len) :
         size(static_cast<uint32_t>(len + FLEX_DATA_OFFSET + ext_len)),
+        inlined(false),
         extMetaLen(static_cast<uint8_t>(ext_len)),
         age(0)
     {
@@ -305,8 +340,9 @@ protected:
         ObjectRegistry::onCreateBlob(this);
     }
 
-    explicit Blob(const Blob& other)
+    explicit Blob(const Blob& other, bool isInline = false)
       : size(other.size),
+        inlined(isInline),
         extMetaLen(other.extMetaLen),
         // While this is a copy, it is a new allocation therefore reset age.
         age(0)
@@ -319,7 +355,15 @@ protected:
         return sizeof(Blob) + len - sizeof(Blob(0,0).data);
     }
 
-    const uint32_t size;
+    /**
+     * Release the StoredValue allocation containing an (already destroyed)
+     * inline Blob; defined alongside StoredValue.
+     */
+    static void deleteInline(void* p);
+
+    const uint32_t size : 31;
+    // Is this Blob allocated inline in a StoredValue? See isInline().
+    const uint32_t inlined : 1;
     const uint8_t extMetaLen;
 
     // The age of this Blob, in terms of some unspecified units of time.
@@ -336,6 +380,13 @@ protected:
 bool operator==(const Blob& lhs, const Blob& rhs);
 std::ostream& operator<<(std::ostream& os, const Blob& b);
 
+template <>
+struct RCValueReleaser<Blob> {
+    static void release(Blob* blob) {
+        Blob::Release(blob);
+    }
+};
+
 typedef SingleThreadedRCPtr<Blob> value_t;
 
 const uint64_t DEFAULT_REV_SEQ_NUM = 1;
@@ -61,17 +61,19 @@ public:
      *              visits
      * @param bias active vbuckets eviction probability bias multiplier (0-1)
      * @param phase pointer to an item_pager_phase to be set
+     * @param algorithm how to pick the items to evict
      */
     PagingVisitor(KVBucketIface& s, EPStats &st, double pcnt,
                   std::shared_ptr<std::atomic<bool>> &sfin, pager_type_t caller,
                   bool pause, double bias,
-                  std::atomic<item_pager_phase>* phase) :
+                  std::atomic<item_pager_phase>* phase,
+                  PagerAlgorithm algorithm = PagerAlgorithm::NRU) :
         store(s), stats(st), percent(pcnt),
         activeBias(bias), ejected(0),
         startTime(ep_real_time()), stateFinalizer(sfin), owner(caller),
         canPause(pause), completePhase(true),
         wasHighMemoryUsage(s.isMemoryUsageTooHigh()),
-        taskStart(gethrtime()), pager_phase(phase) {}
+        taskStart(gethrtime()), pager_phase(phase), algorithm(algorithm) {}
 
     void visit(const HashTable::HashBucketLock& lh, StoredValue* v) override {
         // Delete expired items for an active vbucket.
@@ -93,7 +95,11 @@ public:
             1 :
             static_cast<double>(std::rand()) / static_cast<double>(RAND_MAX);
 
-        if (*pager_phase == PAGING_UNREFERENCED &&
+        if (algorithm == PagerAlgorithm::TwoQueue) {
+            if (shouldEvictTwoQueue(*v, r)) {
+                doEviction(lh, v);
+            }
+        } else if (*pager_phase == PAGING_UNREFERENCED &&
             v->getNRUValue() == MAX_NRU_VALUE) {
             doEviction(lh, v);
         } else if (*pager_phase == PAGING_RANDOM &&
@@ -180,6 +186,9 @@ public:
         hrtime_t elapsed_time = (gethrtime() - taskStart) / 1000;
         if (owner == ITEM_PAGER) {
             stats.itemPagerHisto.add(elapsed_time);
+            // Start of the window to compare with that before this run.
+            stats.cacheHitsAtEviction.store(stats.cacheHits);
+            stats.cacheMissesAtEviction.store(stats.cacheMisses);
         } else if (owner == EXPIRY_PAGER) {
             stats.expiryPagerHisto.add(elapsed_time);
         }
@@ -221,6 +230,34 @@ private:
         }
     }
 
+    /**
+     * The 2Q-style choice: items read more than once since they were last
+     * swept (frequency above MaxProbationFrequency) are "protected", the
+     * rest - including those read just once by a scan - "probationary".
+     * Probationary items are evicted exactly as by the NRU algorithm.
+     * Protected items are not evicted; instead each sweep which finds one
+     * unreferenced ages its frequency, so an item which stops being read
+     * falls back to probation after a sweep or two.
+     */
+    bool shouldEvictTwoQueue(StoredValue& v, double r) {
+        const bool isProtected = v.getFrequency() > MaxProbationFrequency;
+        if (*pager_phase == PAGING_UNREFERENCED) {
+            return !isProtected && v.getNRUValue() == MAX_NRU_VALUE;
+        }
+        if (v.incrNRUValue() != MAX_NRU_VALUE) {
+            return false;
+        }
+        if (isProtected) {
+            v.decayFrequency();
+            return false;
+        }
+        return r <= percent;
+    }
+
+    // Highest frequency at which an item is still probationary (see
+    // shouldEvictTwoQueue()).
+    static const uint8_t MaxProbationFrequency = 1;
+
     void doEviction(const HashTable::HashBucketLock& lh, StoredValue* v) {
         item_eviction_policy_t policy = store.getItemEvictionPolicy();
         StoredDocKey key(v->getKey());
@@ -253,6 +290,7 @@ private:
     bool wasHighMemoryUsage;
     hrtime_t taskStart;
     std::atomic<item_pager_phase>* pager_phase;
+    const PagerAlgorithm algorithm;
     VBucketPtr currentBucket;
 };
 
@@ -296,6 +334,16 @@ bool ItemPager::run(void) {
         Configuration &cfg = engine->getConfiguration();
         size_t activeEvictPerc = cfg.getPagerActiveVbPcnt();
         double bias = static_cast<double>(activeEvictPerc) / 50;
+        const auto algorithm = cfg.getPagerAlgorithm() == "2q"
+                                       ? PagerAlgorithm::TwoQueue
+                                       : PagerAlgorithm::NRU;
+
+        // The gets since the previous run completed, to compare with those
+        // after this one.
+        stats.cacheHitsBeforeEviction.store(stats.cacheHits -
+                                            stats.cacheHitsAtEviction);
+        stats.cacheMissesBeforeEviction.store(stats.cacheMisses -
+                                              stats.cacheMissesAtEviction);
 
         auto pv = std::make_unique<PagingVisitor>(*kvBucket,
                                                   stats,
@@ -304,7 +352,8 @@ bool ItemPager::run(void) {
                                                   ITEM_PAGER,
                                                   false,
                                                   bias,
-                                                  &phase);
+                                                  &phase,
+                                                  algorithm);
         kvBucket->visit(std::move(pv),
                         "Item pager",
                         TaskId::ItemPagerVisitor);
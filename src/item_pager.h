@@ -36,6 +36,14 @@ enum item_pager_phase {
     PAGING_RANDOM
 };
 
+/**
+ * How the item pager picks which items to evict (see pager_algorithm)
+ */
+enum class PagerAlgorithm {
+    NRU, // Evict items not recently used (by their NRU value).
+    TwoQueue // As NRU, but only once they are no longer frequently used.
+};
+
 /**
  * Item eviction policy
  */
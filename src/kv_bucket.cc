@@ -116,8 +116,13 @@ public:
     virtual void sizeValueChanged(const std::string &key, size_t value) {
         if (key.compare("bg_fetch_delay") == 0) {
             store.setBGFetchDelay(static_cast<uint32_t>(value));
+        } else if (key.compare("bg_fetch_max_concurrency") == 0) {
+            store.setBGFetchMaxConcurrency(value);
         } else if (key.compare("compaction_write_queue_cap") == 0) {
             store.setCompactionWriteQueueCap(value);
+        } else if (key.compare("compaction_max_bandwidth") == 0 ||
+                   key.compare("compaction_commit_latency_target") == 0) {
+            store.configureCompactionRateLimiter();
         } else if (key.compare("exp_pager_stime") == 0) {
             store.setExpiryPagerSleeptime(value);
         } else if (key.compare("alog_sleep_time") == 0) {
@@ -164,6 +169,8 @@ public:
             } else {
                 store.disableExpiryPager();
             }
+        } else if (key.compare("flusher_pipeline_enabled") == 0) {
+            store.setFlusherPipelineEnabled(value);
         }
     }
 
@@ -172,6 +179,14 @@ public:
             store.setBfiltersResidencyThreshold(value);
         } else if (key.compare("dcp_min_compression_ratio") == 0) {
             store.getEPEngine().updateDcpMinCompressionRatio(value);
+        } else if (key.compare("compression_min_ratio") == 0) {
+            store.setCompressionMinRatio(value);
+        }
+    }
+
+    virtual void stringValueChanged(const std::string& key, const char* value) {
+        if (key.compare("compression_mode") == 0) {
+            store.setCompressionMode(value);
         }
     }
 
@@ -348,8 +363,12 @@ KVBucket::KVBucket(EventuallyPersistentEngine& theEngine)
       stats(engine.getEpStats()),
       vbMap(theEngine.getConfiguration(), *this),
       defragmenterTask(NULL),
+      compressionActive(false),
+      compressionMinRatio(1.0),
+      flusherPipelineEnabled(false),
       diskDeleteAll(false),
       bgFetchDelay(0),
+      bgFetchMaxConcurrency(1),
       backfillMemoryThreshold(0.95),
       statsSnapshotTaskId(0),
       lastTransTimePerItem(0),
@@ -379,7 +398,7 @@ KVBucket::KVBucket(EventuallyPersistentEngine& theEngine)
     size_t num_vbs = config.getMaxVbuckets();
     vb_mutexes = new std::mutex[num_vbs];
 
-    *stats.memOverhead = sizeof(KVBucket);
+    stats.memOverhead = sizeof(KVBucket);
 
     stats.setMaxDataSize(config.getMaxSize());
     config.addValueChangedListener("max_size",
@@ -418,6 +437,10 @@ KVBucket::KVBucket(EventuallyPersistentEngine& theEngine)
     config.addValueChangedListener("bg_fetch_delay",
                                    new EPStoreValueChangeListener(*this));
 
+    setBGFetchMaxConcurrency(config.getBgFetchMaxConcurrency());
+    config.addValueChangedListener("bg_fetch_max_concurrency",
+                                   new EPStoreValueChangeListener(*this));
+
     stats.warmupMemUsedCap.store(static_cast<double>
                                (config.getWarmupMinMemoryThreshold()) / 100.0);
     config.addValueChangedListener("warmup_min_memory_threshold",
@@ -454,9 +477,27 @@ KVBucket::KVBucket(EventuallyPersistentEngine& theEngine)
     config.addValueChangedListener("compaction_write_queue_cap",
                                    new EPStoreValueChangeListener(*this));
 
+    configureCompactionRateLimiter();
+    config.addValueChangedListener("compaction_max_bandwidth",
+                                   new EPStoreValueChangeListener(*this));
+    config.addValueChangedListener("compaction_commit_latency_target",
+                                   new EPStoreValueChangeListener(*this));
+
     config.addValueChangedListener("dcp_min_compression_ratio",
                                    new EPStoreValueChangeListener(*this));
 
+    setCompressionMode(config.getCompressionMode());
+    config.addValueChangedListener("compression_mode",
+                                   new EPStoreValueChangeListener(*this));
+
+    compressionMinRatio = config.getCompressionMinRatio();
+    config.addValueChangedListener("compression_min_ratio",
+                                   new EPStoreValueChangeListener(*this));
+
+    flusherPipelineEnabled = config.isFlusherPipelineEnabled();
+    config.addValueChangedListener("flusher_pipeline_enabled",
+                                   new EPStoreValueChangeListener(*this));
+
     if (config.isWarmup()) {
         warmupTask = std::make_unique<Warmup>(*this, config);
     }
@@ -611,6 +652,32 @@ bool KVBucket::isMetaDataResident(VBucketPtr &vb, const DocKey& key) {
     }
 }
 
+void KVBucket::setCompressionMode(const std::string& mode) {
+    if (mode == "active") {
+        compressionActive = true;
+    } else if (mode == "off") {
+        compressionActive = false;
+    } else {
+        LOG(EXTENSION_LOG_WARNING,
+            "KVBucket::setCompressionMode: Invalid value '%s' for "
+            "'compression_mode' - ignoring.",
+            mode.c_str());
+    }
+}
+
+void KVBucket::compressValueIfRequired(Item& itm) const {
+    if (!compressionActive || itm.isDeleted() || itm.getNBytes() == 0) {
+        return;
+    }
+
+    if (!itm.compressValue(compressionMinRatio)) {
+        LOG(EXTENSION_LOG_WARNING,
+            "KVBucket::compressValueIfRequired: (vb %" PRIu16 ") Failed to "
+            "snappy compress value - storing it uncompressed",
+            itm.getVBucketId());
+    }
+}
+
 ENGINE_ERROR_CODE KVBucket::set(Item &itm, const void *cookie) {
 
     VBucketPtr vb = getVBucket(itm.getVBucketId());
@@ -619,6 +686,8 @@ ENGINE_ERROR_CODE KVBucket::set(Item &itm, const void *cookie) {
         return ENGINE_NOT_MY_VBUCKET;
     }
 
+    compressValueIfRequired(itm);
+
     // Obtain read-lock on VB state to ensure VB state changes are interlocked
     // with this set
     ReaderLockHolder rlh(vb->getStateLock());
@@ -656,6 +725,8 @@ ENGINE_ERROR_CODE KVBucket::add(Item &itm, const void *cookie)
         return ENGINE_NOT_MY_VBUCKET;
     }
 
+    compressValueIfRequired(itm);
+
     // Obtain read-lock on VB state to ensure VB state changes are interlocked
     // with this add
     ReaderLockHolder rlh(vb->getStateLock());
@@ -695,6 +766,8 @@ ENGINE_ERROR_CODE KVBucket::replace(Item &itm, const void *cookie) {
         return ENGINE_NOT_MY_VBUCKET;
     }
 
+    compressValueIfRequired(itm);
+
     // Obtain read-lock on VB state to ensure VB state changes are interlocked
     // with this replace
     ReaderLockHolder rlh(vb->getStateLock());
@@ -727,6 +800,8 @@ ENGINE_ERROR_CODE KVBucket::addBackfillItem(Item& itm,
         return ENGINE_NOT_MY_VBUCKET;
     }
 
+    compressValueIfRequired(itm);
+
     // Obtain read-lock on VB state to ensure VB state changes are interlocked
     // with this add-tapbackfill
     ReaderLockHolder rlh(vb->getStateLock());
@@ -962,6 +1037,14 @@ ENGINE_ERROR_CODE KVBucket::scheduleCompaction(uint16_t vbid, compaction_ctx c,
    return ENGINE_EWOULDBLOCK;
 }
 
+void KVBucket::configureCompactionRateLimiter() {
+    Configuration& config = engine.getConfiguration();
+    compactionRateLimiter.configure(
+            config.getCompactionMaxBandwidth() * 1024 * 1024,
+            std::chrono::milliseconds(
+                    config.getCompactionCommitLatencyTarget()));
+}
+
 uint16_t KVBucket::getDBFileId(const protocol_binary_request_compact_db& req) {
     KVStore *store = vbMap.shards[0]->getROUnderlying();
     return store->getDBFileId(req);
@@ -974,6 +1057,8 @@ void KVBucket::compactInternal(compaction_ctx *ctx) {
     ExpiredItemsCBPtr expiry(new ExpiredItemsCallback(*this));
     ctx->expiryCallback = expiry;
 
+    ctx->rateLimiter = &compactionRateLimiter;
+
     KVShard* shard = vbMap.getShardByVbId(ctx->db_file_id);
     KVStore* store = shard->getRWUnderlying();
     bool result = store->compactDB(ctx);
@@ -1302,6 +1387,14 @@ void KVBucket::appendAggregatedVBucketStats(VBucketCountVisitor& active,
     DO_STAT("ep_total_cache_size",
             active.getCacheSize() + replica.getCacheSize() +
                     pending.getCacheSize());
+    DO_STAT("ep_compressed_value_size",
+            active.getCompressedValueSize() +
+                    replica.getCompressedValueSize() +
+                    pending.getCompressedValueSize());
+    DO_STAT("ep_uncompressed_value_size",
+            active.getUncompressedValueSize() +
+                    replica.getUncompressedValueSize() +
+                    pending.getUncompressedValueSize());
     DO_STAT("rollback_item_count",
             active.getRollbackItemCount() + replica.getRollbackItemCount() +
                     pending.getRollbackItemCount());
@@ -1371,12 +1464,12 @@ void KVBucket::completeBGFetch(const DocKey& key,
             VBucketBGFetchItem item{gcb.val, cookie, init, isMeta};
             ENGINE_ERROR_CODE status =
                     vb->completeBGFetchForSingleItem(key, item, startTime);
-            engine.notifyIOComplete(item.cookie, status);
+            notifyBGFetchComplete(item.cookie, status);
         } else {
             LOG(EXTENSION_LOG_INFO, "vb:%" PRIu16 " file was deleted in the "
                 "middle of a bg fetch for key{%.*s}\n", vbucket, int(key.size()),
                 key.data());
-            engine.notifyIOComplete(cookie, ENGINE_NOT_MY_VBUCKET);
+            notifyBGFetchComplete(cookie, ENGINE_NOT_MY_VBUCKET);
         }
     }
 
@@ -1395,7 +1488,7 @@ void KVBucket::completeBGFetchMulti(uint16_t vbId,
             auto* fetched_item = item.second;
             ENGINE_ERROR_CODE status = vb->completeBGFetchForSingleItem(
                     key, *fetched_item, startTime);
-            engine.notifyIOComplete(fetched_item->cookie, status);
+            notifyBGFetchComplete(fetched_item->cookie, status);
         }
         LOG(EXTENSION_LOG_DEBUG,
             "EP Store completes %" PRIu64 " of batched background fetch "
@@ -1403,8 +1496,7 @@ void KVBucket::completeBGFetchMulti(uint16_t vbId,
             uint64_t(fetchedItems.size()), vbId, gethrtime()/1000000);
     } else {
         for (const auto& item : fetchedItems) {
-            engine.notifyIOComplete(item.second->cookie,
-                                    ENGINE_NOT_MY_VBUCKET);
+            notifyBGFetchComplete(item.second->cookie, ENGINE_NOT_MY_VBUCKET);
         }
         LOG(EXTENSION_LOG_WARNING,
             "EP Store completes %d of batched background fetch for "
@@ -1414,6 +1506,16 @@ void KVBucket::completeBGFetchMulti(uint16_t vbId,
     }
 }
 
+void KVBucket::notifyBGFetchComplete(const void* cookie,
+                                     ENGINE_ERROR_CODE status) {
+    if (status != ENGINE_SUCCESS) {
+        // memcached only calls the engine again for the waiting command if
+        // the fetch succeeded; clear the retry marker it may have left.
+        engine.storeEngineSpecific(cookie, NULL);
+    }
+    engine.notifyIOComplete(cookie, status);
+}
+
 GetValue KVBucket::getInternal(const DocKey& key, uint16_t vbucket,
                                const void *cookie, vbucket_state_t allowedState,
                                get_options_t options) {
@@ -1543,6 +1645,8 @@ ENGINE_ERROR_CODE KVBucket::setWithMeta(Item &itm,
         return ENGINE_NOT_MY_VBUCKET;
     }
 
+    compressValueIfRequired(itm);
+
     ReaderLockHolder rlh(vb->getStateLock());
     if (vb->getState() == vbucket_state_dead) {
         ++stats.numNotMyVBuckets;
@@ -2038,204 +2142,249 @@ int KVBucket::flushVBucket(uint16_t vbid) {
         }
     }
 
-    int items_flushed = 0;
-    const hrtime_t flush_start = gethrtime();
+    FlushBatch batch;
+    if (!drainFlushBatch(vbid, batch)) {
+        return RETRY_FLUSH_VBUCKET;
+    }
+    if (!batch.vb) {
+        return 0;
+    }
+    if (!writeFlushBatch(batch)) {
+        return RETRY_FLUSH_VBUCKET;
+    }
+    commitFlushBatch(batch);
+    return completeFlushBatch(batch);
+}
+
+bool KVBucket::drainFlushBatch(uint16_t vbid, FlushBatch& batch) {
+    batch.flushStart = gethrtime();
 
     VBucketPtr vb = vbMap.getBucket(vbid);
-    if (vb) {
-        std::unique_lock<std::mutex> lh(vb_mutexes[vbid], std::try_to_lock);
-        if (!lh.owns_lock()) { // Try another bucket if this one is locked
-            return RETRY_FLUSH_VBUCKET; // to avoid blocking flusher
-        }
+    if (!vb) {
+        return true;
+    }
+    batch.lock = std::unique_lock<std::mutex>(vb_mutexes[vbid],
+                                              std::try_to_lock);
+    if (!batch.lock.owns_lock()) { // Try another bucket if this one is locked
+        return false; // to avoid blocking flusher
+    }
+    batch.vb = vb;
 
-        std::vector<queued_item> items;
-        KVStore *rwUnderlying = getRWUnderlying(vbid);
+    auto& items = batch.items;
+    batch.rwUnderlying = getRWUnderlying(vbid);
 
-        while (!vb->rejectQueue.empty()) {
-            items.push_back(vb->rejectQueue.front());
-            vb->rejectQueue.pop();
-        }
+    while (!vb->rejectQueue.empty()) {
+        items.push_back(vb->rejectQueue.front());
+        vb->rejectQueue.pop();
+    }
 
-        // Append any 'backfill' items (mutations added by a TAP stream).
-        vb->getBackfillItems(items);
+    // Append any 'backfill' items (mutations added by a TAP stream).
+    vb->getBackfillItems(items);
 
-        // Append all items outstanding for the persistence cursor.
-        snapshot_range_t range;
-        hrtime_t _begin_ = gethrtime();
-        range = vb->checkpointManager.getAllItemsForCursor(
-                CheckpointManager::pCursorName, items);
-        stats.persistenceCursorGetItemsHisto.add((gethrtime() - _begin_) / 1000);
+    // Append all items outstanding for the persistence cursor.
+    hrtime_t _begin_ = gethrtime();
+    batch.range = vb->checkpointManager.getAllItemsForCursor(
+            CheckpointManager::pCursorName, items);
+    stats.persistenceCursorGetItemsHisto.add((gethrtime() - _begin_) / 1000);
 
-        if (!items.empty()) {
-            while (!rwUnderlying->begin()) {
-                ++stats.beginFailed;
-                LOG(EXTENSION_LOG_WARNING, "Failed to start a transaction!!! "
-                    "Retry in 1 sec ...");
-                sleep(1);
-            }
-            rwUnderlying->optimizeWrites(items);
+    if (!items.empty()) {
+        batch.rwUnderlying->optimizeWrites(items);
+    }
+    return true;
+}
+
+bool KVBucket::writeFlushBatch(FlushBatch& batch) {
+    auto& vb = batch.vb;
+    auto& items = batch.items;
+    auto& range = batch.range;
+    KVStore* rwUnderlying = batch.rwUnderlying;
+    if (items.empty()) {
+        return true;
+    }
 
-            Item *prev = NULL;
-            auto vbstate = vb->getVBucketState();
-            uint64_t maxSeqno = 0;
-            range.start = std::max(range.start, vbstate.lastSnapStart);
+    while (!rwUnderlying->begin()) {
+        ++stats.beginFailed;
+        LOG(EXTENSION_LOG_WARNING, "Failed to start a transaction!!! "
+            "Retry in 1 sec ...");
+        sleep(1);
+    }
 
-            bool mustCheckpointVBState = false;
-            std::list<PersistenceCallback*>& pcbs = rwUnderlying->getPersistenceCbList();
+    Item *prev = NULL;
+    auto vbstate = vb->getVBucketState();
+    uint64_t maxSeqno = 0;
+    range.start = std::max(range.start, vbstate.lastSnapStart);
 
-            SystemEventFlush sef;
+    bool mustCheckpointVBState = false;
+    std::list<PersistenceCallback*>& pcbs = rwUnderlying->getPersistenceCbList();
 
-            for (const auto& item : items) {
+    SystemEventFlush& sef = batch.sef;
 
-                if (!item->shouldPersist()) {
-                    continue;
-                }
+    for (const auto& item : items) {
 
-                // Pass the Item through the SystemEventFlush which may filter
-                // the item away (return Skip).
-                if (sef.process(item) == ProcessStatus::Skip) {
-                    // The item has no further flushing actions i.e. we've
-                    // absorbed it in the process function.
-                    // Update stats and carry-on
-                    --stats.diskQueueSize;
-                    vb->doStatsForFlushing(*item, item->size());
-                    continue;
-                }
+        if (!item->shouldPersist()) {
+            continue;
+        }
 
-                if (item->getOperation() == queue_op::set_vbucket_state) {
-                    // No actual item explicitly persisted to (this op exists
-                    // to ensure a commit occurs with the current vbstate);
-                    // flag that we must trigger a snapshot even if there are
-                    // no 'real' items in the checkpoint.
-                    mustCheckpointVBState = true;
-
-                    // Update queuing stats how this item has logically been
-                    // processed.
-                    --stats.diskQueueSize;
-                    vb->doStatsForFlushing(*item, item->size());
-
-                } else if (!prev || prev->getKey() != item->getKey()) {
-                    prev = item.get();
-                    ++items_flushed;
-                    PersistenceCallback *cb = flushOneDelOrSet(item, vb);
-                    if (cb) {
-                        pcbs.push_back(cb);
-                    }
+        // Pass the Item through the SystemEventFlush which may filter
+        // the item away (return Skip).
+        if (sef.process(item) == ProcessStatus::Skip) {
+            // The item has no further flushing actions i.e. we've
+            // absorbed it in the process function.
+            // Update stats and carry-on
+            --stats.diskQueueSize;
+            vb->doStatsForFlushing(*item, item->size());
+            continue;
+        }
 
-                    maxSeqno = std::max(maxSeqno, (uint64_t)item->getBySeqno());
-                    vbstate.maxCas = std::max(vbstate.maxCas, item->getCas());
-                    if (item->isDeleted()) {
-                        vbstate.maxDeletedSeqno =
-                                std::max(vbstate.maxDeletedSeqno,
-                                         item->getRevSeqno());
-                    }
-                    ++stats.flusher_todo;
+        if (item->getOperation() == queue_op::set_vbucket_state) {
+            // No actual item explicitly persisted to (this op exists
+            // to ensure a commit occurs with the current vbstate);
+            // flag that we must trigger a snapshot even if there are
+            // no 'real' items in the checkpoint.
+            mustCheckpointVBState = true;
 
-                } else {
-                    // Item is the same key as the previous[1] one - don't need
-                    // to flush to disk.
-                    // [1] Previous here really means 'next' - optimizeWrites()
-                    //     above has actually re-ordered items such that items
-                    //     with the same key are ordered from high->low seqno.
-                    //     This means we only write the highest (i.e. newest)
-                    //     item for a given key, and discard any duplicate,
-                    //     older items.
-                    --stats.diskQueueSize;
-                    vb->doStatsForFlushing(*item, item->size());
-                }
+            // Update queuing stats how this item has logically been
+            // processed.
+            --stats.diskQueueSize;
+            vb->doStatsForFlushing(*item, item->size());
+
+        } else if (!prev || prev->getKey() != item->getKey()) {
+            prev = item.get();
+            ++batch.itemsFlushed;
+            PersistenceCallback *cb = flushOneDelOrSet(item, vb);
+            if (cb) {
+                pcbs.push_back(cb);
             }
 
+            maxSeqno = std::max(maxSeqno, (uint64_t)item->getBySeqno());
+            vbstate.maxCas = std::max(vbstate.maxCas, item->getCas());
+            if (item->isDeleted()) {
+                vbstate.maxDeletedSeqno =
+                        std::max(vbstate.maxDeletedSeqno,
+                                 item->getRevSeqno());
+            }
+            ++stats.flusher_todo;
 
-            {
-                ReaderLockHolder rlh(vb->getStateLock());
-                if (vb->getState() == vbucket_state_active) {
-                    if (maxSeqno) {
-                        range.start = maxSeqno;
-                        range.end = maxSeqno;
-                    }
-                }
-
-                // Update VBstate based on the changes we have just made,
-                // then tell the rwUnderlying the 'new' state
-                // (which will persisted as part of the commit() below).
-                vbstate.lastSnapStart = range.start;
-                vbstate.lastSnapEnd = range.end;
-
-                // Do we need to trigger a persist of the state?
-                // If there are no "real" items to flush, and we encountered
-                // a set_vbucket_state meta-item.
-                auto options = VBStatePersist::VBSTATE_CACHE_UPDATE_ONLY;
-                if ((items_flushed == 0) && mustCheckpointVBState) {
-                    options = VBStatePersist::VBSTATE_PERSIST_WITH_COMMIT;
-                }
+        } else {
+            // Item is the same key as the previous[1] one - don't need
+            // to flush to disk.
+            // [1] Previous here really means 'next' - optimizeWrites()
+            //     above has actually re-ordered items such that items
+            //     with the same key are ordered from high->low seqno.
+            //     This means we only write the highest (i.e. newest)
+            //     item for a given key, and discard any duplicate,
+            //     older items.
+            --stats.diskQueueSize;
+            vb->doStatsForFlushing(*item, item->size());
+        }
+    }
 
-                if (rwUnderlying->snapshotVBucket(vb->getId(), vbstate,
-                                                  options) != true) {
-                    return RETRY_FLUSH_VBUCKET;
-                }
 
-                if (vb->setBucketCreation(false)) {
-                    LOG(EXTENSION_LOG_INFO, "VBucket %" PRIu16 " created", vbid);
-                }
+    {
+        ReaderLockHolder rlh(vb->getStateLock());
+        if (vb->getState() == vbucket_state_active) {
+            if (maxSeqno) {
+                range.start = maxSeqno;
+                range.end = maxSeqno;
             }
+        }
 
-            /* Perform an explicit commit to disk if the commit
-             * interval reaches zero and if there is a non-zero number
-             * of items to flush.
-             * Or if there is a manifest item
-             */
-            if (items_flushed > 0 || sef.getCollectionsManifestItem()) {
-                commit(*rwUnderlying, sef.getCollectionsManifestItem());
+        // Update VBstate based on the changes we have just made,
+        // then tell the rwUnderlying the 'new' state
+        // (which will persisted as part of the commit() below).
+        vbstate.lastSnapStart = range.start;
+        vbstate.lastSnapEnd = range.end;
 
-                // Now the commit is complete, vBucket file must exist.
-                if (vb->setBucketCreation(false)) {
-                    LOG(EXTENSION_LOG_INFO, "VBucket %" PRIu16 " created", vbid);
-                }
-            }
+        // Do we need to trigger a persist of the state?
+        // If there are no "real" items to flush, and we encountered
+        // a set_vbucket_state meta-item.
+        auto options = VBStatePersist::VBSTATE_CACHE_UPDATE_ONLY;
+        if ((batch.itemsFlushed == 0) && mustCheckpointVBState) {
+            options = VBStatePersist::VBSTATE_PERSIST_WITH_COMMIT;
+        }
 
-            hrtime_t flush_end = gethrtime();
-            uint64_t trans_time = (flush_end - flush_start) / 1000000;
-
-            lastTransTimePerItem.store((items_flushed == 0) ? 0 :
-                                       static_cast<double>(trans_time) /
-                                       static_cast<double>(items_flushed));
-            stats.cumulativeFlushTime.fetch_add(trans_time);
-            stats.flusher_todo.store(0);
-            stats.totalPersistVBState++;
-
-            if (vb->rejectQueue.empty()) {
-                vb->setPersistedSnapshot(range.start, range.end);
-                uint64_t highSeqno = rwUnderlying->getLastPersistedSeqno(vbid);
-                if (highSeqno > 0 &&
-                    highSeqno != vb->getPersistenceSeqno()) {
-                    vb->setPersistenceSeqno(highSeqno);
-                }
-            }
+        if (rwUnderlying->snapshotVBucket(vb->getId(), vbstate,
+                                          options) != true) {
+            return false;
         }
 
-        rwUnderlying->pendingTasks();
+        if (vb->setBucketCreation(false)) {
+            LOG(EXTENSION_LOG_INFO, "VBucket %" PRIu16 " created",
+                vb->getId());
+        }
+    }
+
+    /* Perform an explicit commit to disk if the commit
+     * interval reaches zero and if there is a non-zero number
+     * of items to flush.
+     * Or if there is a manifest item
+     */
+    batch.needsCommit =
+            batch.itemsFlushed > 0 || sef.getCollectionsManifestItem();
+    return true;
+}
+
+void KVBucket::commitFlushBatch(FlushBatch& batch) {
+    if (batch.needsCommit) {
+        commit(*batch.rwUnderlying, batch.sef.getCollectionsManifestItem());
+    }
+}
 
-        if (vb->checkpointManager.getNumCheckpoints() > 1) {
-            wakeUpCheckpointRemover();
+int KVBucket::completeFlushBatch(FlushBatch& batch) {
+    auto& vb = batch.vb;
+    const uint16_t vbid = vb->getId();
+    KVStore* rwUnderlying = batch.rwUnderlying;
+
+    if (!batch.items.empty()) {
+        if (batch.needsCommit) {
+            // Now the commit is complete, vBucket file must exist.
+            if (vb->setBucketCreation(false)) {
+                LOG(EXTENSION_LOG_INFO, "VBucket %" PRIu16 " created", vbid);
+            }
         }
 
+        hrtime_t flush_end = gethrtime();
+        uint64_t trans_time = (flush_end - batch.flushStart) / 1000000;
+
+        lastTransTimePerItem.store((batch.itemsFlushed == 0) ? 0 :
+                                   static_cast<double>(trans_time) /
+                                   static_cast<double>(batch.itemsFlushed));
+        stats.cumulativeFlushTime.fetch_add(trans_time);
+        stats.flusher_todo.store(0);
+        stats.totalPersistVBState++;
+
         if (vb->rejectQueue.empty()) {
-            vb->checkpointManager.itemsPersisted();
-            uint64_t seqno = vb->getPersistenceSeqno();
-            uint64_t chkid = vb->checkpointManager.getPersistenceCursorPreChkId();
-            vb->notifyHighPriorityRequests(
-                    engine, seqno, HighPriorityVBNotify::Seqno);
-            vb->notifyHighPriorityRequests(
-                    engine, chkid, HighPriorityVBNotify::ChkPersistence);
-            if (chkid > 0 && chkid != vb->getPersistenceCheckpointId()) {
-                vb->setPersistenceCheckpointId(chkid);
+            vb->setPersistedSnapshot(batch.range.start, batch.range.end);
+            uint64_t highSeqno = rwUnderlying->getLastPersistedSeqno(vbid);
+            if (highSeqno > 0 &&
+                highSeqno != vb->getPersistenceSeqno()) {
+                vb->setPersistenceSeqno(highSeqno);
             }
-        } else {
-            return RETRY_FLUSH_VBUCKET;
         }
     }
 
-    return items_flushed;
+    rwUnderlying->pendingTasks();
+
+    if (vb->checkpointManager.getNumCheckpoints() > 1) {
+        wakeUpCheckpointRemover();
+    }
+
+    if (vb->rejectQueue.empty()) {
+        vb->checkpointManager.itemsPersisted();
+        uint64_t seqno = vb->getPersistenceSeqno();
+        uint64_t chkid = vb->checkpointManager.getPersistenceCursorPreChkId();
+        vb->notifyHighPriorityRequests(
+                engine, seqno, HighPriorityVBNotify::Seqno);
+        vb->notifyHighPriorityRequests(
+                engine, chkid, HighPriorityVBNotify::ChkPersistence);
+        if (chkid > 0 && chkid != vb->getPersistenceCheckpointId()) {
+            vb->setPersistenceCheckpointId(chkid);
+        }
+    } else {
+        return RETRY_FLUSH_VBUCKET;
+    }
+
+    return batch.itemsFlushed;
 }
 
 void KVBucket::commit(KVStore& kvstore, const Item* collectionsManifest) {
@@ -2273,6 +2422,8 @@ void KVBucket::commit(KVStore& kvstore, const Item* collectionsManifest) {
 
     ++stats.flusherCommits;
     hrtime_t commit_end = gethrtime();
+    compactionRateLimiter.recordCommitLatency(
+            std::chrono::microseconds((commit_end - commit_start) / 1000));
     uint64_t commit_time = (commit_end - commit_start) / 1000000;
     stats.commit_time.store(commit_time);
     stats.cumulativeCommitTime.fetch_add(commit_time);
@@ -21,11 +21,13 @@
 #include "mutation_log.h"
 #include "storeddockey.h"
 #include "stored-value.h"
+#include "systemevent.h"
 #include "task_type.h"
 #include "vbucket.h"
 #include "vbucketmap.h"
 #include "utility.h"
 #include "kv_bucket_iface.h"
+#include "compaction_rate_limiter.h"
 
 #include <deque>
 
@@ -276,6 +278,18 @@ public:
 
     double getBGFetchDelay(void) { return (double)bgFetchDelay; }
 
+    /**
+     * Set how many sub-batches of bg fetches each shard's BgFetcher may
+     * read from disk at once (bg_fetch_max_concurrency).
+     */
+    void setBGFetchMaxConcurrency(size_t to) {
+        bgFetchMaxConcurrency = to;
+    }
+
+    size_t getBGFetchMaxConcurrency() const {
+        return bgFetchMaxConcurrency;
+    }
+
     virtual bool pauseFlusher();
     virtual bool resumeFlusher();
     virtual void wakeUpFlusher();
@@ -577,6 +591,26 @@ public:
         bfilterResidencyThreshold = to;
     }
 
+    /**
+     * Snappy-compress the value of the given item if the bucket's
+     * compression_mode is 'active' and the compressed value is at most
+     * compression_min_ratio of the original size.
+     * Called on incoming mutations (before any locks are taken) so that
+     * the value is held compressed in the HashTable, the checkpoints and
+     * on disk.
+     */
+    void compressValueIfRequired(Item& itm) const;
+
+    void setCompressionMode(const std::string& mode);
+
+    bool isCompressionActive() const {
+        return compressionActive;
+    }
+
+    void setCompressionMinRatio(float to) {
+        compressionMinRatio = to;
+    }
+
     bool isMetaDataResident(VBucketPtr &vb, const DocKey& key);
 
     void logQTime(TaskId taskType, const ProcessClock::duration enqTime) {
@@ -618,6 +652,65 @@ public:
      */
     int flushVBucket(uint16_t vbid);
 
+    /**
+     * The items drained from one vBucket by a flush, and the state needed
+     * to write, commit and complete them. flushVBucket() performs each
+     * phase in turn; the Flusher's pipelined mode overlaps the commit of
+     * one batch with draining the next. While a batch exists it holds the
+     * vBucket's flush mutex (vb_mutexes).
+     */
+    struct FlushBatch {
+        FlushBatch() = default;
+        FlushBatch(const FlushBatch&) = delete;
+        FlushBatch& operator=(const FlushBatch&) = delete;
+
+        VBucketPtr vb;
+        std::unique_lock<std::mutex> lock;
+        KVStore* rwUnderlying = nullptr;
+        std::vector<queued_item> items;
+        snapshot_range_t range;
+        SystemEventFlush sef;
+        int itemsFlushed = 0;
+        hrtime_t flushStart = 0;
+        /// Does the batch need a KVStore commit (set by writeFlushBatch)?
+        bool needsCommit = false;
+    };
+
+    /**
+     * Drain the items waiting for persistence in a given vbucket into
+     * batch, ordered by optimizeWrites(). Doesn't access the KVStore.
+     * If the vbucket doesn't exist batch.vb is left null.
+     * @return false if the vbucket is locked by another flush operation.
+     */
+    bool drainFlushBatch(uint16_t vbid, FlushBatch& batch);
+
+    /**
+     * Write the batch's items (and the new vbucket state) to its KVStore
+     * as one transaction, without committing it.
+     * @return false if the vbucket state couldn't be updated and the flush
+     *         should be retried.
+     */
+    bool writeFlushBatch(FlushBatch& batch);
+
+    /// Commit a batch written by writeFlushBatch (if it needs a commit).
+    void commitFlushBatch(FlushBatch& batch);
+
+    /**
+     * Update the persisted seqnos / checkpoint of a committed batch's
+     * vbucket, and notify anyone waiting for them.
+     * @return The number of items flushed, or RETRY_FLUSH_VBUCKET if some
+     *         items were rejected and must be flushed again.
+     */
+    int completeFlushBatch(FlushBatch& batch);
+
+    bool isFlusherPipelineEnabled() const {
+        return flusherPipelineEnabled;
+    }
+
+    void setFlusherPipelineEnabled(bool enabled) {
+        flusherPipelineEnabled = enabled;
+    }
+
     void commit(KVStore& kvstore, const Item* collectionsManifest);
 
     void addKVStoreStats(ADD_STAT add_stat, const void* cookie);
@@ -683,6 +776,17 @@ public:
         compactionWriteQueueCap = to;
     }
 
+    /**
+     * (Re)configure the compaction rate limiter from compaction_max_bandwidth
+     * and compaction_commit_latency_target.
+     */
+    void configureCompactionRateLimiter();
+
+    /// @return the current compaction bandwidth limit in bytes/s (0 if none)
+    size_t getCompactionBandwidthLimit() const {
+        return compactionRateLimiter.getRate();
+    }
+
     void setCompactionExpMemThreshold(size_t to) {
         compactionExpMemThreshold = static_cast<double>(to) / 100.0;
     }
@@ -776,6 +880,12 @@ protected:
                          vbucket_state_t allowedState,
                          get_options_t options = TRACK_REFERENCE);
 
+    /**
+     * Notify the cookie waiting on a background fetch of its completion,
+     * clearing the cookie's engine-specific if the command won't be retried.
+     */
+    void notifyBGFetchComplete(const void* cookie, ENGINE_ERROR_CODE status);
+
     bool resetVBucket_UNLOCKED(uint16_t vbid,
                                std::unique_lock<std::mutex>& vbset,
                                std::unique_lock<std::mutex>& vbMutex);
@@ -825,6 +935,15 @@ protected:
 
     size_t                          compactionWriteQueueCap;
     float                           compactionExpMemThreshold;
+    /* Disk bandwidth limit shared by all compactions */
+    CompactionRateLimiter           compactionRateLimiter;
+
+    /* Should incoming values be snappy-compressed (compression_mode)? */
+    std::atomic<bool>               compressionActive;
+    std::atomic<float>              compressionMinRatio;
+
+    /* Should flushers overlap commits with draining the next vBucket? */
+    std::atomic<bool>               flusherPipelineEnabled;
 
     /* Array of mutexes for each vbucket
      * Used by flush operations: flushVB, deleteVB, compactVB, snapshotVB */
@@ -841,6 +960,8 @@ protected:
 
     std::mutex vbsetMutex;
     uint32_t bgFetchDelay;
+    /* How many vBuckets' bg fetches each shard may read at once */
+    std::atomic<size_t> bgFetchMaxConcurrency;
     double backfillMemoryThreshold;
     struct ExpiryPagerDelta {
         ExpiryPagerDelta() : sleeptime(0), task(0), enabled(true) {}
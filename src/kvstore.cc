@@ -230,7 +230,14 @@ void KVStore::addStats(ADD_STAT add_stat, const void *c) {
     addStat(prefix, "failure_open",   st.numOpenFailure, add_stat, c);
     addStat(prefix, "failure_get",    st.numGetFailure,  add_stat, c);
 
-    if (!isReadOnly()) {
+    if (isReadOnly()) {
+        addStat(prefix, "read_handle_hits", st.numReadHandleHits,
+                add_stat, c);
+        addStat(prefix, "read_handle_misses", st.numReadHandleMisses,
+                add_stat, c);
+        addStat(prefix, "read_handle_reopens", st.numReadHandleReopens,
+                add_stat, c);
+    } else {
         addStat(prefix, "failure_set",   st.numSetFailure,   add_stat, c);
         addStat(prefix, "failure_del",   st.numDelFailure,   add_stat, c);
         addStat(prefix, "failure_vbset", st.numVbSetFailure, add_stat, c);
@@ -278,6 +285,11 @@ void KVStore::addTimingStats(ADD_STAT add_stat, const void *c) {
 
     addStat(prefix, "commit",      st.commitHisto,      add_stat, c);
     addStat(prefix, "compact",     st.compactHisto,     add_stat, c);
+    addStat(prefix, "compact_read_rate", st.compactReadRateHisto,
+            add_stat, c);
+    addStat(prefix, "compact_write_rate", st.compactWriteRateHisto,
+            add_stat, c);
+    addStat(prefix, "compact_throttle", st.compactThrottleHisto, add_stat, c);
     addStat(prefix, "snapshot",    st.snapshotHisto,    add_stat, c);
     addStat(prefix, "delete",      st.delTimeHisto,     add_stat, c);
     addStat(prefix, "save_documents", st.saveDocsHisto, add_stat, c);
@@ -35,6 +35,7 @@
 #include "logger.h"
 
 /* Forward declarations */
+class DiskDocument;
 class KVStore;
 class PersistenceCallback;
 class RollbackResult;
@@ -111,6 +112,7 @@ typedef uint16_t DBFileId;
 typedef std::shared_ptr<Callback<uint16_t&, const DocKey&, bool&> > BloomFilterCBPtr;
 typedef std::shared_ptr<Callback<Item&, time_t&> > ExpiredItemsCBPtr;
 
+class CompactionRateLimiter;
 class KVStoreConfig;
 typedef struct {
     uint64_t purge_before_ts;
@@ -123,6 +125,8 @@ typedef struct {
     uint32_t curr_time;
     BloomFilterCBPtr bloomFilterCallback;
     ExpiredItemsCBPtr expiryCallback;
+    // Limiter for the compaction's disk I/O; null if not limited.
+    CompactionRateLimiter* rateLimiter = nullptr;
 } compaction_ctx;
 
 /**
@@ -283,6 +287,10 @@ public:
 
     const std::shared_ptr<Callback<GetValue> > callback;
     const std::shared_ptr<Callback<CacheLookup> > lookup;
+    // Optional: if set, a KVStore which supports it passes the documents
+    // it reads (when values are wanted) to this rather than allocating an
+    // Item for each one to pass to callback.
+    std::shared_ptr<Callback<DiskDocument>> documentCallback;
 
     uint64_t lastReadSeqno;
     const uint64_t startSeqno;
@@ -371,6 +379,9 @@ public:
       numDelFailure(0),
       numOpenFailure(0),
       numVbSetFailure(0),
+      numReadHandleHits(0),
+      numReadHandleMisses(0),
+      numReadHandleReopens(0),
       io_num_read(0),
       io_num_write(0),
       io_read_bytes(0),
@@ -391,6 +402,9 @@ public:
         numDelFailure = 0;
         numOpenFailure = 0;
         numVbSetFailure = 0;
+        numReadHandleHits = 0;
+        numReadHandleMisses = 0;
+        numReadHandleReopens = 0;
 
         readTimeHisto.reset();
         readSizeHisto.reset();
@@ -398,6 +412,9 @@ public:
         writeSizeHisto.reset();
         delTimeHisto.reset();
         compactHisto.reset();
+        compactReadRateHisto.reset();
+        compactWriteRateHisto.reset();
+        compactThrottleHisto.reset();
         snapshotHisto.reset();
         commitHisto.reset();
         saveDocsHisto.reset();
@@ -421,6 +438,13 @@ public:
     Couchbase::RelaxedAtomic<size_t> numOpenFailure;
     Couchbase::RelaxedAtomic<size_t> numVbSetFailure;
 
+    //! Number of reads which re-used a cached read-only file handle
+    Couchbase::RelaxedAtomic<size_t> numReadHandleHits;
+    //! Number of reads which had to open a read-only file handle
+    Couchbase::RelaxedAtomic<size_t> numReadHandleMisses;
+    //! Number of misses due to the cached handle being out of date
+    Couchbase::RelaxedAtomic<size_t> numReadHandleReopens;
+
     //! Number of read related io operations
     Couchbase::RelaxedAtomic<size_t> io_num_read;
     //! Number of write related io operations
@@ -447,6 +471,12 @@ public:
     Histogram<hrtime_t> commitHisto;
     // Time spent in compaction
     Histogram<hrtime_t> compactHisto;
+    // Bytes per second read by each compaction
+    Histogram<size_t> compactReadRateHisto;
+    // Bytes per second written by each compaction
+    Histogram<size_t> compactWriteRateHisto;
+    // Time each compaction spent waiting for the compaction rate limiter
+    Histogram<hrtime_t> compactThrottleHisto;
     // Time spent in saving documents to disk
     Histogram<hrtime_t> saveDocsHisto;
     // Batch size while saving documents
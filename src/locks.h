@@ -33,8 +33,11 @@ using LockHolder = std::lock_guard<std::mutex>;
 
 /**
  * RAII lock holder over multiple locks.
+ *
+ * Mutex may be any type providing lock() and unlock().
  */
-class MultiLockHolder {
+template <typename Mutex>
+class GenericMultiLockHolder {
 public:
 
     /**
@@ -43,13 +46,13 @@ public:
      * @param m beginning of an array of locks
      * @param n the number of locks to lock
      */
-    MultiLockHolder(std::mutex* m, size_t n)
+    GenericMultiLockHolder(Mutex* m, size_t n)
         : mutexes(m),
           n_locks(n) {
         lock();
     }
 
-    ~MultiLockHolder() {
+    ~GenericMultiLockHolder() {
         unlock();
     }
 
@@ -72,11 +75,13 @@ private:
         }
     }
 
-    std::mutex* mutexes;
+    Mutex* mutexes;
     size_t n_locks;
 
-    DISALLOW_COPY_AND_ASSIGN(MultiLockHolder);
+    DISALLOW_COPY_AND_ASSIGN(GenericMultiLockHolder);
 };
+
+using MultiLockHolder = GenericMultiLockHolder<std::mutex>;
 #define MultiLockHolder(x) \
     static_assert(false, "MultiLockHolder: missing variable name for scoped lock.")
 
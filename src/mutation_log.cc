@@ -949,6 +949,156 @@ void MutationLog::resetCounts(size_t *items) {
     }
 }
 
+// ----------------------------------------------------------------------
+// Memory-mapped log
+// ----------------------------------------------------------------------
+
+MappedMutationLog::MappedMutationLog(const std::string& path)
+    : file(path.c_str(), cb::MemoryMappedFile::Mode::RDONLY), numBlocks(0) {
+    try {
+        file.open();
+    } catch (const std::exception& e) {
+        throw MutationLog::ReadException("Unable to map log file " + path +
+                                         ": " + e.what());
+    }
+
+    if (file.getSize() < MIN_LOG_HEADER_SIZE) {
+        throw MutationLog::ShortReadException();
+    }
+    std::array<uint8_t, MIN_LOG_HEADER_SIZE> buf;
+    std::copy_n(static_cast<const uint8_t*>(file.getRoot()),
+                buf.size(),
+                buf.begin());
+    headerBlock.set(buf);
+
+    // The same checks as MutationLog::readInitialBlock.
+    switch (headerBlock.version()) {
+    case MutationLogVersion::V1:
+    case MutationLogVersion::V2:
+        break;
+    default:
+        throw MutationLog::ReadException(
+                "HeaderBlock version is unknown " +
+                std::to_string(int(headerBlock.version())));
+    }
+
+    if (headerBlock.blockCount() != 1) {
+        throw MutationLog::ReadException(
+                "HeaderBlock blockCount mismatch " +
+                std::to_string(headerBlock.blockCount()));
+    }
+
+    const size_t blockSize = headerBlock.blockSize();
+    if (blockSize <= sizeof(uint16_t) + sizeof(uint16_t)) {
+        throw MutationLog::ReadException("HeaderBlock blockSize invalid " +
+                                         std::to_string(blockSize));
+    }
+
+    // As for MutationLog::iterator, the entries start after the header
+    // block(s) and the log must end on a block boundary.
+    const size_t headerSize = blockSize * headerBlock.blockCount();
+    if (file.getSize() < headerSize ||
+        (file.getSize() - headerSize) % blockSize != 0) {
+        LOG(EXTENSION_LOG_WARNING,
+            "MappedMutationLog: size %" PRIu64 " of '%s' is not a whole "
+            "number of %" PRIu64 " byte blocks",
+            uint64_t(file.getSize()),
+            path.c_str(),
+            uint64_t(blockSize));
+        throw MutationLog::ShortReadException();
+    }
+    numBlocks = (file.getSize() - headerSize) / blockSize;
+}
+
+static DocKey entryKey(const MutationLogEntryV1& entry) {
+    return entry.docKey();
+}
+
+static DocKey entryKey(const MutationLogEntryV2& entry) {
+    const auto& key = entry.key();
+    return {key.data(), key.size(), key.getDocNamespace()};
+}
+
+const uint8_t* MappedMutationLog::getBlock(size_t blockNo) const {
+    const size_t blockSize = headerBlock.blockSize();
+    return static_cast<const uint8_t*>(file.getRoot()) +
+           blockSize * (headerBlock.blockCount() + blockNo);
+}
+
+template <typename Entry, typename Fn>
+void MappedMutationLog::readNewEntries(const uint8_t* block, Fn fn) const {
+    // block starts with 2 byte crc and 2 byte item count
+    uint16_t items;
+    memcpy(&items, block + sizeof(uint16_t), sizeof(items));
+    items = ntohs(items);
+
+    const uint8_t* p = block + sizeof(uint16_t) + sizeof(uint16_t);
+    const uint8_t* const end = block + headerBlock.blockSize();
+    for (; items > 0; --items) {
+        const auto* entry = Entry::newEntry(p, end - p);
+        if (entry->type() == MutationLogType::New) {
+            fn(entry->vbucket(), entryKey(*entry));
+        }
+        p += entry->len();
+    }
+}
+
+template <typename Fn>
+void MappedMutationLog::forEachNewEntry(const uint8_t* block, Fn fn) const {
+    switch (headerBlock.version()) {
+    case MutationLogVersion::V1:
+        readNewEntries<MutationLogEntryV1>(block, fn);
+        return;
+    case MutationLogVersion::V2:
+        readNewEntries<MutationLogEntryV2>(block, fn);
+        return;
+    }
+}
+
+std::unordered_map<uint16_t, MappedMutationLog::VBucketBlocks>
+MappedMutationLog::indexBlocks(const std::set<uint16_t>& vbids) const {
+    std::unordered_map<uint16_t, VBucketBlocks> index;
+    const size_t blockSize = headerBlock.blockSize();
+    for (size_t ii = 0; ii < numBlocks; ++ii) {
+        const uint8_t* block = getBlock(ii);
+        uint32_t crc32(crc32buf(const_cast<uint8_t*>(block) + sizeof(uint16_t),
+                                blockSize - sizeof(uint16_t)));
+        uint16_t computed_crc16(crc32 & 0xffff);
+        uint16_t retrieved_crc16;
+        memcpy(&retrieved_crc16, block, sizeof(retrieved_crc16));
+        if (computed_crc16 != ntohs(retrieved_crc16)) {
+            throw MutationLog::CRCReadException();
+        }
+
+        forEachNewEntry(block, [&vbids, &index, ii](uint16_t vb, DocKey) {
+            if (vbids.find(vb) == vbids.end()) {
+                return;
+            }
+            auto& vbIndex = index[vb];
+            if (vbIndex.blocks.empty() || vbIndex.blocks.back() != ii) {
+                vbIndex.blocks.push_back(uint32_t(ii));
+            }
+            ++vbIndex.numKeys;
+        });
+    }
+    return index;
+}
+
+std::vector<DocKey> MappedMutationLog::loadKeys(
+        uint16_t vbid, const VBucketBlocks& index) const {
+    std::vector<DocKey> keys;
+    keys.reserve(index.numKeys);
+    for (const auto blockNo : index.blocks) {
+        forEachNewEntry(getBlock(blockNo),
+                        [vbid, &keys](uint16_t vb, DocKey key) {
+                            if (vb == vbid) {
+                                keys.push_back(key);
+                            }
+                        });
+    }
+    return keys;
+}
+
 // ----------------------------------------------------------------------
 // Reading entries
 // ----------------------------------------------------------------------
@@ -52,6 +52,7 @@
 
 #include <atomic>
 #include <platform/histogram.h>
+#include <platform/memorymap.h>
 #include "utility.h"
 
 #define ML_BUFLEN (128 * 1024 * 1024)
@@ -475,6 +476,86 @@ private:
     DISALLOW_COPY_AND_ASSIGN(MutationLog);
 };
 
+/**
+ * A read-only, memory-mapped view of a MutationLog file, used to read the
+ * access log at warmup.
+ *
+ * Where MutationLog::iterator pread()s each block into its own buffer and
+ * copies each entry out of it, this maps the whole file once and reads the
+ * entries in place; so any number of tasks can read the same log at once,
+ * and the keys handed out are DocKey views which stay valid for as long as
+ * the MappedMutationLog.
+ *
+ * The log is read in two passes: indexBlocks() checks every block and notes
+ * which blocks hold each vBucket's entries, and loadKeys() then reads one
+ * vBucket's keys from just its blocks; so only the index, and the keys of
+ * the vBuckets being loaded, are held at once.
+ */
+class MappedMutationLog {
+public:
+    /**
+     * Map the log at the given path and check its header.
+     *
+     * @throws MutationLog::ReadException if the file can't be mapped or has
+     *         an invalid header, or MutationLog::ShortReadException if it
+     *         doesn't hold a whole number of blocks.
+     */
+    MappedMutationLog(const std::string& path);
+
+    /// The number of bytes mapped.
+    size_t getSize() const {
+        return file.getSize();
+    }
+
+    /// The number of blocks of entries (i.e. excluding the header block).
+    size_t getNumBlocks() const {
+        return numBlocks;
+    }
+
+    /// Where a vBucket's New entries are in the log.
+    struct VBucketBlocks {
+        // The blocks (by number) holding at least one of them, ascending.
+        std::vector<uint32_t> blocks;
+        // The number of entries.
+        size_t numKeys = 0;
+    };
+
+    /**
+     * Check the CRC of every block, and index which blocks hold the New
+     * entries of the given vBuckets.
+     *
+     * @throws MutationLog::CRCReadException if a block is corrupt
+     * @return a map of vBucket to the blocks holding its entries
+     */
+    std::unordered_map<uint16_t, VBucketBlocks> indexBlocks(
+            const std::set<uint16_t>& vbids) const;
+
+    /**
+     * Read the keys of a vBucket's New entries, in the order they appear in
+     * the log, from the blocks indexBlocks() found them in.
+     *
+     * @return the keys, which point into the mapping
+     */
+    std::vector<DocKey> loadKeys(uint16_t vbid,
+                                 const VBucketBlocks& index) const;
+
+private:
+    /// The start of the given block of entries.
+    const uint8_t* getBlock(size_t blockNo) const;
+
+    /// Call fn(vbid, key) for each New entry in the block.
+    template <typename Fn>
+    void forEachNewEntry(const uint8_t* block, Fn fn) const;
+
+    /// As forEachNewEntry, for the given entry version.
+    template <typename Entry, typename Fn>
+    void readNewEntries(const uint8_t* block, Fn fn) const;
+
+    cb::MemoryMappedFile file;
+    LogHeaderBlock headerBlock;
+    size_t numBlocks;
+};
+
 /// @cond DETAILS
 
 //! rowid, (uint8_t)mutation_log_type_t
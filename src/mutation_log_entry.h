@@ -53,6 +53,11 @@ public:
      */
     static const MutationLogEntryV1* newEntry(
             std::vector<uint8_t>::const_iterator itr, size_t buflen) {
+        return newEntry(&(*itr), buflen);
+    }
+
+    static const MutationLogEntryV1* newEntry(const uint8_t* buf,
+                                              size_t buflen) {
         if (buflen < len(0)) {
             throw std::invalid_argument(
                     "MutationLogEntryV1::newEntry: buflen "
@@ -62,7 +67,7 @@ public:
                     std::to_string(len(0)) + ")");
         }
 
-        const auto* me = reinterpret_cast<const MutationLogEntryV1*>(&(*itr));
+        const auto* me = reinterpret_cast<const MutationLogEntryV1*>(buf);
 
         if (me->magic != MagicMarker) {
             throw std::invalid_argument(
@@ -116,6 +121,16 @@ public:
         return keylen;
     }
 
+    /**
+     * This entry's key, in the default collection, as a view onto the
+     * entry (rather than a copy).
+     */
+    DocKey docKey() const {
+        return {reinterpret_cast<const uint8_t*>(_key),
+                keylen,
+                DocNamespace::DefaultCollection};
+    }
+
     /**
      * This entry's rowid.
      */
@@ -232,6 +247,11 @@ public:
      */
     static const MutationLogEntryV2* newEntry(
             std::vector<uint8_t>::const_iterator itr, size_t buflen) {
+        return newEntry(&(*itr), buflen);
+    }
+
+    static const MutationLogEntryV2* newEntry(const uint8_t* buf,
+                                              size_t buflen) {
         if (buflen < len(0)) {
             throw std::invalid_argument(
                     "MutationLogEntryV2::newEntry: buflen "
@@ -241,7 +261,7 @@ public:
                     std::to_string(len(0)) + ")");
         }
 
-        const auto* me = reinterpret_cast<const MutationLogEntryV2*>(&(*itr));
+        const auto* me = reinterpret_cast<const MutationLogEntryV2*>(buf);
 
         if (me->magic != MagicMarker) {
             throw std::invalid_argument(
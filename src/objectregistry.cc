@@ -81,15 +81,17 @@ void ObjectRegistry::onCreateBlob(const Blob *blob)
    EventuallyPersistentEngine *engine = th->get();
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
-       size_t size = getAllocSize(blob);
+       const auto shard = EPStats::ObjectCounter::thisThreadShard();
+       // Inline Blobs aren't allocations in their own right.
+       size_t size = blob->isInline() ? 0 : getAllocSize(blob);
        if (size == 0) {
            size = blob->getSize();
        } else {
-           stats.blobOverhead.fetch_add(size - blob->getSize());
+           stats.blobOverhead.fetch_add(size - blob->getSize(), shard);
        }
-       stats.currentSize.fetch_add(size);
-       stats.totalValueSize.fetch_add(size);
-       stats.numBlob++;
+       stats.currentSize.fetch_add(size, shard);
+       stats.totalValueSize.fetch_add(size, shard);
+       stats.numBlob.fetch_add(1, shard);
    }
 }
 
@@ -98,15 +100,16 @@ void ObjectRegistry::onDeleteBlob(const Blob *blob)
    EventuallyPersistentEngine *engine = th->get();
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
-       size_t size = getAllocSize(blob);
+       const auto shard = EPStats::ObjectCounter::thisThreadShard();
+       size_t size = blob->isInline() ? 0 : getAllocSize(blob);
        if (size == 0) {
            size = blob->getSize();
        } else {
-           stats.blobOverhead.fetch_sub(size - blob->getSize());
+           stats.blobOverhead.fetch_sub(size - blob->getSize(), shard);
        }
-       stats.currentSize.fetch_sub(size);
-       stats.totalValueSize.fetch_sub(size);
-       stats.numBlob--;
+       stats.currentSize.fetch_sub(size, shard);
+       stats.totalValueSize.fetch_sub(size, shard);
+       stats.numBlob.fetch_sub(1, shard);
    }
 }
 
@@ -115,14 +118,23 @@ void ObjectRegistry::onCreateStoredValue(const StoredValue *sv)
    EventuallyPersistentEngine *engine = th->get();
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
+       const auto shard = EPStats::ObjectCounter::thisThreadShard();
        size_t size = getAllocSize(sv);
        if (size == 0) {
            size = sv->getObjectSize();
        } else {
-           stats.storedValOverhead.fetch_add(size - sv->getObjectSize());
+           // Any inline value storage is accounted for by its Blob.
+           size -= sv->getInlineCapacity();
+           stats.storedValOverhead.fetch_add(size - sv->getObjectSize(),
+                                             shard);
        }
-       stats.numStoredVal++;
-       stats.totalStoredValSize.fetch_add(size);
+       if (sv->getInlineCapacity()) {
+           stats.numInlineStoredVal.fetch_add(1, shard);
+           stats.inlineValueSavings.fetch_add(sv->getInlineValueSavings(),
+                                              shard);
+       }
+       stats.numStoredVal.fetch_add(1, shard);
+       stats.totalStoredValSize.fetch_add(size, shard);
    }
 }
 
@@ -131,25 +143,54 @@ void ObjectRegistry::onDeleteStoredValue(const StoredValue *sv)
    EventuallyPersistentEngine *engine = th->get();
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
+       const auto shard = EPStats::ObjectCounter::thisThreadShard();
        size_t size = getAllocSize(sv);
        if (size == 0) {
            size = sv->getObjectSize();
        } else {
-           stats.storedValOverhead.fetch_sub(size - sv->getObjectSize());
+           size -= sv->getInlineCapacity();
+           stats.storedValOverhead.fetch_sub(size - sv->getObjectSize(),
+                                             shard);
+       }
+       if (sv->getInlineCapacity()) {
+           stats.numInlineStoredVal.fetch_sub(1, shard);
+           stats.inlineValueSavings.fetch_sub(sv->getInlineValueSavings(),
+                                              shard);
        }
-       stats.totalStoredValSize.fetch_sub(size);
-       stats.numStoredVal--;
+       stats.totalStoredValSize.fetch_sub(size, shard);
+       stats.numStoredVal.fetch_sub(1, shard);
    }
 }
 
+void ObjectRegistry::onPinInlineStorage(size_t bytes) {
+    EventuallyPersistentEngine* engine = th->get();
+    if (verifyEngine(engine)) {
+        EPStats& stats = engine->getEpStats();
+        const auto shard = EPStats::ObjectCounter::thisThreadShard();
+        stats.inlineStoragePinned.fetch_add(bytes, shard);
+        stats.currentSize.fetch_add(bytes, shard);
+    }
+}
+
+void ObjectRegistry::onUnpinInlineStorage(size_t bytes) {
+    EventuallyPersistentEngine* engine = th->get();
+    if (verifyEngine(engine)) {
+        EPStats& stats = engine->getEpStats();
+        const auto shard = EPStats::ObjectCounter::thisThreadShard();
+        stats.inlineStoragePinned.fetch_sub(bytes, shard);
+        stats.currentSize.fetch_sub(bytes, shard);
+    }
+}
 
 void ObjectRegistry::onCreateItem(const Item *pItem)
 {
    EventuallyPersistentEngine *engine = th->get();
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
-       stats.memOverhead->fetch_add(pItem->size() - pItem->getValMemSize());
-       ++(*stats.numItem);
+       const auto shard = EPStats::ObjectCounter::thisThreadShard();
+       stats.memOverhead.fetch_add(pItem->size() - pItem->getValMemSize(),
+                                   shard);
+       stats.numItem.fetch_add(1, shard);
    }
 }
 
@@ -158,8 +199,10 @@ void ObjectRegistry::onDeleteItem(const Item *pItem)
    EventuallyPersistentEngine *engine = th->get();
    if (verifyEngine(engine)) {
        EPStats &stats = engine->getEpStats();
-       stats.memOverhead->fetch_sub(pItem->size() - pItem->getValMemSize());
-       ++(*stats.numItem);
+       const auto shard = EPStats::ObjectCounter::thisThreadShard();
+       stats.memOverhead.fetch_sub(pItem->size() - pItem->getValMemSize(),
+                                   shard);
+       stats.numItem.fetch_add(1, shard);
    }
 }
 
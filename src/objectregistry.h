@@ -51,6 +51,13 @@ public:
     static void onCreateStoredValue(const StoredValue *sv);
     static void onDeleteStoredValue(const StoredValue *sv);
 
+    /**
+     * The given bytes of a destroyed StoredValue's allocation are kept
+     * allocated by its inline Blob, until that is released.
+     */
+    static void onPinInlineStorage(size_t bytes);
+    static void onUnpinInlineStorage(size_t bytes);
+
 
     static EventuallyPersistentEngine *getCurrentEngine();
 
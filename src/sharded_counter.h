@@ -0,0 +1,130 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <platform/cacheline_padded.h>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <type_traits>
+
+/**
+ * An unsigned counter split over a number of cache line padded shards, for
+ * counters which are updated by many threads at once and read far less
+ * often (such as EPStats' memory accounting of Blobs, StoredValues and
+ * Items). Each thread updates the shard its thread id hashes to, so threads
+ * don't all bounce the same cache line; reading sums every shard.
+ *
+ * Unlike the thread-local TLMemCounter there are no per-thread deltas left
+ * to merge, so a read is exact up to updates in flight. As the shards are
+ * not read atomically together, a read racing with an allocation in one
+ * shard and its free in another could see the free but not the allocation;
+ * such a (transiently negative) total reads as zero rather than wrapping.
+ *
+ * Offers the subset of the std::atomic interface the EPStats counters use.
+ */
+template <typename T, size_t NumShards = 16>
+class ShardedCounter {
+    static_assert(std::is_unsigned<T>::value,
+                  "ShardedCounter: T must be an unsigned integer");
+
+public:
+    ShardedCounter(T initial = 0) {
+        store(initial);
+    }
+
+    ShardedCounter(const ShardedCounter&) = delete;
+    ShardedCounter& operator=(const ShardedCounter&) = delete;
+
+    /// @return the shard which updates from the calling thread go to.
+    static size_t thisThreadShard() {
+        return std::hash<std::thread::id>()(std::this_thread::get_id()) %
+               NumShards;
+    }
+
+    T load() const {
+        T total = 0;
+        for (const auto& shard : shards) {
+            total += shard->load(std::memory_order_relaxed);
+        }
+        using Signed = typename std::make_signed<T>::type;
+        if (total > T(std::numeric_limits<Signed>::max())) {
+            return 0;
+        }
+        return total;
+    }
+
+    operator T() const {
+        return load();
+    }
+
+    /// Set the counter; not atomic with respect to concurrent updates.
+    void store(T value) {
+        shards[0]->store(value, std::memory_order_relaxed);
+        for (size_t ii = 1; ii < NumShards; ++ii) {
+            shards[ii]->store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ShardedCounter& operator=(T value) {
+        store(value);
+        return *this;
+    }
+
+    void fetch_add(T delta) {
+        fetch_add(delta, thisThreadShard());
+    }
+
+    void fetch_sub(T delta) {
+        fetch_sub(delta, thisThreadShard());
+    }
+
+    /// Add to the given shard (from thisThreadShard()), to look the shard
+    /// up once when updating several counters.
+    void fetch_add(T delta, size_t shard) {
+        shards[shard]->fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    void fetch_sub(T delta, size_t shard) {
+        shards[shard]->fetch_sub(delta, std::memory_order_relaxed);
+    }
+
+    void operator++() {
+        fetch_add(1);
+    }
+
+    void operator++(int) {
+        fetch_add(1);
+    }
+
+    void operator--() {
+        fetch_sub(1);
+    }
+
+    void operator--(int) {
+        fetch_sub(1);
+    }
+
+private:
+    std::array<cb::CachelinePadded<std::atomic<T>>, NumShards> shards;
+};
@@ -0,0 +1,121 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <platform/cacheline_padded.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+
+/**
+ * A bounded, lock-free queue for one producer and one consumer thread.
+ *
+ * The slots are allocated once, when the buffer is created; the producer
+ * only writes the tail index and the consumer only the head index (each on
+ * its own cache line), so neither side ever waits for the other. The
+ * producer (or consumer) may be a different thread over time, as long as
+ * there is never more than one at once and something (such as a mutex)
+ * orders one before the next.
+ *
+ * T must be default constructible and copy assignable; popped slots are not
+ * reset, so it is meant for small values such as pointers.
+ */
+template <typename T>
+class SpscRingBuffer {
+public:
+    /**
+     * @param capacity the number of values the buffer can hold; rounded up
+     *        to a power of two
+     */
+    explicit SpscRingBuffer(size_t capacity)
+        : mask(roundUpToPowerOfTwo(capacity) - 1),
+          slots(new T[mask + 1]),
+          head(0),
+          tail(0) {
+    }
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    /**
+     * Producer: add a value to the back of the buffer.
+     *
+     * @return false (and doesn't add the value) if the buffer is full
+     */
+    bool push(const T& value) {
+        const size_t t = tail->load(std::memory_order_relaxed);
+        if (t - head->load(std::memory_order_acquire) > mask) {
+            return false;
+        }
+        slots[t & mask] = value;
+        tail->store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer: @return true if there is nothing to pop.
+    bool empty() const {
+        return head->load(std::memory_order_relaxed) ==
+               tail->load(std::memory_order_acquire);
+    }
+
+    /// Consumer: @return the value at the front; the buffer mustn't be empty.
+    const T& front() const {
+        return slots[head->load(std::memory_order_relaxed) & mask];
+    }
+
+    /// Consumer: remove the value at the front; the buffer mustn't be empty.
+    void pop() {
+        head->store(head->load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+    }
+
+    /// @return the number of values in the buffer (a snapshot if called by
+    ///         neither the producer nor the consumer).
+    size_t size() const {
+        const size_t h = head->load(std::memory_order_acquire);
+        return tail->load(std::memory_order_acquire) - h;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+private:
+    static size_t roundUpToPowerOfTwo(size_t n) {
+        if (n == 0) {
+            throw std::invalid_argument(
+                    "SpscRingBuffer: capacity must be non-zero");
+        }
+        size_t result = 1;
+        while (result < n) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    const size_t mask;
+    std::unique_ptr<T[]> slots;
+    // Count of values popped (written by the consumer only).
+    cb::CachelinePadded<std::atomic<size_t>> head;
+    // Count of values pushed (written by the producer only).
+    cb::CachelinePadded<std::atomic<size_t>> tail;
+};
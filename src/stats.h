@@ -22,6 +22,7 @@
 
 #include <memcached/engine.h>
 
+#include <algorithm>
 #include <map>
 
 #include <platform/cacheline_padded.h>
@@ -32,6 +33,7 @@
 #include <atomic>
 #include "memory_tracker.h"
 #include "objectregistry.h"
+#include "sharded_counter.h"
 #include "threadlocal.h"
 #include "utility.h"
 
@@ -58,6 +60,10 @@ public:
     // ordering (no ordeing or synchronization).
     using Counter = Couchbase::RelaxedAtomic<size_t>;
 
+    // Counter updated by many threads at once on hot paths: every object
+    // (Blob, StoredValue, Item) allocation and free, every front-end get.
+    using ObjectCounter = ShardedCounter<size_t>;
+
     EPStats() :
         warmedUpKeys(0),
         warmedUpValues(0),
@@ -70,6 +76,7 @@ public:
         vbBackfillQueueSize(0),
         flusher_todo(0),
         flusherCommits(0),
+        flusherPipelineDepth(0),
         cumulativeFlushTime(0),
         cumulativeCommitTime(0),
         tooYoung(0),
@@ -102,6 +109,12 @@ public:
         numValueEjects(0),
         numFailedEjects(0),
         numNotMyVBuckets(0),
+        cacheHits(0),
+        cacheMisses(0),
+        cacheHitsBeforeEviction(0),
+        cacheMissesBeforeEviction(0),
+        cacheHitsAtEviction(0),
+        cacheMissesAtEviction(0),
         currentSize(0),
         numBlob(0),
         blobOverhead(0),
@@ -109,6 +122,9 @@ public:
         numStoredVal(0),
         totalStoredValSize(0),
         storedValOverhead(0),
+        numInlineStoredVal(0),
+        inlineValueSavings(0),
+        inlineStoragePinned(0),
         memOverhead(0),
         numItem(0),
         totalMemory(0),
@@ -207,7 +223,19 @@ public:
             auto val = totalMemory->load();
             return val >= 0 ? val : 0;
         }
-        return currentSize.load() + memOverhead->load();
+        return currentSize.load() + memOverhead.load();
+    }
+
+    /**
+     * @return the percentage of front-end gets served without a background
+     *         fetch, given the cacheHits and cacheMisses over some period.
+     *         Zero if there were no gets.
+     */
+    static size_t getHitRatio(size_t hits, size_t misses) {
+        if (hits + misses == 0) {
+            return 0;
+        }
+        return hits * 100 / (hits + misses);
     }
 
     // account for allocated mem
@@ -248,6 +276,8 @@ public:
     Counter flusher_todo;
     //! Number of transaction commits.
     Counter flusherCommits;
+    //! Number of vBucket batches held by the flusher pipelines.
+    Counter flusherPipelineDepth;
     //! Total time spent flushing.
     Counter cumulativeFlushTime;
     //! Total time spent committing.
@@ -322,24 +352,44 @@ public:
     Counter numFailedEjects;
     //! Number of times "Not my bucket" happened
     Counter numNotMyVBuckets;
+    //! Number of front-end gets served from memory. Sharded, as every
+    //! front-end get updates one of these.
+    ObjectCounter cacheHits;
+    //! Number of front-end gets which needed a background fetch (counted
+    //! once, not again when the get is retried after the fetch)
+    ObjectCounter cacheMisses;
+    //! cacheHits / cacheMisses between the end of the item pager's
+    //! previous eviction run and the start of its latest one
+    Counter cacheHitsBeforeEviction;
+    Counter cacheMissesBeforeEviction;
+    //! cacheHits / cacheMisses when the latest eviction run completed
+    Counter cacheHitsAtEviction;
+    Counter cacheMissesAtEviction;
     //! Total size of stored objects.
-    Counter currentSize;
+    ObjectCounter currentSize;
     //! Total number of blob objects
-    Counter numBlob;
+    ObjectCounter numBlob;
     //! Total size of blob memory overhead
-    Counter blobOverhead;
+    ObjectCounter blobOverhead;
     //! Total memory overhead to store values for resident keys.
-    Counter totalValueSize;
+    ObjectCounter totalValueSize;
     //! The number of storedVal object
-    Counter numStoredVal;
+    ObjectCounter numStoredVal;
     //! Total memory for stored values
-    Counter totalStoredValSize;
+    ObjectCounter totalStoredValSize;
     //! Total size of StoredVal memory overhead
-    Counter storedValOverhead;
+    ObjectCounter storedValOverhead;
+    //! Number of StoredVal objects allocated with inline value storage
+    ObjectCounter numInlineStoredVal;
+    //! Estimated memory saved by allocating values inline in StoredVals
+    ObjectCounter inlineValueSavings;
+    //! Memory of deleted StoredVals kept allocated by their inline values
+    //! (still referenced by Items, DCP messages...)
+    ObjectCounter inlineStoragePinned;
     //! Amount of memory used to track items and what-not.
-    cb::CachelinePadded<Counter> memOverhead;
+    ObjectCounter memOverhead;
     //! Total number of Item objects
-    cb::CachelinePadded<Counter> numItem;
+    ObjectCounter numItem;
     //! The total amount of memory used by this bucket (From memory tracking)
     // This is a signed variable as depdending on how/when the thread-local
     // counters merge their info, this could be negative
@@ -583,12 +633,24 @@ public:
     //! Histogram of disk commits
     Histogram<hrtime_t> diskCommitHisto;
 
+    //! Histogram of time spent draining a vBucket during a pipelined commit
+    Histogram<hrtime_t> flusherCommitOverlapHisto;
+
     //! Histogram of mutation log compactor
     Histogram<hrtime_t> mlogCompactorHisto;
 
     //! Historgram of batch reads
     Histogram<hrtime_t> getMultiHisto;
 
+    //! Histogram of the time spent reading each key of a bg fetch batch
+    Histogram<hrtime_t> bgFetchReadHisto;
+
+    //! Histogram of the number of bg fetch batches being read concurrently
+    Histogram<size_t> bgFetchQueueDepthHisto;
+
+    //! Histogram of HashTable lookups made during an incremental resize
+    Histogram<hrtime_t> htResizeLookupHisto;
+
     // ! Histograms of various task wait times, one per Task.
     std::vector<ProcessDurationHistogram> schedulingHisto;
 
@@ -613,6 +675,12 @@ public:
         numValueEjects.store(0);
         numFailedEjects.store(0);
         numNotMyVBuckets.store(0);
+        cacheHits.store(0);
+        cacheMisses.store(0);
+        cacheHitsBeforeEviction.store(0);
+        cacheMissesBeforeEviction.store(0);
+        cacheHitsAtEviction.store(0);
+        cacheMissesAtEviction.store(0);
         bg_fetched.store(0);
         bgNumOperations.store(0);
         bgWait.store(0);
@@ -672,10 +740,14 @@ public:
         diskDelHisto.reset();
         diskVBDelHisto.reset();
         diskCommitHisto.reset();
+        flusherCommitOverlapHisto.reset();
         itemAllocSizeHisto.reset();
         dirtyAgeHisto.reset();
         mlogCompactorHisto.reset();
         getMultiHisto.reset();
+        bgFetchReadHisto.reset();
+        bgFetchQueueDepthHisto.reset();
+        htResizeLookupHisto.reset();
         persistenceCursorGetItemsHisto.reset();
         dcpCursorsGetItemsHisto.reset();
     }
@@ -19,17 +19,25 @@
 #include <platform/cb_malloc.h>
 #include "stored-value.h"
 
+#include "disk_document.h"
+
+#include <algorithm>
+#include <limits>
+
 double StoredValue::mutation_mem_threshold = 0.9;
 const int64_t StoredValue::state_deleted_key = -3;
 const int64_t StoredValue::state_non_existent_key = -4;
 const int64_t StoredValue::state_temp_init = -5;
 const int64_t StoredValue::state_collection_open = -6;
+const uint8_t StoredValue::MaxFrequency;
 
-StoredValue::StoredValue(const Item& itm,
+template <typename Document>
+StoredValue::StoredValue(const Document& itm,
                          UniquePtr n,
                          EPStats& stats,
-                         bool isOrdered)
-    : value(itm.getValue()),
+                         bool isOrdered,
+                         size_t inlineStorageSize)
+    : value(inlineStorageSize ? value_t() : itm.getValue()),
       chain_next_or_replacement(std::move(n)),
       cas(itm.getCas()),
       revSeqno(itm.getRevSeqno()),
@@ -41,8 +49,15 @@ StoredValue::StoredValue(const Item& itm,
       deleted(itm.isDeleted()),
       newCacheItem(true),
       isOrdered(isOrdered),
-      nru(itm.getNRUValue()),
-      stale(false) {
+      refBits(setField(0, NruShift, itm.getNRUValue())),
+      inlineCapacity(static_cast<uint8_t>(inlineStorageSize)) {
+    if (inlineCapacity) {
+        // Copy the value into the inline storage, and take the StoredValue's
+        // own reference on it - released by destroyWithInlineStorage().
+        value.reset(Blob::CopyInline(inlineBlob(), *itm.getValue()));
+        inlineBlob()->_rc_incref();
+    }
+
     // Placement-new the key which lives in memory directly after this
     // object.
     new (key()) SerialisedDocKey(itm.getKey());
@@ -76,8 +91,8 @@ StoredValue::StoredValue(const StoredValue& other,
       deleted(other.deleted),
       newCacheItem(other.newCacheItem),
       isOrdered(other.isOrdered),
-      nru(other.nru),
-      stale(false) {
+      refBits(other.refBits.load(std::memory_order_relaxed) & ~StaleBit),
+      inlineCapacity(0) {
     // Placement-new the key which lives in memory directly after this
     // object.
     StoredDocKey sKey(other.getKey());
@@ -86,7 +101,8 @@ StoredValue::StoredValue(const StoredValue& other,
     ObjectRegistry::onCreateStoredValue(this);
 }
 
-void StoredValue::setValue(const Item& itm) {
+template <typename Document>
+void StoredValue::setValue(const Document& itm) {
     if (isOrdered) {
         return static_cast<OrderedStoredValue*>(this)->setValueImpl(itm);
     } else {
@@ -100,27 +116,39 @@ void StoredValue::ejectValue() {
 }
 
 void StoredValue::referenced() {
-    if (nru > MIN_NRU_VALUE) {
-        --nru;
-    }
+    updateRefBits([](uint8_t bits) {
+        const uint8_t nru = getField(bits, NruShift);
+        if (nru > MIN_NRU_VALUE) {
+            bits = setField(bits, NruShift, nru - 1);
+        }
+        const uint8_t frequency = getField(bits, FrequencyShift);
+        if (frequency < MaxFrequency) {
+            bits = setField(bits, FrequencyShift, frequency + 1);
+        }
+        return bits;
+    });
 }
 
 void StoredValue::setNRUValue(uint8_t nru_val) {
     if (nru_val <= MAX_NRU_VALUE) {
-        nru = nru_val;
+        updateRefBits([nru_val](uint8_t bits) {
+            return setField(bits, NruShift, nru_val);
+        });
     }
 }
 
 uint8_t StoredValue::incrNRUValue() {
     uint8_t ret = MAX_NRU_VALUE;
-    if (nru < MAX_NRU_VALUE) {
-        ret = ++nru;
-    }
+    updateRefBits([&ret](uint8_t bits) {
+        const uint8_t nru = getField(bits, NruShift);
+        ret = nru < MAX_NRU_VALUE ? nru + 1 : MAX_NRU_VALUE;
+        return setField(bits, NruShift, ret);
+    });
     return ret;
 }
 
 uint8_t StoredValue::getNRUValue() const {
-    return nru;
+    return getField(refBits.load(std::memory_order_relaxed), NruShift);
 }
 
 void StoredValue::restoreValue(const Item& itm) {
@@ -130,11 +158,11 @@ void StoredValue::restoreValue(const Item& itm) {
         exptime = itm.getExptime();
         revSeqno = itm.getRevSeqno();
         bySeqno = itm.getBySeqno();
-        nru = INITIAL_NRU_VALUE;
+        setNRUValue(INITIAL_NRU_VALUE);
     }
     datatype = itm.getDataType();
     deleted = itm.isDeleted();
-    value = itm.getValue();
+    assignValue(itm.getValue());
 }
 
 void StoredValue::restoreMeta(const Item& itm) {
@@ -151,8 +179,8 @@ void StoredValue::restoreMeta(const Item& itm) {
            when bg fetch is scheduled (full eviction mode). */
         newCacheItem = false;
     }
-    if (nru == MAX_NRU_VALUE) {
-        nru = INITIAL_NRU_VALUE;
+    if (getNRUValue() == MAX_NRU_VALUE) {
+        setNRUValue(INITIAL_NRU_VALUE);
     }
 }
 
@@ -173,7 +201,8 @@ void StoredValue::setMutationMemoryThreshold(double memThreshold) {
 /**
  * Is there enough space for this thing?
  */
-bool StoredValue::hasAvailableSpace(EPStats &st, const Item &itm,
+template <typename Document>
+bool StoredValue::hasAvailableSpace(EPStats &st, const Document &itm,
                                     bool isReplication) {
     double newSize = static_cast<double>(st.getTotalMemoryUsed() +
                                          sizeof(StoredValue) + itm.getKey().size());
@@ -201,7 +230,7 @@ std::unique_ptr<Item> StoredValue::toItem(bool lck, uint16_t vbucket) const {
         itm->setDataType(datatype);
     }
 
-    itm->setNRUValue(nru);
+    itm->setNRUValue(getNRUValue());
 
     if (deleted) {
         itm->setDeleted();
@@ -228,15 +257,97 @@ std::unique_ptr<Item> StoredValue::toItemWithNoValue(uint16_t vbucket) const {
 }
 
 void StoredValue::reallocate() {
+    if (isValueInline()) {
+        // Moves with the StoredValue itself.
+        return;
+    }
     // Allocate a new Blob for this stored value; copy the existing Blob to
     // the new one and free the old.
     value_t new_val(Blob::Copy(*value));
     value.reset(new_val);
 }
 
+template <typename Document>
+size_t StoredValue::getInlineStorageFor(const Document& item,
+                                        size_t maxInlineSize) {
+    const auto& itemValue = item.getValue();
+    if (!itemValue || item.getBySeqno() == state_temp_init ||
+        item.getBySeqno() == state_deleted_key ||
+        item.getBySeqno() == state_non_existent_key) {
+        return 0;
+    }
+    // Round up so that slightly larger values can later reuse the storage;
+    // inlineCapacity is a single byte.
+    const size_t storage = (itemValue->getSize() + 7) & ~size_t(7);
+    if (storage > std::min(maxInlineSize,
+                           size_t(std::numeric_limits<uint8_t>::max()))) {
+        return 0;
+    }
+    return storage;
+}
+
+size_t StoredValue::getInlineValueSavings() const {
+    if (inlineCapacity == 0) {
+        return 0;
+    }
+    auto roundUp = [](size_t bytes) { return (bytes + 15) & ~size_t(15); };
+    const size_t objectSize = getObjectSize();
+    return roundUp(objectSize) + roundUp(inlineCapacity) -
+           roundUp(objectSize + inlineCapacity);
+}
+
+void StoredValue::assignValue(const value_t& newValue) {
+    Blob* blob = inlineBlob();
+    if (blob && newValue && newValue.get() != blob &&
+        newValue->getSize() <= inlineCapacity) {
+        if (value.get() == blob) {
+            value.reset();
+        }
+        // If only our own reference remains nobody else (an Item, a DCP
+        // message, the DCP compression cache...) can observe the inline
+        // Blob, so it can be rebuilt in place. (Other references can only
+        // be taken from an existing one, so this can't race.) Otherwise the
+        // new value goes in a Blob of its own.
+        if (blob->_rc_refcount.load() == 1) {
+            blob->~Blob();
+            value.reset(Blob::CopyInline(blob, *newValue));
+            // The rebuilt Blob starts without references; take our own one
+            // again, as the constructor does.
+            blob->_rc_incref();
+            return;
+        }
+    }
+    value = newValue;
+}
+
+void StoredValue::destroyWithInlineStorage(StoredValue* val) {
+    Blob* blob = val->inlineBlob();
+    // Until the inline Blob is released (which is only now if nothing else
+    // references it) the rest of the allocation stays allocated, so is
+    // accounted as pinned. Its size is left in place of the StoredValue,
+    // for Blob::deleteInline.
+    const size_t pinned =
+            val->getObjectSize() + val->inlineCapacity - blob->getSize();
+    val->~StoredValue();
+    new (val) size_t(pinned);
+    ObjectRegistry::onPinInlineStorage(pinned);
+    value_t::dropReference(blob);
+}
+
+void Blob::deleteInline(void* p) {
+    // Inline Blobs are located directly after the StoredValue's fixed
+    // fields, at the start of the allocation.
+    void* storage = static_cast<uint8_t*>(p) - sizeof(StoredValue);
+    ObjectRegistry::onUnpinInlineStorage(*static_cast<size_t*>(storage));
+    ::operator delete(storage);
+}
+
 void StoredValue::Deleter::operator()(StoredValue* val) {
     if (val->isOrdered) {
         delete static_cast<OrderedStoredValue*>(val);
+    } else if (val->inlineCapacity) {
+        // The inline Blob may outlive the StoredValue.
+        destroyWithInlineStorage(val);
     } else {
         delete val;
     }
@@ -263,7 +374,8 @@ bool StoredValue::operator==(const StoredValue& other) const {
             exptime == other.exptime && flags == other.flags &&
             _isDirty == other._isDirty && deleted == other.deleted &&
             newCacheItem == other.newCacheItem &&
-            isOrdered == other.isOrdered && nru == other.nru &&
+            isOrdered == other.isOrdered &&
+            getNRUValue() == other.getNRUValue() &&
             getKey() == other.getKey());
 }
 
@@ -282,8 +394,9 @@ bool StoredValue::deleteImpl() {
     return true;
 }
 
-void StoredValue::setValueImpl(const Item& itm) {
-    value = itm.getValue();
+template <typename Document>
+void StoredValue::setValueImpl(const Document& itm) {
+    assignValue(itm.getValue());
     deleted = itm.isDeleted();
     flags = itm.getFlags();
     datatype = itm.getDataType();
@@ -294,7 +407,7 @@ void StoredValue::setValueImpl(const Item& itm) {
     exptime = itm.getExptime();
     revSeqno = itm.getRevSeqno();
 
-    nru = itm.getNRUValue();
+    setNRUValue(itm.getNRUValue());
 
     if (isTempInitialItem()) {
         markClean();
@@ -379,7 +492,8 @@ bool OrderedStoredValue::deleteImpl() {
     return false;
 }
 
-void OrderedStoredValue::setValueImpl(const Item& itm) {
+template <typename Document>
+void OrderedStoredValue::setValueImpl(const Document& itm) {
     StoredValue::setValueImpl(itm);
 
     // Update the deleted time (note - even if it was already deleted we should
@@ -396,3 +510,24 @@ void OrderedStoredValue::setDeletedTime(rel_time_t time) {
     }
     lock_expiry_or_delete_time = time;
 }
+
+// StoredValues are created and updated from Items, and (when warming up)
+// straight from the DiskDocuments read from disk.
+template StoredValue::StoredValue(const Item&,
+                                  UniquePtr,
+                                  EPStats&,
+                                  bool,
+                                  size_t);
+template StoredValue::StoredValue(const DiskDocument&,
+                                  UniquePtr,
+                                  EPStats&,
+                                  bool,
+                                  size_t);
+template void StoredValue::setValue(const Item&);
+template void StoredValue::setValue(const DiskDocument&);
+template bool StoredValue::hasAvailableSpace(EPStats&, const Item&, bool);
+template bool StoredValue::hasAvailableSpace(EPStats&,
+                                             const DiskDocument&,
+                                             bool);
+template size_t StoredValue::getInlineStorageFor(const Item&, size_t);
+template size_t StoredValue::getInlineStorageFor(const DiskDocument&, size_t);
@@ -71,6 +71,32 @@ class OrderedStoredValue;
  *   length  {   | ...               |
  *               +-------------------+
  *
+ * StoredValues created by CompactStoredValueFactory may additionally carry
+ * a small value inline, in the same allocation. The Blob for such a value is
+ * constructed in place between the fixed fields and the key, and is shared
+ * via `value` like any other Blob:
+ *
+ *               .-------------------.
+ *               | StoredValue       |
+ *               +-------------------+
+ *     fixed {   | value [ptr]       | ==.
+ *    length {   | ...               |   |
+ *               + - - - - - - - - - +   |
+ *    inline {   | Blob              | <='
+ *     value {   | ...               |
+ *               + - - - - - - - - - +
+ *  variable {   | key[]             |
+ *   length  {   | ...               |
+ *               +-------------------+
+ *
+ * The StoredValue holds its own reference on the inline Blob for its whole
+ * lifetime, so the storage is never reused while the StoredValue exists.
+ * The allocation is freed by whichever of the StoredValue and the last
+ * outside reference to the Blob (e.g. an Item in a checkpoint) goes last.
+ * While the inline Blob is unreferenced (e.g. after an update with a value of
+ * a different size while the old one was still shared), new values which fit
+ * are copied back into the inline storage.
+ *
  * OrderedStoredValue is a "subclass" of StoredValue, which is used by
  * Ephemeral buckets as it supports maintaining a seqno ordering of items in
  * memory (for Persistent buckets this ordering is maintained on-disk).
@@ -131,8 +157,34 @@ public:
 
     uint8_t incrNRUValue();
 
+    /**
+     * Note a read of this item: makes it more recently used (see
+     * getNRUValue()) and more frequently used (see getFrequency()).
+     */
     void referenced();
 
+    /// Highest value of the frequency counter.
+    static const uint8_t MaxFrequency = 3;
+
+    /**
+     * Get how frequently the item has been read: a count, saturating at
+     * MaxFrequency, of references which the item pager ages (see
+     * decayFrequency()). Only used by the 2Q pager_algorithm.
+     */
+    uint8_t getFrequency() const {
+        return getField(refBits.load(std::memory_order_relaxed),
+                        FrequencyShift);
+    }
+
+    /// Age the frequency counter; the item pager does so as it sweeps.
+    void decayFrequency() {
+        updateRefBits([](uint8_t bits) {
+            const uint8_t frequency = getField(bits, FrequencyShift);
+            return frequency > 0 ? setField(bits, FrequencyShift, frequency - 1)
+                                 : bits;
+        });
+    }
+
     /**
      * Mark this item as needing to be persisted.
      */
@@ -156,7 +208,9 @@ public:
 
     bool eligibleForEviction(item_eviction_policy_t policy) {
         if (policy == VALUE_ONLY) {
-            return isResident() && !isDirty() && !isDeleted();
+            // Ejecting an inline value wouldn't free any memory.
+            return isResident() && !isDirty() && !isDeleted() &&
+                   !isValueInline();
         } else {
             return !isDirty() && !isDeleted();
         }
@@ -247,9 +301,10 @@ public:
     /**
      * Set a new value for this item.
      *
-     * @param itm the item with a new value
+     * @param itm the item (Item or DiskDocument) with a new value
      */
-    void setValue(const Item& itm);
+    template <typename Document>
+    void setValue(const Document& itm);
 
     void markDeleted() {
         deleted = true;
@@ -437,6 +492,31 @@ public:
         return value.get() != NULL;
     }
 
+    /**
+     * True if the current value is held in this StoredValue's inline value
+     * storage.
+     */
+    bool isValueInline() const {
+        return inlineCapacity != 0 && value.get() == inlineBlob();
+    }
+
+    /**
+     * Size in bytes of this StoredValue's inline value storage; zero if it
+     * was allocated without any. Not included in getObjectSize() - when in
+     * use the inline Blob is accounted as the value, like any other Blob.
+     */
+    size_t getInlineCapacity() const {
+        return inlineCapacity;
+    }
+
+    /**
+     * Estimate of the heap memory saved by allocating this StoredValue with
+     * inline value storage, instead of as two separate allocations (for the
+     * StoredValue and its Blob). Allocations are assumed to be rounded up to
+     * a 16 byte quantum, as by jemalloc's small size classes.
+     */
+    size_t getInlineValueSavings() const;
+
     void markNotResident() {
         value.reset();
     }
@@ -496,7 +576,7 @@ public:
     std::unique_ptr<Item> toItemWithNoValue(uint16_t vbucket) const;
 
     void setNext(UniquePtr&& nextSv) {
-        if (stale) {
+        if (isStaleBitSet()) {
             throw std::logic_error(
                     "StoredValue::setNext: StoredValue is stale,"
                     "cannot set chain next value");
@@ -505,7 +585,7 @@ public:
     }
 
     UniquePtr& getNext() {
-        if (stale) {
+        if (isStaleBitSet()) {
             throw std::logic_error(
                     "StoredValue::getNext: StoredValue is stale,"
                     "cannot get chain next value");
@@ -576,33 +656,49 @@ public:
     bool operator==(const StoredValue& other) const;
 
     /* [TBD] : Move this function out of StoredValue class */
+    template <typename Document>
     static bool hasAvailableSpace(EPStats&,
-                                  const Item& item,
+                                  const Document& item,
                                   bool isReplication = false);
 
     /// Return how many bytes are need to store Item as a StoredValue
-    static size_t getRequiredStorage(const Item& item) {
+    template <typename Document>
+    static size_t getRequiredStorage(const Document& item) {
         return sizeof(StoredValue) +
                SerialisedDocKey::getObjectSize(item.getKey().size());
     }
 
+    /**
+     * Return how many bytes of inline value storage a StoredValue for the
+     * given Item should be allocated with, if values up to maxInlineSize
+     * bytes (including the Blob header) are to be stored inline.
+     */
+    template <typename Document>
+    static size_t getInlineStorageFor(const Document& item,
+                                      size_t maxInlineSize);
+
 protected:
     /**
      * Constructor - protected as allocation needs to be done via
      * StoredValueFactory.
      *
-     * @param itm Item to base this StoredValue on.
+     * @param itm Item (or DiskDocument) to base this StoredValue on.
      * @param n The StoredValue which will follow the new stored value in
      *           the hash bucket chain, which this new item will take
      *           ownership of. (Typically the top of the hash bucket into
      *           which the new item is being inserted).
      * @param stats EPStats to update for this new StoredValue
      * @param isOrdered Are we constructing an OrderedStoredValue?
+     * @param inlineStorageSize Size of the inline value storage allocated
+     *        directly after the fixed fields (see getInlineStorageFor());
+     *        only supported for StoredValue (not OrderedStoredValue).
      */
-    StoredValue(const Item& itm,
+    template <typename Document>
+    StoredValue(const Document& itm,
                 UniquePtr n,
                 EPStats& stats,
-                bool isOrdered);
+                bool isOrdered,
+                size_t inlineStorageSize = 0);
 
     // Destructor. protected, as needs to be carefully deleted (via
     // StoredValue::Destructor) depending on the value of isOrdered flag.
@@ -633,6 +729,28 @@ protected:
      */
     inline SerialisedDocKey* key();
 
+    /**
+     * Get the inline Blob storage; null if allocated without any.
+     */
+    Blob* inlineBlob() const {
+        if (inlineCapacity == 0) {
+            return nullptr;
+        }
+        return reinterpret_cast<Blob*>(const_cast<StoredValue*>(this) + 1);
+    }
+
+    /**
+     * Assign a new value, copying it into the inline value storage if that
+     * is possible.
+     */
+    void assignValue(const value_t& newValue);
+
+    /**
+     * Destroy a StoredValue allocated with inline value storage, freeing the
+     * allocation unless the inline Blob is still referenced elsewhere.
+     */
+    static void destroyWithInlineStorage(StoredValue* val);
+
     /**
      * Logically mark this SV as deleted.
      * Implementation for StoredValue instances (dispatched to by del() based
@@ -643,9 +761,11 @@ protected:
     /* Update the value for this SV from the given item.
      * Implementation for StoredValue instances (dispatched to by setValue()).
      */
-    void setValueImpl(const Item& itm);
+    template <typename Document>
+    void setValueImpl(const Document& itm);
 
     friend class StoredValueFactory;
+    friend class CompactStoredValueFactory;
 
     value_t            value;          // 8 bytes
 
@@ -670,21 +790,54 @@ protected:
     bool               deleted   :  1;
     bool               newCacheItem : 1;
     const bool isOrdered : 1; //!< Is this an instance of OrderedStoredValue?
-    uint8_t            nru       :  2; //!< True if referenced since last sweep
-    bool unused : 2; // Unused bits in first byte of bitfields.
 
-    // Indicates if a newer instance of the item is added. Logically part of
-    // OSV, but is physically located in SV as there are spare bytes here.
-    // Guarded by the SequenceList's writeLock.
-    // NOTE: As this is guarded by a different lock to the rest of the SV,
-    // it *must* be in a different byte than any other data not guarded by
-    // writeLock (Hence why this isn't in the same byte as _isDirty, deleted,
-    // newCacheItem etc). To achieve this std::atomic is used to ensure accesses
-    // are not "optimized" and merged with the previous byte. The thread-safety
-    // of std::atomic is not actually used/needed; we just need the no-merge
-    // guarantee.
-    // Note (2): Only 1 bit of this is currently used; rest is "spare".
-    std::atomic<bool> stale;
+    // Bits of refBits.
+    static const uint8_t StaleBit = 0x01;
+    static const int NruShift = 1;
+    static const int FrequencyShift = 3;
+    static const uint8_t FieldMask = 0x03;
+
+    static uint8_t getField(uint8_t bits, int shift) {
+        return (bits >> shift) & FieldMask;
+    }
+
+    static uint8_t setField(uint8_t bits, int shift, uint8_t value) {
+        return (bits & ~(FieldMask << shift)) | ((value & FieldMask) << shift);
+    }
+
+    /// Atomically replace refBits with update(refBits).
+    template <typename Update>
+    void updateRefBits(Update update) {
+        uint8_t bits = refBits.load(std::memory_order_relaxed);
+        uint8_t desired;
+        do {
+            desired = update(bits);
+            if (desired == bits) {
+                // Don't dirty the cache line (say, for an item which is
+                // already as recently used as it can be).
+                return;
+            }
+        } while (!refBits.compare_exchange_weak(
+                bits, desired, std::memory_order_relaxed));
+    }
+
+    bool isStaleBitSet() const {
+        return refBits.load() & StaleBit;
+    }
+
+    // The NRU value (see getNRUValue()), the frequency counter (see
+    // getFrequency()) and the stale flag of an OrderedStoredValue.
+    // Readers update the NRU value and frequency holding only a shared
+    // HashTable lock (see HashTable::getReadLockedBucket()), and stale
+    // (whether a newer instance of the item was added; logically part of
+    // OSV) is guarded by the SequenceList's writeLock rather than the
+    // HashTable lock. So they live in their own byte, apart from the fields
+    // guarded by the HashTable lock, and are only ever accessed atomically.
+    std::atomic<uint8_t> refBits;
+
+    // Size of the inline value storage; zero if none. Occupies what would
+    // otherwise be padding.
+    const uint8_t inlineCapacity;
 
     static double mutation_mem_threshold;
 
@@ -705,7 +858,7 @@ public:
     boost::intrusive::list_member_hook<> seqno_hook;
 
     ~OrderedStoredValue() {
-        if (stale) {
+        if (isStaleBitSet()) {
             // This points to the replacement OSV which we do not actually own.
             // We are reusing a unique_ptr so we explicitly release it in this
             // case. We /do/ own the chain_next if we are not stale.
@@ -721,7 +874,7 @@ public:
      * param.
      */
     bool isStale(std::lock_guard<std::mutex>& writeGuard) const {
-        return stale;
+        return isStaleBitSet();
     }
 
     /**
@@ -736,12 +889,12 @@ public:
         // own the new SV. At destruction, we must release this ptr if
         // we are stale.
         chain_next_or_replacement.reset(newSv);
-        stale = true;
+        refBits.fetch_or(StaleBit);
     }
 
     StoredValue* getReplacementIfStale(
             std::lock_guard<std::mutex>& writeGuard) const {
-        if (!stale) {
+        if (!isStaleBitSet()) {
             return nullptr;
         }
 
@@ -757,7 +910,8 @@ public:
     bool operator==(const OrderedStoredValue& other) const;
 
     /// Return how many bytes are need to store Item as an OrderedStoredValue
-    static size_t getRequiredStorage(const Item& item) {
+    template <typename Document>
+    static size_t getRequiredStorage(const Document& item) {
         return sizeof(OrderedStoredValue) +
                SerialisedDocKey::getObjectSize(item.getKey());
     }
@@ -783,7 +937,8 @@ protected:
      * Implementation for OrderedStoredValue instances (dispatched to by
      *  setValue()).
      */
-    void setValueImpl(const Item& itm);
+    template <typename Document>
+    void setValueImpl(const Document& itm);
 
     /**
      * Set the time the item was deleted to the specified time.
@@ -793,7 +948,8 @@ protected:
 private:
     // Constructor. Private, as needs to be carefully created via
     // OrderedStoredValueFactory.
-    OrderedStoredValue(const Item& itm,
+    template <typename Document>
+    OrderedStoredValue(const Document& itm,
                        UniquePtr n,
                        EPStats& stats)
         : StoredValue(itm, std::move(n), stats, /*isOrdered*/ true) {
@@ -823,11 +979,13 @@ private:
 };
 
 SerialisedDocKey* StoredValue::key() {
-    // key is located immediately following the object.
+    // key is located immediately following the object (and any inline value
+    // storage).
     if (isOrdered) {
         return static_cast<OrderedStoredValue*>(this)->key();
     } else {
-        return reinterpret_cast<SerialisedDocKey*>(this + 1);
+        return reinterpret_cast<SerialisedDocKey*>(
+                reinterpret_cast<uint8_t*>(this + 1) + inlineCapacity);
     }
 }
 
@@ -23,6 +23,7 @@
 
 #include <memory>
 
+#include "disk_document.h"
 #include "stored-value.h"
 
 /**
@@ -44,6 +45,13 @@ public:
     virtual StoredValue::UniquePtr operator()(const Item& itm,
                                               StoredValue::UniquePtr next) = 0;
 
+    /**
+     * Create a new StoredValue (or subclass) with the given document read
+     * from disk, sharing (not copying) its value Blob where possible.
+     */
+    virtual StoredValue::UniquePtr operator()(const DiskDocument& doc,
+                                              StoredValue::UniquePtr next) = 0;
+
     /**
      * Create a new StoredValue (or subclass) from the given StoredValue.
      *
@@ -71,6 +79,23 @@ public:
      */
     StoredValue::UniquePtr operator()(const Item& itm,
                                       StoredValue::UniquePtr next) override {
+        return create(itm, std::move(next));
+    }
+
+    StoredValue::UniquePtr operator()(const DiskDocument& doc,
+                                      StoredValue::UniquePtr next) override {
+        return create(doc, std::move(next));
+    }
+
+    StoredValue::UniquePtr copyStoredValue(const StoredValue& other,
+                                           StoredValue::UniquePtr next) override {
+        throw std::logic_error("Copy of StoredValue is not supported");
+    }
+
+private:
+    template <typename Document>
+    StoredValue::UniquePtr create(const Document& itm,
+                                  StoredValue::UniquePtr next) {
         // Allocate a buffer to store the StoredValue and any trailing bytes
         // that maybe required.
         return StoredValue::UniquePtr(
@@ -81,13 +106,69 @@ public:
                                     /*isOrdered*/ false));
     }
 
+    EPStats* stats;
+};
+
+/**
+ * Creator of StoredValue instances which store small values inline - in the
+ * same allocation as the StoredValue and its key - avoiding a separate Blob
+ * allocation (and pointer chase) per item. See StoredValue for the layout.
+ */
+class CompactStoredValueFactory : public AbstractStoredValueFactory {
+public:
+    using value_type = StoredValue;
+
+    /// Default for the largest value (including Blob header) stored inline.
+    static const size_t DefaultMaxInlineSize = 64;
+
+    /**
+     * @param s EPStats to update for created StoredValues
+     * @param maxInlineSize Values (including their Blob header) up to this
+     *        many bytes are stored inline; larger ones are allocated
+     *        separately as normal.
+     */
+    CompactStoredValueFactory(EPStats& s,
+                              size_t maxInlineSize = DefaultMaxInlineSize)
+        : stats(&s), maxInlineSize(maxInlineSize) {
+    }
+
+    /**
+     * Create a concrete StoredValue object, with inline value storage if the
+     * item's value is small enough.
+     */
+    StoredValue::UniquePtr operator()(const Item& itm,
+                                      StoredValue::UniquePtr next) override {
+        return create(itm, std::move(next));
+    }
+
+    StoredValue::UniquePtr operator()(const DiskDocument& doc,
+                                      StoredValue::UniquePtr next) override {
+        return create(doc, std::move(next));
+    }
+
     StoredValue::UniquePtr copyStoredValue(const StoredValue& other,
                                            StoredValue::UniquePtr next) override {
         throw std::logic_error("Copy of StoredValue is not supported");
     }
 
 private:
+    template <typename Document>
+    StoredValue::UniquePtr create(const Document& itm,
+                                  StoredValue::UniquePtr next) {
+        const size_t inlineSize =
+                StoredValue::getInlineStorageFor(itm, maxInlineSize);
+        return StoredValue::UniquePtr(
+                new (::operator new(StoredValue::getRequiredStorage(itm) +
+                                    inlineSize))
+                        StoredValue(itm,
+                                    std::move(next),
+                                    *stats,
+                                    /*isOrdered*/ false,
+                                    inlineSize));
+    }
+
     EPStats* stats;
+    const size_t maxInlineSize;
 };
 
 /**
@@ -105,12 +186,12 @@ public:
      */
     StoredValue::UniquePtr operator()(const Item& itm,
                                       StoredValue::UniquePtr next) override {
-        // Allocate a buffer to store the OrderStoredValue and any trailing
-        // bytes required for the key.
-        return StoredValue::UniquePtr(
-                new (::operator new(
-                        OrderedStoredValue::getRequiredStorage(itm)))
-                        OrderedStoredValue(itm, std::move(next), *stats));
+        return create(itm, std::move(next));
+    }
+
+    StoredValue::UniquePtr operator()(const DiskDocument& doc,
+                                      StoredValue::UniquePtr next) override {
+        return create(doc, std::move(next));
     }
 
     /**
@@ -126,5 +207,16 @@ public:
     }
 
 private:
+    template <typename Document>
+    StoredValue::UniquePtr create(const Document& itm,
+                                  StoredValue::UniquePtr next) {
+        // Allocate a buffer to store the OrderStoredValue and any trailing
+        // bytes required for the key.
+        return StoredValue::UniquePtr(
+                new (::operator new(
+                        OrderedStoredValue::getRequiredStorage(itm)))
+                        OrderedStoredValue(itm, std::move(next), *stats));
+    }
+
     EPStats* stats;
 };
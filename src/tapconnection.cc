@@ -595,7 +595,7 @@ void TapProducer::clearQueues_UNLOCKED() {
     mem_overhead += (ackLog_.size() * sizeof(TapLogElement));
     ackLog_.clear();
 
-    stats.memOverhead->fetch_sub(mem_overhead);
+    stats.memOverhead.fetch_sub(mem_overhead);
 
     logger.log(EXTENSION_LOG_WARNING, "Clear the tap queues by force");
 }
@@ -678,7 +678,7 @@ void TapProducer::rollback() {
         ++ackLogSize;
     }
 
-    stats.memOverhead->fetch_sub(ackLogSize * sizeof(TapLogElement));
+    stats.memOverhead.fetch_sub(ackLogSize * sizeof(TapLogElement));
 
     seqnoReceived = seqno - 1;
     seqnoAckRequested = seqno - 1;
@@ -916,7 +916,7 @@ ENGINE_ERROR_CODE TapProducer::processAck(uint32_t s,
         ret = ENGINE_DISCONNECT;
     }
 
-    stats.memOverhead->fetch_sub(num_logs * sizeof(TapLogElement));
+    stats.memOverhead.fetch_sub(num_logs * sizeof(TapLogElement));
 
     return ret;
 }
@@ -1113,7 +1113,7 @@ void TapProducer::completeBGFetchJob(Item *itm, uint16_t vbid, bool implicitEnqu
         if (it != checkpointState_.end()) {
             ++(it->second.bgResultSize);
         }
-        stats.memOverhead->fetch_add(sizeof(Item *));
+        stats.memOverhead.fetch_add(sizeof(Item *));
     } else {
         delete itm;
     }
@@ -1138,7 +1138,7 @@ Item* TapProducer::nextBgFetchedItem_UNLOCKED() {
         --(it->second.bgResultSize);
     }
 
-    stats.memOverhead->fetch_sub(sizeof(Item *));
+    stats.memOverhead.fetch_sub(sizeof(Item *));
 
     return rv;
 }
@@ -1355,7 +1355,7 @@ queued_item TapProducer::nextFgFetched_UNLOCKED(bool &shouldPause) {
         } else {
             queueMemSize.store(0);
         }
-        stats.memOverhead->fetch_sub(sizeof(queued_item));
+        stats.memOverhead.fetch_sub(sizeof(queued_item));
         ++recordsFetched;
         return qi;
     }
@@ -1499,7 +1499,7 @@ bool TapProducer::addEvent_UNLOCKED(const queued_item &it) {
         queue->push_back(it);
         ++queueSize;
         queueMemSize.fetch_add(sizeof(queued_item));
-        stats.memOverhead->fetch_add(sizeof(queued_item));
+        stats.memOverhead.fetch_add(sizeof(queued_item));
         return wasEmpty;
     } else {
         return queue->empty();
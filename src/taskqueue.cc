@@ -22,10 +22,15 @@
 
 #include <cmath>
 
-TaskQueue::TaskQueue(ExecutorPool *m, task_type_t t, const char *nm) :
+TaskQueue::TaskQueue(ExecutorPool *m, task_type_t t, const char *nm,
+                     bool timerWheel) :
     name(nm), queueType(t), manager(m), sleepers(0)
 {
-    // EMPTY
+    if (timerWheel) {
+        futureQueue.reset(new TimerWheelFutureQueue());
+    } else {
+        futureQueue.reset(new FutureQueue<>());
+    }
 }
 
 TaskQueue::~TaskQueue() {
@@ -43,7 +48,7 @@ size_t TaskQueue::getReadyQueueSize() {
 
 size_t TaskQueue::getFutureQueueSize() {
     LockHolder lh(mutex);
-    return futureQueue.size();
+    return futureQueue->size();
 }
 
 size_t TaskQueue::getPendingQueueSize() {
@@ -123,10 +128,10 @@ bool TaskQueue::_fetchNextTask(ExecutorThread &t, bool toSleep) {
 
     size_t numToWake = _moveReadyTasks(t.getCurTime());
 
-    if (!futureQueue.empty() && t.taskType == queueType &&
-        futureQueue.top()->getWaketime() < t.getWaketime()) {
+    if (!futureQueue->empty() && t.taskType == queueType &&
+        futureQueue->top()->getWaketime() < t.getWaketime()) {
         // record earliest waketime
-        t.setWaketime(futureQueue.top()->getWaketime());
+        t.setWaketime(futureQueue->top()->getWaketime());
     }
 
     if (!readyQueue.empty() && readyQueue.top()->isdead()) {
@@ -144,6 +149,12 @@ bool TaskQueue::_fetchNextTask(ExecutorThread &t, bool toSleep) {
         numToWake = numToWake ? numToWake - 1 : 0; // 1 fewer task ready
     }
 
+    if (ret && manager->isWorkStealing()) {
+        // Take the rest of the ready tasks too, so we don't come back to the
+        // shared queue for each one; the threads woken below steal them.
+        _moveReadyTasksToLocal(t);
+    }
+
     _doWake_UNLOCKED(numToWake);
     lh.unlock();
 
@@ -163,10 +174,10 @@ size_t TaskQueue::_moveReadyTasks(const ProcessClock::time_point tv) {
     }
 
     size_t numReady = 0;
-    while (!futureQueue.empty()) {
-        ExTask tid = futureQueue.top();
+    while (!futureQueue->empty()) {
+        ExTask tid = futureQueue->top();
         if (tid->getWaketime() <= tv) {
-            futureQueue.pop();
+            futureQueue->pop();
             readyQueue.push(tid);
             numReady++;
         } else {
@@ -180,6 +191,15 @@ size_t TaskQueue::_moveReadyTasks(const ProcessClock::time_point tv) {
     return numReady ? numReady - 1 : 0;
 }
 
+void TaskQueue::_moveReadyTasksToLocal(ExecutorThread& t) {
+    // The tasks remain accounted as ready work (numReadyTasks) until they
+    // are popped from the LocalTaskQueue.
+    while (!readyQueue.empty()) {
+        t.localQueue.push(readyQueue.top(), this);
+        readyQueue.pop();
+    }
+}
+
 void TaskQueue::_checkPendingQueue(void) {
     if (!pendingQueue.empty()) {
         ExTask runnableTask = pendingQueue.front();
@@ -192,8 +212,8 @@ void TaskQueue::_checkPendingQueue(void) {
 ProcessClock::time_point TaskQueue::_reschedule(ExTask &task) {
     LockHolder lh(mutex);
 
-    futureQueue.push(task);
-    return futureQueue.top()->getWaketime();
+    futureQueue->push(task);
+    return futureQueue->top()->getWaketime();
 }
 
 ProcessClock::time_point TaskQueue::reschedule(ExTask &task) {
@@ -203,6 +223,31 @@ ProcessClock::time_point TaskQueue::reschedule(ExTask &task) {
     return rv;
 }
 
+void TaskQueue::_requeue(ExTask& task) {
+    TaskQueue* sleepQ;
+    // A task which isn't due yet is picked up by the sleeping threads'
+    // periodic wake, as for a rescheduled task.
+    size_t numToWake = task->getWaketime() <= ProcessClock::now() ? 1 : 0;
+    {
+        LockHolder lh(mutex);
+        futureQueue->push(task);
+        if (!numToWake) {
+            return;
+        }
+        sleepQ = manager->getSleepQ(queueType);
+        _doWake_UNLOCKED(numToWake);
+    }
+    if (this != sleepQ) {
+        sleepQ->doWake(numToWake);
+    }
+}
+
+void TaskQueue::requeue(ExTask& task) {
+    EventuallyPersistentEngine *epe = ObjectRegistry::onSwitchThread(NULL, true);
+    _requeue(task);
+    ObjectRegistry::onSwitchThread(epe);
+}
+
 void TaskQueue::_schedule(ExTask &task) {
     TaskQueue* sleepQ;
     size_t numToWake = 1;
@@ -229,7 +274,7 @@ void TaskQueue::_schedule(ExTask &task) {
             }
         }
 
-        futureQueue.push(task);
+        futureQueue->push(task);
 
         LOG(EXTENSION_LOG_DEBUG,
             "%s: Schedule a task \"%.*s\" id %" PRIu64,
@@ -279,7 +324,7 @@ void TaskQueue::_wake(ExTask &task) {
             }
         }
 
-        futureQueue.updateWaketime(task, now);
+        futureQueue->updateWaketime(task, now);
         task->setState(TASK_RUNNING, TASK_SNOOZED);
 
         while (!notReady.empty()) {
@@ -289,7 +334,7 @@ void TaskQueue::_wake(ExTask &task) {
             }
 
             // MB-18453: Only push to the futureQueue
-            futureQueue.push(tid);
+            futureQueue->push(tid);
             notReady.pop();
         }
 
@@ -321,3 +366,39 @@ const std::string TaskQueue::taskType2Str(task_type_t type) {
         return std::string("None");
     }
 }
+
+void LocalTaskQueue::push(const ExTask& task, TaskQueue* q) {
+    LockHolder lh(mutex);
+    ready.push(std::make_pair(task, q));
+    count.store(ready.size(), std::memory_order_relaxed);
+}
+
+bool LocalTaskQueue::pop(Entry& entry) {
+    if (size() == 0) {
+        // Only the owner adds tasks, so if it sees the queue empty it is.
+        return false;
+    }
+    LockHolder lh(mutex);
+    return pop_UNLOCKED(entry);
+}
+
+bool LocalTaskQueue::steal(Entry& entry) {
+    if (size() == 0) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lh(mutex, std::try_to_lock);
+    if (!lh.owns_lock()) {
+        return false;
+    }
+    return pop_UNLOCKED(entry);
+}
+
+bool LocalTaskQueue::pop_UNLOCKED(Entry& entry) {
+    if (ready.empty()) {
+        return false;
+    }
+    entry = ready.top();
+    ready.pop();
+    count.store(ready.size(), std::memory_order_relaxed);
+    return true;
+}
@@ -25,16 +25,74 @@
 
 #include <platform/processclock.h>
 
+#include <atomic>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <utility>
+#include <vector>
 
 class ExecutorPool;
 class ExecutorThread;
+class TaskQueue;
+
+/**
+ * A per-ExecutorThread queue of tasks which are ready to run, used by the
+ * work-stealing scheduler.
+ *
+ * Only the owning thread adds tasks (tasks it reschedules to run again
+ * immediately, and batches of tasks it takes from a shared TaskQueue), so
+ * the owner's push/pop are normally uncontended. Idle threads of the same
+ * type steal from it. Each task is kept with the TaskQueue it belongs to,
+ * so it can be returned there if it is snoozed. Tasks are ordered by
+ * priority, as in TaskQueue's readyQueue.
+ */
+class LocalTaskQueue {
+public:
+    typedef std::pair<ExTask, TaskQueue*> Entry;
+
+    LocalTaskQueue() : count(0) {
+    }
+
+    void push(const ExTask& task, TaskQueue* q);
+
+    /// Pop the highest priority task; returns false if empty.
+    bool pop(Entry& entry);
+
+    /**
+     * Steal the highest priority task. Called by other threads; gives up
+     * (returns false) instead of blocking if the queue is in use.
+     */
+    bool steal(Entry& entry);
+
+    size_t size() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+private:
+    bool pop_UNLOCKED(Entry& entry);
+
+    class CompareEntryByPriority {
+    public:
+        bool operator()(Entry& e1, Entry& e2) {
+            return CompareByPriority()(e1.first, e2.first);
+        }
+    };
+
+    std::mutex mutex;
+    std::priority_queue<Entry, std::vector<Entry>, CompareEntryByPriority>
+            ready;
+    // Copy of ready.size(), so thieves can skip empty queues without
+    // taking the mutex.
+    std::atomic<size_t> count;
+};
 
 class TaskQueue {
     friend class ExecutorPool;
 public:
-    TaskQueue(ExecutorPool *m, task_type_t t, const char *nm);
+    TaskQueue(ExecutorPool *m, task_type_t t, const char *nm,
+              bool timerWheel = false);
     ~TaskQueue();
 
     void schedule(ExTask &task);
@@ -62,14 +120,23 @@ public:
     size_t getPendingQueueSize();
 
     void snooze(ExTask& task, const double secs) {
-        futureQueue.snooze(task, secs);
+        futureQueue->snooze(task, secs);
     }
 
+    /**
+     * Return a task taken from this queue (and held in a LocalTaskQueue) to
+     * the future queue, e.g. because it was snoozed before it ran or its
+     * thread is stopping. Wakes a thread if the task is ready to run.
+     */
+    void requeue(ExTask& task);
+
 private:
     void _schedule(ExTask &task);
     ProcessClock::time_point _reschedule(ExTask &task);
     void _checkPendingQueue(void);
     bool _fetchNextTask(ExecutorThread &thread, bool toSleep);
+    void _moveReadyTasksToLocal(ExecutorThread& thread);
+    void _requeue(ExTask& task);
     void _wake(ExTask &task);
     bool _doSleep(ExecutorThread &thread, std::unique_lock<std::mutex>& lock);
     void _doWake_UNLOCKED(size_t &numToWake);
@@ -86,8 +153,8 @@ private:
     std::priority_queue<ExTask, std::deque<ExTask>,
                         CompareByPriority> readyQueue;
 
-    // sorted by waketime.
-    FutureQueue<> futureQueue;
+    // sorted by waketime; a FutureQueue or TimerWheelFutureQueue.
+    std::unique_ptr<AbstractFutureQueue> futureQueue;
 
     std::list<ExTask> pendingQueue;
 };
@@ -29,6 +29,7 @@
 
 // Read IO tasks
 TASK(MultiBGFetcherTask, READER_TASK_IDX, 0)
+TASK(BGFetchBatchTask, READER_TASK_IDX, 0)
 TASK(FetchAllKeysTask, READER_TASK_IDX, 0)
 TASK(Warmup, READER_TASK_IDX, 0)
 TASK(WarmupInitialize, READER_TASK_IDX, 0)
@@ -57,6 +58,7 @@ TASK(BackfillManagerTask, AUXIO_TASK_IDX, 8)
 TASK(RollbackTask, WRITER_TASK_IDX, 1)
 TASK(CompactVBucketTask, WRITER_TASK_IDX, 2)
 TASK(FlusherTask, WRITER_TASK_IDX, 5)
+TASK(FlushCommitTask, WRITER_TASK_IDX, 5)
 TASK(StatSnap, WRITER_TASK_IDX, 9)
 
 // Non-IO tasks
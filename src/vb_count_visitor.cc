@@ -31,6 +31,8 @@ void VBucketCountVisitor::visitBucket(VBucketPtr& vb) {
         htMemory += vb->ht.memorySize();
         htItemMemory += vb->ht.getItemMemory();
         htCacheSize += vb->ht.cacheSize;
+        htCompressedValueSize += vb->ht.getCompressedValueSize();
+        htUncompressedValueSize += vb->ht.getUncompressedValueSize();
         numEjects += vb->ht.getNumEjects();
         numExpiredItems += vb->numExpiredItems;
         metaDataMemory += vb->ht.metaDataMemory;
@@ -66,7 +68,7 @@ void VBucketCountVisitor::visitBucket(VBucketPtr& vb) {
 
         // Iterate over each datatype combination
         for (uint8_t ii = 0; ii < datatypeCounts.size(); ++ii) {
-            datatypeCounts[ii] += vb->ht.datatypeCounts[ii];
+            datatypeCounts[ii] += vb->ht.datatypeCounts[ii].items;
         }
     }
 }
@@ -39,6 +39,8 @@ public:
           htMemory(0),
           htItemMemory(0),
           htCacheSize(0),
+          htCompressedValueSize(0),
+          htUncompressedValueSize(0),
           numEjects(0),
           numExpiredItems(0),
           metaDataMemory(0),
@@ -117,6 +119,14 @@ public:
         return htCacheSize;
     }
 
+    size_t getCompressedValueSize() {
+        return htCompressedValueSize;
+    }
+
+    size_t getUncompressedValueSize() {
+        return htUncompressedValueSize;
+    }
+
     size_t getOpsCreate() {
         return opsCreate;
     }
@@ -188,6 +198,8 @@ private:
     size_t htMemory;
     size_t htItemMemory;
     size_t htCacheSize;
+    size_t htCompressedValueSize;
+    size_t htUncompressedValueSize;
     size_t numEjects;
     size_t numExpiredItems;
     size_t metaDataMemory;
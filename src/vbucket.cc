@@ -25,7 +25,9 @@
 
 #include "atomic.h"
 #include "bgfetcher.h"
+#include "bloomfilter_file.h"
 #include "conflict_resolution.h"
+#include "disk_document.h"
 #include "ep_engine.h"
 #include "ep_types.h"
 #include "failover-table.h"
@@ -40,6 +42,7 @@
 
 #include "vbucket.h"
 
+#include <platform/compress.h>
 #include <xattr/blob.h>
 #include <xattr/utils.h>
 
@@ -150,7 +153,13 @@ VBucket::VBucket(id_type i,
                  uint64_t purgeSeqno,
                  uint64_t maxCas,
                  const std::string& collectionsManifest)
-    : ht(st, std::move(valFact), config.getHtSize(), config.getHtLocks()),
+    : ht(st,
+         std::move(valFact),
+         config.getHtSize(),
+         config.getHtLocks(),
+         config.getHtLockMode() == "shared_reads"
+                 ? HashTable::LockMode::SharedReads
+                 : HashTable::LockMode::Exclusive),
       checkpointManager(st,
                         i,
                         chkConfig,
@@ -182,6 +191,7 @@ VBucket::VBucket(id_type i,
       takeover_backed_up(false),
       persisted_snapshot_start(lastSnapStart),
       persisted_snapshot_end(lastSnapEnd),
+      blockedFilter(config.getBfilterType() == "blocked"),
       rollbackItemCount(0),
       hlc(maxCas,
           std::chrono::microseconds(config.getHlcDriftAheadThresholdUs()),
@@ -199,9 +209,14 @@ VBucket::VBucket(id_type i,
         conflictResolver.reset(new RevisionSeqnoResolution());
     }
 
+    ht.setResizeStepSize(config.getHtResizeStepSize());
+    if (config.getHtIndexType() == "tagged") {
+        ht.enableTagIndex();
+    }
+
     backfill.isBackfillPhase = false;
     pendingOpsStart = 0;
-    stats.memOverhead->fetch_add(sizeof(VBucket)
+    stats.memOverhead.fetch_add(sizeof(VBucket)
                                 + ht.memorySize() + sizeof(CheckpointManager));
     LOG(EXTENSION_LOG_NOTICE,
         "VBucket: created vbucket:%" PRIu16 " with state:%s "
@@ -230,7 +245,7 @@ VBucket::~VBucket() {
     // Clear out the bloomfilter(s)
     clearFilter();
 
-    stats.memOverhead->fetch_sub(sizeof(VBucket) + ht.memorySize() +
+    stats.memOverhead.fetch_sub(sizeof(VBucket) + ht.memorySize() +
                                 sizeof(CheckpointManager));
 
     LOG(EXTENSION_LOG_INFO, "Destroying vbucket %d\n", id);
@@ -443,6 +458,15 @@ bool VBucket::isResidentRatioUnderThreshold(float threshold) {
     }
 }
 
+std::unique_ptr<AbstractBloomFilter> VBucket::makeFilter(
+        size_t key_count, double probability, bfilter_status_t status) {
+    if (blockedFilter) {
+        return std::make_unique<BlockedBloomFilter>(
+                key_count, probability, status);
+    }
+    return std::make_unique<BloomFilter>(key_count, probability, status);
+}
+
 void VBucket::createFilter(size_t key_count, double probability) {
     // Create the actual bloom filter upon vbucket creation during
     // scenarios:
@@ -450,8 +474,7 @@ void VBucket::createFilter(size_t key_count, double probability) {
     //      - Rebalance
     LockHolder lh(bfMutex);
     if (bFilter == nullptr && tempFilter == nullptr) {
-        bFilter = std::make_unique<BloomFilter>(key_count, probability,
-                                        BFILTER_ENABLED);
+        bFilter = makeFilter(key_count, probability, BFILTER_ENABLED);
     } else {
         LOG(EXTENSION_LOG_WARNING, "(vb %" PRIu16 ") Bloom filter / Temp filter"
             " already exist!", id);
@@ -463,8 +486,7 @@ void VBucket::initTempFilter(size_t key_count, double probability) {
     // if the main filter is found to exist, set its state to
     // COMPACTING as well.
     LockHolder lh(bfMutex);
-    tempFilter = std::make_unique<BloomFilter>(key_count, probability,
-                                     BFILTER_COMPACTING);
+    tempFilter = makeFilter(key_count, probability, BFILTER_COMPACTING);
     if (bFilter) {
         bFilter->setStatus(BFILTER_COMPACTING);
     }
@@ -586,6 +608,51 @@ size_t VBucket::getNumOfKeysInFilter() {
     }
 }
 
+/**
+ * Adds the key of every item in a hash table to its vBucket's bloom filter.
+ */
+class AddToFilterVisitor : public HashTableVisitor {
+public:
+    AddToFilterVisitor(VBucket& vb) : vb(vb) {
+    }
+
+    void visit(const HashTable::HashBucketLock& lh, StoredValue* v) override {
+        vb.addToFilter(StoredDocKey(v->getKey()));
+    }
+
+private:
+    VBucket& vb;
+};
+
+bool VBucket::saveFilter(const std::string& fname) {
+    if (eviction == FULL_EVICTION) {
+        // Takes bfMutex under the hash bucket locks, so not under bfMutex.
+        AddToFilterVisitor visitor(*this);
+        ht.visit(visitor);
+    }
+
+    LockHolder lh(bfMutex);
+    // Only blocked filters can be saved (see BloomFilterFile).
+    auto* filter = dynamic_cast<BlockedBloomFilter*>(bFilter.get());
+    if (!filter || (filter->getStatus() != BFILTER_ENABLED &&
+                    filter->getStatus() != BFILTER_COMPACTING)) {
+        return false;
+    }
+    BloomFilterFile::save(fname,
+                          id,
+                          failovers->getLatestUUID(),
+                          getPersistenceSeqno(),
+                          *filter);
+    return true;
+}
+
+void VBucket::setFilter(std::unique_ptr<BlockedBloomFilter> filter) {
+    LockHolder lh(bfMutex);
+    if (bFilter == nullptr && tempFilter == nullptr) {
+        bFilter = std::move(filter);
+    }
+}
+
 VBNotifyCtx VBucket::queueDirty(
         StoredValue& v,
         const GenerateBySeqno generateBySeqno,
@@ -1509,7 +1576,8 @@ GetValue VBucket::getAndUpdateTtl(const DocKey& key,
     return gv;
 }
 
-MutationStatus VBucket::insertFromWarmup(Item& itm,
+template <typename Document>
+MutationStatus VBucket::insertFromWarmup(const Document& itm,
                                          bool eject,
                                          bool keyMetaDataOnly) {
     if (!StoredValue::hasAvailableSpace(stats, itm)) {
@@ -1523,7 +1591,7 @@ MutationStatus VBucket::insertFromWarmup(Item& itm,
                                       TrackReference::No);
 
     if (v == NULL) {
-        v = addNewStoredValue(hbl, itm, /*queueItmCtx*/ nullptr).first;
+        v = ht.unlocked_addNewStoredValue(hbl, itm);
         if (keyMetaDataOnly) {
             v->markNotResident();
             /* For now ht stats are updated from outside ht. This seems to be
@@ -1555,7 +1623,7 @@ MutationStatus VBucket::insertFromWarmup(Item& itm,
                 return MutationStatus::InvalidCas;
             }
         }
-        updateStoredValue(hbl, *v, itm, /*queueItmCtx*/ nullptr);
+        ht.unlocked_updateStoredValue(hbl.getHTLock(), *v, itm);
     }
 
     v->markClean();
@@ -1567,6 +1635,11 @@ MutationStatus VBucket::insertFromWarmup(Item& itm,
     return MutationStatus::NotFound;
 }
 
+template MutationStatus VBucket::insertFromWarmup(const Item&, bool, bool);
+template MutationStatus VBucket::insertFromWarmup(const DiskDocument&,
+                                                  bool,
+                                                  bool);
+
 GetValue VBucket::getInternal(const DocKey& key,
                               const void* cookie,
                               EventuallyPersistentEngine& engine,
@@ -1577,6 +1650,31 @@ GetValue VBucket::getInternal(const DocKey& key,
                                                   ? TrackReference::Yes
                                                   : TrackReference::No;
     const bool getDeletedValue = (options & GET_DELETED_VALUE);
+
+    if (ht.getLockMode() == HashTable::LockMode::SharedReads) {
+        // Serve live, resident items under the shared lock; anything which
+        // may need expiring, bg-fetching or temp item cleanup falls through
+        // to the exclusive path below.
+        auto rlh = ht.getReadLockedBucket(key);
+        StoredValue* v = ht.unlocked_find(key,
+                                          rlh.getBucketNum(),
+                                          WantsDeleted::No,
+                                          TrackReference::No);
+        if (v && !v->isTempItem() && v->isResident() &&
+            !v->isExpired(ep_real_time())) {
+            if (trackReference == TrackReference::Yes) {
+                v->referenced();
+            }
+            const bool hide_cas = (options & HIDE_LOCKED_CAS) &&
+                                  v->isLocked(ep_current_time());
+            return GetValue(v->toItem(hide_cas, getId()).release(),
+                            ENGINE_SUCCESS,
+                            v->getBySeqno(),
+                            false,
+                            v->getNRUValue());
+        }
+    }
+
     auto hbl = ht.getLockedBucket(key);
     StoredValue* v = fetchValidValue(
             hbl, key, WantsDeleted::Yes, trackReference, QueueExpired::Yes);
@@ -1637,6 +1735,21 @@ ENGINE_ERROR_CODE VBucket::getMetaData(const DocKey& key,
                                        uint32_t& deleted,
                                        uint8_t& datatype) {
     deleted = 0;
+
+    if (ht.getLockMode() == HashTable::LockMode::SharedReads) {
+        // Only a lookup miss or a temp initial item require modifying the
+        // HashTable; everything else can be answered under the shared lock.
+        auto rlh = ht.getReadLockedBucket(key);
+        StoredValue* v = ht.unlocked_find(key,
+                                          rlh.getBucketNum(),
+                                          WantsDeleted::Yes,
+                                          TrackReference::No);
+        if (v && !v->isTempInitialItem()) {
+            stats.numOpsGetMeta++;
+            return getMetaDataFromStoredValue(*v, metadata, deleted, datatype);
+        }
+    }
+
     auto hbl = ht.getLockedBucket(key);
     StoredValue* v = ht.unlocked_find(
             key, hbl.getBucketNum(), WantsDeleted::Yes, TrackReference::No);
@@ -1647,26 +1760,8 @@ ENGINE_ERROR_CODE VBucket::getMetaData(const DocKey& key,
             // Need bg meta fetch.
             bgFetch(key, cookie, engine, bgFetchDelay, true);
             return ENGINE_EWOULDBLOCK;
-        } else if (v->isTempNonExistentItem()) {
-            metadata.cas = v->getCas();
-            return ENGINE_KEY_ENOENT;
         } else {
-            if (v->isTempDeletedItem() || v->isDeleted() ||
-                v->isExpired(ep_real_time())) {
-                deleted |= GET_META_ITEM_DELETED_FLAG;
-            }
-
-            if (v->isLocked(ep_current_time())) {
-                metadata.cas = static_cast<uint64_t>(-1);
-            } else {
-                metadata.cas = v->getCas();
-            }
-            metadata.flags = v->getFlags();
-            metadata.exptime = v->getExptime();
-            metadata.revSeqno = v->getRevSeqno();
-            datatype = v->getDatatype();
-
-            return ENGINE_SUCCESS;
+            return getMetaDataFromStoredValue(*v, metadata, deleted, datatype);
         }
     } else {
         // The key wasn't found. However, this may be because it was previously
@@ -1688,12 +1783,63 @@ ENGINE_ERROR_CODE VBucket::getMetaData(const DocKey& key,
     }
 }
 
+ENGINE_ERROR_CODE VBucket::getMetaDataFromStoredValue(const StoredValue& v,
+                                                      ItemMetaData& metadata,
+                                                      uint32_t& deleted,
+                                                      uint8_t& datatype) {
+    if (v.isTempNonExistentItem()) {
+        metadata.cas = v.getCas();
+        return ENGINE_KEY_ENOENT;
+    }
+
+    if (v.isTempDeletedItem() || v.isDeleted() ||
+        v.isExpired(ep_real_time())) {
+        deleted |= GET_META_ITEM_DELETED_FLAG;
+    }
+
+    if (v.isLocked(ep_current_time())) {
+        metadata.cas = static_cast<uint64_t>(-1);
+    } else {
+        metadata.cas = v.getCas();
+    }
+    metadata.flags = v.getFlags();
+    metadata.exptime = v.getExptime();
+    metadata.revSeqno = v.getRevSeqno();
+    datatype = v.getDatatype();
+
+    return ENGINE_SUCCESS;
+}
+
 ENGINE_ERROR_CODE VBucket::getKeyStats(const DocKey& key,
                                        const void* cookie,
                                        EventuallyPersistentEngine& engine,
                                        int bgFetchDelay,
                                        struct key_stats& kstats,
                                        WantsDeleted wantsDeleted) {
+    if (ht.getLockMode() == HashTable::LockMode::SharedReads) {
+        // Live (or, under value eviction, deleted) non-temp items need no
+        // HashTable changes; defer expired ones to the exclusive path, which
+        // expires them, and deleted ones under full eviction, so they are
+        // handled exactly as that path handles them.
+        auto rlh = ht.getReadLockedBucket(key);
+        StoredValue* v = ht.unlocked_find(key,
+                                          rlh.getBucketNum(),
+                                          WantsDeleted::Yes,
+                                          TrackReference::No);
+        if (v && !v->isTempItem() &&
+            (v->isDeleted() ? eviction == VALUE_ONLY
+                            : !v->isExpired(ep_real_time()))) {
+            if (v->isDeleted() && wantsDeleted == WantsDeleted::No) {
+                return ENGINE_KEY_ENOENT;
+            }
+            if (!v->isDeleted()) {
+                v->referenced();
+            }
+            getKeyStatsFromStoredValue(*v, kstats);
+            return ENGINE_SUCCESS;
+        }
+    }
+
     auto hbl = ht.getLockedBucket(key);
     StoredValue* v = fetchValidValue(hbl,
                                      key,
@@ -1711,12 +1857,7 @@ ENGINE_ERROR_CODE VBucket::getKeyStats(const DocKey& key,
             bgFetch(key, cookie, engine, bgFetchDelay, true);
             return ENGINE_EWOULDBLOCK;
         }
-        kstats.logically_deleted = v->isDeleted();
-        kstats.dirty = v->isDirty();
-        kstats.exptime = v->getExptime();
-        kstats.flags = v->getFlags();
-        kstats.cas = v->getCas();
-        kstats.vb_state = getState();
+        getKeyStatsFromStoredValue(*v, kstats);
         return ENGINE_SUCCESS;
     } else {
         if (eviction == VALUE_ONLY) {
@@ -1735,6 +1876,16 @@ ENGINE_ERROR_CODE VBucket::getKeyStats(const DocKey& key,
     }
 }
 
+void VBucket::getKeyStatsFromStoredValue(const StoredValue& v,
+                                         struct key_stats& kstats) {
+    kstats.logically_deleted = v.isDeleted();
+    kstats.dirty = v.isDirty();
+    kstats.exptime = v.getExptime();
+    kstats.flags = v.getFlags();
+    kstats.cas = v.getCas();
+    kstats.vb_state = getState();
+}
+
 GetValue VBucket::getLocked(const DocKey& key,
                             rel_time_t currentTime,
                             uint32_t lockTimeout,
@@ -2404,12 +2555,27 @@ size_t VBucket::getCheckpointFlushTimeout() {
 std::unique_ptr<Item> VBucket::pruneXattrDocument(
         StoredValue& v, const ItemMetaData& itemMeta) {
     // Need to take a copy of the value, prune it, and add it back
+    cb::const_char_buffer value{v.getValue()->getData(),
+                                v.getValue()->vlength()};
+
+    // The value may be held compressed (see compression_mode); the XATTRs
+    // can only be pruned from the inflated document.
+    cb::compression::Buffer inflated;
+    if (mcbp::datatype::is_snappy(v.getDatatype())) {
+        if (!cb::compression::inflate(cb::compression::Algorithm::Snappy,
+                                      value.data(),
+                                      value.size(),
+                                      inflated)) {
+            throw std::runtime_error(
+                    "VBucket::pruneXattrDocument: failed to inflate value "
+                    "with seqno:" + std::to_string(v.getBySeqno()));
+        }
+        value = {inflated.data.get(), inflated.len};
+    }
 
     // Create work-space document
-    std::vector<uint8_t> workspace(v.getValue()->vlength());
-    std::copy_n(v.getValue()->getData(),
-                v.getValue()->vlength(),
-                workspace.begin());
+    std::vector<uint8_t> workspace(value.size());
+    std::copy_n(value.data(), value.size(), workspace.begin());
 
     // Now attach to the XATTRs in the document
     auto sz = cb::xattr::get_body_offset(
@@ -2429,14 +2595,18 @@ std::unique_ptr<Item> VBucket::pruneXattrDocument(
                                   v.getValue()->getExtMeta())),
                           v.getValue()->getExtLen());
 
-        return std::make_unique<Item>(v.getKey(),
-                                      itemMeta.flags,
-                                      itemMeta.exptime,
-                                      newValue,
-                                      itemMeta.cas,
-                                      v.getBySeqno(),
-                                      getId(),
-                                      itemMeta.revSeqno);
+        auto prunedItem = std::make_unique<Item>(v.getKey(),
+                                                 itemMeta.flags,
+                                                 itemMeta.exptime,
+                                                 newValue,
+                                                 itemMeta.cas,
+                                                 v.getBySeqno(),
+                                                 getId(),
+                                                 itemMeta.revSeqno);
+        // The pruned XATTRs are held uncompressed.
+        prunedItem->setDataType(protocol_binary_datatype_t(
+                prunedItem->getDataType() & ~PROTOCOL_BINARY_DATATYPE_SNAPPY));
+        return prunedItem;
     } else {
         return {};
     }
@@ -459,7 +459,7 @@ public:
             backfill.items.pop();
         }
         stats.vbBackfillQueueSize.fetch_sub(num_items);
-        stats.memOverhead->fetch_sub(num_items * sizeof(queued_item));
+        stats.memOverhead.fetch_sub(num_items * sizeof(queued_item));
     }
 
     bool isBackfillPhase() {
@@ -577,6 +577,23 @@ public:
     size_t getFilterSize();
     size_t getNumOfKeysInFilter();
 
+    /**
+     * Save the bloom filter to the given file for the next warmup (see
+     * BloomFilterFile). Under full eviction the keys of everything in the
+     * hash table are added to the filter first, as none of them will be
+     * resident after the restart.
+     *
+     * @return true if there was an enabled (blocked) filter to save
+     * @throws std::system_error if the file cannot be written
+     */
+    bool saveFilter(const std::string& fname);
+
+    /**
+     * Use the given filter (loaded at warmup), if the vBucket doesn't
+     * already have one.
+     */
+    void setFilter(std::unique_ptr<BlockedBloomFilter> filter);
+
     uint64_t nextHLCCas() {
         return hlc.nextHLC();
     }
@@ -1018,16 +1035,19 @@ public:
      * Insert an item into the VBucket during warmup. If we're trying to insert
      * a partial item we mark it as nonResident
      *
-     * @param itm Item to insert. itm is not modified. But cannot be passed as
-     *            const because it is passed to functions that can generally
-     *            modify the itm but do not modify it due to the flags passed.
+     * Only (EP bucket) warmup inserts items this way, so the item is stored
+     * in the HashTable directly rather than via addNewStoredValue() /
+     * updateStoredValue(), as nothing is queued.
+     *
+     * @param itm Item (or DiskDocument) to insert; not modified.
      * @param eject true if we should eject the value immediately
      * @param keyMetaDataOnly is this just the key and meta-data or a complete
      *                        item
      *
      * @return the result of the operation
      */
-    MutationStatus insertFromWarmup(Item& itm,
+    template <typename Document>
+    MutationStatus insertFromWarmup(const Document& itm,
                                     bool eject,
                                     bool keyMetaDataOnly);
 
@@ -1468,6 +1488,11 @@ private:
 
     void decrDirtyQueuePendingWrites(size_t decrementBy);
 
+    /// Create a bloom filter of the configured type (bfilter_type).
+    std::unique_ptr<AbstractBloomFilter> makeFilter(size_t key_count,
+                                                    double probability,
+                                                    bfilter_status_t status);
+
     /**
      * Updates an existing StoredValue in in-memory data structures like HT.
      * Assumes that HT bucket lock is grabbed.
@@ -1612,6 +1637,27 @@ private:
                                             get_options_t options,
                                             const StoredValue& v) = 0;
 
+    /**
+     * Populate the metadata of a key from its StoredValue, for getMetaData().
+     * Only reads the StoredValue, so may be called with the hash bucket
+     * locked for reading. Must not be called for temp initial items.
+     *
+     * @return ENGINE_KEY_ENOENT for temp non-existent items, else
+     *         ENGINE_SUCCESS
+     */
+    ENGINE_ERROR_CODE getMetaDataFromStoredValue(const StoredValue& v,
+                                                 ItemMetaData& metadata,
+                                                 uint32_t& deleted,
+                                                 uint8_t& datatype);
+
+    /**
+     * Populate key stats from a StoredValue, for getKeyStats(). Only reads
+     * the StoredValue, so may be called with the hash bucket locked for
+     * reading.
+     */
+    void getKeyStatsFromStoredValue(const StoredValue& v,
+                                    struct key_stats& kstats);
+
     /**
      * Update the revision seqno of a newly StoredValue item.
      * We must ensure that it is greater the maxDeletedRevSeqno
@@ -1658,8 +1704,10 @@ private:
     uint64_t persisted_snapshot_end;
 
     std::mutex bfMutex;
-    std::unique_ptr<BloomFilter> bFilter;
-    std::unique_ptr<BloomFilter> tempFilter;    // Used during compaction.
+    std::unique_ptr<AbstractBloomFilter> bFilter;
+    std::unique_ptr<AbstractBloomFilter> tempFilter; // Used during compaction.
+    // Whether the filters are BlockedBloomFilters (bfilter_type).
+    const bool blockedFilter;
 
     std::atomic<uint64_t> rollbackItemCount;
 
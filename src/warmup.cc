@@ -17,8 +17,11 @@
 
 #include "warmup.h"
 
+#include "bloomfilter_file.h"
 #include "common.h"
+#include "compact_access_log.h"
 #include "connmap.h"
+#include "disk_document.h"
 #include "ep_engine.h"
 #include "failover-table.h"
 #include "mutation_log.h"
@@ -29,22 +32,29 @@
 
 #include <platform/make_unique.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <limits>
 #include <string>
 #include <utility>
 #include <array>
 #include <random>
+#include <set>
+#include <unordered_map>
 
 struct WarmupCookie {
     WarmupCookie(KVBucket* s, Callback<GetValue>& c) :
         cb(c), epstore(s),
-        loaded(0), skipped(0), error(0)
+        loaded(0), skipped(0), error(0), bytes(0)
     { /* EMPTY */ }
     Callback<GetValue>& cb;
     KVBucket* epstore;
     size_t loaded;
     size_t skipped;
     size_t error;
+    // Bytes of value loaded.
+    size_t bytes;
 };
 
 // Warmup Tasks ///////////////////////////////////////////////////////////////
@@ -210,6 +220,102 @@ private:
     const std::string _description;
 };
 
+struct Warmup::ShardAccessLog {
+    ShardAccessLog(uint16_t shardId, std::string path, hrtime_t start)
+        : shardId(shardId),
+          path(std::move(path)),
+          start(start),
+          pendingTasks(0),
+          success(true) {
+    }
+
+    const uint16_t shardId;
+    const std::string path;
+    // When the log is taken.
+    const hrtime_t start;
+    // Not set for a compact log, whose vBuckets each task reads itself.
+    std::unique_ptr<MappedMutationLog> log;
+    // Which of the log's blocks hold each vBucket's keys; each fetching task
+    // reads the keys of one of its vBuckets at a time from them.
+    std::unordered_map<uint16_t, MappedMutationLog::VBucketBlocks> index;
+    // Number of fetching tasks yet to complete.
+    std::atomic<size_t> pendingTasks;
+    std::atomic<bool> success;
+};
+
+/**
+ * Checks and indexes the access log of one shard once, when it is read
+ * through a MappedMutationLog (warmup_access_log_mmap), and then splits
+ * fetching the values of its vBuckets between several
+ * WarmupFetchMappedAccessLog tasks.
+ */
+class WarmupLoadMappedAccessLog : public GlobalTask {
+public:
+    WarmupLoadMappedAccessLog(KVBucket& st, uint16_t sh, Warmup* w)
+        : GlobalTask(&st.getEPEngine(), TaskId::WarmupLoadAccessLog, 0, false),
+          _shardId(sh),
+          _warmup(w),
+          _description("Warmup - loading access log: shard " +
+                       std::to_string(_shardId)) {
+        _warmup->addToTaskSet(uid);
+    }
+
+    cb::const_char_buffer getDescription() {
+        return _description;
+    }
+
+    bool run() {
+        TRACE_EVENT0("ep-engine/task", "WarmupLoadMappedAccessLog");
+        _warmup->loadingMappedAccessLog(_shardId);
+        _warmup->removeFromTaskSet(uid);
+        return false;
+    }
+
+private:
+    uint16_t _shardId;
+    Warmup* _warmup;
+    const std::string _description;
+};
+
+/**
+ * Fetches the values of some of a shard's vBuckets listed in its access
+ * log, once WarmupLoadMappedAccessLog has indexed it.
+ */
+class WarmupFetchMappedAccessLog : public GlobalTask {
+public:
+    WarmupFetchMappedAccessLog(KVBucket& st,
+                               std::shared_ptr<Warmup::ShardAccessLog> log,
+                               size_t partition,
+                               std::vector<uint16_t> vbids,
+                               Warmup* w)
+        : GlobalTask(&st.getEPEngine(), TaskId::WarmupLoadAccessLog, 0, false),
+          _log(std::move(log)),
+          _vbids(std::move(vbids)),
+          _warmup(w),
+          _description("Warmup - loading access log: shard " +
+                       std::to_string(_log->shardId) + " partition " +
+                       std::to_string(partition)) {
+        _warmup->addToTaskSet(uid);
+    }
+
+    cb::const_char_buffer getDescription() {
+        return _description;
+    }
+
+    bool run() {
+        TRACE_EVENT0("ep-engine/task", "WarmupFetchMappedAccessLog");
+        _warmup->fetchingMappedAccessLog(*_log, _vbids);
+        _warmup->removeFromTaskSet(uid);
+        return false;
+    }
+
+private:
+    const std::shared_ptr<Warmup::ShardAccessLog> _log;
+    const std::vector<uint16_t> _vbids;
+    Warmup* _warmup;
+    const std::string _description;
+};
+
 class WarmupLoadingKVPairs : public GlobalTask {
 public:
     WarmupLoadingKVPairs(KVBucket& st, uint16_t sh, Warmup* w)
@@ -290,17 +396,22 @@ private:
 };
 
 
-static bool batchWarmupCallback(uint16_t vbId,
-                                const std::set<StoredDocKey>& fetches,
-                                void *arg)
-{
+/**
+ * Fetch the given keys of a vBucket with one getMulti, and load them.
+ *
+ * @param fetches a container of StoredDocKey or DocKey
+ * @return false if warmup should stop loading values
+ */
+template <typename Keys>
+static bool warmupFetchBatch(uint16_t vbId, const Keys& fetches, void* arg) {
     WarmupCookie *c = static_cast<WarmupCookie *>(arg);
 
     if (!c->epstore->maybeEnableTraffic()) {
         vb_bgfetch_queue_t items2fetch;
         for (auto& key : fetches) {
             // Deleted below via a unique_ptr in the next loop
-            vb_bgfetch_item_ctx_t& bg_itm_ctx = items2fetch[key];
+            vb_bgfetch_item_ctx_t& bg_itm_ctx =
+                    items2fetch[StoredDocKey(key)];
             bg_itm_ctx.isMetaOnly = false;
             bg_itm_ctx.bgfetched_list.emplace_back(
                     std::make_unique<VBucketBGFetchItem>(nullptr, false));
@@ -320,7 +431,9 @@ static bool batchWarmupCallback(uint16_t vbId,
                     std::move(bg_itm_ctx.bgfetched_list.back()));
             if (applyItem) {
                 GetValue &val = fetchedItem->value;
+                size_t nbytes = 0;
                 if (val.getStatus() == ENGINE_SUCCESS) {
+                    nbytes = val.getValue()->getNBytes();
                     // NB: callback will delete the GetValue's Item
                     c->cb.callback(val);
                 } else {
@@ -333,6 +446,7 @@ static bool batchWarmupCallback(uint16_t vbId,
 
                 if (c->cb.getStatus() == ENGINE_SUCCESS) {
                     c->loaded++;
+                    c->bytes += nbytes;
                 } else {
                     // Failed to apply an Item, so fail the rest
                     applyItem = false;
@@ -353,6 +467,13 @@ static bool batchWarmupCallback(uint16_t vbId,
     }
 }
 
+static bool batchWarmupCallback(uint16_t vbId,
+                                const std::set<StoredDocKey>& fetches,
+                                void *arg)
+{
+    return warmupFetchBatch(vbId, fetches, arg);
+}
+
 static bool warmupCallback(void *arg, uint16_t vb, const DocKey& key)
 {
     WarmupCookie *cookie = static_cast<WarmupCookie*>(arg);
@@ -363,6 +484,7 @@ static bool warmupCallback(void *arg, uint16_t vb, const DocKey& key)
         cb.waitForValue();
 
         if (cb.val.getStatus() == ENGINE_SUCCESS) {
+            cookie->bytes += cb.val.getValue()->getNBytes();
             cookie->cb.callback(cb.val);
             cookie->loaded++;
         } else {
@@ -480,32 +602,45 @@ LoadStorageKVPairCallback::LoadStorageKVPairCallback(KVBucket& ep,
 void LoadStorageKVPairCallback::callback(GetValue &val) {
     // This callback method is responsible for deleting the Item
     std::unique_ptr<Item> i(val.getValue());
+    val.setValue(NULL);
 
+    if (!val.isPartial() && !epstore.getWarmup()->isComplete()) {
+        epstore.compressValueIfRequired(*i);
+    }
+    load(*i, val.isPartial());
+}
+
+void LoadStorageKVPairCallback::load(DiskDocument& doc) {
+    load(doc, /*partial*/ false);
+}
+
+template <typename Document>
+void LoadStorageKVPairCallback::load(Document& doc, bool partial) {
     // Don't attempt to load the system event documents.
-    if (i->getKey().getDocNamespace() == DocNamespace::System) {
+    if (doc.getKey().getDocNamespace() == DocNamespace::System) {
         return;
     }
 
     bool stopLoading = false;
-    if (i != NULL && !epstore.getWarmup()->isComplete()) {
-        VBucketPtr vb = vbuckets.getBucket(i->getVBucketId());
+    if (!epstore.getWarmup()->isComplete()) {
+        VBucketPtr vb = vbuckets.getBucket(doc.getVBucketId());
         if (!vb) {
             setStatus(ENGINE_NOT_MY_VBUCKET);
             return;
         }
+
         bool succeeded(false);
         int retry = 2;
         do {
-            if (i->getCas() == static_cast<uint64_t>(-1)) {
-                if (val.isPartial()) {
-                    i->setCas(0);
+            if (doc.getCas() == static_cast<uint64_t>(-1)) {
+                if (partial) {
+                    doc.setCas(0);
                 } else {
-                    i->setCas(vb->nextHLCCas());
+                    doc.setCas(vb->nextHLCCas());
                 }
             }
 
-            const auto res =
-                    vb->insertFromWarmup(*i, shouldEject(), val.isPartial());
+            const auto res = vb->insertFromWarmup(doc, shouldEject(), partial);
             switch (res) {
             case MutationStatus::NoMem:
                 if (retry == 2) {
@@ -528,7 +663,9 @@ void LoadStorageKVPairCallback::callback(GetValue &val) {
             case MutationStatus::InvalidCas:
                 LOG(EXTENSION_LOG_DEBUG,
                     "Value changed in memory before restore from disk. "
-                    "Ignored disk value for: key{%s}.", i->getKey().c_str());
+                    "Ignored disk value for: key{%.*s}.",
+                    int(doc.getKey().size()),
+                    doc.getKey().data());
                 ++stats.warmDups;
                 succeeded = true;
                 break;
@@ -543,8 +680,6 @@ void LoadStorageKVPairCallback::callback(GetValue &val) {
             }
         } while (!succeeded && retry-- > 0);
 
-        val.setValue(NULL);
-
         if (maybeEnableTraffic) {
             stopLoading = epstore.maybeEnableTraffic();
         }
@@ -678,7 +813,10 @@ Warmup::Warmup(KVBucket& st, Configuration& config_)
       corruptAccessLog(false),
       warmupComplete(false),
       warmupOOMFailure(false),
-      estimatedWarmupCount(std::numeric_limits<size_t>::max())
+      estimatedWarmupCount(std::numeric_limits<size_t>::max()),
+      bloomFiltersLoaded(0),
+      accessLogTasks(0),
+      accessLogKeys(0)
 {
 }
 
@@ -777,6 +915,9 @@ void Warmup::createVBuckets(uint16_t shardId) {
                                                         maxEntries);
             }
             KVShard* shard = store.getVBuckets().getShardByVbId(vbid);
+            // The filter must be checked against the failover UUID before
+            // any new entry is created below.
+            const uint64_t vbUuid = table->getLatestUUID();
 
             vb = store.makeVBucket(
                     vbid,
@@ -795,6 +936,8 @@ void Warmup::createVBuckets(uint16_t shardId) {
                                       ->getCollectionsManifest(vbid)
                             : ""/*no collections manifest*/);
 
+            loadBloomFilter(*vb, vbUuid, vbs.highSeqno);
+
             if(vbs.state == vbucket_state_active && !cleanShutdown) {
                 if (static_cast<uint64_t>(vbs.highSeqno) == vbs.lastSnapEnd) {
                     vb->failovers->createEntry(vbs.lastSnapEnd);
@@ -822,6 +965,22 @@ void Warmup::createVBuckets(uint16_t shardId) {
     }
 }
 
+void Warmup::loadBloomFilter(VBucket& vb, uint64_t vbUuid, int64_t highSeqno) {
+    const std::string fname =
+            BloomFilterFile::getFileName(config.getDbname(), vb.getId());
+    // The file is only valid for the vBucket as it was at the last (clean)
+    // shutdown, so it is removed whether or not it is used.
+    if (cleanShutdown && config.isBfilterEnabled() &&
+        config.getBfilterType() == "blocked") {
+        auto filter = BloomFilterFile::load(fname, vb.getId(), vbUuid,
+                                            highSeqno);
+        if (filter) {
+            vb.setFilter(std::move(filter));
+            ++bloomFiltersLoaded;
+        }
+    }
+    remove(fname.c_str());
+}
 
 void Warmup::scheduleEstimateDatabaseItemCount()
 {
@@ -846,6 +1005,13 @@ void Warmup::estimateDatabaseItemCount(uint16_t shardId)
         VBucketPtr vb = store.getVBucket(vbid);
         if (vb) {
             vb->ht.numTotalItems = vbItemCount;
+            // With value eviction every item is about to be loaded, so
+            // size the HashTable for them all now rather than resizing it
+            // repeatedly as they are. (With full eviction only as many as
+            // fit in memory are loaded.)
+            if (store.getItemEvictionPolicy() == VALUE_ONLY) {
+                vb->ht.presize(vbItemCount);
+            }
         }
         item_count += vbItemCount;
     }
@@ -957,8 +1123,20 @@ void Warmup::checkForAccessLog()
 void Warmup::scheduleLoadingAccessLog()
 {
     threadtask_count = 0;
+    if (!config.isWarmupAccessLogMmap()) {
+        accessLogTasks = store.vbMap.shards.size();
+        for (size_t i = 0; i < store.vbMap.shards.size(); i++) {
+            ExTask task = make_STRCPtr<WarmupLoadAccessLog>(store, i, this);
+            ExecutorPool::get()->schedule(task);
+        }
+        return;
+    }
+
+    // Each shard's log is read once by its own task, which then hands its
+    // vBuckets out to the tasks fetching their values.
+    accessLogTasks = store.vbMap.shards.size();
     for (size_t i = 0; i < store.vbMap.shards.size(); i++) {
-        ExTask task = make_STRCPtr<WarmupLoadAccessLog>(store, i, this);
+        ExTask task = make_STRCPtr<WarmupLoadMappedAccessLog>(store, i, this);
         ExecutorPool::get()->schedule(task);
     }
 }
@@ -970,11 +1148,17 @@ void Warmup::loadingAccessLog(uint16_t shardId)
     hrtime_t stTime = gethrtime();
     if (store.accessLog[shardId].exists()) {
         try {
-            store.accessLog[shardId].open();
-            if (doWarmup(store.accessLog[shardId],
-                         shardVbStates[shardId],
-                         load_cb) != (size_t)-1) {
+            const std::string& curr = store.accessLog[shardId].getLogFile();
+            if (CompactAccessLog::isCompact(curr)) {
+                doCompactWarmup(curr, shardId, shardVbIds[shardId], load_cb);
                 success = true;
+            } else {
+                store.accessLog[shardId].open();
+                if (doWarmup(store.accessLog[shardId],
+                             shardVbStates[shardId],
+                             load_cb) != (size_t)-1) {
+                    success = true;
+                }
             }
         } catch (MutationLog::ReadException &e) {
             corruptAccessLog = true;
@@ -990,10 +1174,15 @@ void Warmup::loadingAccessLog(uint16_t shardId)
         MutationLog old(nm);
         if (old.exists()) {
             try {
-                old.open();
-                if (doWarmup(old, shardVbStates[shardId], load_cb) !=
-                    (size_t)-1) {
+                if (CompactAccessLog::isCompact(nm)) {
+                    doCompactWarmup(nm, shardId, shardVbIds[shardId], load_cb);
                     success = true;
+                } else {
+                    old.open();
+                    if (doWarmup(old, shardVbStates[shardId], load_cb) !=
+                        (size_t)-1) {
+                        success = true;
+                    }
                 }
             } catch (MutationLog::ReadException &e) {
                 corruptAccessLog = true;
@@ -1003,6 +1192,100 @@ void Warmup::loadingAccessLog(uint16_t shardId)
         }
     }
 
+    completeLoadingAccessLog(success, stTime);
+}
+
+void Warmup::loadingMappedAccessLog(uint16_t shardId) {
+    const hrtime_t stTime = gethrtime();
+    std::shared_ptr<ShardAccessLog> shardLog;
+
+    // As loadingAccessLog(), fall back to the previous log if the current
+    // one is missing or unreadable.
+    const std::string curr = store.accessLog[shardId].getLogFile();
+    for (const auto& path : {curr, curr + ".old"}) {
+        if (access(path.c_str(), F_OK) != 0) {
+            continue;
+        }
+        try {
+            auto candidate =
+                    std::make_shared<ShardAccessLog>(shardId, path, stTime);
+            if (!CompactAccessLog::isCompact(path)) {
+                // Check the whole log once, indexing where the keys of each
+                // of the shard's vBuckets are; the keys themselves are only
+                // read by the fetching tasks, a vBucket at a time.
+                std::set<uint16_t> vbids;
+                for (const auto& vbState : shardVbStates[shardId]) {
+                    vbids.insert(vbState.first);
+                }
+                candidate->log = std::make_unique<MappedMutationLog>(path);
+                candidate->index = candidate->log->indexBlocks(vbids);
+                accessLogRead.record(
+                        gethrtime() - stTime, 0, candidate->log->getSize());
+            }
+            shardLog = std::move(candidate);
+            break;
+        } catch (MutationLog::ReadException& e) {
+            corruptAccessLog = true;
+            LOG(EXTENSION_LOG_WARNING,
+                "Error reading warmup access log '%s': %s",
+                path.c_str(),
+                e.what());
+        }
+    }
+
+    if (!shardLog) {
+        completeLoadingAccessLog(false, stTime);
+        return;
+    }
+
+    // Split the shard's vBuckets between enough tasks to keep every reader
+    // thread busy fetching their values.
+    const size_t numShards = store.vbMap.shards.size();
+    const size_t perShard = std::max(
+            size_t(1),
+            (ExecutorPool::get()->getNumReaders() + numShards - 1) / numShards);
+    const auto& vbStates = shardVbStates[shardId];
+    const size_t count =
+            std::max(size_t(1), std::min(perShard, vbStates.size()));
+    std::vector<std::vector<uint16_t>> partitions(count);
+    size_t next = 0;
+    for (const auto& vbState : vbStates) {
+        partitions[next++ % count].push_back(vbState.first);
+    }
+
+    shardLog->pendingTasks = count;
+    for (size_t i = 0; i < count; i++) {
+        ExTask task = make_STRCPtr<WarmupFetchMappedAccessLog>(
+                store, shardLog, i, std::move(partitions[i]), this);
+        ExecutorPool::get()->schedule(task);
+    }
+}
+
+void Warmup::fetchingMappedAccessLog(ShardAccessLog& log,
+                                     const std::vector<uint16_t>& vbids) {
+    LoadStorageKVPairCallback load_cb(store, true, state.getState());
+    try {
+        if (log.log) {
+            doMappedWarmup(log, vbids, load_cb);
+        } else {
+            doCompactWarmup(log.path, log.shardId, vbids, load_cb);
+        }
+    } catch (MutationLog::ReadException& e) {
+        corruptAccessLog = true;
+        log.success = false;
+        LOG(EXTENSION_LOG_WARNING,
+            "Error reading warmup access log '%s': %s",
+            log.path.c_str(),
+            e.what());
+    }
+
+    // The shard's log is loaded once all its tasks are done.
+    if (--log.pendingTasks == 0) {
+        completeLoadingAccessLog(log.success, log.start);
+    }
+}
+
+void Warmup::completeLoadingAccessLog(bool success, hrtime_t stTime) {
     size_t numItems = store.getEPEngine().getEpStats().warmedUpValues;
     if (success && numItems) {
         LOG(EXTENSION_LOG_NOTICE,
@@ -1014,7 +1297,7 @@ void Warmup::loadingAccessLog(uint16_t shardId)
         setEstimatedWarmupCount(estimatedCount);
     }
 
-    if (++threadtask_count == store.vbMap.getNumShards()) {
+    if (++threadtask_count == accessLogTasks) {
         if (!store.maybeEnableTraffic()) {
             transition(WarmupState::LoadingData);
         } else {
@@ -1070,6 +1353,173 @@ size_t Warmup::doWarmup(MutationLog &lf, const std::map<uint16_t,
     return cookie.loaded;
 }
 
+/**
+ * Load the values of the given keys of a vBucket, in batches of batchSize;
+ * as for MutationLogHarvester::apply, skipping those which are no longer in
+ * the HashTable.
+ *
+ * @param keys a vector of StoredDocKey or DocKey
+ * @return false if warmup should stop loading values
+ */
+template <typename Key>
+static bool warmupFetchKeys(KVBucket& store,
+                            VBucket& vb,
+                            const std::vector<Key>& keys,
+                            size_t batchSize,
+                            WarmupCookie& cookie) {
+    bool more = true;
+    std::vector<DocKey> batch;
+    for (auto key = keys.begin(); more && key != keys.end();) {
+        batch.clear();
+        for (; key != keys.end() && batch.size() < batchSize; ++key) {
+            if (vb.ht.find(*key, TrackReference::No, WantsDeleted::No)) {
+                batch.push_back(*key);
+            }
+        }
+        if (batch.empty()) {
+            continue;
+        }
+        if (store.multiBGFetchEnabled()) {
+            more = warmupFetchBatch(vb.getId(), batch, &cookie);
+        } else {
+            for (const auto& k : batch) {
+                if (!(more = warmupCallback(&cookie, vb.getId(), k))) {
+                    break;
+                }
+            }
+        }
+    }
+    return more;
+}
+
+/// Order keys as couchstore's by-id index does.
+static bool byIdOrder(const DocKey& a, const DocKey& b) {
+    if (a.getDocNamespace() != b.getDocNamespace()) {
+        return a.getDocNamespace() < b.getDocNamespace();
+    }
+    const int cmp =
+            std::memcmp(a.data(), b.data(), std::min(a.size(), b.size()));
+    return cmp < 0 || (cmp == 0 && a.size() < b.size());
+}
+
+size_t Warmup::doMappedWarmup(ShardAccessLog& log,
+                              const std::vector<uint16_t>& vbids,
+                              Callback<GetValue>& cb) {
+    size_t numKeys = 0;
+    for (const auto vbid : vbids) {
+        const auto it = log.index.find(vbid);
+        if (it != log.index.end()) {
+            numKeys += it->second.numKeys;
+        }
+    }
+    setEstimatedWarmupCount(accessLogKeys += numKeys);
+
+    // Only one vBucket's keys are held at a time (as views into the mapped
+    // log). Sort them into by-id order so that the batches below each cover
+    // the next range of keys, and together make one pass over the by-id
+    // index from start to end (rather than each batch's lookups landing all
+    // over it).
+    const size_t batchSize = config.getWarmupBatchSize();
+    WarmupCookie cookie(&store, cb);
+    bool more = true;
+    for (auto vbid = vbids.begin(); more && vbid != vbids.end(); ++vbid) {
+        const auto it = log.index.find(*vbid);
+        VBucketPtr vb = store.getVBucket(*vbid);
+        if (it == log.index.end() || !vb) {
+            continue;
+        }
+        const hrtime_t readStart = gethrtime();
+        auto keys = log.log->loadKeys(*vbid, it->second);
+        std::sort(keys.begin(), keys.end(), byIdOrder);
+        keys.erase(std::unique(keys.begin(),
+                               keys.end(),
+                               [](const DocKey& a, const DocKey& b) {
+                                   return !byIdOrder(a, b) && !byIdOrder(b, a);
+                               }),
+                   keys.end());
+        const hrtime_t fetchStart = gethrtime();
+        accessLogRead.record(fetchStart - readStart, keys.size(), 0);
+
+        const size_t loaded = cookie.loaded;
+        const size_t bytes = cookie.bytes;
+        more = warmupFetchKeys(store, *vb, keys, batchSize, cookie);
+        accessLogFetch.record(gethrtime() - fetchStart,
+                              cookie.loaded - loaded,
+                              cookie.bytes - bytes);
+    }
+
+    LOG(EXTENSION_LOG_DEBUG,
+        "Populated %" PRIu64 " vBuckets from log '%s' (%" PRIu64 " keys) "
+        "with(l: %ld, s: %ld, e: %ld)",
+        uint64_t(vbids.size()),
+        log.path.c_str(),
+        uint64_t(numKeys),
+        cookie.loaded,
+        cookie.skipped,
+        cookie.error);
+
+    return cookie.loaded;
+}
+
+size_t Warmup::doCompactWarmup(const std::string& path,
+                               uint16_t shardId,
+                               std::vector<uint16_t> vbids,
+                               Callback<GetValue>& cb) {
+    CompactAccessLog::Reader log(path);
+
+    // Each vBucket's keys can be read on their own, so load the active
+    // vBuckets before the others.
+    const auto& vbStates = shardVbStates[shardId];
+    std::stable_partition(
+            vbids.begin(), vbids.end(), [&vbStates](uint16_t vbid) {
+                const auto it = vbStates.find(vbid);
+                return it != vbStates.end() &&
+                       it->second.state == vbucket_state_active;
+            });
+
+    size_t numKeys = 0;
+    for (const auto vbid : vbids) {
+        numKeys += log.getKeyCount(vbid);
+    }
+    setEstimatedWarmupCount(accessLogKeys += numKeys);
+
+    // Only one vBucket's keys are held at a time; they are already in by-id
+    // order.
+    const size_t batchSize = config.getWarmupBatchSize();
+    WarmupCookie cookie(&store, cb);
+    bool more = true;
+    for (auto vbid = vbids.begin(); more && vbid != vbids.end(); ++vbid) {
+        VBucketPtr vb = store.getVBucket(*vbid);
+        if (!vb) {
+            continue;
+        }
+        const hrtime_t readStart = gethrtime();
+        const auto keys = log.loadKeys(*vbid);
+        const hrtime_t fetchStart = gethrtime();
+        accessLogRead.record(
+                fetchStart - readStart, keys.size(), log.getSize(*vbid));
+
+        const size_t loaded = cookie.loaded;
+        const size_t bytes = cookie.bytes;
+        more = warmupFetchKeys(store, *vb, keys, batchSize, cookie);
+        accessLogFetch.record(gethrtime() - fetchStart,
+                              cookie.loaded - loaded,
+                              cookie.bytes - bytes);
+    }
+
+    LOG(EXTENSION_LOG_DEBUG,
+        "Populated %" PRIu64 " vBuckets from compact log '%s' "
+        "(%" PRIu64 " keys) with(l: %ld, s: %ld, e: %ld)",
+        uint64_t(vbids.size()),
+        path.c_str(),
+        uint64_t(numKeys),
+        cookie.loaded,
+        cookie.skipped,
+        cookie.error);
+
+    return cookie.loaded;
+}
+
 void Warmup::scheduleLoadingKVPairs()
 {
     // We reach here only if keyDump didn't return SUCCESS or if
@@ -1086,6 +1536,20 @@ void Warmup::scheduleLoadingKVPairs()
 
 }
 
+/**
+ * Make the callback to have a KVStore scan pass documents straight to the
+ * given loader (see ScanContext::documentCallback), if possible: if values
+ * are to be compressed as they are loaded they need to be loaded as Items.
+ */
+static std::shared_ptr<Callback<DiskDocument>> makeDocumentCallback(
+        const KVBucket& store,
+        std::shared_ptr<LoadStorageKVPairCallback> loader) {
+    if (store.isCompressionActive()) {
+        return nullptr;
+    }
+    return std::make_shared<LoadStorageDocumentCallback>(std::move(loader));
+}
+
 void Warmup::loadKVPairsforShard(uint16_t shardId)
 {
     bool maybe_enable_traffic = false;
@@ -1098,6 +1562,7 @@ void Warmup::loadKVPairsforShard(uint16_t shardId)
     KVStore* kvstore = store.getROUnderlyingByShard(shardId);
     auto cb = std::make_shared<LoadStorageKVPairCallback>(
             store, maybe_enable_traffic, state.getState());
+    auto documentCb = makeDocumentCallback(store, cb);
     auto cl =
             std::make_shared<LoadValueCallback>(store.vbMap, state.getState());
 
@@ -1106,6 +1571,7 @@ void Warmup::loadKVPairsforShard(uint16_t shardId)
                                                     DocumentFilter::NO_DELETES,
                                                     ValueFilter::VALUES_DECOMPRESSED);
         if (ctx) {
+            ctx->documentCallback = documentCb;
             errorCode = kvstore->scan(ctx);
             kvstore->destroyScanContext(ctx);
             if (errorCode == scan_again) { // ENGINE_ENOMEM
@@ -1138,6 +1604,7 @@ void Warmup::loadDataforShard(uint16_t shardId)
     KVStore* kvstore = store.getROUnderlyingByShard(shardId);
     auto cb = std::make_shared<LoadStorageKVPairCallback>(
             store, true, state.getState());
+    auto documentCb = makeDocumentCallback(store, cb);
     auto cl =
             std::make_shared<LoadValueCallback>(store.vbMap, state.getState());
 
@@ -1146,6 +1613,7 @@ void Warmup::loadDataforShard(uint16_t shardId)
                                                     DocumentFilter::NO_DELETES,
                                                     ValueFilter::VALUES_DECOMPRESSED);
         if (ctx) {
+            ctx->documentCallback = documentCb;
             errorCode = kvstore->scan(ctx);
             kvstore->destroyScanContext(ctx);
             if (errorCode == scan_again) { // ENGINE_ENOMEM
@@ -1218,6 +1686,18 @@ void Warmup::transition(int to, bool force) {
     }
 }
 
+void WarmupPhaseStats::record(hrtime_t taskDuration,
+                              size_t nkeys,
+                              size_t nbytes) {
+    keys.fetch_add(nkeys);
+    bytes.fetch_add(nbytes);
+    duration.fetch_add(taskDuration);
+}
+
+WarmupPhaseStats::Snapshot WarmupPhaseStats::get() const {
+    return {keys.load(), bytes.load(), duration.load()};
+}
+
 template <typename T>
 void Warmup::addStat(const char *nm, const T &val, ADD_STAT add_stat,
                      const void *c) const {
@@ -1247,6 +1727,7 @@ void Warmup::addStats(ADD_STAT add_stat, const void *c) const
     addStat("value_count", stats.warmedUpValues, add_stat, c);
     addStat("dups", stats.warmDups, add_stat, c);
     addStat("oom", stats.warmOOM, add_stat, c);
+    addStat("bloomfilters_loaded", bloomFiltersLoaded.load(), add_stat, c);
     addStat("min_memory_threshold",
             stats.warmupMemUsedCap * 100.0,
             add_stat,
@@ -1278,6 +1759,33 @@ void Warmup::addStats(ADD_STAT add_stat, const void *c) const
         addStat("access_log", "corrupt", add_stat, c);
     }
 
+    // Throughput of each phase of loading the access log (when it is read
+    // with warmup_access_log_mmap, or is a compact access log).
+    for (const auto& phase :
+         {std::make_pair("access_log_read", &accessLogRead),
+          std::make_pair("access_log_fetch", &accessLogFetch)}) {
+        const auto snapshot = phase.second->get();
+        if (snapshot.duration == 0) {
+            continue;
+        }
+        const std::string name = phase.first;
+        const double seconds = snapshot.duration / 1e9;
+        addStat((name + "_keys").c_str(), snapshot.keys, add_stat, c);
+        addStat((name + "_bytes").c_str(), snapshot.bytes, add_stat, c);
+        addStat((name + "_time").c_str(),
+                snapshot.duration / 1000,
+                add_stat,
+                c);
+        addStat((name + "_keys_per_sec").c_str(),
+                uint64_t(snapshot.keys / seconds),
+                add_stat,
+                c);
+        addStat((name + "_bytes_per_sec").c_str(),
+                uint64_t(snapshot.bytes / seconds),
+                add_stat,
+                c);
+    }
+
     size_t warmupCount = estimatedWarmupCount.load();
     if (warmupCount == std::numeric_limits<size_t>::max()) {
         addStat("estimated_value_count", "unknown", add_stat, c);
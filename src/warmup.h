@@ -24,6 +24,8 @@
 
 #include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <ostream>
 #include <string>
 #include <unordered_set>
@@ -32,9 +34,11 @@
 #include <phosphor/phosphor.h>
 
 class Configuration;
+class DiskDocument;
 class EPStats;
 class KVBucket;
 class MutationLog;
+class VBucket;
 class VBucketMap;
 
 struct vbucket_state;
@@ -85,7 +89,14 @@ public:
 
     void callback(GetValue &val);
 
+    /// Load a document passed straight from the KVStore (see
+    /// LoadStorageDocumentCallback).
+    void load(DiskDocument& doc);
+
 private:
+    template <typename Document>
+    void load(Document& doc, bool partial);
+
     bool shouldEject() const;
 
     void purge();
@@ -99,6 +110,26 @@ private:
     int         warmupState;
 };
 
+/**
+ * Passes the documents read by a KVStore scan to a LoadStorageKVPairCallback
+ * as DiskDocuments, so they are loaded without allocating an Item for each.
+ */
+class LoadStorageDocumentCallback : public Callback<DiskDocument> {
+public:
+    LoadStorageDocumentCallback(
+            std::shared_ptr<LoadStorageKVPairCallback> loader)
+        : loader(std::move(loader)) {
+    }
+
+    void callback(DiskDocument& doc) override {
+        loader->load(doc);
+        setStatus(loader->getStatus());
+    }
+
+private:
+    std::shared_ptr<LoadStorageKVPairCallback> loader;
+};
+
 class LoadValueCallback : public Callback<CacheLookup> {
 public:
     LoadValueCallback(VBucketMap& vbMap, int _warmupState) :
@@ -112,6 +143,35 @@ private:
 };
 
 
+/**
+ * How much of one phase of loading the access log (reading the log, or
+ * fetching the values it lists) has been done across all the tasks doing
+ * it, and the time they spent on it (summed over the tasks, as a task
+ * reading a compact access log alternates between the phases a vBucket at
+ * a time).
+ */
+class WarmupPhaseStats {
+public:
+    struct Snapshot {
+        size_t keys;
+        size_t bytes;
+        hrtime_t duration;
+    };
+
+    WarmupPhaseStats() : keys(0), bytes(0), duration(0) {
+    }
+
+    /// Record that a task spent the given time doing the given work.
+    void record(hrtime_t taskDuration, size_t nkeys, size_t nbytes);
+
+    Snapshot get() const;
+
+private:
+    std::atomic<size_t> keys;
+    std::atomic<size_t> bytes;
+    std::atomic<hrtime_t> duration;
+};
+
 class Warmup {
 public:
     Warmup(KVBucket& st, Configuration& config);
@@ -160,6 +220,13 @@ public:
     void keyDumpforShard(uint16_t shardId);
     void checkForAccessLog();
     void loadingAccessLog(uint16_t shardId);
+    void loadingMappedAccessLog(uint16_t shardId);
+
+    /// A shard's access log, as read by loadingMappedAccessLog().
+    struct ShardAccessLog;
+
+    void fetchingMappedAccessLog(ShardAccessLog& log,
+                                 const std::vector<uint16_t>& vbids);
     void loadKVPairsforShard(uint16_t shardId);
     void loadDataforShard(uint16_t shardId);
     void done();
@@ -175,6 +242,37 @@ private:
 
     void populateShardVbStates();
 
+    /**
+     * Load the values listed in the (already indexed) shard access log for
+     * the given vBuckets, reading the keys of a vBucket at a time.
+     *
+     * @return the number of values loaded
+     */
+    size_t doMappedWarmup(ShardAccessLog& log,
+                          const std::vector<uint16_t>& vbids,
+                          Callback<GetValue>& cb);
+
+    /**
+     * Load the values listed in the compact access log at the given path
+     * for the given vBuckets of the shard, a vBucket at a time, active
+     * vBuckets first.
+     *
+     * @return the number of values loaded
+     */
+    size_t doCompactWarmup(const std::string& path,
+                           uint16_t shardId,
+                           std::vector<uint16_t> vbids,
+                           Callback<GetValue>& cb);
+
+    /// Common end of the LoadingAccessLog tasks.
+    void completeLoadingAccessLog(bool success, hrtime_t taskStart);
+
+    /**
+     * Give the vBucket the bloom filter saved at the last shutdown, if there
+     * is one and it is still valid (see BloomFilterFile).
+     */
+    void loadBloomFilter(VBucket& vb, uint64_t vbUuid, int64_t highSeqno);
+
     void scheduleInitialize();
     void scheduleCreateVBuckets();
     void scheduleEstimateDatabaseItemCount();
@@ -215,6 +313,17 @@ private:
     std::atomic<bool> warmupComplete;
     std::atomic<bool> warmupOOMFailure;
     std::atomic<size_t> estimatedWarmupCount;
+    // Number of vBuckets whose bloom filter was loaded from disk.
+    std::atomic<size_t> bloomFiltersLoaded;
+
+    // Number of shards whose access log is being loaded; each completes
+    // via completeLoadingAccessLog().
+    size_t accessLogTasks;
+    // Keys found in the access logs by the LoadingAccessLog tasks which
+    // read them through a MappedMutationLog or CompactAccessLog::Reader.
+    std::atomic<size_t> accessLogKeys;
+    WarmupPhaseStats accessLogRead;
+    WarmupPhaseStats accessLogFetch;
 
     DISALLOW_COPY_AND_ASSIGN(Warmup);
 };
@@ -897,6 +897,47 @@ static void perf_dcp_client(ENGINE_HANDLE* h, ENGINE_HANDLE_V1* h1,
     uint32_t bytes_read = 0;
     bool pending_marker_ack = false;
     uint64_t marker_end = 0;
+    bool send_marker_ack = false;
+    uint32_t marker_ack_opaque = 0;
+
+    // The producer may send several messages per step (see
+    // dcp_producer_step_batch_items), so handle each as it is sent.
+    dcp_message_callback = [&]() {
+        if (done) {
+            return;
+        }
+        switch (dcp_last_op) {
+            case PROTOCOL_BINARY_CMD_DCP_MUTATION:
+            case PROTOCOL_BINARY_CMD_DCP_DELETION:
+                // Check for sentinel (before adding to timings).
+                if (dcp_last_key == SENTINEL_KEY) {
+                    done = true;
+                    break;
+                }
+                recv_timings.push_back(gethrtime());
+                bytes_received.push_back(dcp_last_value.length());
+                bytes_read += dcp_last_packet_size;
+                if (pending_marker_ack && dcp_last_byseqno == marker_end) {
+                    // Acknowledged once the step returns.
+                    send_marker_ack = true;
+                    marker_ack_opaque = dcp_last_opaque;
+                }
+                break;
+
+            case PROTOCOL_BINARY_CMD_DCP_SNAPSHOT_MARKER:
+                if (dcp_last_flags & 8) {
+                    pending_marker_ack = true;
+                    marker_end = dcp_last_snap_end_seqno;
+                }
+                bytes_read += dcp_last_packet_size;
+                break;
+
+            default:
+                fprintf(stderr, "Unexpected DCP event type received: %d\n",
+                        dcp_last_op);
+                abort();
+        }
+    };
 
     do {
         if (bytes_read > 512) {
@@ -917,44 +958,13 @@ static void perf_dcp_client(ENGINE_HANDLE* h, ENGINE_HANDLE_V1* h1,
             break;
 
         case ENGINE_WANT_MORE:
-            switch (dcp_last_op) {
-                case PROTOCOL_BINARY_CMD_DCP_MUTATION:
-                case PROTOCOL_BINARY_CMD_DCP_DELETION:
-                    // Check for sentinel (before adding to timings).
-                    if (dcp_last_key == SENTINEL_KEY) {
-                        done = true;
-                        break;
-                    }
-                    recv_timings.push_back(gethrtime());
-                    bytes_received.push_back(dcp_last_value.length());
-                    bytes_read += dcp_last_packet_size;
-                    if (pending_marker_ack && dcp_last_byseqno == marker_end) {
-                        sendDcpAck(h, h1, cookie,
-                                   PROTOCOL_BINARY_CMD_DCP_SNAPSHOT_MARKER,
-                                   PROTOCOL_BINARY_RESPONSE_SUCCESS,
-                                   dcp_last_opaque);
-                    }
-
-                    break;
-
-                case PROTOCOL_BINARY_CMD_DCP_SNAPSHOT_MARKER:
-                    if (dcp_last_flags & 8) {
-                        pending_marker_ack = true;
-                        marker_end = dcp_last_snap_end_seqno;
-                    }
-                    bytes_read += dcp_last_packet_size;
-                    break;
-
-                case 0:
-                    /* Consider case where no messages were ready on the last
-                     * step call so we will just ignore this case. Note that we
-                     * check for 0 because we clear the dcp_last_op value below.
-                     */
-                    break;
-                default:
-                    fprintf(stderr, "Unexpected DCP event type received: %d\n",
-                            dcp_last_op);
-                    abort();
+            // The messages sent were handled by dcp_message_callback.
+            if (send_marker_ack) {
+                sendDcpAck(h, h1, cookie,
+                           PROTOCOL_BINARY_CMD_DCP_SNAPSHOT_MARKER,
+                           PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                           marker_ack_opaque);
+                send_marker_ack = false;
             }
             dcp_last_op = 0;
             break;
@@ -965,6 +975,7 @@ static void perf_dcp_client(ENGINE_HANDLE* h, ENGINE_HANDLE_V1* h1,
         }
     } while (!done);
 
+    dcp_message_callback = nullptr;
     testHarness.destroy_cookie(cookie);
 }
 
@@ -1045,17 +1056,25 @@ struct Ret_vals {
     std::vector<size_t> received;
 };
 
+/*
+ * Results of a single DCP latency / bandwidth test: the latency and received
+ * bytes of each item, and the rate the DCP client received them at.
+ */
+struct Dcp_results {
+    std::vector<hrtime_t> timings;
+    std::vector<size_t> received;
+    double items_per_sec;
+};
+
 /*
  * Performs a single DCP latency / bandwidth test with the given parameters.
- * Returns vectors of item timings and recived bytes.
  */
-static std::pair<std::vector<hrtime_t>,
-                 std::vector<size_t>>
+static Dcp_results
 single_dcp_latency_bw_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
                            uint16_t vb, size_t item_count,
                            Doc_format typeOfData, const std::string& name,
                            uint32_t opaque, bool retrieveCompressed) {
-    std::vector<size_t> received;
+    Dcp_results results;
 
     check(set_vbucket_state(h, h1, vb, vbucket_state_active),
             "Failed set_vbucket_state for vbucket");
@@ -1069,24 +1088,29 @@ single_dcp_latency_bw_test(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1,
     std::vector<hrtime_t> recv_times;
     std::thread dcp_thread{perf_dcp_client, h, h1, item_count, name,
                            opaque, vb, retrieveCompressed,
-                           std::ref(recv_times), std::ref(received)};
+                           std::ref(recv_times), std::ref(results.received)};
     load_thread.join();
     dcp_thread.join();
 
-    std::vector<hrtime_t> timings;
     for (size_t j = 0; j < insert_times.size(); ++j) {
         if (insert_times[j] < recv_times[j]) {
-            timings.push_back(recv_times[j] - insert_times[j]);
+            results.timings.push_back(recv_times[j] - insert_times[j]);
         } else {
             // Since there is no network overhead at all, it is seen
             // that sometimes the DCP client actually received the
             // mutation before the store from the load client returned
             // a SUCCESS.
-            timings.push_back(0);
+            results.timings.push_back(0);
         }
     }
 
-    return {timings, received};
+    results.items_per_sec = 0;
+    if (recv_times.size() > 1 && recv_times.back() > recv_times.front()) {
+        results.items_per_sec = (recv_times.size() - 1) * 1e9 /
+                                (recv_times.back() - recv_times.front());
+    }
+
+    return results;
 }
 
 static enum test_result perf_dcp_latency_and_bandwidth(ENGINE_HANDLE *h,
@@ -1097,6 +1121,7 @@ static enum test_result perf_dcp_latency_and_bandwidth(ENGINE_HANDLE *h,
 
     std::vector<std::pair<std::string, std::vector<hrtime_t>*> > all_timings;
     std::vector<std::pair<std::string, std::vector<size_t>*> > all_sizes;
+    std::vector<std::pair<std::string, double> > all_throughputs;
 
     std::vector<struct Ret_vals> iterations;
 
@@ -1104,15 +1129,32 @@ static enum test_result perf_dcp_latency_and_bandwidth(ENGINE_HANDLE *h,
     auto as_is_results =
             single_dcp_latency_bw_test(h, h1, /*vb*/0, item_count, typeOfData,
                                        "As_is", /*opaque*/0xFFFFFF00, false);
-    all_timings.push_back({"As_is", &as_is_results.first});
-    all_sizes.push_back({"As_s", &as_is_results.second});
+    all_timings.push_back({"As_is", &as_is_results.timings});
+    all_sizes.push_back({"As_s", &as_is_results.received});
+    all_throughputs.push_back({"As_is", as_is_results.items_per_sec});
 
     // For Loader & DCP client to get documents compressed from vbucket 1
     auto compress_results =
             single_dcp_latency_bw_test(h, h1, /*vb*/1, item_count, typeOfData,
                                       "Compress", /*opaque*/0xFF000000, true);
-    all_timings.push_back({"Compress", &compress_results.first});
-    all_sizes.push_back({"Compress", &compress_results.second});
+    all_timings.push_back({"Compress", &compress_results.timings});
+    all_sizes.push_back({"Compress", &compress_results.received});
+    all_throughputs.push_back({"Compress", compress_results.items_per_sec});
+
+    // For Loader & DCP client to get documents as is from vbucket 2, with
+    // the producer sending up to 64 messages per step.
+    check(set_param(h, h1, protocol_binary_engine_param_dcp,
+                    "dcp_producer_step_batch_items", "64"),
+          "Failed to set dcp_producer_step_batch_items");
+    auto batched_results =
+            single_dcp_latency_bw_test(h, h1, /*vb*/2, item_count, typeOfData,
+                                       "Batched", /*opaque*/0xFFFF0000, false);
+    check(set_param(h, h1, protocol_binary_engine_param_dcp,
+                    "dcp_producer_step_batch_items", "1"),
+          "Failed to reset dcp_producer_step_batch_items");
+    all_timings.push_back({"Batched", &batched_results.timings});
+    all_sizes.push_back({"Batched", &batched_results.received});
+    all_throughputs.push_back({"Batched", batched_results.items_per_sec});
 
     printf("\n\n");
 
@@ -1129,6 +1171,14 @@ static enum test_result perf_dcp_latency_and_bandwidth(ENGINE_HANDLE *h,
     fillLineWith('=', 88-printed);
 
     output_result(title, "Latency", all_timings, "µs");
+
+    printed = printf("=== %s Throughput - %zu items (items/s)",
+                     title.c_str(), item_count);
+    fillLineWith('=', 86-printed);
+
+    for (const auto& throughput : all_throughputs) {
+        printf("%-14s %12.0f\n", throughput.first.c_str(), throughput.second);
+    }
     printf("\n\n");
 
     return SUCCESS;
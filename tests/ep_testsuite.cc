@@ -2164,6 +2164,18 @@ static enum test_result test_bg_stats(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
     checkeq(1, std::stoi(stats.at("ep_bg_num_samples")),
                "Expected one sample");
 
+    // The get which waited for the fetch counts as one miss; its retry
+    // isn't also counted as a hit.
+    checkeq(1, get_int_stat(h, h1, "ep_cache_misses", "memory"),
+            "Expected one cache miss");
+    checkeq(0, get_int_stat(h, h1, "ep_cache_hits", "memory"),
+            "Expected no cache hits");
+    check_key_value(h, h1, "a", "b\r\n", 3, 0);
+    checkeq(1, get_int_stat(h, h1, "ep_cache_hits", "memory"),
+            "Expected one cache hit");
+    checkeq(50, get_int_stat(h, h1, "ep_pager_hit_ratio_after", "memory"),
+            "Expected half the gets to be hits");
+
     const char* bg_keys[] = { "ep_bg_min_wait",
                               "ep_bg_max_wait",
                               "ep_bg_wait_avg",
@@ -2737,6 +2749,74 @@ static enum test_result test_bloomfilter_delete_plus_set_scenario(
     return SUCCESS;
 }
 
+static enum test_result test_bloomfilter_persisted(ENGINE_HANDLE *h,
+                                                   ENGINE_HANDLE_V1 *h1) {
+    if (get_bool_stat(h, h1, "ep_bfilter_enabled") == false) {
+        check(set_param(h, h1, protocol_binary_engine_param_flush,
+                    "bfilter_enabled", "true"),
+                "Set bloomfilter_enabled should have worked");
+    }
+    checkeq(std::string("ENABLED"),
+            get_str_stat(h, h1, "vb_0:bloom_filter", "vbucket-details 0"),
+            "Vbucket 0's bloom filter wasn't enabled upon setup!");
+
+    item *it = NULL;
+    for (int i = 0; i < 10; ++i) {
+        std::string key("key-" + std::to_string(i));
+        checkeq(ENGINE_SUCCESS,
+                store(h, h1, NULL, OPERATION_SET, key.c_str(), "somevalue",
+                      &it),
+                "Error setting.");
+        h1->release(h, NULL, it);
+    }
+    wait_for_flusher_to_settle(h, h1);
+
+    // The filter is saved on (clean) shutdown and loaded by warmup, rather
+    // than there being no filter until the next compaction.
+    testHarness.reload_engine(&h, &h1,
+                              testHarness.engine_path,
+                              testHarness.get_current_testcase()->cfg,
+                              true, false);
+    wait_for_warmup_complete(h, h1);
+
+    checkeq(1, get_int_stat(h, h1, "ep_warmup_bloomfilters_loaded", "warmup"),
+            "Expected vb 0's bloom filter to be loaded");
+    checkeq(std::string("ENABLED"),
+            get_str_stat(h, h1, "vb_0:bloom_filter", "vbucket-details 0"),
+            "Vbucket 0's bloom filter wasn't enabled after warmup");
+
+    // Keys stored before the restart are still found...
+    for (int i = 0; i < 10; ++i) {
+        std::string key("key-" + std::to_string(i));
+        check_key_value(h, h1, key.c_str(), "somevalue", 9);
+    }
+
+    // ... and (bar false positives) keys which never existed don't need a
+    // bg fetch to find that out.
+    const int bgFetched = get_int_stat(h, h1, "ep_bg_fetched");
+    for (int i = 0; i < 10; ++i) {
+        std::string key("missing-" + std::to_string(i));
+        checkeq(ENGINE_KEY_ENOENT,
+                verify_key(h, h1, key.c_str()),
+                "Expected missing key to not exist");
+    }
+    check(get_int_stat(h, h1, "ep_bg_fetched") - bgFetched < 5,
+          "Expected the bloom filter to avoid bg fetches of missing keys");
+
+    // Nothing is saved on an unclean shutdown, and warmup removed the file
+    // it loaded.
+    testHarness.reload_engine(&h, &h1,
+                              testHarness.engine_path,
+                              testHarness.get_current_testcase()->cfg,
+                              true, true);
+    wait_for_warmup_complete(h, h1);
+    checkeq(0, get_int_stat(h, h1, "ep_warmup_bloomfilters_loaded", "warmup"),
+            "Expected no bloom filter to be loaded after an unclean "
+            "shutdown");
+
+    return SUCCESS;
+}
+
 static enum test_result test_datatype(ENGINE_HANDLE *h, ENGINE_HANDLE_V1 *h1) {
     const void *cookie = testHarness.create_cookie();
     testHarness.set_datatype_support(cookie, true);
@@ -4937,6 +5017,60 @@ static enum test_result test_multiple_transactions(ENGINE_HANDLE *h,
     return SUCCESS;
 }
 
+static enum test_result test_pipelined_flush(ENGINE_HANDLE *h,
+                                            ENGINE_HANDLE_V1 *h1) {
+    // Spread the items over several vbuckets of one shard, so the commit of
+    // each vbucket overlaps with draining the next.
+    const int num_vbs = 4;
+    const int num_items = 100;
+    for (int vb = 1; vb < num_vbs; ++vb) {
+        check(set_vbucket_state(h, h1, vb, vbucket_state_active),
+              "Failed to set vbucket state.");
+    }
+    for (int j = 0; j < num_items; ++j) {
+        for (int vb = 0; vb < num_vbs; ++vb) {
+            const std::string key = "key-" + std::to_string(vb) + "-" +
+                                    std::to_string(j);
+            item *i;
+            checkeq(ENGINE_SUCCESS,
+                    store(h, h1, NULL, OPERATION_SET, key.c_str(),
+                          key.c_str(), &i, 0, vb),
+                    "Failed to store a value");
+            h1->release(h, NULL, i);
+        }
+    }
+    wait_for_stat_to_be(h, h1, "ep_total_persisted", num_vbs * num_items);
+    wait_for_flusher_to_settle(h, h1);
+    checkeq(0, get_int_stat(h, h1, "ep_flusher_pipeline_depth"),
+            "Expected the flusher pipeline to be empty");
+
+    // Pipelining can be switched off at runtime.
+    check(set_param(h, h1, protocol_binary_engine_param_flush,
+                    "flusher_pipeline_enabled", "false"),
+          "Failed to disable the flusher pipeline");
+    checkeq(ENGINE_SUCCESS,
+            store(h, h1, NULL, OPERATION_SET, "unpipelined", "value", nullptr),
+            "Failed to store a value");
+    wait_for_stat_to_be(h, h1, "ep_total_persisted", num_vbs * num_items + 1);
+
+    if (!isWarmupEnabled(h, h1)) {
+        return SUCCESS;
+    }
+
+    // Restart and check every vbucket's items were written.
+    testHarness.reload_engine(&h, &h1,
+                              testHarness.engine_path,
+                              testHarness.get_current_testcase()->cfg,
+                              true, false);
+    wait_for_warmup_complete(h, h1);
+    for (int vb = 0; vb < num_vbs; ++vb) {
+        const std::string key = "key-" + std::to_string(vb) + "-" +
+                                std::to_string(num_items - 1);
+        check_key_value(h, h1, key.c_str(), key.data(), key.size(), vb);
+    }
+    return SUCCESS;
+}
+
 static enum test_result test_set_ret_meta(ENGINE_HANDLE *h,
                                           ENGINE_HANDLE_V1 *h1) {
     // Check that set without cas succeeds
@@ -6131,6 +6265,9 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ro_0:io_write_bytes",
                 "ro_0:numLoadedVb",
                 "ro_0:open",
+                "ro_0:read_handle_hits",
+                "ro_0:read_handle_misses",
+                "ro_0:read_handle_reopens",
                 "ro_1:backend_type",
                 "ro_1:close",
                 "ro_1:failure_get",
@@ -6145,6 +6282,9 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ro_1:io_write_bytes",
                 "ro_1:numLoadedVb",
                 "ro_1:open",
+                "ro_1:read_handle_hits",
+                "ro_1:read_handle_misses",
+                "ro_1:read_handle_reopens",
                 "ro_2:backend_type",
                 "ro_2:close",
                 "ro_2:failure_get",
@@ -6159,6 +6299,9 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ro_2:io_write_bytes",
                 "ro_2:numLoadedVb",
                 "ro_2:open",
+                "ro_2:read_handle_hits",
+                "ro_2:read_handle_misses",
+                "ro_2:read_handle_reopens",
                 "ro_3:backend_type",
                 "ro_3:close",
                 "ro_3:failure_get",
@@ -6172,7 +6315,10 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ro_3:io_total_write_bytes",
                 "ro_3:io_write_bytes",
                 "ro_3:numLoadedVb",
-                "ro_3:open"
+                "ro_3:open",
+                "ro_3:read_handle_hits",
+                "ro_3:read_handle_misses",
+                "ro_3:read_handle_reopens"
     };
 
     std::vector<std::string> rwKVStoreStats = {
@@ -6431,15 +6577,21 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_bfilter_fp_prob",
                 "ep_bfilter_key_count",
                 "ep_bfilter_residency_threshold",
+                "ep_bfilter_type",
                 "ep_bg_fetch_delay",
+                "ep_bg_fetch_max_concurrency",
                 "ep_bucket_type",
                 "ep_cache_size",
                 "ep_chk_max_items",
                 "ep_chk_period",
                 "ep_chk_remover_stime",
                 "ep_collections_prototype_enabled",
+                "ep_compaction_commit_latency_target",
                 "ep_compaction_exp_mem_threshold",
+                "ep_compaction_max_bandwidth",
                 "ep_compaction_write_queue_cap",
+                "ep_compression_min_ratio",
+                "ep_compression_mode",
                 "ep_config_file",
                 "ep_conflict_resolution_type",
                 "ep_connection_manager_interval",
@@ -6449,6 +6601,8 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_data_traffic_enabled",
                 "ep_dbname",
                 "ep_dcp_backfill_byte_limit",
+                "ep_dcp_backfill_share_scans",
+                "ep_dcp_compression_cache_size",
                 "ep_dcp_conn_buffer_size",
                 "ep_dcp_conn_buffer_size_aggr_mem_threshold",
                 "ep_dcp_conn_buffer_size_aggressive_perc",
@@ -6462,6 +6616,8 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_dcp_idle_timeout",
                 "ep_dcp_noop_tx_interval",
                 "ep_dcp_producer_snapshot_marker_yield_limit",
+                "ep_dcp_producer_step_batch_bytes",
+                "ep_dcp_producer_step_batch_items",
                 "ep_dcp_consumer_process_buffered_messages_yield_limit",
                 "ep_dcp_consumer_process_buffered_messages_batch_size",
                 "ep_dcp_scan_byte_limit",
@@ -6473,17 +6629,23 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_defragmenter_enabled",
                 "ep_defragmenter_interval",
                 "ep_enable_chk_merge",
+                "ep_executor_pool_future_queue",
+                "ep_executor_pool_scheduler",
                 "ep_exp_pager_enabled",
                 "ep_exp_pager_initial_run_time",
                 "ep_exp_pager_stime",
                 "ep_failpartialwarmup",
                 "ep_flushall_enabled",
+                "ep_flusher_pipeline_enabled",
                 "ep_getl_default_timeout",
                 "ep_getl_max_timeout",
                 "ep_hlc_drift_ahead_threshold_us",
                 "ep_hlc_drift_behind_threshold_us",
+                "ep_ht_index_type",
+                "ep_ht_lock_mode",
                 "ep_ht_locks",
                 "ep_ht_resize_interval",
+                "ep_ht_resize_step_size",
                 "ep_ht_size",
                 "ep_initfile",
                 "ep_item_num_based_new_chk",
@@ -6511,6 +6673,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_num_reader_threads",
                 "ep_num_writer_threads",
                 "ep_pager_active_vb_pcnt",
+                "ep_pager_algorithm",
                 "ep_postInitfile",
                 "ep_replication_throttle_cap_pcnt",
                 "ep_replication_throttle_queue_cap",
@@ -6521,6 +6684,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_vb0",
                 "ep_waitforwarmup",
                 "ep_warmup",
+                "ep_warmup_access_log_mmap",
                 "ep_warmup_batch_size",
                 "ep_warmup_min_items_threshold",
                 "ep_warmup_min_memory_threshold"
@@ -6592,7 +6756,9 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_bfilter_fp_prob",
                 "ep_bfilter_key_count",
                 "ep_bfilter_residency_threshold",
+                "ep_bfilter_type",
                 "ep_bg_fetch_delay",
+                "ep_bg_fetch_max_concurrency",
                 "ep_bg_fetched",
                 "ep_bg_meta_fetched",
                 "ep_bg_remaining_items",
@@ -6608,8 +6774,14 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_chk_remover_stime",
                 "ep_clock_cas_drift_threshold_exceeded",
                 "ep_collections_prototype_enabled",
+                "ep_compaction_bandwidth_limit",
+                "ep_compaction_commit_latency_target",
                 "ep_compaction_exp_mem_threshold",
+                "ep_compaction_max_bandwidth",
                 "ep_compaction_write_queue_cap",
+                "ep_compressed_value_size",
+                "ep_compression_min_ratio",
+                "ep_compression_mode",
                 "ep_config_file",
                 "ep_conflict_resolution_type",
                 "ep_connection_manager_interval",
@@ -6622,6 +6794,8 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_data_traffic_enabled",
                 "ep_dbname",
                 "ep_dcp_backfill_byte_limit",
+                "ep_dcp_backfill_share_scans",
+                "ep_dcp_compression_cache_size",
                 "ep_dcp_conn_buffer_size",
                 "ep_dcp_conn_buffer_size_aggr_mem_threshold",
                 "ep_dcp_conn_buffer_size_aggressive_perc",
@@ -6637,6 +6811,8 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_dcp_min_compression_ratio",
                 "ep_dcp_noop_tx_interval",
                 "ep_dcp_producer_snapshot_marker_yield_limit",
+                "ep_dcp_producer_step_batch_bytes",
+                "ep_dcp_producer_step_batch_items",
                 "ep_dcp_scan_byte_limit",
                 "ep_dcp_scan_item_limit",
                 "ep_dcp_takeover_max_time",
@@ -6654,6 +6830,8 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_diskqueue_memory",
                 "ep_diskqueue_pending",
                 "ep_enable_chk_merge",
+                "ep_executor_pool_future_queue",
+                "ep_executor_pool_scheduler",
                 "ep_exp_pager_enabled",
                 "ep_exp_pager_initial_run_time",
                 "ep_exp_pager_stime",
@@ -6665,12 +6843,16 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_flush_all",
                 "ep_flush_duration_total",
                 "ep_flushall_enabled",
+                "ep_flusher_pipeline_enabled",
                 "ep_getl_default_timeout",
                 "ep_getl_max_timeout",
                 "ep_hlc_drift_ahead_threshold_us",
                 "ep_hlc_drift_behind_threshold_us",
+                "ep_ht_index_type",
+                "ep_ht_lock_mode",
                 "ep_ht_locks",
                 "ep_ht_resize_interval",
+                "ep_ht_resize_step_size",
                 "ep_ht_size",
                 "ep_initfile",
                 "ep_io_compaction_read_bytes",
@@ -6731,6 +6913,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_oom_errors",
                 "ep_overhead",
                 "ep_pager_active_vb_pcnt",
+                "ep_pager_algorithm",
                 "ep_pending_compactions",
                 "ep_pending_ops",
                 "ep_pending_ops_max",
@@ -6770,6 +6953,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_total_del_items",
                 "ep_total_enqueued",
                 "ep_total_new_items",
+                "ep_uncompressed_value_size",
                 "ep_uuid",
                 "ep_value_size",
                 "ep_vb0",
@@ -6780,6 +6964,7 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                 "ep_version",
                 "ep_waitforwarmup",
                 "ep_warmup",
+                "ep_warmup_access_log_mmap",
                 "ep_warmup_batch_size",
                 "ep_warmup_min_items_threshold",
                 "ep_warmup_min_memory_threshold",
@@ -6880,8 +7065,10 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                          std::initializer_list<std::string>{"ep_db_data_size",
                                                             "ep_db_file_size"});
         eng_stats.insert(eng_stats.end(),
-                         std::initializer_list<std::string>{"ep_flusher_state",
-                                                            "ep_flusher_todo"});
+                         std::initializer_list<std::string>{
+                                 "ep_flusher_pipeline_depth",
+                                 "ep_flusher_state",
+                                 "ep_flusher_todo"});
         eng_stats.insert(eng_stats.end(),
                          {"ep_commit_num",
                           "ep_commit_time",
@@ -6910,11 +7097,13 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
         eng_stats.insert(eng_stats.end(),
                          {"ep_access_scanner_enabled",
                           "ep_alog_block_size",
+                          "ep_alog_compact",
                           "ep_alog_max_stored_items",
                           "ep_alog_path",
                           "ep_alog_resident_ratio_threshold",
                           "ep_alog_sleep_time",
                           "ep_alog_task_time",
+                          "ep_ht_inline_value_max_size",
                           "ep_item_eviction_policy",
                           "ep_tap_requeue_sleep_time"});
 
@@ -6943,11 +7132,13 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
         config_stats.insert(config_stats.end(),
                             {"ep_access_scanner_enabled",
                              "ep_alog_block_size",
+                             "ep_alog_compact",
                              "ep_alog_max_stored_items",
                              "ep_alog_path",
                              "ep_alog_resident_ratio_threshold",
                              "ep_alog_sleep_time",
                              "ep_alog_task_time",
+                             "ep_ht_inline_value_max_size",
                              "ep_item_eviction_policy",
                              "ep_tap_ack_grace_period",
                              "ep_tap_ack_initial_sequence_number",
@@ -7056,6 +7247,19 @@ static enum test_result test_mb19687_fixed(ENGINE_HANDLE* h,
                               entry.first.size(), add_stats),
                 (std::string("Failed to get stats: ") + entry.first).c_str());
 
+        // The checkpoint lock-wait histograms only report non-empty bins,
+        // which depend on timing - ignore them.
+        if (entry.first.compare(0, 10, "checkpoint") == 0) {
+            for (auto iter = vals.begin(); iter != vals.end();) {
+                if (iter->first.find(":queue_lock_wait_") !=
+                    std::string::npos) {
+                    iter = vals.erase(iter);
+                } else {
+                    ++iter;
+                }
+            }
+        }
+
         std::unordered_set<std::string> accountedFor;
         for (const auto& key : entry.second) {
             auto iter = vals.find(key);
@@ -7159,6 +7363,7 @@ static enum test_result test_mb19687_variable(ENGINE_HANDLE* h,
                                         "ep_warmup_value_count",
                                         "ep_warmup_dups",
                                         "ep_warmup_oom",
+                                        "ep_warmup_bloomfilters_loaded",
                                         "ep_warmup_min_memory_threshold",
                                         "ep_warmup_min_item_threshold",
                                         "ep_warmup_estimated_key_count",
@@ -7529,6 +7734,10 @@ BaseTestCase testsuite_testcases[] = {
         TestCase("test bloomfilters's in a delete+set scenario",
                  test_bloomfilter_delete_plus_set_scenario, test_setup,
                  teardown, NULL, prepare_ep_bucket, cleanup),
+        TestCase("test bloomfilter persisted across restart",
+                 test_bloomfilter_persisted, test_setup,
+                 teardown, "bfilter_type=blocked", prepare_ep_bucket,
+                 cleanup),
         TestCase("test datatype", test_datatype, test_setup,
                  teardown, NULL, prepare, cleanup),
         TestCase("test datatype with unknown command", test_datatype_with_unknown_command,
@@ -7808,6 +8017,10 @@ BaseTestCase testsuite_testcases[] = {
         // Transaction tests
         TestCase("multiple transactions", test_multiple_transactions,
                  test_setup, teardown, NULL, prepare_ep_bucket, cleanup),
+        TestCase("pipelined flush", test_pipelined_flush,
+                 test_setup, teardown,
+                 "flusher_pipeline_enabled=true;max_num_shards=1",
+                 prepare_ep_bucket, cleanup),
 
         // Returning meta tests
         TestCase("test set ret meta", test_set_ret_meta,
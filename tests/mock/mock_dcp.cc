@@ -44,10 +44,27 @@ std::string dcp_last_meta;
 std::string dcp_last_value;
 std::string dcp_last_key;
 vbucket_state_t dcp_last_vbucket_state;
+std::function<void()> dcp_message_callback;
+int dcp_e2big_after = -1;
 
 static ENGINE_HANDLE *engine_handle = nullptr;
 static ENGINE_HANDLE_V1 *engine_handle_v1 = nullptr;
 
+/*
+ * Returns true if the (mock) connection's write buffer has no room for
+ * another message; see dcp_e2big_after.
+ */
+static bool mock_buffer_full() {
+    if (dcp_e2big_after < 0) {
+        return false;
+    }
+    if (dcp_e2big_after == 0) {
+        return true;
+    }
+    --dcp_e2big_after;
+    return false;
+}
+
 extern "C" {
 
 std::vector<std::pair<uint64_t, uint64_t> > dcp_failover_log;
@@ -153,6 +170,9 @@ static ENGINE_ERROR_CODE mock_marker(const void *cookie,
                                      uint64_t snap_end_seqno,
                                      uint32_t flags) {
     (void) cookie;
+    if (mock_buffer_full()) {
+        return ENGINE_E2BIG;
+    }
     clear_dcp_data();
     dcp_last_op = PROTOCOL_BINARY_CMD_DCP_SNAPSHOT_MARKER;
     dcp_last_opaque = opaque;
@@ -161,6 +181,9 @@ static ENGINE_ERROR_CODE mock_marker(const void *cookie,
     dcp_last_snap_start_seqno = snap_start_seqno;
     dcp_last_snap_end_seqno = snap_end_seqno;
     dcp_last_flags = flags;
+    if (dcp_message_callback) {
+        dcp_message_callback();
+    }
     return ENGINE_SUCCESS;
 }
 
@@ -176,6 +199,12 @@ static ENGINE_ERROR_CODE mock_mutation(const void* cookie,
                                        uint8_t nru,
                                        uint8_t collectionLen) {
     (void) cookie;
+    if (mock_buffer_full()) {
+        if (engine_handle_v1 && engine_handle) {
+            engine_handle_v1->release(engine_handle, nullptr, itm);
+        }
+        return ENGINE_E2BIG;
+    }
     clear_dcp_data();
     Item* item = reinterpret_cast<Item*>(itm);
     dcp_last_op = PROTOCOL_BINARY_CMD_DCP_MUTATION;
@@ -200,6 +229,9 @@ static ENGINE_ERROR_CODE mock_mutation(const void* cookie,
                            item->getNBytes() + nmeta;
 
     dcp_last_collection_len = collectionLen;
+    if (dcp_message_callback) {
+        dcp_message_callback();
+    }
     if (engine_handle_v1 && engine_handle) {
         engine_handle_v1->release(engine_handle, NULL, item);
     }
@@ -216,6 +248,12 @@ static ENGINE_ERROR_CODE mock_deletion(const void* cookie,
                                        uint16_t nmeta,
                                        uint8_t collectionLen) {
     (void) cookie;
+    if (mock_buffer_full()) {
+        if (engine_handle_v1 && engine_handle) {
+            engine_handle_v1->release(engine_handle, nullptr, itm);
+        }
+        return ENGINE_E2BIG;
+    }
     clear_dcp_data();
     Item* item = reinterpret_cast<Item*>(itm);
     dcp_last_op = PROTOCOL_BINARY_CMD_DCP_DELETION;
@@ -235,6 +273,9 @@ static ENGINE_ERROR_CODE mock_deletion(const void* cookie,
     dcp_last_value.assign(static_cast<const char*>(item->getData()),
                           item->getNBytes());
     dcp_last_collection_len = collectionLen;
+    if (dcp_message_callback) {
+        dcp_message_callback();
+    }
 
     if (engine_handle_v1 && engine_handle) {
         engine_handle_v1->release(engine_handle, nullptr, item);
@@ -375,5 +416,6 @@ std::unique_ptr<dcp_message_producers> get_dcp_producers(ENGINE_HANDLE *_h,
 
     engine_handle = _h;
     engine_handle_v1 = _h1;
+    dcp_e2big_after = -1;
     return producers;
 }
@@ -23,6 +23,8 @@
 #include <memcached/engine.h>
 #include <memcached/dcp.h>
 
+#include <functional>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -39,6 +41,24 @@ ENGINE_ERROR_CODE mock_dcp_add_failover_log(vbucket_failover_t* entry,
 
 void clear_dcp_data();
 
+/**
+ * If set, called after each mutation, deletion and snapshot marker passed to
+ * the mock producers, with the dcp_last_* variables describing it. Lets a
+ * client see every message when a producer sends more than one per step.
+ */
+extern std::function<void()> dcp_message_callback;
+
+/// By-seqno of the last mutation or deletion passed to the mock producers.
+extern uint64_t dcp_last_byseqno;
+
+/**
+ * Number of further snapshot markers, mutations and deletions the mock
+ * producers accept before they return ENGINE_E2BIG, as memcached does once
+ * the connection's write buffer is full. Negative (the default, restored by
+ * get_dcp_producers) never rejects a message.
+ */
+extern int dcp_e2big_after;
+
 std::unique_ptr<dcp_message_producers> get_dcp_producers(ENGINE_HANDLE *_h,
                                                          ENGINE_HANDLE_V1 *_h1);
 
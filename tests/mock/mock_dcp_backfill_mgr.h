@@ -36,4 +36,8 @@ public:
     bool getBackfillBufferFullStatus() {
         return buffer.full;
     }
+
+    void setScanItemLimit(size_t newLimit) {
+        scanBuffer.maxItems = newLimit;
+    }
 };
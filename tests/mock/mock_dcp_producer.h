@@ -119,4 +119,12 @@ public:
         return dynamic_cast<MockDcpBackfillManager*>(backfillMgr.get())
                 ->getBackfillBufferFullStatus();
     }
+
+    /**
+     * Sets the max items a single run of a backfill can read
+     */
+    void setScanItemLimit(size_t newLimit) {
+        dynamic_cast<MockDcpBackfillManager*>(backfillMgr.get())
+                ->setScanItemLimit(newLimit);
+    }
 };
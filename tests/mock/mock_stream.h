@@ -65,7 +65,7 @@ public:
         return nextCheckpointItem();
     }
 
-    const std::queue<DcpResponse*>& public_readyQ() {
+    const ReadyQueue& public_readyQ() {
         return readyQ;
     }
 
@@ -135,9 +135,27 @@ static void testOperators() {
     cb_assert(Doodad::getNumInstances() == 0);
 }
 
+static void testReleaseReference() {
+    SingleThreadedRCPtr<Doodad> dd(new Doodad);
+    Doodad* raw = SingleThreadedRCPtr<Doodad>(dd).release();
+    cb_assert(raw == dd.get());
+    cb_assert(dd.refCount() == 2);
+    cb_assert(SingleThreadedRCPtr<Doodad>::isReferenceCounted(raw));
+
+    // The released reference keeps the value alive once the pointer is gone.
+    dd.reset();
+    cb_assert(Doodad::getNumInstances() == 1);
+    SingleThreadedRCPtr<Doodad>::dropReference(raw);
+    cb_assert(Doodad::getNumInstances() == 0);
+
+    Doodad unshared;
+    cb_assert(!SingleThreadedRCPtr<Doodad>::isReferenceCounted(&unshared));
+}
+
 int main() {
     testOperators();
     testAtomicPtr();
+    testReleaseReference();
 }
 #else
 int main() {}
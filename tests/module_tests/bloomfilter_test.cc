@@ -14,11 +14,15 @@
  *   limitations under the License.
  */
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
 #include <unordered_set>
 
 #include <gtest/gtest.h>
 
 #include "bloomfilter.h"
+#include "bloomfilter_file.h"
 #include "murmurhash3.h"
 #include "tests/module_tests/test_helpers.h"
 
@@ -80,6 +84,199 @@ TEST_P(BloomFilterDocKeyTest, check_maybeKeyExist) {
     }
 }
 
+class BlockedBloomFilterDocKeyTest
+        : public BlockedBloomFilter,
+          public ::testing::TestWithParam<
+                  std::tuple<DocNamespace, DocNamespace>> {
+public:
+    BlockedBloomFilterDocKeyTest()
+        : BlockedBloomFilter(10000, 0.01, BFILTER_ENABLED) {
+    }
+};
+
+/*
+ * All of a key's bits are in one cache line aligned block, and keys in
+ * different namespaces probe different bits.
+ */
+TEST_P(BlockedBloomFilterDocKeyTest, check_probe) {
+    auto key1 = StoredDocKey("key", std::get<0>(GetParam()));
+    auto key2 = StoredDocKey("key", std::get<1>(GetParam()));
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(blocks) % 64);
+
+    auto probe1 = probeFor(key1);
+    auto probe2 = probeFor(key2);
+    EXPECT_LT(probe1.block, noOfBlocks);
+    size_t bits = 0;
+    for (auto word : probe1.mask) {
+        for (; word != 0; word &= word - 1) {
+            bits++;
+        }
+    }
+    EXPECT_EQ(noOfHashes, bits);
+
+    bool same = probe1.block == probe2.block &&
+                std::equal(std::begin(probe1.mask), std::end(probe1.mask),
+                           std::begin(probe2.mask));
+    EXPECT_EQ(std::get<0>(GetParam()) == std::get<1>(GetParam()), same);
+}
+
+TEST_P(BlockedBloomFilterDocKeyTest, check_addKey) {
+    auto key1 = StoredDocKey("key", std::get<0>(GetParam()));
+    auto key2 = StoredDocKey("key", std::get<1>(GetParam()));
+    addKey(key1);
+    addKey(key2);
+    if (std::get<0>(GetParam()) != std::get<1>(GetParam())) {
+        EXPECT_EQ(2, getNumOfKeysInFilter());
+    } else {
+        EXPECT_EQ(1, getNumOfKeysInFilter());
+    }
+}
+
+TEST_P(BlockedBloomFilterDocKeyTest, check_maybeKeyExist) {
+    auto key1 = StoredDocKey("key", std::get<0>(GetParam()));
+    auto key2 = StoredDocKey("key", std::get<1>(GetParam()));
+    addKey(key1);
+    EXPECT_EQ(1, getNumOfKeysInFilter());
+    if (std::get<0>(GetParam()) != std::get<1>(GetParam())) {
+        EXPECT_FALSE(maybeKeyExists(key2));
+    } else {
+        EXPECT_TRUE(maybeKeyExists(key2));
+    }
+}
+
+/*
+ * Filled to its key count the filter has no false negatives, and a false
+ * positive rate no higher than the configured one.
+ */
+class BlockedBloomFilterRateTest : public ::testing::TestWithParam<double> {};
+
+TEST_P(BlockedBloomFilterRateTest, false_positive_rate) {
+    const size_t keys = 10000;
+    const size_t probes = 1000000;
+    BlockedBloomFilter filter(keys, GetParam(), BFILTER_ENABLED);
+    for (size_t i = 0; i < keys; i++) {
+        filter.addKey(StoredDocKey("key" + std::to_string(i),
+                                   DocNamespace::DefaultCollection));
+    }
+    for (size_t i = 0; i < keys; i++) {
+        EXPECT_TRUE(filter.maybeKeyExists(StoredDocKey(
+                "key" + std::to_string(i), DocNamespace::DefaultCollection)));
+    }
+    size_t falsePositives = 0;
+    for (size_t i = keys; i < keys + probes; i++) {
+        if (filter.maybeKeyExists(StoredDocKey(
+                    "key" + std::to_string(i),
+                    DocNamespace::DefaultCollection))) {
+            falsePositives++;
+        }
+    }
+    EXPECT_LE(double(falsePositives) / probes, GetParam());
+    EXPECT_LE(BlockedBloomFilter::estimateFalsePositiveRate(
+                      double(keys) / filter.getNoOfBlocks(),
+                      filter.getNoOfHashes()),
+              GetParam());
+}
+
+INSTANTIATE_TEST_CASE_P(FalsePositiveProbabilities,
+                        BlockedBloomFilterRateTest,
+                        ::testing::Values(0.1, 0.05, 0.01, 0.001, 0.0001), );
+
+TEST(BlockedBloomFilterTest, disable) {
+    BlockedBloomFilter filter(10000, 0.01, BFILTER_ENABLED);
+    auto key = StoredDocKey("key", DocNamespace::DefaultCollection);
+    filter.addKey(key);
+    // A little larger than BloomFilter's 95851 bits, to make up for the
+    // uneven spread of keys over the blocks.
+    EXPECT_EQ(BlockedBloomFilter::BitsPerBlock * 195, filter.getFilterSize());
+
+    filter.setStatus(BFILTER_DISABLED);
+    EXPECT_EQ("DISABLED", filter.getStatusString());
+    EXPECT_EQ(0, filter.getFilterSize());
+    EXPECT_EQ(0, filter.getNumOfKeysInFilter());
+
+    // Once disabled every key may exist, even after being re-enabled (the
+    // bits are gone; a new filter is built by the next compaction).
+    filter.setStatus(BFILTER_ENABLED);
+    EXPECT_EQ("PENDING (ENABLED)", filter.getStatusString());
+    filter.setStatus(BFILTER_COMPACTING);
+    filter.addKey(key);
+    EXPECT_TRUE(filter.maybeKeyExists(
+            StoredDocKey("other", DocNamespace::DefaultCollection)));
+}
+
+class BloomFilterFileTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fname = BloomFilterFile::getFileName(".", 3);
+        remove(fname.c_str());
+        for (size_t i = 0; i < 1000; i++) {
+            filter.addKey(makeKey(i));
+        }
+    }
+
+    void TearDown() override {
+        remove(fname.c_str());
+    }
+
+    static StoredDocKey makeKey(size_t i) {
+        return StoredDocKey("key" + std::to_string(i),
+                            DocNamespace::DefaultCollection);
+    }
+
+    /// Flip a bit of the saved file at the given offset.
+    void corrupt(long offset) {
+        FILE* fp = fopen(fname.c_str(), "r+b");
+        ASSERT_NE(nullptr, fp);
+        ASSERT_EQ(0, fseek(fp, offset, SEEK_SET));
+        int c = fgetc(fp);
+        ASSERT_EQ(0, fseek(fp, offset, SEEK_SET));
+        fputc(c ^ 1, fp);
+        fclose(fp);
+    }
+
+    BlockedBloomFilter filter{1000, 0.01, BFILTER_ENABLED};
+    std::string fname;
+};
+
+TEST_F(BloomFilterFileTest, save_load) {
+    BloomFilterFile::save(fname, 3, 0xcafe, 1000, filter);
+    auto loaded = BloomFilterFile::load(fname, 3, 0xcafe, 1000);
+    ASSERT_TRUE(loaded);
+    EXPECT_EQ("ENABLED", loaded->getStatusString());
+    EXPECT_EQ(filter.getFilterSize(), loaded->getFilterSize());
+    EXPECT_EQ(filter.getNumOfKeysInFilter(), loaded->getNumOfKeysInFilter());
+    EXPECT_EQ(filter.getNoOfHashes(), loaded->getNoOfHashes());
+    for (size_t i = 0; i < 2000; i++) {
+        EXPECT_EQ(filter.maybeKeyExists(makeKey(i)),
+                  loaded->maybeKeyExists(makeKey(i)));
+    }
+}
+
+TEST_F(BloomFilterFileTest, missing) {
+    EXPECT_FALSE(BloomFilterFile::load(fname, 3, 0xcafe, 1000));
+}
+
+// A filter is only used for the vBucket state it was saved with.
+TEST_F(BloomFilterFileTest, mismatch) {
+    BloomFilterFile::save(fname, 3, 0xcafe, 1000, filter);
+    EXPECT_FALSE(BloomFilterFile::load(fname, 4, 0xcafe, 1000));
+    EXPECT_FALSE(BloomFilterFile::load(fname, 3, 0xbeef, 1000));
+    EXPECT_FALSE(BloomFilterFile::load(fname, 3, 0xcafe, 1001));
+    EXPECT_TRUE(BloomFilterFile::load(fname, 3, 0xcafe, 1000));
+}
+
+TEST_F(BloomFilterFileTest, corrupt_header) {
+    BloomFilterFile::save(fname, 3, 0xcafe, 1000, filter);
+    corrupt(offsetof(BloomFilterFile::Header, keyCount));
+    EXPECT_FALSE(BloomFilterFile::load(fname, 3, 0xcafe, 1000));
+}
+
+TEST_F(BloomFilterFileTest, corrupt_blocks) {
+    BloomFilterFile::save(fname, 3, 0xcafe, 1000, filter);
+    corrupt(sizeof(BloomFilterFile::Header) + 100);
+    EXPECT_FALSE(BloomFilterFile::load(fname, 3, 0xcafe, 1000));
+}
+
 static std::vector<DocNamespace> allDocNamespaces = {{DocNamespace::DefaultCollection,
                                                       DocNamespace::Collections,
                                                       DocNamespace::System}};
@@ -89,3 +286,9 @@ INSTANTIATE_TEST_CASE_P(
         BloomFilterDocKeyTest,
         ::testing::Combine(::testing::ValuesIn(allDocNamespaces),
                            ::testing::ValuesIn(allDocNamespaces)), );
+
+INSTANTIATE_TEST_CASE_P(
+        DocNamespace,
+        BlockedBloomFilterDocKeyTest,
+        ::testing::Combine(::testing::ValuesIn(allDocNamespaces),
+                           ::testing::ValuesIn(allDocNamespaces)), );
@@ -792,6 +792,61 @@ TYPED_TEST(CheckpointTest, ItemsForCheckpointCursor) {
     EXPECT_EQ(2 * MIN_CHECKPOINT_ITEMS + 3, items.size());
 }
 
+// Test that a cursor reading several closed checkpoints (which are read
+// without holding the queue lock) gets every item in order, and leaves the
+// cursor positioned in the open checkpoint.
+TYPED_TEST(CheckpointTest, ItemsFromClosedCheckpoints) {
+    this->checkpoint_config = CheckpointConfig(DEFAULT_CHECKPOINT_PERIOD,
+                                               MIN_CHECKPOINT_ITEMS,
+                                               /*numCheckpoints*/ 4,
+                                               /*itemBased*/ true,
+                                               /*keepClosed*/ false,
+                                               /*enableMerge*/ false,
+                                               /*persistenceEnabled*/ true);
+    this->createManager();
+
+    // Fill three checkpoints (two closed, one open).
+    for (unsigned int ii = 0; ii < 3 * MIN_CHECKPOINT_ITEMS; ii++) {
+        EXPECT_TRUE(this->queueNewItem("key" + std::to_string(ii)));
+    }
+    ASSERT_EQ(3, this->manager->getNumCheckpoints());
+
+    std::vector<queued_item> items;
+    auto range = this->manager->getAllItemsForCursor(
+            CheckpointManager::pCursorName, items);
+    // 3 * MIN_CHECKPOINT_ITEMS items, plus checkpoint_start and
+    // checkpoint_end for the closed checkpoints, and checkpoint_start for the
+    // open one.
+    EXPECT_EQ(3 * MIN_CHECKPOINT_ITEMS + 5, items.size());
+    EXPECT_EQ(1001, range.start);
+    EXPECT_EQ(1000 + 3 * MIN_CHECKPOINT_ITEMS, range.end);
+
+    int64_t lastSeqno = 0;
+    for (const auto& qi : items) {
+        if (!qi->isCheckPointMetaItem()) {
+            EXPECT_GT(qi->getBySeqno(), lastSeqno);
+            lastSeqno = qi->getBySeqno();
+        }
+    }
+    EXPECT_EQ(1000 + 3 * MIN_CHECKPOINT_ITEMS, lastSeqno);
+    EXPECT_EQ(0, this->manager->getNumItemsForCursor(
+                         CheckpointManager::pCursorName));
+
+    // Closed checkpoints are no longer referenced, so can be removed.
+    this->manager->itemsPersisted();
+    bool newCheckpointCreated;
+    EXPECT_EQ(2 * MIN_CHECKPOINT_ITEMS,
+              this->manager->removeClosedUnrefCheckpoints(
+                      *this->vbucket, newCheckpointCreated));
+
+    // A further read only returns newly-queued items.
+    EXPECT_TRUE(this->queueNewItem("another_key"));
+    items.clear();
+    this->manager->getAllItemsForCursor(CheckpointManager::pCursorName, items);
+    ASSERT_EQ(1, items.size());
+    EXPECT_EQ(1001 + 3 * MIN_CHECKPOINT_ITEMS, items[0]->getBySeqno());
+}
+
 // Test the checkpoint cursor movement
 TYPED_TEST(CheckpointTest, CursorMovement) {
     /* We want to have items across 2 checkpoints. Size down the default number
@@ -1231,3 +1286,140 @@ TYPED_TEST(CheckpointTest,
     // Test - second item (duplicate key) should return false.
     EXPECT_FALSE(this->queueNewItem("key"));
 }
+
+static queued_item makeQueuedItem(const std::string& key, int64_t seqno) {
+    return queued_item(new Item(makeStoredDocKey(key),
+                                /*vbid*/ 0,
+                                queue_op::set,
+                                /*revSeq*/ 0,
+                                seqno));
+}
+
+// Check that positions in a CheckpointQueue remain valid (and iteration
+// skips removed items) as items are added and removed around them.
+TEST(CheckpointQueueTest, StablePositions) {
+    CheckpointQueue queue;
+    std::vector<CheckpointQueue::iterator> positions;
+    const int64_t numItems = CheckpointQueue::ChunkSize * 3 + 1;
+    for (int64_t i = 0; i < numItems; ++i) {
+        positions.push_back(queue.push_back(makeQueuedItem("key", i)));
+    }
+    ASSERT_EQ(size_t(numItems), queue.size());
+
+    // Remove every item except the first and last - which includes whole
+    // chunks.
+    for (int64_t i = 1; i < numItems - 1; ++i) {
+        queue.erase(positions[i]);
+    }
+    EXPECT_EQ(2, queue.size());
+    EXPECT_EQ(0, (*positions.front())->getBySeqno());
+    EXPECT_EQ(numItems - 1, (*positions.back())->getBySeqno());
+
+    auto it = queue.begin();
+    EXPECT_EQ(positions.front(), it);
+    EXPECT_EQ(positions.back(), ++it);
+    EXPECT_EQ(queue.end(), ++it);
+    EXPECT_EQ(positions.back(), --it);
+    EXPECT_EQ(numItems - 1, (*queue.rbegin())->getBySeqno());
+
+    // Prepend, and check forward and reverse order.
+    queue.push_front(makeQueuedItem("key", -1));
+    std::vector<int64_t> seqnos;
+    for (const auto& qi : queue) {
+        seqnos.push_back(qi->getBySeqno());
+    }
+    EXPECT_EQ(std::vector<int64_t>({-1, 0, numItems - 1}), seqnos);
+    seqnos.clear();
+    for (auto rit = queue.rbegin(); rit != queue.rend(); ++rit) {
+        seqnos.push_back((*rit)->getBySeqno());
+    }
+    EXPECT_EQ(std::vector<int64_t>({numItems - 1, 0, -1}), seqnos);
+
+    queue.pop_back();
+    EXPECT_EQ(0, queue.back()->getBySeqno());
+    EXPECT_EQ(2, queue.size());
+}
+
+// Check that repeatedly replacing the same keys re-uses the queue's storage
+// instead of growing it.
+TEST(CheckpointQueueTest, DedupReusesChunks) {
+    CheckpointQueue queue;
+    CheckpointIndex index;
+    auto queueDeduped = [&queue, &index](const queued_item& qi) {
+        index_entry* existing = index.find(qi->getKey());
+        if (existing) {
+            auto oldPos = existing->position;
+            existing->position = queue.push_back(qi);
+            queue.erase(oldPos);
+        } else {
+            index.insert({queue.push_back(qi), qi->getBySeqno()});
+        }
+    };
+
+    for (int64_t i = 0; i < 10; ++i) {
+        queueDeduped(makeQueuedItem("key" + std::to_string(i), i));
+    }
+    const size_t initialMemory = queue.memorySize();
+    for (int64_t i = 10; i < 100000; ++i) {
+        queueDeduped(makeQueuedItem("key" + std::to_string(i % 10), i));
+    }
+    EXPECT_EQ(10, queue.size());
+    EXPECT_EQ(10, index.size());
+    // At most the two chunks the items straddle, and the spare one.
+    EXPECT_LE(queue.memorySize(), 3 * initialMemory);
+
+    int64_t expected = 100000 - 10;
+    for (const auto& qi : queue) {
+        EXPECT_EQ(expected++, qi->getBySeqno());
+    }
+
+    // An item which is never replaced keeps its chunk, but the released
+    // chunks queued after it don't take any space.
+    CheckpointQueue pinnedQueue;
+    pinnedQueue.push_back(makeQueuedItem("pinned", 0));
+    auto last = pinnedQueue.push_back(makeQueuedItem("key", 1));
+    for (int64_t i = 2; i < 100000; ++i) {
+        auto next = pinnedQueue.push_back(makeQueuedItem("key", i));
+        pinnedQueue.erase(last);
+        last = next;
+    }
+    EXPECT_EQ(2, pinnedQueue.size());
+    EXPECT_LE(pinnedQueue.memorySize(), 3 * initialMemory);
+    std::vector<int64_t> seqnos;
+    for (const auto& qi : pinnedQueue) {
+        seqnos.push_back(qi->getBySeqno());
+    }
+    EXPECT_EQ(std::vector<int64_t>({0, 99999}), seqnos);
+}
+
+// Check CheckpointIndex lookup, update and erase, including growing the
+// table and erasing from the middle of probe sequences.
+TEST(CheckpointQueueTest, Index) {
+    CheckpointQueue queue;
+    CheckpointIndex index;
+    const int64_t numKeys = 1000;
+    for (int64_t i = 0; i < numKeys; ++i) {
+        index.insert({queue.push_back(makeQueuedItem("key" + std::to_string(i),
+                                                     i)),
+                      i});
+    }
+    ASSERT_EQ(size_t(numKeys), index.size());
+
+    for (int64_t i = 0; i < numKeys; i += 2) {
+        index.erase(makeStoredDocKey("key" + std::to_string(i)));
+    }
+    EXPECT_EQ(size_t(numKeys / 2), index.size());
+
+    for (int64_t i = 0; i < numKeys; ++i) {
+        const auto key = makeStoredDocKey("key" + std::to_string(i));
+        const index_entry* entry = index.find(key);
+        if (i % 2 == 0) {
+            EXPECT_EQ(nullptr, entry) << key;
+        } else {
+            ASSERT_NE(nullptr, entry) << key;
+            EXPECT_EQ(i, entry->mutation_id);
+            EXPECT_EQ(key, (*entry->position)->getKey());
+        }
+    }
+    EXPECT_EQ(nullptr, index.find(makeStoredDocKey("missing")));
+}
@@ -0,0 +1,77 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "compaction_rate_limiter.h"
+
+using namespace std::chrono;
+
+// Unconfigured (or a max of zero) means unlimited.
+TEST(CompactionRateLimiterTest, Unlimited) {
+    CompactionRateLimiter limiter;
+    EXPECT_EQ(0u, limiter.getRate());
+    EXPECT_EQ(microseconds(0), limiter.acquire(1024 * 1024 * 1024));
+
+    // Commit latencies don't make an unlimited limiter limited.
+    limiter.recordCommitLatency(seconds(10));
+    EXPECT_EQ(0u, limiter.getRate());
+}
+
+// The bucket starts with one second's worth of tokens; beyond that callers
+// wait for the refill.
+TEST(CompactionRateLimiterTest, Throttles) {
+    const size_t rate = 10 * 1024 * 1024;
+    CompactionRateLimiter limiter;
+    limiter.configure(rate, milliseconds(100));
+    EXPECT_EQ(rate, limiter.getRate());
+
+    EXPECT_EQ(microseconds(0), limiter.acquire(rate));
+
+    // A further 1/10th of a second's worth must wait ~100ms.
+    const auto start = steady_clock::now();
+    const auto waited = limiter.acquire(rate / 10);
+    EXPECT_GE(waited, milliseconds(80));
+    EXPECT_LE(waited, milliseconds(110));
+    EXPECT_GE(steady_clock::now() - start, waited);
+}
+
+// The rate backs off while commits are slow, to no less than 1/16th of the
+// maximum, and recovers to the maximum once they are fast again.
+TEST(CompactionRateLimiterTest, AdaptsToCommitLatency) {
+    const size_t rate = 16 * 1024 * 1024;
+    CompactionRateLimiter limiter;
+    limiter.configure(rate, milliseconds(100));
+
+    limiter.recordCommitLatency(milliseconds(200));
+    EXPECT_EQ(rate - rate / 4, limiter.getRate());
+
+    for (int ii = 0; ii < 100; ++ii) {
+        limiter.recordCommitLatency(milliseconds(200));
+    }
+    EXPECT_EQ(rate / CompactionRateLimiter::MinRateDivisor, limiter.getRate());
+
+    limiter.recordCommitLatency(milliseconds(50));
+    EXPECT_EQ(rate / CompactionRateLimiter::MinRateDivisor +
+                      rate / CompactionRateLimiter::IncreaseSteps,
+              limiter.getRate());
+
+    for (size_t ii = 0; ii < CompactionRateLimiter::IncreaseSteps; ++ii) {
+        limiter.recordCommitLatency(milliseconds(50));
+    }
+    EXPECT_EQ(rate, limiter.getRate());
+}
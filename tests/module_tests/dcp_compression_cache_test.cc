@@ -0,0 +1,145 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "dcp/compression_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+class DcpCompressionCacheTest : public ::testing::Test {
+protected:
+    static value_t makeValue(const std::string& data) {
+        uint8_t extMeta[1] = {uint8_t(PROTOCOL_BINARY_RAW_BYTES)};
+        return value_t(Blob::New(
+                data.data(), data.size(), extMeta, sizeof(extMeta)));
+    }
+};
+
+TEST_F(DcpCompressionCacheTest, LookupAfterInsert) {
+    DcpCompressionCache cache(1024 * 1024);
+    const auto value = makeValue(std::string(100, 'x'));
+    const auto compressed = makeValue("compressed");
+
+    value_t found;
+    EXPECT_FALSE(cache.lookup(value, found));
+    cache.insert(value, compressed, /*duration*/ 10);
+    ASSERT_TRUE(cache.lookup(value, found));
+    EXPECT_EQ(compressed.get(), found.get());
+
+    // A different Blob with the same content is a different value.
+    EXPECT_FALSE(cache.lookup(makeValue(std::string(100, 'x')), found));
+}
+
+// A value not worth compressing is remembered as such.
+TEST_F(DcpCompressionCacheTest, NotWorthCompressing) {
+    DcpCompressionCache cache(1024 * 1024);
+    const auto value = makeValue("incompressible");
+    cache.insert(value, value_t(), /*duration*/ 10);
+
+    value_t found = makeValue("stale");
+    ASSERT_TRUE(cache.lookup(value, found));
+    EXPECT_FALSE(found);
+}
+
+// The first insert of a value wins.
+TEST_F(DcpCompressionCacheTest, InsertTwice) {
+    DcpCompressionCache cache(1024 * 1024);
+    const auto value = makeValue(std::string(100, 'x'));
+    const auto first = makeValue("first");
+    cache.insert(value, first, /*duration*/ 10);
+    const size_t size = cache.getSize();
+    cache.insert(value, makeValue("second"), /*duration*/ 10);
+    EXPECT_EQ(size, cache.getSize());
+
+    value_t found;
+    ASSERT_TRUE(cache.lookup(value, found));
+    EXPECT_EQ(first.get(), found.get());
+}
+
+// The oldest entries are dropped to keep within the max size (with one
+// shard, so the order is over all entries).
+TEST_F(DcpCompressionCacheTest, EvictsOldest) {
+    const auto compressed = makeValue("compressed");
+    std::vector<value_t> values;
+    for (int ii = 0; ii < 10; ++ii) {
+        values.push_back(makeValue(std::string(1000, 'a' + ii)));
+    }
+
+    DcpCompressionCache sizing(1024 * 1024, /*numShards*/ 1);
+    sizing.insert(values[0], compressed, /*duration*/ 10);
+    const size_t entrySize = sizing.getSize();
+
+    DcpCompressionCache cache(entrySize * 3, /*numShards*/ 1);
+    for (const auto& value : values) {
+        cache.insert(value, compressed, /*duration*/ 10);
+    }
+    EXPECT_EQ(entrySize * 3, cache.getSize());
+
+    value_t found;
+    EXPECT_FALSE(cache.lookup(values[6], found));
+    for (int ii = 7; ii < 10; ++ii) {
+        EXPECT_TRUE(cache.lookup(values[ii], found)) << ii;
+    }
+
+    cache.setMaxSize(entrySize);
+    EXPECT_EQ(entrySize, cache.getSize());
+    EXPECT_TRUE(cache.lookup(values[9], found));
+
+    cache.clear();
+    EXPECT_EQ(0, cache.getSize());
+    EXPECT_FALSE(cache.lookup(values[9], found));
+}
+
+// Each shard keeps within its part of the max size, dropping its own oldest
+// entries; the latest value inserted is always kept.
+TEST_F(DcpCompressionCacheTest, ShardsKeepWithinMaxSize) {
+    const auto compressed = makeValue("compressed");
+    std::vector<value_t> values;
+    for (int ii = 0; ii < 100; ++ii) {
+        values.push_back(makeValue(std::string(1000, 'a' + (ii % 26))));
+    }
+
+    DcpCompressionCache sizing(1024 * 1024, /*numShards*/ 1);
+    sizing.insert(values[0], compressed, /*duration*/ 10);
+    const size_t entrySize = sizing.getSize();
+
+    const size_t numShards = 4;
+    DcpCompressionCache cache(entrySize * 2 * numShards, numShards);
+    value_t found;
+    for (const auto& value : values) {
+        cache.insert(value, compressed, /*duration*/ 10);
+        EXPECT_LE(cache.getSize(), entrySize * 2 * numShards);
+        EXPECT_TRUE(cache.lookup(value, found));
+    }
+    EXPECT_GT(cache.getSize(), 0);
+
+    cache.clear();
+    EXPECT_EQ(0, cache.getSize());
+}
+
+// A max size of zero disables the cache.
+TEST_F(DcpCompressionCacheTest, Disabled) {
+    DcpCompressionCache cache(0);
+    const auto value = makeValue(std::string(100, 'x'));
+    cache.insert(value, makeValue("compressed"), /*duration*/ 10);
+
+    value_t found;
+    EXPECT_FALSE(cache.lookup(value, found));
+    EXPECT_EQ(0, cache.getSize());
+}
@@ -550,6 +550,193 @@ TEST_P(StreamTest, BackfillSmallBuffer) {
     mock_stream->consumeBackfillItems(1);
 }
 
+/* Two streams backfilling the same vbucket from disk share one scan */
+TEST_P(StreamTest, BackfillSharedScan) {
+    if (bucketType == "ephemeral") {
+        /* Ephemeral buckets backfill from memory, there is no disk scan */
+        return;
+    }
+
+    engine->getConfiguration().setDcpBackfillShareScans(true);
+
+    /* Add 3 items */
+    int numItems = 3;
+    for (int i = 0; i < numItems; ++i) {
+        std::string key("key" + std::to_string(i));
+        store_item(vbid, key, "value");
+    }
+
+    /* Create new checkpoint so that we can remove the current checkpoint
+       and force a backfill in the DCP streams */
+    auto& ckpt_mgr = vb0->checkpointManager;
+    ckpt_mgr.createNewCheckpoint();
+
+    /* Wait for removal of the old checkpoint, this also would imply that the
+       items are persisted */
+    {
+        bool new_ckpt_created;
+        std::chrono::microseconds uSleepTime(128);
+        while (static_cast<size_t>(numItems) !=
+               ckpt_mgr.removeClosedUnrefCheckpoints(*vb0, new_ckpt_created)) {
+            uSleepTime = decayingSleep(uSleepTime);
+        }
+    }
+
+    /* Set up two DCP streams (on different producers) for the backfill */
+    setup_dcp_stream();
+    MockActiveStream* mock_stream =
+            static_cast<MockActiveStream*>(stream.get());
+
+    dcp_producer_t producer2 = new MockDcpProducer(*engine,
+                                                   /*cookie*/ nullptr,
+                                                   "test_producer2",
+                                                   /*notifyOnly*/ false);
+    stream_t stream2 = new MockActiveStream(engine,
+                                            producer2,
+                                            producer2->getName(),
+                                            /*flags*/ 0,
+                                            /*opaque*/ 0,
+                                            vbid,
+                                            /*st_seqno*/ 0,
+                                            /*en_seqno*/ ~0,
+                                            /*vb_uuid*/ 0xabcd,
+                                            /*snap_start_seqno*/ 0,
+                                            /*snap_end_seqno*/ ~0);
+    MockActiveStream* mock_stream2 =
+            static_cast<MockActiveStream*>(stream2.get());
+
+    /* Schedule both backfills before letting the backfill task run, so the
+       second joins the scan before it reads anything */
+    mock_stream->transitionStateToBackfilling();
+    mock_stream2->transitionStateToBackfilling();
+    ExecutorPool::get()->setNumAuxIO(1);
+
+    /* Wait for the backfills to complete */
+    {
+        std::chrono::microseconds uSleepTime(128);
+        while (numItems != mock_stream->getLastReadSeqno() ||
+               numItems != mock_stream2->getLastReadSeqno()) {
+            uSleepTime = decayingSleep(uSleepTime);
+        }
+    }
+
+    /* Both streams are passed every item */
+    EXPECT_EQ(numItems, mock_stream->getNumBackfillItems());
+    EXPECT_EQ(numItems, mock_stream2->getNumBackfillItems());
+
+    /* The second stream attached to the scan of the first */
+    auto& registry = engine->getDcpConnMap().getDiskScanRegistry();
+    EXPECT_EQ(1, registry.getAttaches());
+    EXPECT_LT(0, registry.getBytesSaved());
+
+    producer2->clearCheckpointProcessorTaskQueues();
+}
+
+/* Each stream sharing a disk scan counts only the items in its own range as
+   remaining to backfill */
+TEST_P(StreamTest, BackfillSharedScanRemaining) {
+    if (bucketType == "ephemeral") {
+        /* Ephemeral buckets backfill from memory, there is no disk scan */
+        return;
+    }
+
+    engine->getConfiguration().setDcpBackfillShareScans(true);
+
+    int numItems = 3;
+    for (int i = 0; i < numItems; ++i) {
+        std::string key("key" + std::to_string(i));
+        store_item(vbid, key, "value");
+    }
+
+    auto& ckpt_mgr = vb0->checkpointManager;
+    ckpt_mgr.createNewCheckpoint();
+    {
+        bool new_ckpt_created;
+        std::chrono::microseconds uSleepTime(128);
+        while (static_cast<size_t>(numItems) !=
+               ckpt_mgr.removeClosedUnrefCheckpoints(*vb0, new_ckpt_created)) {
+            uSleepTime = decayingSleep(uSleepTime);
+        }
+    }
+
+    /* The second stream wants only the last item */
+    setup_dcp_stream();
+    MockActiveStream* mock_stream =
+            static_cast<MockActiveStream*>(stream.get());
+
+    dcp_producer_t producer2 = new MockDcpProducer(*engine,
+                                                   /*cookie*/ nullptr,
+                                                   "test_producer2",
+                                                   /*notifyOnly*/ false);
+    stream_t stream2 = new MockActiveStream(engine,
+                                            producer2,
+                                            producer2->getName(),
+                                            /*flags*/ 0,
+                                            /*opaque*/ 0,
+                                            vbid,
+                                            /*st_seqno*/ numItems - 1,
+                                            /*en_seqno*/ ~0,
+                                            /*vb_uuid*/ 0xabcd,
+                                            /*snap_start_seqno*/ numItems - 1,
+                                            /*snap_end_seqno*/ numItems - 1);
+    MockActiveStream* mock_stream2 =
+            static_cast<MockActiveStream*>(stream2.get());
+
+    mock_stream->transitionStateToBackfilling();
+    mock_stream2->transitionStateToBackfilling();
+    ExecutorPool::get()->setNumAuxIO(1);
+
+    {
+        std::chrono::microseconds uSleepTime(128);
+        while (numItems != mock_stream->getLastReadSeqno() ||
+               numItems != mock_stream2->getLastReadSeqno()) {
+            uSleepTime = decayingSleep(uSleepTime);
+        }
+    }
+
+    auto& registry = engine->getDcpConnMap().getDiskScanRegistry();
+    EXPECT_EQ(1, registry.getAttaches());
+    EXPECT_EQ(numItems, mock_stream->getNumBackfillItemsRemaining());
+    EXPECT_EQ(1, mock_stream2->getNumBackfillItemsRemaining());
+    EXPECT_EQ(1, mock_stream2->getNumBackfillItems());
+
+    producer2->clearCheckpointProcessorTaskQueues();
+}
+
+/* Items a shared disk scan reads for a stream while another stream's backfill
+   runs it are limited by the stream's connection's backfill buffer only; its
+   scan buffer is reset only when its own backfill manager runs, so charging
+   it would stall the scan until then */
+TEST_P(StreamTest, BackfillSharedReadSkipsScanBuffer) {
+    setup_dcp_stream();
+    MockDcpProducer* mock_producer =
+            dynamic_cast<MockDcpProducer*>(producer.get());
+    mock_producer->setScanItemLimit(1);
+    mock_producer->setBackfillBufferSize(3);
+
+    /* The connection's own backfill can read only 1 item per run */
+    EXPECT_TRUE(producer->recordBackfillManagerBytesRead(1, /*force*/ false));
+    EXPECT_FALSE(producer->recordBackfillManagerBytesRead(1, /*force*/ false));
+    EXPECT_FALSE(mock_producer->getBackfillBufferFullStatus());
+
+    /* Shared reads go on until the backfill buffer is full */
+    EXPECT_TRUE(producer->recordBackfillManagerBytesRead(
+            1, /*force*/ false, /*shared*/ true));
+    EXPECT_TRUE(producer->recordBackfillManagerBytesRead(
+            1, /*force*/ false, /*shared*/ true));
+    EXPECT_FALSE(producer->recordBackfillManagerBytesRead(
+            1, /*force*/ false, /*shared*/ true));
+    EXPECT_TRUE(mock_producer->getBackfillBufferFullStatus());
+
+    /* ... and resume once the connection has sent enough, without its
+       backfill manager running */
+    producer->recordBackfillManagerBytesSent(3);
+    EXPECT_FALSE(mock_producer->getBackfillBufferFullStatus());
+    EXPECT_TRUE(producer->recordBackfillManagerBytesRead(
+            1, /*force*/ false, /*shared*/ true));
+    producer->recordBackfillManagerBytesSent(1);
+}
+
 class ConnectionTest : public DCPTest {
 protected:
     ENGINE_ERROR_CODE set_vb_state(uint16_t vbid, vbucket_state_t state) {
@@ -1441,6 +1628,24 @@ TEST_F(ConnectionTest, test_mb24424_mutationResponse) {
     destroy_mock_cookie(cookie);
 }
 
+// Check that a mutation sent by reference rather than copied is kept alive by
+// the reference until the engine releases it.
+TEST_F(ConnectionTest, MutationItemReference) {
+    queued_item qi(new Item(make_item(0, makeStoredDocKey("key"), "value")));
+    item* itm;
+    {
+        MutationResponse response(qi, /*opaque*/0, /*isKeyOnly*/false);
+        itm = response.getItemReference();
+        EXPECT_EQ(qi.get(), reinterpret_cast<Item*>(itm));
+        EXPECT_EQ(3, qi.refCount());
+    }
+    EXPECT_EQ(2, qi.refCount());
+    engine_v1->release(handle, nullptr, itm);
+    EXPECT_EQ(1, qi.refCount());
+
+    MutationResponse keyOnly(qi, /*opaque*/0, /*isKeyOnly*/true);
+    EXPECT_THROW(keyOnly.getItemReference(), std::logic_error);
+}
 
 // Test cases which run in both Full and Value eviction
 INSTANTIATE_TEST_CASE_P(PersistentAndEphemeral,
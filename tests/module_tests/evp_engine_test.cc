@@ -147,6 +147,20 @@ TEST_F(EventuallyPersistentEngineTest, requirements_tap) {
             << "Setting \"tap_keepalive\" should be invalid if tap is disabled";
 }
 
+TEST_F(EventuallyPersistentEngineTest, set_flusher_pipeline_enabled) {
+    std::string msg;
+    EXPECT_FALSE(engine->getKVBucket()->isFlusherPipelineEnabled());
+
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS,
+              engine->setFlushParam("flusher_pipeline_enabled", "true", msg));
+    EXPECT_TRUE(engine->getConfiguration().isFlusherPipelineEnabled());
+    EXPECT_TRUE(engine->getKVBucket()->isFlusherPipelineEnabled());
+
+    EXPECT_EQ(PROTOCOL_BINARY_RESPONSE_SUCCESS,
+              engine->setFlushParam("flusher_pipeline_enabled", "false", msg));
+    EXPECT_FALSE(engine->getKVBucket()->isFlusherPipelineEnabled());
+}
+
 // Test cases which run for persistent and ephemeral buckets
 INSTANTIATE_TEST_CASE_P(EphemeralOrPersistent,
                         SetParamTest,
@@ -19,11 +19,14 @@
 #include "evp_store_test.h"
 #include "evp_store_single_threaded_test.h"
 #include "fakes/fake_executorpool.h"
+#include "htresizer.h"
 #include "taskqueue.h"
+#include "../mock/mock_dcp.h"
 #include "../mock/mock_dcp_producer.h"
 #include "../mock/mock_dcp_consumer.h"
 #include "../mock/mock_stream.h"
 #include "programs/engine_testapp/mock_server.h"
+#include "tests/mock/mock_global_task.h"
 #include "tests/module_tests/test_helpers.h"
 #include "tests/module_tests/test_task.h"
 
@@ -1112,3 +1115,305 @@ TEST_F(SingleThreadedEPBucketTest, pre_expiry_xattrs) {
 
     delete get_itm;
 }
+
+// Check that with bg_fetch_max_concurrency > 1 the BGFetcher hands the
+// batches of other vBuckets to BGFetchBatchTasks, fetching only the last one
+// itself, and that those tasks complete the rest.
+TEST_F(SingleThreadedEPBucketTest, ConcurrentBGFetch) {
+    engine->getConfiguration().setBgFetchMaxConcurrency(4);
+
+    // vBuckets in the same shard as vbid, so they share a BGFetcher.
+    const size_t numShards = store->getVBuckets().getNumShards();
+    std::vector<uint16_t> vbids;
+    for (size_t ii = 0; ii < 4; ++ii) {
+        vbids.push_back(vbid + ii * numShards);
+    }
+
+    for (const auto vb : vbids) {
+        setVBucketStateAndRunPersistTask(vb, vbucket_state_active);
+        const auto key = makeStoredDocKey("key_" + std::to_string(vb));
+        store_item(vb, key, "value");
+        flush_vbucket_to_disk(vb);
+        evict_key(vb, key);
+    }
+
+    get_options_t options = static_cast<get_options_t>(
+            QUEUE_BG_FETCH | HONOR_STATES | TRACK_REFERENCE | DELETE_TEMP |
+            HIDE_LOCKED_CAS | TRACK_STATISTICS);
+    for (const auto vb : vbids) {
+        const auto key = makeStoredDocKey("key_" + std::to_string(vb));
+        EXPECT_EQ(ENGINE_EWOULDBLOCK,
+                  store->get(key, vb, cookie, options).getStatus());
+    }
+
+    // Manually run the BGFetcher task; it should only fetch one vBucket's
+    // batch itself.
+    MockGlobalTask mockTask(engine->getTaskable(),
+                            TaskId::MultiBGFetcherTask);
+    store->getVBucket(vbid)->getShard()->getBgFetcher()->run(&mockTask);
+    EXPECT_EQ(1u, engine->getEpStats().bg_fetched.load());
+
+    // The other three are each fetched by a BGFetchBatchTask.
+    auto& lpReaderQ = *task_executor->getLpTaskQ()[READER_TASK_IDX];
+    for (size_t ii = 0; ii < 3; ++ii) {
+        runNextTask(lpReaderQ);
+    }
+
+    for (const auto vb : vbids) {
+        const auto key = makeStoredDocKey("key_" + std::to_string(vb));
+        auto gv = store->get(key, vb, cookie, options);
+        ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus()) << "vb:" << vb;
+        std::unique_ptr<Item> itm(gv.getValue());
+        EXPECT_EQ("value", std::string(itm->getData(), itm->getNBytes()));
+    }
+    EXPECT_EQ(4u, engine->getEpStats().bg_fetched.load());
+}
+
+// Check that with bg_fetch_max_concurrency > 1 a single vBucket's batch is
+// split into sub-batches which are read by BGFetchBatchTasks, each completing
+// its keys as soon as it has read them.
+TEST_F(SingleThreadedEPBucketTest, ConcurrentBGFetchSubBatches) {
+    engine->getConfiguration().setBgFetchMaxConcurrency(4);
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+
+    std::vector<StoredDocKey> keys;
+    for (size_t ii = 0; ii < 4; ++ii) {
+        keys.push_back(makeStoredDocKey("key_" + std::to_string(ii)));
+        store_item(vbid, keys.back(), "value");
+    }
+    flush_vbucket_to_disk(vbid, 4);
+    for (const auto& key : keys) {
+        evict_key(vbid, key);
+    }
+
+    get_options_t options = static_cast<get_options_t>(
+            QUEUE_BG_FETCH | HONOR_STATES | TRACK_REFERENCE | DELETE_TEMP |
+            HIDE_LOCKED_CAS | TRACK_STATISTICS);
+    for (const auto& key : keys) {
+        EXPECT_EQ(ENGINE_EWOULDBLOCK,
+                  store->get(key, vbid, cookie, options).getStatus());
+    }
+
+    // The BGFetcher only reads one sub-batch itself...
+    MockGlobalTask mockTask(engine->getTaskable(),
+                            TaskId::MultiBGFetcherTask);
+    store->getVBucket(vbid)->getShard()->getBgFetcher()->run(&mockTask);
+    EXPECT_EQ(1u, engine->getEpStats().bg_fetched.load());
+
+    // ... and each BGFetchBatchTask completes another.
+    auto& lpReaderQ = *task_executor->getLpTaskQ()[READER_TASK_IDX];
+    for (size_t ii = 0; ii < 3; ++ii) {
+        runNextTask(lpReaderQ);
+        EXPECT_EQ(2u + ii, engine->getEpStats().bg_fetched.load());
+    }
+
+    for (const auto& key : keys) {
+        auto gv = store->get(key, vbid, cookie, options);
+        ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+        std::unique_ptr<Item> itm(gv.getValue());
+        EXPECT_EQ("value", std::string(itm->getData(), itm->getNBytes()));
+    }
+}
+
+// Check that stopping the BGFetcher cancels the BGFetchBatchTasks it handed
+// sub-batches to, so none runs against a stopped (and later deleted)
+// BGFetcher.
+TEST_F(SingleThreadedEPBucketTest, BGFetcherStopCancelsBatchTasks) {
+    engine->getConfiguration().setBgFetchMaxConcurrency(4);
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+
+    std::vector<StoredDocKey> keys;
+    for (size_t ii = 0; ii < 4; ++ii) {
+        keys.push_back(makeStoredDocKey("key_" + std::to_string(ii)));
+        store_item(vbid, keys.back(), "value");
+    }
+    flush_vbucket_to_disk(vbid, 4);
+    for (const auto& key : keys) {
+        evict_key(vbid, key);
+    }
+
+    get_options_t options = static_cast<get_options_t>(
+            QUEUE_BG_FETCH | HONOR_STATES | TRACK_REFERENCE | DELETE_TEMP |
+            HIDE_LOCKED_CAS | TRACK_STATISTICS);
+    for (const auto& key : keys) {
+        EXPECT_EQ(ENGINE_EWOULDBLOCK,
+                  store->get(key, vbid, cookie, options).getStatus());
+    }
+
+    auto* bgfetcher = store->getVBucket(vbid)->getShard()->getBgFetcher();
+    MockGlobalTask mockTask(engine->getTaskable(),
+                            TaskId::MultiBGFetcherTask);
+    bgfetcher->run(&mockTask);
+    bgfetcher->stop();
+
+    // Each of the three BGFetchBatchTasks is dead; remove them without
+    // running them.
+    auto& lpReaderQ = *task_executor->getLpTaskQ()[READER_TASK_IDX];
+    for (size_t ii = 0; ii < 3; ++ii) {
+        CheckedExecutor executor(task_executor, lpReaderQ);
+        EXPECT_TRUE(executor.getCurrentTask()->isdead());
+        executor.completeCurrentTask();
+    }
+    EXPECT_EQ(1u, engine->getEpStats().bg_fetched.load());
+}
+
+/*
+ * Test that a producer sending a batch of messages per step doesn't fail the
+ * step (which would close the connection) when memcached's write buffer fills
+ * part way through the batch, and that the rejected message is sent first
+ * on a later step.
+ */
+TEST_F(SingleThreadedEPBucketTest, ProducerStepBatchE2BIG) {
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+    engine->getConfiguration().setDcpProducerStepBatchItems(64);
+
+    const int numItems = 4;
+    for (int ii = 0; ii < numItems; ++ii) {
+        store_item(vbid, makeStoredDocKey("key" + std::to_string(ii)),
+                   "value");
+    }
+
+    SingleThreadedRCPtr<MockDcpProducer> producer =
+            new MockDcpProducer(*engine,
+                                cookie,
+                                "test_producer",
+                                /*notifyOnly*/ false,
+                                /*startTask*/ false);
+    producer->createCheckpointProcessorTask();
+    auto producers = get_dcp_producers(nullptr, nullptr);
+
+    uint64_t rollbackSeqno;
+    ASSERT_EQ(ENGINE_SUCCESS,
+              producer->streamRequest(/*flags*/ 0,
+                                      /*opaque*/ 0,
+                                      vbid,
+                                      /*start_seqno*/ 0,
+                                      /*end_seqno*/ ~0ull,
+                                      /*vb_uuid*/ 0,
+                                      /*snap_start*/ 0,
+                                      /*snap_end*/ 0,
+                                      &rollbackSeqno,
+                                      fakeDcpAddFailoverLog));
+    auto vb = store->getVBucket(vbid);
+    producer->notifySeqnoAvailable(vbid, vb->getHighSeqno());
+
+    // Step which will notify the snapshot task, then move the checkpoint
+    // into the stream: a snapshot marker and numItems mutations.
+    EXPECT_EQ(ENGINE_SUCCESS, producer->step(producers.get()));
+    producer->getCheckpointSnapshotTask().run();
+
+    // Record the seqno of each message sent (0 for the snapshot marker).
+    std::vector<uint64_t> seqnos;
+    dcp_message_callback = [&seqnos]() {
+        seqnos.push_back(dcp_last_byseqno);
+    };
+
+    // The buffer fills after the marker and first mutation. The step sent
+    // something, so it must ask to be stepped again rather than fail.
+    dcp_e2big_after = 2;
+    EXPECT_EQ(ENGINE_WANT_MORE, producer->step(producers.get()));
+    EXPECT_EQ(std::vector<uint64_t>({0, 1}), seqnos);
+
+    // Still full: the first message of this step is rejected.
+    seqnos.clear();
+    EXPECT_EQ(ENGINE_E2BIG, producer->step(producers.get()));
+    EXPECT_TRUE(seqnos.empty());
+
+    // Once the buffer drains the rejected message goes out first, followed
+    // by the rest of the batch.
+    dcp_e2big_after = -1;
+    EXPECT_EQ(ENGINE_WANT_MORE, producer->step(producers.get()));
+    EXPECT_EQ(std::vector<uint64_t>({2, 3, 4}), seqnos);
+    dcp_message_callback = nullptr;
+
+    producer->closeAllStreams();
+}
+
+// Check that a get whose background fetch fails doesn't leave the cookie
+// marked as waiting to retry the get, so the connection's next get is
+// counted (and other commands don't see a stale engine-specific).
+TEST_F(SingleThreadedEPBucketTest, FailedBGFetchClearsGetRetryMarker) {
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+    const auto key = makeStoredDocKey("key");
+    store_item(vbid, key, "value");
+    flush_vbucket_to_disk(vbid);
+    evict_key(vbid, key);
+
+    get_options_t options = static_cast<get_options_t>(
+            QUEUE_BG_FETCH | HONOR_STATES | TRACK_REFERENCE | DELETE_TEMP |
+            HIDE_LOCKED_CAS | TRACK_STATISTICS);
+    item* itm = nullptr;
+    EXPECT_EQ(ENGINE_EWOULDBLOCK,
+              engine->get(cookie, &itm, key, vbid, options));
+    EXPECT_EQ(1u, engine->getEpStats().cacheMisses.load());
+    EXPECT_NE(nullptr, engine->getEngineSpecific(cookie));
+
+    // The read fails, so memcached reports TMPFAIL without retrying the get.
+    VBucketBGFetchItem fetched{GetValue(nullptr, ENGINE_TMPFAIL),
+                               cookie,
+                               ProcessClock::now(),
+                               /*meta_only*/ false};
+    std::vector<bgfetched_item_t> fetchedItems;
+    fetchedItems.emplace_back(key, &fetched);
+    store->completeBGFetchMulti(vbid, fetchedItems, ProcessClock::now());
+    EXPECT_EQ(nullptr, engine->getEngineSpecific(cookie));
+
+    // The next get on the connection is a new get, and counts again.
+    EXPECT_EQ(ENGINE_EWOULDBLOCK,
+              engine->get(cookie, &itm, key, vbid, options));
+    EXPECT_EQ(2u, engine->getEpStats().cacheMisses.load());
+}
+
+// Check that the HashtableResizerTask backs off, rather than re-running
+// immediately, while a visitor stops it stepping an incremental resize.
+TEST_F(SingleThreadedEPBucketTest, HashtableResizerBacksOffUnderVisitor) {
+    setVBucketStateAndRunPersistTask(vbid, vbucket_state_active);
+    for (int ii = 0; ii < 100; ++ii) {
+        store_item(vbid, makeStoredDocKey("key" + std::to_string(ii)),
+                   "value");
+    }
+
+    auto vb = store->getVBucket(vbid);
+    vb->ht.setResizeStepSize(1);
+    vb->ht.resize(769);
+    ASSERT_TRUE(vb->ht.isResizing());
+
+    // Runs the resizer from within a visit of the table, when no HashTable
+    // locks are held.
+    class ResizerRunningVisitor : public HashTableVisitor {
+    public:
+        ResizerRunningVisitor(GlobalTask& task) : task(task) {
+        }
+
+        void visit(const HashTable::HashBucketLock& lh,
+                   StoredValue* v) override {
+        }
+
+        bool shouldContinue() override {
+            task.run();
+            waketime = task.getWaketime();
+            return false;
+        }
+
+        GlobalTask& task;
+        ProcessClock::time_point waketime;
+    };
+
+    ExTask task = new HashtableResizerTask(store, 0);
+    const auto interval = std::chrono::seconds(
+            engine->getConfiguration().getHtResizeInterval());
+    ASSERT_GT(interval.count(), 0);
+
+    const auto start = ProcessClock::now();
+    ResizerRunningVisitor visitor(*task);
+    vb->ht.visit(visitor);
+    EXPECT_TRUE(vb->ht.isResizing());
+    EXPECT_GE(visitor.waketime, start + interval)
+            << "resizer should back off while the table has a visitor";
+
+    // Without the visitor the resize makes progress, and the task runs
+    // again straight away.
+    task->run();
+    EXPECT_TRUE(vb->ht.isResizing());
+    EXPECT_LT(task->getWaketime(), ProcessClock::now() + interval);
+}
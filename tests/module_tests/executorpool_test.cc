@@ -260,6 +260,77 @@ TEST_F(ExecutorPoolDynamicWorkerTest, reschedule_dead_task) {
     EXPECT_EQ(2, runCount);
 }
 
+/* With the work-stealing scheduler, check that all tasks run to completion -
+ * including tasks which reschedule themselves (and so are held in a thread's
+ * local queue) - with a mix of tasks woken together (taken from the shared
+ * queue in one batch, and stolen by other threads).
+ */
+TEST_F(ExecutorPoolTest, work_stealing_runs_all_tasks) {
+    TestExecutorPool pool(10, // MaxThreads
+                          NUM_TASK_GROUPS,
+                          2, // MaxNumReaders
+                          4, // MaxNumWriters
+                          2, // MaxNumAuxio
+                          2, // MaxNumNonio
+                          /*workStealing*/ true);
+    MockTaskable taskable;
+    pool.registerTaskable(taskable);
+    ASSERT_TRUE(pool.isWorkStealing());
+
+    const size_t numTasks = 100;
+    const int runsPerTask = 10;
+    std::atomic<size_t> runs{0};
+    for (size_t i = 0; i < numTasks; ++i) {
+        auto remaining = std::make_shared<std::atomic<int>>(runsPerTask);
+        pool.schedule(new LambdaTask(
+                taskable, TaskId::StatSnap, 0, true, [&runs, remaining] {
+                    ++runs;
+                    return --(*remaining) > 0;
+                }));
+    }
+
+    pool.waitForEmptyTaskLocator();
+    EXPECT_EQ(numTasks * runsPerTask, runs.load());
+    EXPECT_EQ(0, pool.getNumReadyTasks());
+
+    pool.unregisterTaskable(taskable, false);
+}
+
+/* With TimerWheelFutureQueue task queues, check that tasks which snooze
+ * themselves (and so move around the wheel) all run to completion.
+ */
+TEST_F(ExecutorPoolTest, timer_wheel_runs_all_tasks) {
+    TestExecutorPool pool(10, // MaxThreads
+                          NUM_TASK_GROUPS,
+                          2, // MaxNumReaders
+                          4, // MaxNumWriters
+                          2, // MaxNumAuxio
+                          2, // MaxNumNonio
+                          /*workStealing*/ false,
+                          /*timerWheel*/ true);
+    MockTaskable taskable;
+    pool.registerTaskable(taskable);
+
+    const size_t numTasks = 100;
+    const int runsPerTask = 5;
+    std::atomic<size_t> runs{0};
+    for (size_t i = 0; i < numTasks; ++i) {
+        auto remaining = std::make_shared<std::atomic<int>>(runsPerTask);
+        ExTask task = new LambdaTask(
+                taskable, TaskId::StatSnap, 0, true, [&runs, remaining] {
+                    ++runs;
+                    return --(*remaining) > 0;
+                });
+        pool.schedule(task);
+        pool.snooze(task->getId(), 0.001 * (i % 10));
+    }
+
+    pool.waitForEmptyTaskLocator();
+    EXPECT_EQ(numTasks * runsPerTask, runs.load());
+
+    pool.unregisterTaskable(taskable, false);
+}
+
 /* Testing to ensure that repeatedly scheduling a task does not result in
  * multiple entries in the taskQueue - this could cause a deadlock in
  * _unregisterTaskable when the taskLocator is empty but duplicate tasks remain
@@ -59,13 +59,17 @@ public:
                      size_t maxReaders,
                      size_t maxWriters,
                      size_t maxAuxIO,
-                     size_t maxNonIO)
+                     size_t maxNonIO,
+                     bool workStealing = false,
+                     bool timerWheel = false)
         : ExecutorPool(maxThreads,
                        nTaskSets,
                        maxReaders,
                        maxWriters,
                        maxAuxIO,
-                       maxNonIO) {
+                       maxNonIO,
+                       workStealing,
+                       timerWheel) {
     }
 
     size_t getNumBuckets() {
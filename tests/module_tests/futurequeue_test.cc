@@ -17,48 +17,59 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <climits>
+#include <random>
+#include <vector>
+
 #include "futurequeue.h"
 #include "tests/module_tests/test_task.h"
 
-class FutureQueueTest : public ::testing::TestWithParam<std::string> {
+template <typename Queue>
+class FutureQueueTest : public ::testing::Test {
 public:
-    FutureQueue<> queue;
+    Queue queue;
 };
 
-TEST_F(FutureQueueTest, initAssumptions) {
-    EXPECT_EQ(0u, queue.size());
-    EXPECT_TRUE(queue.empty());
+using FutureQueueTypes =
+        ::testing::Types<FutureQueue<>, TimerWheelFutureQueue>;
+
+TYPED_TEST_CASE(FutureQueueTest, FutureQueueTypes);
+
+TYPED_TEST(FutureQueueTest, initAssumptions) {
+    EXPECT_EQ(0u, this->queue.size());
+    EXPECT_TRUE(this->queue.empty());
 }
 
-TEST_F(FutureQueueTest, push1) {
+TYPED_TEST(FutureQueueTest, push1) {
     ExTask hpTask = new TestTask(nullptr,
                                  TaskId::PendingOpsNotification);
 
-    queue.push(hpTask);
-    EXPECT_EQ(1u, queue.size());
-    EXPECT_FALSE(queue.empty());
+    this->queue.push(hpTask);
+    EXPECT_EQ(1u, this->queue.size());
+    EXPECT_FALSE(this->queue.empty());
 
-    EXPECT_EQ(TaskId::PendingOpsNotification, queue.top()->getTypeId());
+    EXPECT_EQ(TaskId::PendingOpsNotification, this->queue.top()->getTypeId());
 }
 
-TEST_F(FutureQueueTest, pushn) {
+TYPED_TEST(FutureQueueTest, pushn) {
     ExTask hpTask = new TestTask(nullptr,
                                  TaskId::PendingOpsNotification);
 
     const size_t n = 10;
     for (size_t i = 0; i < n; i++) {
-        queue.push(hpTask);
+        this->queue.push(hpTask);
     }
-    EXPECT_EQ(n, queue.size());
-    EXPECT_FALSE(queue.empty());
-    EXPECT_EQ(TaskId::PendingOpsNotification, queue.top()->getTypeId());
+    EXPECT_EQ(n, this->queue.size());
+    EXPECT_FALSE(this->queue.empty());
+    EXPECT_EQ(TaskId::PendingOpsNotification, this->queue.top()->getTypeId());
 }
 
 /*
  * Push n TestTask objects, each with an id of their push order but with
  * a decreasing waketime, i.e. last element pushed has the smallest wakeTime.
  */
-TEST_F(FutureQueueTest, pushOrder) {
+TYPED_TEST(FutureQueueTest, pushOrder) {
     const int n = 10;
     for (int i = 0; i <= n; i++) {
         ExTask hpTask;
@@ -67,11 +78,11 @@ TEST_F(FutureQueueTest, pushOrder) {
                               i);
         const auto newtime = std::chrono::nanoseconds(n - i);
         hpTask->updateWaketime(ProcessClock::time_point(newtime));
-        queue.push(hpTask);
+        this->queue.push(hpTask);
     }
 
     // last task pushed must be the first one in the queue
-    EXPECT_EQ(n, static_cast<TestTask*>(queue.top().get())->order);
+    EXPECT_EQ(n, static_cast<TestTask*>(this->queue.top().get())->order);
 }
 
 /*
@@ -81,7 +92,7 @@ TEST_F(FutureQueueTest, pushOrder) {
  * Then use the queue updateWake time to move a task to the front
  *
  */
-TEST_F(FutureQueueTest, updateWaketime) {
+TYPED_TEST(FutureQueueTest, updateWaketime) {
     const int n = 10;
     ExTask middleTask;
     for (int i = 0; i <= n; i++) {
@@ -91,7 +102,7 @@ TEST_F(FutureQueueTest, updateWaketime) {
                               i);
         const auto newtime = std::chrono::nanoseconds((n * 2) - i);
         hpTask->updateWaketime(ProcessClock::time_point(newtime));
-        queue.push(hpTask);
+        this->queue.push(hpTask);
 
         if (i == n/2) {
             middleTask = hpTask;
@@ -101,17 +112,17 @@ TEST_F(FutureQueueTest, updateWaketime) {
     ASSERT_NE(nullptr, middleTask.get());
 
     // last task pushed must be the first one in the queue
-    EXPECT_EQ(n, static_cast<TestTask*>(queue.top().get())->order);
+    EXPECT_EQ(n, static_cast<TestTask*>(this->queue.top().get())->order);
     EXPECT_NE(static_cast<TestTask*>(middleTask.get())->order,
-              static_cast<TestTask*>(queue.top().get())->order);
+              static_cast<TestTask*>(this->queue.top().get())->order);
 
     // Now update the n/2 task's time and expect it to become the front task
-    EXPECT_TRUE(queue.updateWaketime(middleTask,
+    EXPECT_TRUE(this->queue.updateWaketime(middleTask,
                                      ProcessClock::time_point::min()));
 
-    // Now the middleTask is queue.top
+    // Now the middleTask is this->queue.top
     EXPECT_EQ(static_cast<TestTask*>(middleTask.get())->order,
-              static_cast<TestTask*>(queue.top().get())->order);
+              static_cast<TestTask*>(this->queue.top().get())->order);
 }
 
 /*
@@ -121,7 +132,7 @@ TEST_F(FutureQueueTest, updateWaketime) {
  * Then use the snooze method to move a task from the front
  *
  */
-TEST_F(FutureQueueTest, snooze) {
+TYPED_TEST(FutureQueueTest, snooze) {
     const int n = 10;
 
     for (int i = 0; i <= n; i++) {
@@ -131,26 +142,26 @@ TEST_F(FutureQueueTest, snooze) {
                               i);
         const auto newtime = std::chrono::nanoseconds((n * 2) - i);
         hpTask->updateWaketime(ProcessClock::time_point(newtime));
-        queue.push(hpTask);
+        this->queue.push(hpTask);
     }
 
     // Now update the top task's time and expect it to become the last task
     // we can't see the back, so will pop/top all..
-    int top = static_cast<TestTask*>(queue.top().get())->order;
-    EXPECT_TRUE(queue.snooze(queue.top(), n*3));
+    int top = static_cast<TestTask*>(this->queue.top().get())->order;
+    EXPECT_TRUE(this->queue.snooze(this->queue.top(), n*3));
 
     // The top task is not the old top
     EXPECT_NE(top,
-              static_cast<TestTask*>(queue.top().get())->order);
+              static_cast<TestTask*>(this->queue.top().get())->order);
 
     ExTask lastTask;
-    while (!queue.empty()) {
+    while (!this->queue.empty()) {
         if (lastTask) {
             EXPECT_LT(lastTask->getWaketime(),
-                      queue.top()->getWaketime());
+                      this->queue.top()->getWaketime());
         }
-        lastTask = queue.top();
-        queue.pop();
+        lastTask = this->queue.top();
+        this->queue.pop();
     }
 
     EXPECT_EQ(top, static_cast<TestTask*>(lastTask.get())->order);
@@ -159,62 +170,194 @@ TEST_F(FutureQueueTest, snooze) {
 /*
  * snooze/wake a task not in the queue, the queue is also empty.
  */
-TEST_F(FutureQueueTest, taskNotInEmptyQueue) {
+TYPED_TEST(FutureQueueTest, taskNotInEmptyQueue) {
     ExTask task = new TestTask(nullptr, TaskId::PendingOpsNotification);
 
     const auto wake = task->getWaketime();
-    queue.snooze(task, 5.0);
+    this->queue.snooze(task, 5.0);
     // snooze uses gethrtime so we'll only check that the tasks time changed.
     EXPECT_NE(wake, task->getWaketime());
 
-    EXPECT_EQ(0u, queue.size());
-    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(0u, this->queue.size());
+    EXPECT_TRUE(this->queue.empty());
 
     const auto newtime = std::chrono::nanoseconds(5);
-    EXPECT_FALSE(queue.updateWaketime(task, ProcessClock::time_point(newtime)));
+    EXPECT_FALSE(this->queue.updateWaketime(task,
+                                            ProcessClock::time_point(newtime)));
     EXPECT_EQ(ProcessClock::time_point(std::chrono::nanoseconds(5)),
               task->getWaketime());
 
-    EXPECT_EQ(0u, queue.size());
-    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(0u, this->queue.size());
+    EXPECT_TRUE(this->queue.empty());
 }
 
 /*
  * snooze/wake a task not in the queue
  */
-TEST_F(FutureQueueTest, taskNotInQueue) {
+TYPED_TEST(FutureQueueTest, taskNotInQueue) {
     const size_t nTasks = 5;
     for (size_t ii = 1; ii < nTasks; ii++) {
         ExTask t = new TestTask(nullptr, TaskId::PendingOpsNotification);
         const auto newtime = std::chrono::nanoseconds(1+ii);
         t->updateWaketime(ProcessClock::time_point(newtime));
-        queue.push(t);
+        this->queue.push(t);
     }
     // Finally push a task with an obvious ID value of -1
     ExTask task = new TestTask(nullptr, TaskId::PendingOpsNotification, -1);
     task->updateWaketime(ProcessClock::time_point::min());
-    queue.push(task);
+    this->queue.push(task);
 
     // Now operate with a new task not in the queue
     task = new TestTask(nullptr, TaskId::PendingOpsNotification);
     const auto wake = task->getWaketime();
-    EXPECT_FALSE(queue.snooze(task, 5.0));
+    EXPECT_FALSE(this->queue.snooze(task, 5.0));
 
     // snooze uses gethrtime so we'll only check that the tasks time changed.
     EXPECT_NE(wake, task->getWaketime());
 
-    EXPECT_EQ(nTasks, queue.size());
-    EXPECT_FALSE(queue.empty());
+    EXPECT_EQ(nTasks, this->queue.size());
+    EXPECT_FALSE(this->queue.empty());
     EXPECT_EQ(-1,
-              static_cast<TestTask*>(queue.top().get())->order);
+              static_cast<TestTask*>(this->queue.top().get())->order);
 
     const auto newtime = std::chrono::nanoseconds(5);
-    EXPECT_FALSE(queue.updateWaketime(task, ProcessClock::time_point(newtime)));
+    EXPECT_FALSE(this->queue.updateWaketime(task,
+                                            ProcessClock::time_point(newtime)));
     EXPECT_EQ(ProcessClock::time_point(std::chrono::nanoseconds(5)),
               task->getWaketime());
 
-    EXPECT_EQ(nTasks, queue.size());
-    EXPECT_FALSE(queue.empty());
+    EXPECT_EQ(nTasks, this->queue.size());
+    EXPECT_FALSE(this->queue.empty());
     EXPECT_EQ(-1,
-              static_cast<TestTask*>(queue.top().get())->order);
+              static_cast<TestTask*>(this->queue.top().get())->order);
+}
+
+/*
+ * Push tasks with wake times spread from nanoseconds to years apart (so they
+ * occupy every level of a timer wheel) in a random order, and check they are
+ * popped in waketime order.
+ */
+TYPED_TEST(FutureQueueTest, manyTasksOrdered) {
+    std::vector<ProcessClock::duration> offsets;
+    for (int shift = 2; shift < 60; shift++) {
+        offsets.push_back(std::chrono::nanoseconds(int64_t(1) << shift));
+        offsets.push_back(std::chrono::nanoseconds((int64_t(1) << shift) + 1));
+    }
+    std::mt19937 gen(1);
+    std::shuffle(offsets.begin(), offsets.end(), gen);
+
+    const auto now = ProcessClock::now();
+    for (size_t i = 0; i < offsets.size(); i++) {
+        ExTask task =
+                new TestTask(nullptr, TaskId::PendingOpsNotification, i);
+        task->updateWaketime(now + offsets[i]);
+        this->queue.push(task);
+    }
+    EXPECT_EQ(offsets.size(), this->queue.size());
+
+    ExTask lastTask;
+    while (!this->queue.empty()) {
+        if (lastTask) {
+            EXPECT_LT(lastTask->getWaketime(),
+                      this->queue.top()->getWaketime());
+        }
+        lastTask = this->queue.top();
+        this->queue.pop();
+    }
+}
+
+/*
+ * Tasks snoozed forever must stay behind tasks pushed later with an earlier
+ * waketime, and can be brought forward again by updateWaketime.
+ */
+TYPED_TEST(FutureQueueTest, snoozeForever) {
+    ExTask forever = new TestTask(nullptr, TaskId::PendingOpsNotification, 1);
+    forever->snooze(INT_MAX);
+    this->queue.push(forever);
+    EXPECT_EQ(1, static_cast<TestTask*>(this->queue.top().get())->order);
+
+    ExTask soon = new TestTask(nullptr, TaskId::PendingOpsNotification, 2);
+    soon->updateWaketime(ProcessClock::now() + std::chrono::seconds(1));
+    this->queue.push(soon);
+    EXPECT_EQ(2, static_cast<TestTask*>(this->queue.top().get())->order);
+
+    // Wake the forever task; it should now be first.
+    EXPECT_TRUE(this->queue.updateWaketime(forever, ProcessClock::now()));
+    EXPECT_EQ(1, static_cast<TestTask*>(this->queue.top().get())->order);
+    this->queue.pop();
+    EXPECT_EQ(2, static_cast<TestTask*>(this->queue.top().get())->order);
+    this->queue.pop();
+    EXPECT_TRUE(this->queue.empty());
+}
+
+/*
+ * A task pushed more than once is moved (each time it appears) by
+ * updateWaketime.
+ */
+TYPED_TEST(FutureQueueTest, updateWaketimeDuplicate) {
+    const auto now = ProcessClock::now();
+    ExTask other = new TestTask(nullptr, TaskId::PendingOpsNotification, 1);
+    other->updateWaketime(now + std::chrono::seconds(10));
+    this->queue.push(other);
+
+    ExTask task = new TestTask(nullptr, TaskId::PendingOpsNotification, 2);
+    task->updateWaketime(now + std::chrono::seconds(20));
+    this->queue.push(task);
+    this->queue.push(task);
+
+    EXPECT_TRUE(this->queue.updateWaketime(task, now));
+    EXPECT_EQ(3u, this->queue.size());
+    EXPECT_EQ(2, static_cast<TestTask*>(this->queue.top().get())->order);
+    this->queue.pop();
+    EXPECT_EQ(2, static_cast<TestTask*>(this->queue.top().get())->order);
+    this->queue.pop();
+    EXPECT_EQ(1, static_cast<TestTask*>(this->queue.top().get())->order);
+}
+
+/*
+ * A task can only be in one TimerWheelFutureQueue at a time, and can be
+ * pushed to another once popped.
+ */
+TEST(TimerWheelFutureQueueTest, oneQueueAtATime) {
+    TimerWheelFutureQueue first;
+    TimerWheelFutureQueue second;
+    ExTask task = new TestTask(nullptr, TaskId::PendingOpsNotification);
+
+    first.push(task);
+    EXPECT_THROW(second.push(task), std::logic_error);
+    EXPECT_TRUE(second.empty());
+
+    first.pop();
+    EXPECT_TRUE(first.empty());
+    second.push(task);
+    EXPECT_EQ(1u, second.size());
+}
+
+/*
+ * A task snoozed forever pushed to an empty queue must not become the base
+ * of the wheel, leaving every sooner task in the due heap.
+ */
+TEST(TimerWheelFutureQueueTest, snoozeForeverFirstUsesWheel) {
+    TimerWheelFutureQueue queue;
+    ExTask forever = new TestTask(nullptr, TaskId::PendingOpsNotification, 0);
+    forever->snooze(INT_MAX);
+    queue.push(forever);
+    EXPECT_EQ(0u, queue.getNumDue());
+
+    const auto now = ProcessClock::now();
+    std::vector<ExTask> tasks;
+    for (int i = 1; i <= 10; i++) {
+        ExTask task = new TestTask(nullptr, TaskId::PendingOpsNotification, i);
+        task->updateWaketime(now + std::chrono::seconds(i));
+        queue.push(task);
+        tasks.push_back(task);
+    }
+    EXPECT_EQ(0u, queue.getNumDue());
+    EXPECT_EQ(11u, queue.size());
+
+    for (int i = 1; i <= 10; i++) {
+        EXPECT_EQ(i, static_cast<TestTask*>(queue.top().get())->order);
+        queue.pop();
+    }
+    EXPECT_EQ(0, static_cast<TestTask*>(queue.top().get())->order);
 }
@@ -31,6 +31,7 @@
 #include <algorithm>
 #include <limits>
 #include <signal.h>
+#include <thread>
 
 EPStats global_stats;
 
@@ -249,6 +250,70 @@ TEST_F(HashTableTest, Resize) {
     verifyFound(h, keys);
 }
 
+TEST_F(HashTableTest, IncrementalResize) {
+    HashTable h(global_stats, makeFactory(), 5, 3);
+    h.setResizeStepSize(2);
+
+    auto keys = generateKeys(1000);
+    storeMany(h, keys);
+    const size_t memOverhead = global_stats.memOverhead.load();
+
+    h.resize(769);
+    ASSERT_TRUE(h.isResizing());
+    EXPECT_EQ(769, h.getResizeTargetSize());
+    EXPECT_EQ(5, h.getSize());
+    EXPECT_EQ(memOverhead + 769 * sizeof(StoredValue*),
+              global_stats.memOverhead.load());
+
+    // A second resize request is ignored until the first completes.
+    h.resize(6143);
+    EXPECT_EQ(769, h.getResizeTargetSize());
+
+    // Items must remain visible in both tables mid-resize.
+    EXPECT_TRUE(h.resizeStep());
+    verifyFound(h, keys);
+    EXPECT_EQ(1000, count(h));
+
+    // Items added and removed mid-resize are routed to the correct table.
+    auto extraKeys = generateKeys(1100, 1000);
+    storeMany(h, extraKeys);
+    verifyFound(h, extraKeys);
+    for (const auto& key : extraKeys) {
+        EXPECT_TRUE(del(h, key));
+    }
+
+    // Step 2 slots at a time; 5 slots needs 2 more steps.
+    EXPECT_TRUE(h.resizeStep());
+    EXPECT_TRUE(h.isResizing());
+    EXPECT_TRUE(h.resizeStep());
+    EXPECT_FALSE(h.isResizing());
+    EXPECT_FALSE(h.resizeStep());
+    EXPECT_EQ(769, h.getSize());
+    EXPECT_EQ(1, h.getNumResizes());
+    EXPECT_EQ(memOverhead + (769 - 5) * sizeof(StoredValue*),
+              global_stats.memOverhead.load());
+
+    verifyFound(h, keys);
+    EXPECT_EQ(1000, count(h));
+}
+
+TEST_F(HashTableTest, IncrementalResizeClear) {
+    HashTable h(global_stats, makeFactory(), 5, 3);
+    h.setResizeStepSize(1);
+
+    auto keys = generateKeys(100);
+    storeMany(h, keys);
+
+    h.resize(97);
+    ASSERT_TRUE(h.resizeStep());
+
+    // Clearing mid-resize completes the resize and empties both tables.
+    h.clear();
+    EXPECT_FALSE(h.isResizing());
+    EXPECT_EQ(97, h.getSize());
+    EXPECT_EQ(0, count(h));
+}
+
 class AccessGenerator : public Generator<bool> {
 public:
 
@@ -271,6 +336,9 @@ private:
 
     void resize() {
         ht.resize(size);
+        // No-op unless incremental resizing is enabled.
+        while (ht.resizeStep()) {
+        }
         size = size == 1000 ? 3000 : 1000;
     }
 
@@ -293,6 +361,159 @@ TEST_F(HashTableTest, ConcurrentAccessResize) {
     getCompletedThreads(4, &gen);
 }
 
+TEST_F(HashTableTest, ConcurrentAccessIncrementalResize) {
+    HashTable h(global_stats, makeFactory(), 5, 3);
+    h.setResizeStepSize(7);
+
+    auto keys = generateKeys(2000);
+    h.resize(keys.size());
+    while (h.resizeStep()) {
+    }
+    storeMany(h, keys);
+
+    verifyFound(h, keys);
+
+    srand(918475);
+    AccessGenerator gen(keys, h);
+    getCompletedThreads(4, &gen);
+}
+
+TEST_F(HashTableTest, TagIndexFind) {
+    HashTable h(global_stats, makeFactory(), 47, 3);
+    h.enableTagIndex();
+    ASSERT_TRUE(h.isTagIndexEnabled());
+    testFind(h);
+}
+
+// With a tiny table every index line overflows; check lookups still work
+// (by falling back to the chain) and that lines recover as items are removed.
+TEST_F(HashTableTest, TagIndexOverflow) {
+    HashTable h(global_stats, makeFactory(), 5, 1);
+    h.enableTagIndex();
+
+    auto keys = generateKeys(1000);
+    storeMany(h, keys);
+    verifyFound(h, keys);
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ASSERT_TRUE(del(h, keys[i]));
+        // Spot-check the remaining keys as we shrink back within capacity.
+        if (i > keys.size() - 20) {
+            verifyFound(h, {keys.begin() + i + 1, keys.end()});
+        }
+    }
+    EXPECT_EQ(0, count(h));
+}
+
+// Existing items are indexed when the tag index is enabled later.
+TEST_F(HashTableTest, TagIndexEnableWithItems) {
+    HashTable h(global_stats, makeFactory(), 769, 3);
+    auto keys = generateKeys(500);
+    storeMany(h, keys);
+
+    h.enableTagIndex();
+    verifyFound(h, keys);
+}
+
+TEST_F(HashTableTest, TagIndexResize) {
+    HashTable h(global_stats, makeFactory(), 5, 3);
+    h.enableTagIndex();
+
+    auto keys = generateKeys(1000);
+    storeMany(h, keys);
+
+    h.resize(769);
+    EXPECT_EQ(769, h.getSize());
+    verifyFound(h, keys);
+
+    // And incrementally, checking lookups mid-way.
+    h.setResizeStepSize(100);
+    h.resize(97);
+    ASSERT_TRUE(h.resizeStep());
+    verifyFound(h, keys);
+    while (h.resizeStep()) {
+    }
+    EXPECT_EQ(97, h.getSize());
+    verifyFound(h, keys);
+
+    for (const auto& key : keys) {
+        EXPECT_TRUE(del(h, key));
+    }
+    EXPECT_EQ(0, count(h));
+}
+
+// Lookups via a read-locked bucket should see the same items as find().
+TEST_F(HashTableTest, SharedReadsFind) {
+    HashTable h(global_stats,
+                makeFactory(),
+                47,
+                3,
+                HashTable::LockMode::SharedReads);
+    ASSERT_EQ(HashTable::LockMode::SharedReads, h.getLockMode());
+    testFind(h);
+
+    auto keys = generateKeys(100);
+    storeMany(h, keys);
+    for (const auto& key : keys) {
+        auto rlh = h.getReadLockedBucket(key);
+        EXPECT_TRUE(h.unlocked_find(key,
+                                    rlh.getBucketNum(),
+                                    WantsDeleted::No,
+                                    TrackReference::No));
+    }
+    auto rlh = h.getReadLockedBucket(makeStoredDocKey("aMissingKey"));
+    EXPECT_FALSE(h.unlocked_find(makeStoredDocKey("aMissingKey"),
+                                 rlh.getBucketNum(),
+                                 WantsDeleted::No,
+                                 TrackReference::No));
+}
+
+// In SharedReads mode a reader must not block another reader of the same
+// bucket.
+TEST_F(HashTableTest, SharedReadLocksDoNotBlock) {
+    HashTable h(global_stats,
+                makeFactory(),
+                5,
+                1,
+                HashTable::LockMode::SharedReads);
+    auto key = makeStoredDocKey("key");
+    store(h, key);
+
+    auto rlh = h.getReadLockedBucket(key);
+    ASSERT_TRUE(rlh.ownsLock());
+    std::thread reader([&h, &key]() {
+        auto other = h.getReadLockedBucket(key);
+        EXPECT_TRUE(h.unlocked_find(key,
+                                    other.getBucketNum(),
+                                    WantsDeleted::No,
+                                    TrackReference::Yes));
+    });
+    reader.join();
+
+    rlh.unlock();
+    EXPECT_FALSE(rlh.ownsLock());
+    // With the read lock released, writers can proceed.
+    EXPECT_TRUE(del(h, key));
+}
+
+TEST_F(HashTableTest, ConcurrentAccessSharedReads) {
+    HashTable h(global_stats,
+                makeFactory(),
+                5,
+                3,
+                HashTable::LockMode::SharedReads);
+
+    auto keys = generateKeys(2000);
+    h.resize(keys.size());
+    storeMany(h, keys);
+
+    verifyFound(h, keys);
+
+    srand(918475);
+    AccessGenerator gen(keys, h);
+    getCompletedThreads(4, &gen);
+}
+
 TEST_F(HashTableTest, AutoResize) {
     HashTable h(global_stats, makeFactory(), 5, 3);
 
@@ -308,6 +529,30 @@ TEST_F(HashTableTest, AutoResize) {
     verifyFound(h, keys);
 }
 
+// Presizing picks the size resize() would for that many items, and resizes
+// at once even if incremental resizing is enabled.
+TEST_F(HashTableTest, Presize) {
+    HashTable h(global_stats, makeFactory(), 5, 3);
+    h.setResizeStepSize(2);
+
+    h.presize(1000);
+    EXPECT_FALSE(h.isResizing());
+    EXPECT_EQ(769, h.getSize());
+    EXPECT_EQ(1, h.getNumResizes());
+
+    auto keys = generateKeys(1000);
+    storeMany(h, keys);
+    verifyFound(h, keys);
+
+    // No resize is needed once the items are added, and presizing never
+    // shrinks the table.
+    h.resize();
+    EXPECT_FALSE(h.isResizing());
+    h.presize(10);
+    EXPECT_EQ(769, h.getSize());
+    EXPECT_EQ(1, h.getNumResizes());
+}
+
 TEST_F(HashTableTest, DepthCounting) {
     HashTable h(global_stats, makeFactory(), 5, 1);
     const int nkeys = 5000;
@@ -440,6 +685,87 @@ TEST_F(HashTableTest, SizeStatsEjectFlush) {
     cb_free(someval);
 }
 
+// Check the compressed / uncompressed value sizes follow snappy-compressed
+// values as they are stored, replaced, ejected and restored.
+TEST_F(HashTableTest, CompressedValueSize) {
+    HashTable ht(global_stats, makeFactory(), 5, 1);
+
+    StoredDocKey key = makeStoredDocKey("somekey");
+    const std::string value(4096, 'x');
+    Item compressed(key, 0, 0, value.data(), value.size());
+    ASSERT_TRUE(compressed.compressValue());
+    ASSERT_TRUE(mcbp::datatype::is_snappy(compressed.getDataType()));
+    const size_t compressedSize = compressed.getNBytes();
+    ASSERT_LT(compressedSize, value.size());
+
+    EXPECT_EQ(MutationStatus::WasClean, ht.set(compressed));
+    EXPECT_EQ(compressedSize, ht.getCompressedValueSize());
+    EXPECT_EQ(value.size(), ht.getUncompressedValueSize());
+    EXPECT_EQ(1,
+              ht.datatypeCounts[PROTOCOL_BINARY_DATATYPE_SNAPPY].items.load());
+
+    // Replacing with an uncompressed value removes it from the sizes.
+    Item uncompressed(key, 0, 0, value.data(), value.size());
+    EXPECT_EQ(MutationStatus::WasDirty, ht.set(uncompressed));
+    EXPECT_EQ(0, ht.getCompressedValueSize());
+    EXPECT_EQ(0, ht.getUncompressedValueSize());
+    EXPECT_EQ(0,
+              ht.datatypeCounts[PROTOCOL_BINARY_DATATYPE_SNAPPY].items.load());
+
+    // Ejecting the value does too...
+    EXPECT_EQ(MutationStatus::WasDirty, ht.set(compressed));
+    StoredValue* v(ht.find(key, TrackReference::No, WantsDeleted::No));
+    ASSERT_TRUE(v);
+    v->markClean();
+    EXPECT_TRUE(ht.unlocked_ejectItem(v, VALUE_ONLY));
+    EXPECT_EQ(0, ht.getCompressedValueSize());
+    EXPECT_EQ(0, ht.getUncompressedValueSize());
+
+    // ... and restoring it puts it back.
+    {
+        auto hbl = ht.getLockedBucket(key);
+        EXPECT_TRUE(ht.unlocked_restoreValue(hbl.getHTLock(), compressed, *v));
+    }
+    EXPECT_EQ(compressedSize, ht.getCompressedValueSize());
+    EXPECT_EQ(value.size(), ht.getUncompressedValueSize());
+
+    del(ht, key);
+    EXPECT_EQ(0, ht.getCompressedValueSize());
+    EXPECT_EQ(0, ht.getUncompressedValueSize());
+}
+
+// A value whose datatype claims SNAPPY but whose body is not valid snappy
+// counts as its own length, rather than failing the mutation part way
+// through updating the stats.
+TEST_F(HashTableTest, InvalidSnappyValueSize) {
+    HashTable ht(global_stats, makeFactory(), 5, 1);
+
+    StoredDocKey key = makeStoredDocKey("somekey");
+    const std::string value("not snappy");
+    Item item(key, 0, 0, value.data(), value.size());
+    item.setDataType(PROTOCOL_BINARY_DATATYPE_SNAPPY);
+    const size_t cacheSize = ht.cacheSize;
+
+    EXPECT_EQ(MutationStatus::WasClean, ht.set(item));
+    EXPECT_EQ(value.size(), ht.getCompressedValueSize());
+    EXPECT_EQ(value.size(), ht.getUncompressedValueSize());
+    EXPECT_LT(cacheSize, ht.cacheSize.load());
+
+    // Replacing it keeps the stats consistent.
+    Item uncompressed(key, 0, 0, value.data(), value.size());
+    EXPECT_EQ(MutationStatus::WasDirty, ht.set(uncompressed));
+    EXPECT_EQ(0, ht.getCompressedValueSize());
+    EXPECT_EQ(value.size(),
+              ht.datatypeCounts[PROTOCOL_BINARY_DATATYPE_RAW_BYTES]
+                      .valueSize.load());
+
+    del(ht, key);
+    EXPECT_EQ(0,
+              ht.datatypeCounts[PROTOCOL_BINARY_DATATYPE_RAW_BYTES]
+                      .valueSize.load());
+    EXPECT_EQ(cacheSize, ht.cacheSize.load());
+}
+
 TEST_F(HashTableTest, ItemAge) {
     // Setup
     HashTable ht(global_stats, makeFactory(), 5, 1);
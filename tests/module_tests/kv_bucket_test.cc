@@ -593,6 +593,89 @@ TEST_P(KVBucketParamTest, mb22824) {
     EXPECT_EQ(itemMeta1.cas, itemMeta2.cas);
 }
 
+// Check that with compression_mode=active incoming values are held
+// snappy-compressed in the HashTable, and that incompressible values are
+// left alone.
+TEST_P(KVBucketParamTest, CompressionModeActive) {
+    engine->getConfiguration().setCompressionMode("active");
+
+    auto key = makeStoredDocKey("key");
+    const std::string value(4096, 'x');
+    store_item(vbid, key, value);
+
+    auto vb = store->getVBucket(vbid);
+    auto* v = vb->ht.find(key, TrackReference::No, WantsDeleted::No);
+    ASSERT_TRUE(v);
+    EXPECT_EQ(PROTOCOL_BINARY_DATATYPE_JSON | PROTOCOL_BINARY_DATATYPE_SNAPPY,
+              v->getDatatype());
+    EXPECT_LT(v->getValue()->vlength(), value.size());
+    EXPECT_EQ(value.size(), v->getValue()->getUncompressedLength());
+    EXPECT_EQ(v->getValue()->vlength(), vb->ht.getCompressedValueSize());
+
+    // A GET hands back the compressed value; it inflates to the original.
+    auto options = static_cast<get_options_t>(QUEUE_BG_FETCH | HONOR_STATES);
+    GetValue gv = store->get(key, vbid, cookie, options);
+    ASSERT_EQ(ENGINE_SUCCESS, gv.getStatus());
+    std::unique_ptr<Item> item(gv.getValue());
+    EXPECT_TRUE(mcbp::datatype::is_snappy(item->getDataType()));
+    ASSERT_TRUE(item->decompressValue());
+    EXPECT_EQ(value, std::string(item->getData(), item->getNBytes()));
+
+    // A value which does not compress by compression_min_ratio is stored
+    // uncompressed.
+    auto key2 = makeStoredDocKey("key2");
+    store_item(vbid, key2, "v");
+    v = vb->ht.find(key2, TrackReference::No, WantsDeleted::No);
+    ASSERT_TRUE(v);
+    EXPECT_FALSE(mcbp::datatype::is_snappy(v->getDatatype()));
+
+    // With compression_mode=off new values are stored as received.
+    engine->getConfiguration().setCompressionMode("off");
+    store_item(vbid, key, value);
+    v = vb->ht.find(key, TrackReference::No, WantsDeleted::No);
+    ASSERT_TRUE(v);
+    EXPECT_FALSE(mcbp::datatype::is_snappy(v->getDatatype()));
+    EXPECT_EQ(0, vb->ht.getCompressedValueSize());
+}
+
+class InlineValueTest : public KVBucketTest {
+    void SetUp() override {
+        config_string += "ht_inline_value_max_size=64";
+        KVBucketTest::SetUp();
+        store->setVBucketState(vbid, vbucket_state_active, false);
+    }
+};
+
+// A deleted StoredValue's allocation is kept (and accounted as pinned) while
+// an Item still references its inline value.
+TEST_F(InlineValueTest, PinnedStorageAccounted) {
+    auto key = makeStoredDocKey("key");
+    store_item(vbid, key, "value");
+    auto vb = store->getVBucket(vbid);
+    auto& stats = engine->getEpStats();
+
+    auto* v = vb->ht.find(key, TrackReference::No, WantsDeleted::No);
+    ASSERT_TRUE(v);
+    ASSERT_TRUE(v->isValueInline());
+    const size_t pinned = v->getObjectSize() + v->getInlineCapacity() -
+                          v->getValue()->getSize();
+    auto item = v->toItem(false, vbid);
+    EXPECT_EQ(0, stats.inlineStoragePinned.load());
+
+    const size_t memUsed = stats.currentSize.load();
+    {
+        auto hbl = vb->ht.getLockedBucket(key);
+        vb->ht.unlocked_del(hbl, key);
+    }
+    EXPECT_EQ(pinned, stats.inlineStoragePinned.load());
+    EXPECT_EQ("value", item->getValue()->to_s());
+
+    // Releasing the value frees the rest of the allocation.
+    item.reset();
+    EXPECT_EQ(0, stats.inlineStoragePinned.load());
+    EXPECT_GT(memUsed, stats.currentSize.load());
+}
+
 // Test cases which run for EP (Full and Value eviction) and Ephemeral
 INSTANTIATE_TEST_CASE_P(EphemeralOrPersistent,
                         KVBucketParamTest,
@@ -383,6 +383,85 @@ TEST_F(CouchKVStoreTest, MB_18580_ENOENT) {
     EXPECT_THROW(kvstore.ro->getDbFileInfo(0), std::system_error);
 }
 
+// Verify the read-only store re-uses its file handle for reads, and that a
+// commit by the read-write store means the next read re-opens the file (and
+// so sees the commit).
+TEST_F(CouchKVStoreTest, ReadHandleCache) {
+    KVStoreConfig config(
+            1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
+    auto kvstore = KVStoreFactory::create(config);
+    ASSERT_NE(nullptr, kvstore.ro);
+    initialize_kv_store(kvstore.rw.get());
+
+    WriteCallback wc;
+    kvstore.rw->begin();
+    Item item1(makeStoredDocKey("key1"), 0, 0, "value", 5);
+    kvstore.rw->set(item1, wc);
+    ASSERT_TRUE(kvstore.rw->commit(nullptr /*no collections manifest*/));
+
+    GetCallback gc;
+    kvstore.ro->get(item1.getKey(), 0, gc);
+    kvstore.ro->get(item1.getKey(), 0, gc);
+
+    std::map<std::string, std::string> stats;
+    kvstore.ro->addStats(add_stat_callback, &stats);
+    EXPECT_EQ("1", stats["ro_0:read_handle_misses"]);
+    EXPECT_EQ("1", stats["ro_0:read_handle_hits"]);
+    EXPECT_EQ("0", stats["ro_0:read_handle_reopens"]);
+
+    // A new commit must be visible to the next read.
+    kvstore.rw->begin();
+    Item item2(makeStoredDocKey("key2"), 0, 0, "value", 5);
+    kvstore.rw->set(item2, wc);
+    ASSERT_TRUE(kvstore.rw->commit(nullptr /*no collections manifest*/));
+
+    kvstore.ro->get(item2.getKey(), 0, gc);
+
+    stats.clear();
+    kvstore.ro->addStats(add_stat_callback, &stats);
+    EXPECT_EQ("2", stats["ro_0:read_handle_misses"]);
+    EXPECT_EQ("1", stats["ro_0:read_handle_hits"]);
+    EXPECT_EQ("1", stats["ro_0:read_handle_reopens"]);
+}
+
+// Verify compaction closes the read-only store's cached handle on the old
+// file straight away (rather than on the next read), so the unlinked file
+// isn't held open.
+TEST_F(CouchKVStoreTest, ReadHandleClosedOnCompaction) {
+    KVStoreConfig config(
+            1024, 4, data_dir, "couchdb", 0, false /*persistnamespace*/);
+    auto kvstore = KVStoreFactory::create(config);
+    ASSERT_NE(nullptr, kvstore.ro);
+    initialize_kv_store(kvstore.rw.get());
+
+    WriteCallback wc;
+    kvstore.rw->begin();
+    Item item(makeStoredDocKey("key"), 0, 0, "value", 5);
+    kvstore.rw->set(item, wc);
+    ASSERT_TRUE(kvstore.rw->commit(nullptr /*no collections manifest*/));
+
+    GetCallback gc;
+    kvstore.ro->get(item.getKey(), 0, gc);
+
+    compaction_ctx cctx;
+    cctx.purge_before_seq = 0;
+    cctx.purge_before_ts = 0;
+    cctx.curr_time = 0;
+    cctx.drop_deletes = 0;
+    cctx.db_file_id = 0;
+    ASSERT_TRUE(kvstore.rw->compactDB(&cctx));
+
+    // The next read opens the new file; there was no stale handle left to
+    // drop.
+    kvstore.ro->get(item.getKey(), 0, gc);
+
+    std::map<std::string, std::string> stats;
+    kvstore.ro->addStats(add_stat_callback, &stats);
+    EXPECT_EQ("2", stats["ro_0:read_handle_misses"]);
+    EXPECT_EQ("0", stats["ro_0:read_handle_hits"]);
+    EXPECT_EQ("0", stats["ro_0:read_handle_reopens"]);
+}
+
 /**
  * The CouchKVStoreErrorInjectionTest cases utilise GoogleMock to inject
  * errors into couchstore as if they come from the filesystem in order
@@ -32,6 +32,7 @@ extern "C" {
 #include "crc32.h"
 }
 
+#include "compact_access_log.h"
 #include "mutation_log.h"
 #include "tests/module_tests/test_helpers.h"
 
@@ -506,6 +507,267 @@ TEST_F(MutationLogTest, BatchLoad) {
     }
 }
 
+// A MappedMutationLog reads the same New entries as the harvester, for
+// just the requested vBuckets and across several blocks.
+TEST_F(MutationLogTest, MappedLoadKeys) {
+    const size_t numKeys = 1000;
+    {
+        MutationLog ml(tmp_log_filename.c_str());
+        ml.open();
+        for (size_t ii = 0; ii < numKeys; ii++) {
+            ml.newItem(ii % 3, makeStoredDocKey("key" + std::to_string(ii)));
+        }
+        ml.commit1();
+        ml.commit2();
+    }
+
+    MappedMutationLog mapped(tmp_log_filename);
+    EXPECT_LT(1, mapped.getNumBlocks());
+    EXPECT_EQ((mapped.getNumBlocks() + 1) * MIN_LOG_HEADER_SIZE,
+              mapped.getSize());
+
+    auto index = mapped.indexBlocks({0, 1});
+    EXPECT_EQ(2, index.size());
+    EXPECT_EQ(0, index.count(2));
+    for (uint16_t vb = 0; vb < 2; vb++) {
+        // The keys of each vBucket are spread over every block.
+        EXPECT_EQ(mapped.getNumBlocks(), index[vb].blocks.size());
+        EXPECT_EQ(numKeys / 3 + (vb == 0 ? 1 : 0), index[vb].numKeys);
+
+        const auto vbKeys = mapped.loadKeys(vb, index[vb]);
+        ASSERT_EQ(numKeys / 3 + (vb == 0 ? 1 : 0), vbKeys.size());
+        // In log order.
+        for (size_t ii = 0; ii < vbKeys.size(); ii++) {
+            EXPECT_EQ(makeStoredDocKey("key" + std::to_string(ii * 3 + vb)),
+                      StoredDocKey(vbKeys[ii]));
+        }
+    }
+}
+
+// Only the blocks holding a vBucket's entries are indexed for it.
+TEST_F(MutationLogTest, MappedIndexBlocks) {
+    const size_t numKeys = 1000;
+    {
+        MutationLog ml(tmp_log_filename.c_str());
+        ml.open();
+        for (size_t ii = 0; ii < numKeys; ii++) {
+            ml.newItem(ii < numKeys / 2 ? 0 : 1,
+                       makeStoredDocKey("key" + std::to_string(ii)));
+        }
+        ml.commit1();
+        ml.commit2();
+    }
+
+    MappedMutationLog mapped(tmp_log_filename);
+    auto index = mapped.indexBlocks({0, 1});
+    ASSERT_EQ(2, index.size());
+    EXPECT_LT(index[0].blocks.size(), mapped.getNumBlocks());
+    EXPECT_LT(index[1].blocks.size(), mapped.getNumBlocks());
+    EXPECT_LE(index[0].blocks.back(), index[1].blocks.front());
+
+    for (uint16_t vb = 0; vb < 2; vb++) {
+        const auto vbKeys = mapped.loadKeys(vb, index[vb]);
+        ASSERT_EQ(numKeys / 2, vbKeys.size());
+        for (size_t ii = 0; ii < vbKeys.size(); ii++) {
+            EXPECT_EQ(makeStoredDocKey(
+                              "key" + std::to_string(vb * numKeys / 2 + ii)),
+                      StoredDocKey(vbKeys[ii]));
+        }
+    }
+}
+
+TEST_F(MutationLogTest, MappedBadCRC) {
+    {
+        MutationLog ml(tmp_log_filename.c_str());
+        ml.open();
+        ml.newItem(2, makeStoredDocKey("key1"));
+        ml.commit1();
+        ml.commit2();
+    }
+
+    // Break the log
+    int file = open(tmp_log_filename.c_str(), O_RDWR, FilePerms::Read | FilePerms::Write);
+    EXPECT_EQ(5000, lseek(file, 5000, SEEK_SET));
+    uint8_t b;
+    EXPECT_EQ(1, read(file, &b, sizeof(b)));
+    EXPECT_EQ(5000, lseek(file, 5000, SEEK_SET));
+    b = ~b;
+    EXPECT_EQ(1, write(file, &b, sizeof(b)));
+    close(file);
+
+    MappedMutationLog mapped(tmp_log_filename);
+    EXPECT_THROW(mapped.indexBlocks({2}), MutationLog::CRCReadException);
+}
+
+TEST_F(MutationLogTest, MappedShortRead) {
+    {
+        MutationLog ml(tmp_log_filename.c_str());
+        ml.open();
+        ml.newItem(2, makeStoredDocKey("key1"));
+        ml.commit1();
+        ml.commit2();
+    }
+
+    // A partial block.
+    EXPECT_EQ(0, truncate(tmp_log_filename.c_str(), 5000));
+    EXPECT_THROW(MappedMutationLog{tmp_log_filename},
+                 MutationLog::ShortReadException);
+
+    // Not even a header.
+    EXPECT_EQ(0, truncate(tmp_log_filename.c_str(), 4000));
+    EXPECT_THROW(MappedMutationLog{tmp_log_filename},
+                 MutationLog::ShortReadException);
+}
+
+TEST_F(MutationLogTest, MappedMissing) {
+    remove(tmp_log_filename.c_str());
+    EXPECT_THROW(MappedMutationLog{tmp_log_filename},
+                 MutationLog::ReadException);
+}
+
+static std::vector<StoredDocKey> makeKeys(
+        const std::vector<std::string>& keys) {
+    std::vector<StoredDocKey> result;
+    for (const auto& key : keys) {
+        result.push_back(makeStoredDocKey(key));
+    }
+    return result;
+}
+
+// Each vBucket's keys come back sorted and deduplicated, merged across all
+// of the vBucket's sections.
+TEST_F(MutationLogTest, CompactLoadKeys) {
+    {
+        CompactAccessLog::Writer writer(tmp_log_filename);
+        auto keys = makeKeys({"key_b", "key_a", "key_b", "other"});
+        writer.addSection(2, keys);
+        keys = makeKeys({"key_c", "a"});
+        writer.addSection(3, keys);
+        keys = makeKeys({"key_aa", "key_b", ""});
+        writer.addSection(2, keys);
+        keys.clear();
+        writer.addSection(4, keys);
+        EXPECT_EQ(8u, writer.getKeyCount());
+        writer.close();
+    }
+
+    EXPECT_TRUE(CompactAccessLog::isCompact(tmp_log_filename));
+
+    CompactAccessLog::Reader reader(tmp_log_filename);
+    EXPECT_EQ(std::vector<uint16_t>({2, 3}), reader.getVBuckets());
+    EXPECT_EQ(6u, reader.getKeyCount(2));
+    EXPECT_EQ(makeKeys({"", "key_a", "key_aa", "key_b", "other"}),
+              reader.loadKeys(2));
+    EXPECT_EQ(makeKeys({"a", "key_c"}), reader.loadKeys(3));
+    EXPECT_TRUE(reader.loadKeys(4).empty());
+}
+
+// Keys sharing long prefixes are stored in much less space than the V2
+// format takes for them.
+TEST_F(MutationLogTest, CompactSize) {
+    const std::string prefix = "customer::2017::order::";
+    std::vector<std::string> names;
+    for (int ii = 0; ii < 10000; ++ii) {
+        names.push_back(prefix + std::to_string(ii));
+    }
+
+    const std::string v2_log_filename = tmp_log_filename + ".v2";
+    {
+        MutationLog ml(v2_log_filename);
+        ml.open();
+        for (const auto& name : names) {
+            ml.newItem(0, makeStoredDocKey(name));
+        }
+        ml.commit1();
+        ml.commit2();
+    }
+    {
+        CompactAccessLog::Writer writer(tmp_log_filename);
+        auto keys = makeKeys(names);
+        writer.addSection(0, keys);
+        writer.close();
+    }
+
+    CompactAccessLog::Reader reader(tmp_log_filename);
+    MappedMutationLog v2(v2_log_filename);
+    EXPECT_LT(reader.getSize() * 2, v2.getSize());
+    EXPECT_EQ(names.size(), reader.loadKeys(0).size());
+    remove(v2_log_filename.c_str());
+}
+
+// Readers of the block format reject the compact format, and vice versa.
+TEST_F(MutationLogTest, CompactVersion) {
+    {
+        CompactAccessLog::Writer writer(tmp_log_filename);
+        auto keys = makeKeys({"key"});
+        writer.addSection(0, keys);
+        writer.close();
+    }
+    EXPECT_THROW(MappedMutationLog{tmp_log_filename},
+                 MutationLog::ReadException);
+    {
+        MutationLog ml(tmp_log_filename);
+        EXPECT_THROW(ml.open(true), MutationLog::ReadException);
+    }
+
+    remove(tmp_log_filename.c_str());
+    {
+        MutationLog ml(tmp_log_filename);
+        ml.open();
+        ml.newItem(0, makeStoredDocKey("key"));
+        ml.commit1();
+        ml.commit2();
+    }
+    EXPECT_FALSE(CompactAccessLog::isCompact(tmp_log_filename));
+    EXPECT_THROW(CompactAccessLog::Reader{tmp_log_filename},
+                 MutationLog::ReadException);
+}
+
+TEST_F(MutationLogTest, CompactBadCRC) {
+    {
+        CompactAccessLog::Writer writer(tmp_log_filename);
+        auto keys = makeKeys({"key1", "key2"});
+        writer.addSection(2, keys);
+        writer.close();
+    }
+
+    // Break the section, which starts straight after the header.
+    int file = open(tmp_log_filename.c_str(), O_RDWR, FilePerms::Read | FilePerms::Write);
+    EXPECT_EQ(4100, lseek(file, 4100, SEEK_SET));
+    uint8_t b;
+    EXPECT_EQ(1, read(file, &b, sizeof(b)));
+    EXPECT_EQ(4100, lseek(file, 4100, SEEK_SET));
+    b = ~b;
+    EXPECT_EQ(1, write(file, &b, sizeof(b)));
+    close(file);
+
+    CompactAccessLog::Reader reader(tmp_log_filename);
+    EXPECT_THROW(reader.loadKeys(2), MutationLog::CRCReadException);
+}
+
+TEST_F(MutationLogTest, CompactShortRead) {
+    {
+        CompactAccessLog::Writer writer(tmp_log_filename);
+        auto keys = makeKeys({"key1", "key2"});
+        writer.addSection(2, keys);
+        // Not closed: no index.
+    }
+    EXPECT_THROW(CompactAccessLog::Reader{tmp_log_filename},
+                 MutationLog::ShortReadException);
+
+    {
+        CompactAccessLog::Writer writer(tmp_log_filename);
+        auto keys = makeKeys({"key1", "key2"});
+        writer.addSection(2, keys);
+        writer.close();
+    }
+    struct stat st;
+    ASSERT_EQ(0, stat(tmp_log_filename.c_str(), &st));
+    EXPECT_EQ(0, truncate(tmp_log_filename.c_str(), st.st_size - 1));
+    EXPECT_THROW(CompactAccessLog::Reader{tmp_log_filename},
+                 MutationLog::ShortReadException);
+}
+
 // @todo
 //   Test Read Only log
 //   Test close / open / close / open
@@ -645,4 +907,16 @@ TEST_F(MutationLogTest, upgrade) {
             EXPECT_TRUE(maps[vbid].count(makeStoredDocKey(keys[i])) == 1);
         }
     }
+
+    // The V1 keys read through a MappedMutationLog are in the default
+    // collection, as for the upgraded entries above.
+    {
+        MappedMutationLog mapped(tmp_log_filename);
+        auto mappedKeys = mapped.loadKeys({vbid});
+        ASSERT_EQ(items, mappedKeys[vbid].size());
+        for (int i = 0; i < items; i++) {
+            EXPECT_EQ(makeStoredDocKey(keys[i]),
+                      StoredDocKey(mappedKeys[vbid][i]));
+        }
+    }
 }
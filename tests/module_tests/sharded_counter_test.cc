@@ -0,0 +1,86 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "sharded_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+TEST(ShardedCounterTest, Basic) {
+    ShardedCounter<size_t> counter;
+    EXPECT_EQ(0u, counter.load());
+
+    counter.fetch_add(10);
+    counter++;
+    ++counter;
+    EXPECT_EQ(12u, counter.load());
+
+    counter.fetch_sub(5);
+    counter--;
+    --counter;
+    EXPECT_EQ(5u, size_t(counter));
+
+    counter = 100;
+    EXPECT_EQ(100u, counter.load());
+}
+
+// Updates made to different shards all count towards the total.
+TEST(ShardedCounterTest, SumsShards) {
+    ShardedCounter<size_t, 4> counter(1);
+    for (size_t shard = 0; shard < 4; ++shard) {
+        counter.fetch_add(10, shard);
+    }
+    EXPECT_EQ(41u, counter.load());
+
+    // store() discards what was in the other shards.
+    counter.store(7);
+    EXPECT_EQ(7u, counter.load());
+}
+
+// A free seen in one shard before its allocation in another reads as zero
+// rather than wrapping around to a huge value.
+TEST(ShardedCounterTest, TransientlyNegative) {
+    ShardedCounter<size_t, 4> counter;
+    counter.fetch_sub(64, 1);
+    EXPECT_EQ(0u, counter.load());
+    counter.fetch_add(64 + 8, 2);
+    EXPECT_EQ(8u, counter.load());
+}
+
+// Concurrent allocation / free churn from many threads leaves an exact
+// total.
+TEST(ShardedCounterTest, ConcurrentChurn) {
+    ShardedCounter<size_t> counter(1000);
+    const size_t numThreads = 8;
+    const size_t iterations = 100000;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&counter, iterations]() {
+            for (size_t ii = 0; ii < iterations; ++ii) {
+                counter.fetch_add(3);
+                counter.fetch_sub(2);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(1000 + numThreads * iterations, counter.load());
+}
@@ -0,0 +1,172 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2017 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "spsc_ring_buffer.h"
+
+#include "dcp/ready_queue.h"
+#include "dcp/response.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+TEST(SpscRingBufferTest, PushPop) {
+    SpscRingBuffer<int> buffer(4);
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_EQ(0u, buffer.size());
+
+    EXPECT_TRUE(buffer.push(1));
+    EXPECT_TRUE(buffer.push(2));
+    EXPECT_FALSE(buffer.empty());
+    EXPECT_EQ(2u, buffer.size());
+
+    EXPECT_EQ(1, buffer.front());
+    buffer.pop();
+    EXPECT_EQ(2, buffer.front());
+    buffer.pop();
+    EXPECT_TRUE(buffer.empty());
+}
+
+TEST(SpscRingBufferTest, CapacityIsRoundedUp) {
+    EXPECT_EQ(1u, SpscRingBuffer<int>(1).capacity());
+    EXPECT_EQ(8u, SpscRingBuffer<int>(5).capacity());
+    EXPECT_EQ(8u, SpscRingBuffer<int>(8).capacity());
+    EXPECT_THROW(SpscRingBuffer<int>(0), std::invalid_argument);
+}
+
+TEST(SpscRingBufferTest, Full) {
+    SpscRingBuffer<int> buffer(4);
+    for (int ii = 0; ii < 4; ++ii) {
+        EXPECT_TRUE(buffer.push(ii));
+    }
+    EXPECT_FALSE(buffer.push(4));
+    EXPECT_EQ(4u, buffer.size());
+
+    // Popping makes room again, and the indices wrap around the slots.
+    for (int ii = 4; ii < 100; ++ii) {
+        EXPECT_EQ(ii - 4, buffer.front());
+        buffer.pop();
+        EXPECT_TRUE(buffer.push(ii));
+    }
+    EXPECT_EQ(96, buffer.front());
+}
+
+// One thread pushes while another pops; every value must be popped once, in
+// order.
+TEST(SpscRingBufferTest, ProducerConsumer) {
+    const size_t count = 100000;
+    SpscRingBuffer<size_t> buffer(64);
+
+    std::thread producer([&buffer, count]() {
+        for (size_t ii = 0; ii < count; ++ii) {
+            while (!buffer.push(ii)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    size_t expected = 0;
+    while (expected < count) {
+        if (buffer.empty()) {
+            std::this_thread::yield();
+            continue;
+        }
+        ASSERT_EQ(expected, buffer.front());
+        buffer.pop();
+        ++expected;
+    }
+    producer.join();
+    EXPECT_TRUE(buffer.empty());
+}
+
+class ReadyQueueTest : public ::testing::Test {
+protected:
+    DcpResponse* makeResponse() {
+        responses.emplace_back(
+                new StreamEndResponse(responses.size(), 0, /*vb*/ 0));
+        return responses.back().get();
+    }
+
+    std::vector<std::unique_ptr<DcpResponse>> responses;
+};
+
+// Messages pushed once the ring is full go to the overflow deque, and are
+// popped after those in the ring.
+TEST_F(ReadyQueueTest, OverflowKeepsOrder) {
+    ReadyQueue queue(2);
+    for (int ii = 0; ii < 5; ++ii) {
+        queue.push(makeResponse());
+    }
+    EXPECT_EQ(5u, queue.size());
+
+    // The first two are in the ring, so can be popped without the lock.
+    EXPECT_EQ(responses[0].get(), queue.frontLockFree());
+    queue.pop();
+    // A push while the overflow deque is non-empty must go after it, even
+    // though the ring has room.
+    queue.push(makeResponse());
+    EXPECT_EQ(responses[1].get(), queue.frontLockFree());
+    queue.pop();
+    EXPECT_EQ(nullptr, queue.frontLockFree());
+    EXPECT_FALSE(queue.empty());
+
+    for (size_t ii = 2; ii < responses.size(); ++ii) {
+        ASSERT_FALSE(queue.empty());
+        EXPECT_EQ(responses[ii].get(), queue.front());
+        queue.pop();
+    }
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(0u, queue.size());
+}
+
+// A producer pushes (holding a lock) while the consumer pops what is in the
+// ring without the lock, falling back to the lock once the ring is empty.
+TEST_F(ReadyQueueTest, LockFreeConsumer) {
+    const size_t count = 100000;
+    for (size_t ii = 0; ii < count; ++ii) {
+        makeResponse();
+    }
+    ReadyQueue queue(16);
+    std::mutex mutex;
+
+    std::thread producer([this, &queue, &mutex, count]() {
+        for (size_t ii = 0; ii < count; ++ii) {
+            std::lock_guard<std::mutex> lh(mutex);
+            queue.push(responses[ii].get());
+        }
+    });
+
+    size_t expected = 0;
+    while (expected < count) {
+        DcpResponse* resp = queue.frontLockFree();
+        if (resp == nullptr) {
+            std::lock_guard<std::mutex> lh(mutex);
+            if (queue.empty()) {
+                continue;
+            }
+            resp = queue.front();
+        }
+        ASSERT_EQ(responses[expected].get(), resp);
+        queue.pop();
+        ++expected;
+    }
+    producer.join();
+    EXPECT_TRUE(queue.empty());
+}
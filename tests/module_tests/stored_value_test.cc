@@ -21,6 +21,7 @@
 
 #include "config.h"
 
+#include "disk_document.h"
 #include "hash_table.h"
 #include "stats.h"
 #include "stored_value_factories.h"
@@ -54,7 +55,8 @@ public:
     }
 
     /// Allow testing access to StoredValue::getRequiredStorage
-    static size_t public_getRequiredStorage(const Item& item) {
+    template <typename Document>
+    static size_t public_getRequiredStorage(const Document& item) {
         return Factory::value_type::getRequiredStorage(item);
     }
 
@@ -66,8 +68,9 @@ protected:
     StoredValue::UniquePtr sv;
 };
 
-using ValueFactories =
-        ::testing::Types<StoredValueFactory, OrderedStoredValueFactory>;
+using ValueFactories = ::testing::Types<StoredValueFactory,
+                                        CompactStoredValueFactory,
+                                        OrderedStoredValueFactory>;
 TYPED_TEST_CASE(ValueTest, ValueFactories);
 
 // Check that the size calculation methods return the expected sizes.
@@ -127,6 +130,44 @@ TYPED_TEST(ValueTest, getRequiredStorage) {
                "predicted";
 }
 
+// Check that a StoredValue created from a DiskDocument matches one created
+// from the equivalent Item.
+TYPED_TEST(ValueTest, createFromDiskDocument) {
+    const auto& item = this->item;
+    DiskDocument doc(item.getKey(),
+                     item.getValue(),
+                     ItemMetaData(item.getCas(),
+                                  item.getRevSeqno(),
+                                  item.getFlags(),
+                                  item.getExptime()),
+                     item.getBySeqno(),
+                     item.getVBucketId(),
+                     /*deleted*/ false);
+    auto docSv = this->factory(doc, {});
+
+    EXPECT_EQ(*this->sv, *docSv);
+    EXPECT_EQ(item.getDataType(), docSv->getDatatype());
+    EXPECT_EQ(this->sv->size(), docSv->size());
+    EXPECT_EQ(this->sv->getValue()->to_s(), docSv->getValue()->to_s());
+    EXPECT_EQ(docSv->getObjectSize(), this->public_getRequiredStorage(doc));
+}
+
+// Check that references count up to MaxFrequency, and the pager ages them.
+TYPED_TEST(ValueTest, frequency) {
+    EXPECT_EQ(0, this->sv->getFrequency());
+    for (int ii = 0; ii < 5; ++ii) {
+        this->sv->referenced();
+    }
+    EXPECT_EQ(StoredValue::MaxFrequency, this->sv->getFrequency());
+
+    this->sv->decayFrequency();
+    EXPECT_EQ(StoredValue::MaxFrequency - 1, this->sv->getFrequency());
+    for (int ii = 0; ii < 5; ++ii) {
+        this->sv->decayFrequency();
+    }
+    EXPECT_EQ(0, this->sv->getFrequency());
+}
+
 /// Check that StoredValue / OrderedStoredValue don't unexpectedly change in
 /// size (we've carefully crafted them to be as efficient as possible).
 TEST(StoredValueTest, expectedSize) {
@@ -146,3 +187,90 @@ TEST(OrderedStoredValueTest, expectedSize) {
             << "Unexpected change in OrderedStoredValue storage size for item: "
             << item;
 }
+
+/**
+ * Test fixture for StoredValues with inline value storage (created by
+ * CompactStoredValueFactory).
+ */
+class CompactStoredValueTest : public ::testing::Test {
+protected:
+    CompactStoredValueTest()
+        : factory(stats, /*maxInlineSize*/ 64),
+          key(makeStoredDocKey("key")) {
+    }
+
+    EPStats stats;
+    CompactStoredValueFactory factory;
+    StoredDocKey key;
+};
+
+TEST_F(CompactStoredValueTest, SmallValueInline) {
+    auto item = make_item(0, key, "value");
+    auto sv = factory(item, {});
+    EXPECT_GT(sv->getInlineCapacity(), 0u);
+    EXPECT_TRUE(sv->isValueInline());
+    EXPECT_EQ("value", sv->getValue()->to_s());
+    EXPECT_EQ(key, sv->getKey());
+    // Inline storage isn't part of the StoredValue's own size.
+    EXPECT_EQ(sizeof(StoredValue) + SerialisedDocKey::getObjectSize(key),
+              sv->getObjectSize());
+}
+
+TEST_F(CompactStoredValueTest, LargeValueNotInline) {
+    auto item = make_item(0, key, std::string(100, 'x'));
+    auto sv = factory(item, {});
+    EXPECT_EQ(0, sv->getInlineCapacity());
+    EXPECT_FALSE(sv->isValueInline());
+    EXPECT_EQ(0, sv->getInlineValueSavings());
+    EXPECT_EQ(std::string(100, 'x'), sv->getValue()->to_s());
+    EXPECT_EQ(key, sv->getKey());
+}
+
+// An inline value shared with an Item must remain valid after the
+// StoredValue is deleted.
+TEST_F(CompactStoredValueTest, InlineValueOutlivesStoredValue) {
+    auto item = make_item(0, key, "value");
+    auto sv = factory(item, {});
+    auto copy = sv->toItem(false, 0);
+    ASSERT_TRUE(copy->getValue()->isInline());
+
+    sv.reset();
+    EXPECT_EQ("value", copy->getValue()->to_s());
+}
+
+// Updating with a value which fits reuses the inline storage, unless the
+// current inline value is still referenced elsewhere.
+TEST_F(CompactStoredValueTest, UpdateReusesInlineStorage) {
+    auto sv = factory(make_item(0, key, "value"), {});
+    ASSERT_TRUE(sv->isValueInline());
+
+    sv->setValue(make_item(0, key, "other"));
+    EXPECT_TRUE(sv->isValueInline());
+    EXPECT_EQ("other", sv->getValue()->to_s());
+
+    // While an Item shares the inline value, updates go out of line...
+    auto shared = sv->toItem(false, 0);
+    sv->setValue(make_item(0, key, "third"));
+    EXPECT_FALSE(sv->isValueInline());
+    EXPECT_EQ("third", sv->getValue()->to_s());
+    EXPECT_EQ("other", shared->getValue()->to_s());
+
+    // ... and come back inline once it's released.
+    shared.reset();
+    sv->setValue(make_item(0, key, "fourth"));
+    EXPECT_TRUE(sv->isValueInline());
+    EXPECT_EQ("fourth", sv->getValue()->to_s());
+
+    // Values which don't fit are stored out of line.
+    sv->setValue(make_item(0, key, std::string(100, 'x')));
+    EXPECT_FALSE(sv->isValueInline());
+    EXPECT_EQ(std::string(100, 'x'), sv->getValue()->to_s());
+}
+
+// Ejecting an inline value wouldn't free anything.
+TEST_F(CompactStoredValueTest, InlineValueNotEligibleForValueEviction) {
+    auto sv = factory(make_item(0, key, "value"), {});
+    sv->markClean();
+    EXPECT_FALSE(sv->eligibleForEviction(VALUE_ONLY));
+    EXPECT_TRUE(sv->eligibleForEviction(FULL_EVICTION));
+}